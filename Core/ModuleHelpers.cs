@@ -103,6 +103,8 @@ namespace nDiscUtils.Core
 
             Logger.SetVerbose(opts.Verbose);
             Logger.SetDebug(opts.Debug);
+
+            Logger.Debug("Memory kernels use {0}", Memory.KernelLevel);
         }
 
         public static long ParseSizeString(string sizeString)
@@ -155,6 +157,35 @@ namespace nDiscUtils.Core
             }
         }
 
+        // Opens an existing image for reading through mappings of the system
+        // cache, which the native engines read in place. Devices and images
+        // which cannot be mapped are opened through OpenPath() instead.
+        public static Stream OpenPathMapped(string path, FileShare share, bool randomAccess = false)
+        {
+            var device = (!IsLinux && path.StartsWith("\\\\.\\")) || (IsLinux && path.StartsWith("/dev/"));
+            if (device || !System.IO.File.Exists(path))
+                return OpenPath(path, FileMode.Open, System.IO.FileAccess.Read, share);
+
+            // Random reads gain nothing from sliding windows, so all of the
+            // image is mapped at once
+            var options = new MappedImageStreamOptions();
+            if (randomAccess)
+            {
+                options.WindowSize = 0;
+                options.RandomAccess = true;
+            }
+
+            try
+            {
+                return new MappedImageStream(path, options);
+            }
+            catch (Exception ex) when (ex is IOException || ex is OverflowException || ex is UnauthorizedAccessException)
+            {
+                Logger.Verbose("Could not map image \"{0}\", reading it instead: {1}", path, ex.Message);
+                return OpenPath(path, FileMode.Open, System.IO.FileAccess.Read, share);
+            }
+        }
+
         public static void MountStream(Stream stream, BaseMountOptions opts)
         {
             using (var mountPoint = new DiscFileSystemMountPoint(stream, opts))
@@ -354,6 +385,14 @@ exit:
                 input, BYTE_SUFFIXES[suffix]);
         }
 
+        public static string FormatLatency(TimeSpan latency)
+        {
+            if (latency.TotalMilliseconds < 1.0)
+                return string.Format("{0:0.0} us", latency.TotalMilliseconds * 1000.0);
+
+            return string.Format("{0:0.00} ms", latency.TotalMilliseconds);
+        }
+
         // https://stackoverflow.com/a/1600990
         public static DateTime GetLinkerTime(this Assembly assembly, TimeZoneInfo target = null)
         {
@@ -378,8 +417,7 @@ exit:
             return localTime;
         }
 
-        // https://stackoverflow.com/a/33307903
-        public static unsafe bool EqualBytesLongUnrolled(byte[] data1, byte[] data2)
+        public static bool EqualBytes(byte[] data1, byte[] data2)
         {
             if (data1 == data2)
                 return true;
@@ -387,35 +425,7 @@ exit:
             if (data1.Length != data2.Length)
                 return false;
 
-            fixed (byte* bytes1 = data1, bytes2 = data2)
-            {
-                int len = data1.Length;
-                int rem = len % (sizeof(long) * 16);
-                long* b1 = (long*)bytes1;
-                long* b2 = (long*)bytes2;
-                long* e1 = (long*)(bytes1 + len - rem);
-
-                while (b1 < e1)
-                {
-                    if (*(b1) != *(b2) || *(b1 + 1) != *(b2 + 1) ||
-                        *(b1 + 2) != *(b2 + 2) || *(b1 + 3) != *(b2 + 3) ||
-                        *(b1 + 4) != *(b2 + 4) || *(b1 + 5) != *(b2 + 5) ||
-                        *(b1 + 6) != *(b2 + 6) || *(b1 + 7) != *(b2 + 7) ||
-                        *(b1 + 8) != *(b2 + 8) || *(b1 + 9) != *(b2 + 9) ||
-                        *(b1 + 10) != *(b2 + 10) || *(b1 + 11) != *(b2 + 11) ||
-                        *(b1 + 12) != *(b2 + 12) || *(b1 + 13) != *(b2 + 13) ||
-                        *(b1 + 14) != *(b2 + 14) || *(b1 + 15) != *(b2 + 15))
-                        return false;
-                    b1 += 16;
-                    b2 += 16;
-                }
-
-                for (int i = 0; i < rem; i++)
-                    if (data1[len - 1 - i] != data2[len - 1 - i])
-                        return false;
-
-                return true;
-            }
+            return MemoryWrapper.FindMismatch(data1, data2, data1.Length) == data1.Length;
         }
 
         public static void IndexDirectory(string path, int threadCount,
@@ -35,10 +35,14 @@ namespace nDiscUtils.Core
         public const uint FSCTL_ALLOW_EXTENDED_DASD_IO = 0x00090083;
         public const uint FSCTL_LOCK_VOLUME = 0x00090018;
         public const uint FSCTL_UNLOCK_VOLUME = 0x0009001C;
+        public const uint FSCTL_SET_SPARSE = 0x000900C4;
+        public const uint FSCTL_QUERY_ALLOCATED_RANGES = 0x000940CF;
 
         public const uint IOCTL_STORAGE_PREDICT_FAILURE = 0x002D1100;
         public const uint IOCTL_DISK_GET_DRIVE_GEOMETRY = 0x00070000;
 
+        public const int ERROR_MORE_DATA = 234;
+
         public const int CTRL_C_EVENT = 0;
 
         [DllImport("kernel32.dll", CharSet = CharSet.Auto, SetLastError = true,
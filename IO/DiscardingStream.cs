@@ -0,0 +1,105 @@
+﻿/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+using System;
+using System.Collections.Generic;
+using System.IO;
+
+using DiscUtils.Streams;
+
+namespace nDiscUtils.IO
+{
+
+    // Exposes an IDiscardableStream to DiscUtils, which clears freed
+    // ranges through SparseStream.Clear(). The wrapped stream stays
+    // owned by the caller.
+    public sealed class DiscardingStream : SparseStream
+    {
+
+        private Stream mStream;
+        private IDiscardableStream mDiscardable;
+
+        public DiscardingStream(Stream stream)
+        {
+            mStream = stream;
+            mDiscardable = stream as IDiscardableStream;
+
+            if (mDiscardable == null)
+                throw new ArgumentException("Stream does not support discarding ranges", nameof(stream));
+        }
+
+        public static bool IsDiscardable(Stream stream)
+        {
+            return stream is IDiscardableStream;
+        }
+
+        public override bool CanRead
+        {
+            get => mStream.CanRead;
+        }
+
+        public override bool CanSeek
+        {
+            get => mStream.CanSeek;
+        }
+
+        public override bool CanWrite
+        {
+            get => mStream.CanWrite;
+        }
+
+        public override IEnumerable<StreamExtent> Extents
+        {
+            get => new[] { new StreamExtent(0, mStream.Length) };
+        }
+
+        public override long Length
+        {
+            get => mStream.Length;
+        }
+
+        public override long Position
+        {
+            get => mStream.Position;
+            set => mStream.Position = value;
+        }
+
+        public override void Clear(int count)
+        {
+            mDiscardable.Discard(mStream.Position, count);
+            mStream.Position += count;
+        }
+
+        public override void Flush()
+            => mStream.Flush();
+
+        public override int Read(byte[] buffer, int offset, int count)
+            => mStream.Read(buffer, offset, count);
+
+        public override long Seek(long offset, SeekOrigin origin)
+            => mStream.Seek(offset, origin);
+
+        public override void SetLength(long value)
+            => mStream.SetLength(value);
+
+        public override void Write(byte[] buffer, int offset, int count)
+            => mStream.Write(buffer, offset, count);
+
+    }
+
+}
@@ -0,0 +1,182 @@
+﻿/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+using System.Text;
+
+namespace nDiscUtils.IO
+{
+
+    // Block digests of a stream saved next to an image, so the image can be
+    // verified later without access to the data it was taken from
+    public sealed class HashList
+    {
+
+        private const string Header = "nDiscUtils-hashlist 1";
+
+        public HashAlgorithm Algorithm { get; private set; }
+
+        public int BlockSize { get; private set; }
+
+        public long Length { get; private set; }
+
+        public byte[] Digest { get; private set; }
+
+        public byte[] BlockDigests { get; private set; }
+
+        public int DigestSize
+        {
+            get => StreamHasher.DigestSize(Algorithm);
+        }
+
+        public int BlockCount
+        {
+            get => BlockDigests.Length / DigestSize;
+        }
+
+        public static HashList FromHash(StreamHash hash)
+        {
+            if (!hash.Succeeded)
+                throw new ArgumentException("Hash of a failed read cannot be saved", "hash");
+
+            return new HashList()
+            {
+                Algorithm = hash.Algorithm,
+                BlockSize = hash.BlockSize,
+                Length = hash.HashedBytes,
+                Digest = hash.Digest,
+                BlockDigests = hash.BlockDigests
+            };
+        }
+
+        public void Save(string path)
+        {
+            using (var writer = new StreamWriter(path, false, new UTF8Encoding(false)))
+            {
+                writer.NewLine = "\n";
+                writer.WriteLine(Header);
+                writer.WriteLine("algorithm {0}", StreamHasher.AlgorithmName(Algorithm));
+                writer.WriteLine("block-size {0}", BlockSize);
+                writer.WriteLine("length {0}", Length);
+                writer.WriteLine("digest {0}", ToHex(Digest, 0, Digest.Length));
+
+                for (int i = 0; i < BlockCount; i++)
+                    writer.WriteLine(ToHex(BlockDigests, i * DigestSize, DigestSize));
+            }
+        }
+
+        public static HashList Load(string path)
+        {
+            using (var reader = new StreamReader(path, Encoding.UTF8))
+            {
+                if (reader.ReadLine() != Header)
+                    throw new InvalidDataException(string.Format("\"{0}\" is not a hash list", path));
+
+                var list = new HashList();
+
+                if (!StreamHasher.TryParseAlgorithm(ReadField(reader, "algorithm"), out var algorithm))
+                    throw new InvalidDataException("Hash list uses an unknown algorithm");
+                list.Algorithm = algorithm;
+
+                if (!int.TryParse(ReadField(reader, "block-size"), NumberStyles.None, CultureInfo.InvariantCulture, out var blockSize) || blockSize <= 0)
+                    throw new InvalidDataException("Hash list has an invalid block size");
+                list.BlockSize = blockSize;
+
+                if (!long.TryParse(ReadField(reader, "length"), NumberStyles.None, CultureInfo.InvariantCulture, out var length))
+                    throw new InvalidDataException("Hash list has an invalid length");
+                list.Length = length;
+
+                list.Digest = FromHex(ReadField(reader, "digest"), list.DigestSize);
+
+                var blocks = (length + blockSize - 1) / blockSize;
+                if (blocks > int.MaxValue / list.DigestSize)
+                    throw new InvalidDataException("Hash list has more blocks than can be held");
+
+                list.BlockDigests = new byte[blocks * list.DigestSize];
+                for (int i = 0; i < blocks; i++)
+                {
+                    var line = reader.ReadLine();
+                    if (line == null)
+                        throw new InvalidDataException(string.Format("Hash list ends after {0} of {1} blocks", i, blocks));
+
+                    Buffer.BlockCopy(FromHex(line, list.DigestSize), 0, list.BlockDigests, i * list.DigestSize, list.DigestSize);
+                }
+
+                return list;
+            }
+        }
+
+        // Indices of the blocks whose digests differ from those of a hash
+        // taken with the same algorithm and block size
+        public List<int> FindMismatchingBlocks(StreamHash hash)
+        {
+            if (hash.Algorithm != Algorithm || hash.BlockSize != BlockSize)
+                throw new ArgumentException("Hash was taken with another algorithm or block size", "hash");
+
+            var mismatching = new List<int>();
+            var blocks = Math.Min(BlockCount, hash.BlockCount);
+
+            for (int i = 0; i < blocks; i++)
+            {
+                var offset = i * DigestSize;
+                if (MemoryWrapper.FindMismatch(BlockDigests, offset, hash.BlockDigests, offset, DigestSize) != DigestSize)
+                    mismatching.Add(i);
+            }
+
+            return mismatching;
+        }
+
+        public static string ToHex(byte[] data, int offset, int count)
+        {
+            var builder = new StringBuilder(count * 2);
+            for (int i = 0; i < count; i++)
+                builder.Append(data[offset + i].ToString("x2", CultureInfo.InvariantCulture));
+
+            return builder.ToString();
+        }
+
+        private static byte[] FromHex(string hex, int size)
+        {
+            if (hex == null || hex.Length != size * 2)
+                throw new InvalidDataException("Hash list holds a digest of the wrong size");
+
+            var data = new byte[size];
+            for (int i = 0; i < size; i++)
+            {
+                if (!byte.TryParse(hex.Substring(i * 2, 2), NumberStyles.AllowHexSpecifier, CultureInfo.InvariantCulture, out data[i]))
+                    throw new InvalidDataException(string.Format("Hash list holds an invalid digest \"{0}\"", hex));
+            }
+
+            return data;
+        }
+
+        private static string ReadField(StreamReader reader, string name)
+        {
+            var line = reader.ReadLine();
+            if (line == null || !line.StartsWith(name + " ", StringComparison.Ordinal))
+                throw new InvalidDataException(string.Format("Hash list lacks the {0} field", name));
+
+            return line.Substring(name.Length + 1);
+        }
+
+    }
+
+}
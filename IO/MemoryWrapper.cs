@@ -102,6 +102,72 @@ namespace nDiscUtils.IO
 #endif
         }
 
+        public static long FindMismatch(byte[] left, byte[] right, long count)
+        {
+            return FindMismatch(left, 0, right, 0, count);
+        }
+
+        public static long FindMismatch(byte[] left, long leftOffset, byte[] right, long rightOffset, long count)
+        {
+            fixed (byte* leftptr = left)
+            fixed (byte* rightptr = right)
+                return FindMismatch(leftptr + leftOffset, rightptr + rightOffset, count);
+        }
+
+        public static long FindMismatch(void* left, void* right, long count)
+        {
+#if __x64__
+            return (long)Memory.FindMismatch(left, right, (ulong)count);
+#elif __x86__
+            return (long)Memory.FindMismatch(left, right, (uint)count);
+#endif
+        }
+
+        public static bool IsZero(byte[] buffer, long offset, long count)
+        {
+            fixed (byte* bufferptr = buffer)
+                return IsZero(bufferptr + offset, count);
+        }
+
+        public static bool IsZero(void* ptr, long count)
+        {
+#if __x64__
+            return Memory.IsZero(ptr, (ulong)count);
+#elif __x86__
+            return Memory.IsZero(ptr, (uint)count);
+#endif
+        }
+
+        public static long PopCount(byte[] buffer, long offset, long count)
+        {
+            fixed (byte* bufferptr = buffer)
+                return PopCount(bufferptr + offset, count);
+        }
+
+        public static long PopCount(void* ptr, long count)
+        {
+#if __x64__
+            return (long)Memory.PopCount(ptr, (ulong)count);
+#elif __x86__
+            return (long)Memory.PopCount(ptr, (uint)count);
+#endif
+        }
+
+        public static void FillRandom(byte[] buffer, long offset, long count, ulong seed, long position, int threads = 0)
+        {
+            fixed (byte* bufferptr = buffer)
+                FillRandom(bufferptr + offset, count, seed, position, threads);
+        }
+
+        public static void FillRandom(void* ptr, long count, ulong seed, long position, int threads = 0)
+        {
+#if __x64__
+            Memory.FillRandom(ptr, (ulong)count, seed, (ulong)position, threads);
+#elif __x86__
+            Memory.FillRandom(ptr, (uint)count, seed, (ulong)position, threads);
+#endif
+        }
+
     }
 
 }
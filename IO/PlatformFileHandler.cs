@@ -17,10 +17,14 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 using System;
+using System.Collections.Generic;
 using System.IO;
+using System.Linq;
 using System.Management;
 using System.Runtime.InteropServices;
 
+using DiscUtils.Streams;
+
 using nDiscUtils.Core;
 
 using static nDiscUtils.Core.NativeMethods;
@@ -88,6 +92,92 @@ namespace nDiscUtils.IO
             return new FixedLengthStream(handle, access, (long)size.Value);
         }
 
+        /// <summary>
+        /// Marks a file as sparse, so ranges which are never written do not occupy
+        /// any space. Files on Linux file systems are sparse without any request.
+        /// </summary>
+        public static bool MakeSparse(Stream stream)
+        {
+            if (!(stream is FileStream fileStream))
+                return false;
+
+            if (ModuleHelpers.IsLinux)
+                return true;
+
+            var result = DeviceIoControl(fileStream.SafeFileHandle, FSCTL_SET_SPARSE, IntPtr.Zero, 0, IntPtr.Zero, 0,
+                out var dummy, IntPtr.Zero);
+
+            if (!result)
+                Logger.Verbose("DeviceIoControl(FSCTL_SET_SPARSE) on \"{0}\" returned with {1}",
+                    fileStream.Name, Marshal.GetLastWin32Error());
+
+            return result;
+        }
+
+        /// <summary>
+        /// Ranges of a stream which hold data: the extents of DiscUtils' sparse streams,
+        /// such as the allocated clusters of files and dynamic disk images, or the
+        /// allocated ranges of a sparse file. Returns null if nothing is known.
+        /// </summary>
+        public static DataExtent[] GetAllocatedRanges(Stream stream)
+        {
+            if (stream is SparseStream sparseStream)
+                return sparseStream.Extents.Select((extent) => new DataExtent(extent.Start, extent.Length)).ToArray();
+
+            if (!(stream is FileStream fileStream) || ModuleHelpers.IsLinux)
+                return null;
+
+            // FILE_ALLOCATED_RANGE_BUFFER, fetched in batches until no more data is reported
+            const int rangeSize = 16;
+            const int batchSize = 256;
+
+            var input = Marshal.AllocHGlobal(rangeSize);
+            var output = Marshal.AllocHGlobal(rangeSize * batchSize);
+
+            try
+            {
+                var ranges = new List<DataExtent>();
+                var length = fileStream.Length;
+                var offset = 0L;
+
+                while (offset < length)
+                {
+                    Marshal.WriteInt64(input, 0, offset);
+                    Marshal.WriteInt64(input, 8, length - offset);
+
+                    var result = DeviceIoControl(fileStream.SafeFileHandle, FSCTL_QUERY_ALLOCATED_RANGES,
+                        input, rangeSize, output, rangeSize * batchSize, out var returned, IntPtr.Zero);
+
+                    var error = Marshal.GetLastWin32Error();
+                    if (!result && error != ERROR_MORE_DATA)
+                    {
+                        Logger.Verbose("DeviceIoControl(FSCTL_QUERY_ALLOCATED_RANGES) on \"{0}\" returned with {1}",
+                            fileStream.Name, error);
+                        return null;
+                    }
+
+                    var count = (int)(returned / rangeSize);
+                    for (var i = 0; i < count; i++)
+                    {
+                        ranges.Add(new DataExtent(Marshal.ReadInt64(output, i * rangeSize),
+                            Marshal.ReadInt64(output, i * rangeSize + 8)));
+                    }
+
+                    if (result || count == 0)
+                        break;
+
+                    offset = ranges[ranges.Count - 1].Offset + ranges[ranges.Count - 1].Length;
+                }
+
+                return ranges.ToArray();
+            }
+            finally
+            {
+                Marshal.FreeHGlobal(input);
+                Marshal.FreeHGlobal(output);
+            }
+        }
+
     }
     
 }
@@ -18,16 +18,14 @@
  */
 using System;
 using System.IO;
-using System.Runtime.InteropServices;
-using System.Threading;
 
 using CommandLine;
 
 using nDiscUtils.Core;
+using nDiscUtils.IO;
 using nDiscUtils.Options;
 
 using static nDiscUtils.Core.ModuleHelpers;
-using static nDiscUtils.Core.NativeMethods;
 using static nDiscUtils.Core.ReturnCodes;
 
 namespace nDiscUtils.Modules
@@ -36,208 +34,278 @@ namespace nDiscUtils.Modules
     public static class Benchmark
     {
 
+        private const string RamdiskTarget = "ramdisk";
+
+        // Unbuffered requests have to be aligned to the page size
+        private const int UnbufferedAlignment = 4096;
+
         private static Random mRandom = new Random();
 
         public static int Run(Options opts)
         {
             RunHelpers(opts);
 
-            var path = $"{opts.Drive}:\\ndiscutils-benchmark.dat";
-
-            if (File.Exists(path))
-                File.Delete(path);
-
-            var attributes = 0U;
+            if (opts.BufferSize <= 0 || opts.BufferSize > int.MaxValue || (opts.Size % opts.BufferSize) != 0)
+            {
+                Logger.Error("Requested size if not divisible by buffer size");
+                WaitForUserExit();
+                return INVALID_ARGUMENT;
+            }
 
-            if ((!opts.NoWriteThrough || opts.Unbuffered) && !opts.Pratical)
-                attributes |= FILE_FLAG_WRITE_THROUGH;
-            else
-                Logger.Warn("Disabling WRITE_THROUGH flag");
+            if (opts.Threads <= 0 || opts.QueueDepth <= 0)
+            {
+                Logger.Error("Thread count and queue depth have to be greater than zero");
+                WaitForUserExit();
+                return INVALID_ARGUMENT;
+            }
 
-            if ((!opts.Buffering || opts.Unbuffered) && !opts.Pratical)
-                attributes |= FILE_FLAG_NO_BUFFERING;
-            else
-                Logger.Warn("Disabling NO_BUFFERING flag");
+            if (opts.Size / opts.BufferSize < opts.Threads)
+            {
+                Logger.Error("Requested size does not hold one buffer per thread");
+                WaitForUserExit();
+                return INVALID_ARGUMENT;
+            }
 
-            if ((!opts.NoSequentialScan || opts.Unbuffered) && !opts.Pratical)
-                attributes |= FILE_FLAG_SEQUENTIAL_SCAN;
-            else
-                Logger.Warn("Disabling SEQUENTIAL_SCAN flag");
-
-            Logger.Info("Attempting to open benchmark-file at \"{0}:\\\"", opts.Drive);
-            var handle = CreateFile(
-                path,
-                FileAccess.ReadWrite,
-                FileShare.None,
-                IntPtr.Zero,
-                FileMode.Create,
-                attributes,
-                IntPtr.Zero);
-
-            var error = Marshal.GetLastWin32Error();
-            if (handle.IsInvalid || error != 0)
+            if (opts.ReadPercentage > 100)
             {
-                Logger.Error("Failed to open benchmark-file: Error {0}", error);
+                Logger.Error("Read percentage may not exceed 100");
                 WaitForUserExit();
                 return INVALID_ARGUMENT;
             }
 
-            if ((opts.Size % opts.BufferSize) != 0)
+            var pattern = AccessPattern.Random;
+            if (opts.PatternString != null && !ParsePattern(opts.PatternString, out pattern))
             {
-                Logger.Error("Requested size if not divisible by buffer size", error);
+                Logger.Error("Unknown access pattern \"{0}\", expected sequential, random or zipf", opts.PatternString);
                 WaitForUserExit();
                 return INVALID_ARGUMENT;
             }
 
-            var buffer = new byte[opts.BufferSize];
-            var secondaryBuffer = new byte[0];
-            var randomPos = new long[(opts.Size / opts.BufferSize) - 1];
+            var writeThrough = (!opts.NoWriteThrough || opts.Unbuffered) && !opts.Pratical;
+            if (!writeThrough)
+                Logger.Warn("Disabling WRITE_THROUGH flag");
 
-            // generate random data
-            Logger.Debug("Generating random data");
-            for (int i = 0; i < 4; i++)
+            var unbuffered = (!opts.Buffering || opts.Unbuffered) && !opts.Pratical;
+            if (!unbuffered)
+                Logger.Warn("Disabling NO_BUFFERING flag");
+
+            if (unbuffered && (opts.BufferSize % UnbufferedAlignment) != 0)
             {
-                mRandom.NextBytes(buffer);
-                Thread.Sleep(mRandom.Next(1, 25));
+                Logger.Error("Requested buffer size is not aligned to {0}, which unbuffered I/O requires", FormatBytes(UnbufferedAlignment, 0));
+                WaitForUserExit();
+                return INVALID_ARGUMENT;
             }
 
-            if (opts.Pratical)
+            var ramdisk = string.Equals(opts.Target, RamdiskTarget, StringComparison.OrdinalIgnoreCase);
+            var device = !ramdisk && (opts.Target.StartsWith("\\\\.\\") || opts.Target.StartsWith("/dev/"));
+
+            // Devices are only written to on request, so their contents survive
+            if (device && !opts.Destructive && opts.ReadPercentage >= 0 && opts.ReadPercentage < 100)
             {
-                Logger.Debug("Generating secondary random data");
-                secondaryBuffer = new byte[opts.BufferSize];
-                for (int i = 0; i < 4; i++)
-                {
-                    mRandom.NextBytes(secondaryBuffer);
-                    Thread.Sleep(mRandom.Next(1, 25));
-                }
+                Logger.Error("Mixed tests write to the device \"{0}\", use --destructive to allow that", opts.Target);
+                WaitForUserExit();
+                return INVALID_ARGUMENT;
             }
 
-            // generate random positions
-            Logger.Debug("Generating random read/write positions");
-            for (long i = 0; i < randomPos.LongLength; i++)
-            {
-                var pos = NextLongRandom(mRandom, 0, opts.Size - opts.BufferSize);
-                if ((pos % opts.BufferSize) != 0)
-                    pos -= (pos % opts.BufferSize);
+            var writable = (!device || opts.Destructive);
+            if (!writable)
+                Logger.Warn("Skipping write tests on the device \"{0}\", use --destructive to allow them", opts.Target);
 
-                randomPos[i] = pos;
+            // A drive letter gets a file in its root, any other path is the file itself
+            string path = null;
+            if (!ramdisk && !device)
+            {
+                path = opts.Target;
+                if (path.Length == 1 || (path.Length == 2 && path[1] == ':'))
+                    path = $"{path[0]}:\\ndiscutils-benchmark.dat";
             }
 
-            var usePrimaryBuffer = true;
-            var getBuffer = new Func<byte[]>(() =>
+            Stream stream = null;
+            if (ramdisk)
             {
-                if (opts.Pratical)
-                {
-                    usePrimaryBuffer = !usePrimaryBuffer;
-                    return (usePrimaryBuffer ? buffer : secondaryBuffer);
-                }
-                else
-                {
-                    return buffer;
-                }
-            });
-
-            using (var stream = new FileStream(handle, FileAccess.ReadWrite, (int)opts.InternalBufferSize))
+                Logger.Info("Creating memory stream with size 0x{0:X}", opts.Size);
+                stream = new StaticMemoryStream(opts.Size);
+            }
+            else if (path != null)
             {
-                stream.SetLength(opts.Size);
+                if (File.Exists(path))
+                    File.Delete(path);
 
-                // check for correct alignment of buffer size and physical sector size
+                Logger.Info("Attempting to create benchmark-file at \"{0}\"", path);
                 try
                 {
-                    stream.Seek(opts.BufferSize, SeekOrigin.Begin);
+                    var fileStream = new FileStream(path, FileMode.Create, FileAccess.ReadWrite, FileShare.None,
+                        (int)opts.InternalBufferSize);
+                    fileStream.SetLength(opts.Size);
+
+                    // Practical runs go through the stream and its buffer, the
+                    // others reopen the file natively
+                    if (opts.Pratical)
+                        stream = fileStream;
+                    else
+                        fileStream.Dispose();
                 }
-                catch (IOException)
+                catch (Exception ex) when (ex is IOException || ex is UnauthorizedAccessException)
                 {
-                    Logger.Error("Requested buffer size is not aligned to physical sector size");
+                    Logger.Error("Failed to create benchmark-file: {0}", ex.Message);
                     WaitForUserExit();
                     return INVALID_ARGUMENT;
                 }
+            }
 
-                var sequentialAction = new Func<string, Action, TimeSpan>((name, action) =>
-                {
-                    stream.Position = 0;
-                    Logger.Info("===== Starting Sequential {0} Process", name);
-
-                    var start = DateTime.Now;
-                    Logger.Verbose("Sequential {0} start: {1}", name, start);
-
-                    while (stream.Position < stream.Length)
-                        action();
-
-                    var end = DateTime.Now;
-                    Logger.Verbose("Sequential {0} end:   {1}", name, end);
+            // Each write gets fresh data from a counter-based stream, so the
+            // device can neither compress nor deduplicate it
+            var seed = ((long)(uint)mRandom.Next() << 32) | (uint)mRandom.Next();
+            Logger.Debug("Generating random data from seed 0x{0:X16} with {1}", seed, Memory.RandomImplementation);
 
-                    var duration = end.Subtract(start);
-                    Logger.Info("Sequential {0} duration: {1}", name, duration);
-                    Logger.Info("Sequential {0} speed:    {1}/s", name,
-                        FormatBytes(stream.Length / duration.TotalSeconds, 3));
-                    return duration;
-                });
+            var run = new Func<string, AccessPattern, int, bool>((name, accessPattern, readPercentage) =>
+            {
+                var options = new StreamBenchmarkOptions()
+                {
+                    Threads = opts.Threads,
+                    QueueDepth = opts.QueueDepth,
+                    BlockSize = (int)opts.BufferSize,
+                    ReadPercentage = readPercentage,
+                    Pattern = accessPattern,
+                    ZipfTheta = opts.ZipfTheta,
+                    Duration = TimeSpan.FromSeconds(opts.Runtime),
+                    Size = (opts.Runtime > 0 ? 0 : opts.Size),
+                    Seed = seed
+                };
+
+                return RunTest(name, options, stream, stream == null ? (path ?? opts.Target) : null,
+                    opts.Size, unbuffered, writeThrough);
+            });
 
-                var randomAction = new Func<string, Action, TimeSpan>((name, action) =>
+            var patterns = new AccessPattern[0];
+            if (opts.PatternString != null)
+                patterns = new[] { pattern };
+            else if (!opts.SkipSequential && !opts.SkipRandom)
+                patterns = new[] { AccessPattern.Sequential, AccessPattern.Random };
+            else if (!opts.SkipSequential)
+                patterns = new[] { AccessPattern.Sequential };
+            else if (!opts.SkipRandom)
+                patterns = new[] { AccessPattern.Random };
+
+            var result = SUCCESS;
+            try
+            {
+                foreach (var accessPattern in patterns)
                 {
-                    stream.Position = 0;
-                    Logger.Info("===== Starting Random {0} Process", name);
+                    var succeeded = true;
 
-                    var start = DateTime.Now;
-                    Logger.Verbose("Random {0} start: {1}", name, start);
+                    if (opts.ReadPercentage >= 0)
+                    {
+                        succeeded = run($"{accessPattern} {opts.ReadPercentage}% read", accessPattern, opts.ReadPercentage);
+                    }
+                    else
+                    {
+                        if (writable)
+                            succeeded = run($"{accessPattern} write", accessPattern, 0);
 
-                    for (long i = 0; i < randomPos.Length; i++)
+                        succeeded = succeeded && run($"{accessPattern} read", accessPattern, 100);
+                    }
+
+                    if (!succeeded)
                     {
-                        stream.Seek(randomPos[i], SeekOrigin.Begin);
-                        action();
+                        result = ERROR;
+                        break;
                     }
+                }
+            }
+            finally
+            {
+                stream?.Dispose();
 
-                    var end = DateTime.Now;
-                    Logger.Verbose("Random {0} end:   {1}", name, end);
+                if (path != null && File.Exists(path))
+                    File.Delete(path);
+            }
 
-                    var duration = end.Subtract(start);
-                    Logger.Info("Random {0} duration: {1}", name, duration);
-                    Logger.Info("Random {0} speed:    {1}/s", name,
-                        FormatBytes(stream.Length / duration.TotalSeconds, 3));
-                    return duration;
-                });
+            WaitForUserExit();
+            return result;
+        }
 
-                var write = new Action(() =>
-                {
-                    var useBuffer = getBuffer();
-                    stream.Write(useBuffer, 0, useBuffer.Length);
-                    stream.Flush();
-                });
+        private static bool RunTest(string name, StreamBenchmarkOptions options, Stream stream, string path,
+            long length, bool unbuffered, bool writeThrough)
+        {
+            Logger.Info("===== Starting {0} Process", name);
+            Logger.Verbose("{0}: {1} thread(s) at queue depth {2}, {3} per request", name, options.Threads,
+                options.QueueDepth, FormatBytes(options.BlockSize, 0));
 
-                var read = new Action(() =>
-                {
-                    stream.Read(buffer, 0, buffer.Length);
-                });
+            var progress = new StreamBenchmarkProgressHandler((interval) =>
+            {
+                if (interval.Total.Requests == 0)
+                    return;
 
-                if (!opts.SkipSequential)
-                {
-                    var sequentialWriteDuration = sequentialAction("write", write);
-                    var sequentialReadDuration = sequentialAction("read", read);
-                }
+                Logger.Info("{0} {1,4:0}s: {2,8:0} IOPS, {3}/s, p50 {4}, p99 {5}, p99.9 {6}", name,
+                    interval.Elapsed.TotalSeconds, interval.Total.RequestsPerSecond,
+                    FormatBytes(interval.Total.BytesPerSecond, 3), FormatLatency(interval.Total.P50Latency),
+                    FormatLatency(interval.Total.P99Latency), FormatLatency(interval.Total.P999Latency));
+            });
 
-                if (!opts.SkipRandom)
+            StreamBenchmark benchmark;
+            try
+            {
+                using (var benchmarker = new StreamBenchmarker(options))
                 {
-                    var randomWriteDuration = randomAction("write", write);
-                    var randomReadDuration = randomAction("read", read);
+                    if (stream != null)
+                        benchmark = benchmarker.Run(stream, length, progress);
+                    else
+                        benchmark = benchmarker.Run(path, length, unbuffered, writeThrough, progress);
                 }
             }
+            catch (IOException ex)
+            {
+                Logger.Error("Failed to open \"{0}\": {1}", path, ex.Message);
+                return false;
+            }
 
-            if (File.Exists(path))
-                File.Delete(path);
+            if (!benchmark.Succeeded)
+            {
+                Logger.Error("{0} failed at 0x{1:X}: {2}", name, benchmark.FailedPosition, benchmark.Failure);
+                return false;
+            }
 
-            WaitForUserExit();
-            return SUCCESS;
+            Logger.Info("{0} duration: {1}", name, benchmark.Elapsed);
+            ReportCounters(name, "read", benchmark.Read);
+            ReportCounters(name, "write", benchmark.Write);
+            return true;
         }
-        
+
+        private static void ReportCounters(string name, string kind, StreamBenchmarkCounters counters)
+        {
+            if (counters.Requests == 0)
+                return;
+
+            Logger.Info("{0} {1} speed:   {2}/s, {3:0} IOPS", name, kind,
+                FormatBytes(counters.BytesPerSecond, 3), counters.RequestsPerSecond);
+            Logger.Info("{0} {1} latency: mean {2}, p50 {3}, p99 {4}, p99.9 {5}, max {6}", name, kind,
+                FormatLatency(counters.MeanLatency), FormatLatency(counters.P50Latency),
+                FormatLatency(counters.P99Latency), FormatLatency(counters.P999Latency),
+                FormatLatency(counters.MaxLatency));
+        }
+
+        private static bool ParsePattern(string value, out AccessPattern pattern)
+        {
+            switch (value.ToLowerInvariant())
+            {
+                case "sequential": pattern = AccessPattern.Sequential; return true;
+                case "random": pattern = AccessPattern.Random; return true;
+                case "zipf": pattern = AccessPattern.Zipfian; return true;
+            }
+
+            pattern = AccessPattern.Random;
+            return false;
+        }
+
         [Verb("benchmark", HelpText = "Run various kind of benchmarks on several kind of disks")]
         public sealed class Options : BaseOptions
         {
 
-            [Value(0, Default = null, HelpText = "Letter of the drive which should be benchmarked", Required = true)]
-            public char Drive { get; set; }
+            [Value(0, Default = null, HelpText = "Letter of the drive, file or raw device which should be benchmarked, or \"ramdisk\" for a memory stream", Required = true)]
+            public string Target { get; set; }
 
-            [Option('s', "size", Default = "1G", HelpText = "Size of the file which will be used to write and read the test-data", Required = false)]
+            [Option('s', "size", Default = "1G", HelpText = "Size of the file, memory stream or range of the device which will be used to write and read the test-data", Required = false)]
             public string SizeString { get; set; }
 
             public long Size
@@ -245,7 +313,7 @@ namespace nDiscUtils.Modules
                 get => ParseSizeString(SizeString);
             }
 
-            [Option('b', "buffer-size", Default = "16M", HelpText = "Size of the I/O-buffer used to read/write the test-data", Required = false)]
+            [Option('b', "buffer-size", Default = "16M", HelpText = "Size of each request used to read/write the test-data", Required = false)]
             public string BufferSizeString { get; set; }
 
             public long BufferSize
@@ -253,7 +321,7 @@ namespace nDiscUtils.Modules
                 get => ParseSizeString(BufferSizeString);
             }
 
-            [Option('i', "internal-buffer-size", Default = "512", HelpText = "Size of the internal I/O-buffer used to read/write the test-data", Required = false)]
+            [Option('i', "internal-buffer-size", Default = "512", HelpText = "Size of the internal I/O-buffer of the benchmarking-file in practical tests", Required = false)]
             public string InternalBufferSizeString { get; set; }
 
             public long InternalBufferSize
@@ -261,6 +329,27 @@ namespace nDiscUtils.Modules
                 get => ParseSizeString(InternalBufferSizeString);
             }
 
+            [Option('t', "threads", Default = 1, HelpText = "Threads issuing requests", Required = false)]
+            public int Threads { get; set; }
+
+            [Option('q', "queue-depth", Default = 1, HelpText = "Requests each thread keeps in flight", Required = false)]
+            public int QueueDepth { get; set; }
+
+            [Option("pattern", Default = null, HelpText = "Only test this access pattern: sequential, random or zipf", Required = false)]
+            public string PatternString { get; set; }
+
+            [Option("read-percentage", Default = -1, HelpText = "Run one mixed test with this percentage of reads instead of separate write and read tests", Required = false)]
+            public int ReadPercentage { get; set; }
+
+            [Option("zipf-theta", Default = 1.2, HelpText = "Skew of the zipf pattern, larger values concentrate the requests on fewer blocks", Required = false)]
+            public double ZipfTheta { get; set; }
+
+            [Option("runtime", Default = 0, HelpText = "Seconds each test runs for, zero to transfer the size once", Required = false)]
+            public int Runtime { get; set; }
+
+            [Option("destructive", Default = false, HelpText = "Allow write tests on raw devices, which destroys their contents", Required = false)]
+            public bool Destructive { get; set; }
+
             [Option('u', "unbuffered", Default = false, HelpText = "Disables all buffers to get the most realistic physical I/O speed", Required = false)]
             public bool Unbuffered { get; set; }
 
@@ -279,7 +368,7 @@ namespace nDiscUtils.Modules
             [Option("buffering", Default = false, HelpText = "Disable NO_BUFFERING flag when creating the benchmarking-file", Required = false)]
             public bool Buffering { get; set; }
 
-            [Option("no-sequential-scan", Default = false, HelpText = "Disable sequential scan flag when creating the benchmarking-file", Required = false)]
+            [Option("no-sequential-scan", Default = false, HelpText = "Has no effect, the benchmark no longer requests sequential scans", Required = false)]
             public bool NoSequentialScan { get; set; }
 
         }
@@ -49,16 +49,39 @@ namespace nDiscUtils.Modules
         private static Stream mDestinationStream;
 
         private static long mBufferSize;
+        private static StreamCopier mCopier;
+        private static long mCopyFailures;
+
+        private static bool mSparse;
+        private static bool mDestinationZeroed;
+        private static long mCopiedBytes;
+        private static long mSkippedBytes;
+        private static long mUnreadBytes;
         private static bool mForceExactCloning;
         private static bool mFullClone;
+
+        private static bool mVerify;
+        private static StreamHasher mHasher;
+        private static string mHashListPath;
+        private static long mVerifyFailures;
         
         private static long mTaskIdCounter;
+
+        // Granularity at which sparse clones detect zeros
+        private const int SparseBlockSize = 4096;
         
         private static event CloneProgressEventHandler CloneProgressEvent;
 
         public static int Run(Options opts)
         {
             RunHelpers(opts);
+
+            if (opts.Sparse && (opts.BufferSize % SparseBlockSize) != 0)
+            {
+                Logger.Error("Buffer size has to be a multiple of {0} for sparse clones", FormatBytes(SparseBlockSize, 0));
+                WaitForUserExit();
+                return INVALID_ARGUMENT;
+            }
             OpenNewConsoleBuffer();
             InitializeConsole();
             ResetColor();
@@ -76,8 +99,6 @@ namespace nDiscUtils.Modules
             // register progress handler
             var lastPartition = -1;
             var lastTaskId = -1L;
-            var lastSpeedMeasure = DateTime.Now;
-            var lastSpeedCurrent = 0L;
             var lastProgressString = "";
             var lastSpeedString = "";
 
@@ -98,7 +119,6 @@ namespace nDiscUtils.Modules
 
                     lastPartition = e.Partition;
                     needToClearProgress = true;
-                    lastSpeedMeasure = DateTime.Now;
                 }
 
                 if (lastTaskId != e.TaskID)
@@ -109,60 +129,49 @@ namespace nDiscUtils.Modules
 
                     lastTaskId = e.TaskID;
                     needToClearProgress = true;
-                    lastSpeedMeasure = DateTime.Now;
                 }
 
                 if (needToClearProgress)
                     Write(ContentLeft + 1, ContentTop + 4, ' ', relativeProgressWidth);
 
-                // the actual progress
-                var speedMeasureNow = DateTime.Now;
-                var speedMeasureDiff = DateTime.Now.Subtract(lastSpeedMeasure);
-                if (speedMeasureDiff.TotalSeconds >= 1.0 || (e.Current >= e.Total) || opts.FastRefresh)
-                {
-                    var progress = ((double)e.Current / e.Total) * 100;
-                    var widthProgress = (int)Math.Min(((double)e.Current / e.Total)
-                        * relativeProgressWidth, relativeProgressWidth);
-
-                    var currentDelta = e.Current - lastSpeedCurrent;
-                    var averageSpeed = (currentDelta == 0 ? 0.0 :
-                        currentDelta / speedMeasureDiff.TotalSeconds);
+                // the actual progress, reported by the copy engine once per interval
+                var progress = ((double)e.Current / e.Total) * 100;
+                var widthProgress = (int)Math.Min(((double)e.Current / e.Total)
+                    * relativeProgressWidth, relativeProgressWidth);
 
-                    var estimatedEnd = (averageSpeed == 0 ? TimeSpan.MaxValue :
-                    TimeSpan.FromSeconds((e.Total - e.Current) / averageSpeed));
+                var averageSpeed = e.BytesPerSecond;
+                var estimatedEnd = (averageSpeed == 0 ? TimeSpan.MaxValue :
+                TimeSpan.FromSeconds((e.Total - e.Current) / averageSpeed));
 
-                    ResetColor();
-
-                    Write(ContentLeft + 1, ContentTop + 4, '|', widthProgress);
-                    WriteFormat(ContentLeft, ContentTop + 5, "{0:0.00} %  ", progress);
+                ResetColor();
 
-                    var progressString = string.Format(
-                        "{0} / {1}",
-                        FormatBytes(e.Current, 3), FormatBytes(e.Total, 3));
+                Write(ContentLeft + 1, ContentTop + 4, '|', widthProgress);
+                WriteFormat(ContentLeft, ContentTop + 5, "{0:0.00} %  ", progress);
 
-                    var progressPadding = "";
-                    if (progressString.Length < lastProgressString.Length)
-                        progressPadding = new string(' ', lastProgressString.Length - progressString.Length);
-                    lastProgressString = progressString;
+                var progressString = string.Format(
+                    "{0} / {1}",
+                    FormatBytes(e.Current, 3), FormatBytes(e.Total, 3));
 
-                    WriteFormatRight(ContentLeft + ContentWidth, ContentTop + 3,
-                        "{0}{1}", progressPadding, progressString);
+                var progressPadding = "";
+                if (progressString.Length < lastProgressString.Length)
+                    progressPadding = new string(' ', lastProgressString.Length - progressString.Length);
+                lastProgressString = progressString;
 
-                    var speedString = string.Format(
-                        "ETA: {0:hh\\:mm\\:ss}  @  {1}/s",
-                        estimatedEnd, FormatBytes(averageSpeed, 3));
+                WriteFormatRight(ContentLeft + ContentWidth, ContentTop + 3,
+                    "{0}{1}", progressPadding, progressString);
 
-                    var speedPadding = "";
-                    if (speedString.Length < lastSpeedString.Length)
-                        speedPadding = new string(' ', lastSpeedString.Length - speedString.Length);
-                    lastSpeedString = speedString;
+                var speedString = string.Format(
+                    "r {0:0.00} ms  w {1:0.00} ms  ETA: {2:hh\\:mm\\:ss}  @  {3}/s",
+                    e.ReadLatency.TotalMilliseconds, e.WriteLatency.TotalMilliseconds,
+                    estimatedEnd, FormatBytes(averageSpeed, 3));
 
-                    WriteFormatRight(ContentLeft + ContentWidth, ContentTop + 5,
-                        "{0}{1}", speedPadding, speedString);
+                var speedPadding = "";
+                if (speedString.Length < lastSpeedString.Length)
+                    speedPadding = new string(' ', lastSpeedString.Length - speedString.Length);
+                lastSpeedString = speedString;
 
-                    lastSpeedCurrent = e.Current;
-                    lastSpeedMeasure = speedMeasureNow;
-                }
+                WriteFormatRight(ContentLeft + ContentWidth, ContentTop + 5,
+                    "{0}{1}", speedPadding, speedString);
             };
 
             mSourcePath = opts.Source;
@@ -173,12 +182,56 @@ namespace nDiscUtils.Modules
             
             mTaskIdCounter = 0;
 
+            // The destination file was just created, so everything which is
+            // not written stays a hole that reads back as zero
+            mSparse = opts.Sparse;
+            mDestinationZeroed = opts.Sparse && PlatformFileHandler.MakeSparse(mDestinationStream);
+            mCopiedBytes = 0;
+            mSkippedBytes = 0;
+            mUnreadBytes = 0;
+
             mBufferSize = opts.BufferSize;
+            mCopier = new StreamCopier((int)Math.Min(opts.BufferSize, int.MaxValue), opts.QueueDepth,
+                TimeSpan.FromSeconds(opts.FastRefresh ? 0.1 : 1.0), (opts.Sparse ? SparseBlockSize : 0));
+            mCopyFailures = 0;
             mForceExactCloning = opts.ForceExactCloning;
             mFullClone = opts.FullClone;
 
+            mVerify = opts.Verify;
+            mHashListPath = opts.HashListFile;
+            mVerifyFailures = 0;
+            if (opts.Verify || opts.HashListFile != null)
+                mHasher = new StreamHasher(HashAlgorithm.XxHash3, 1 << 20);
+
             var returnCode = StartInternal();
 
+            mCopier.Dispose();
+            mCopier = null;
+
+            if (mSparse)
+            {
+                Logger.Info("Copied {0} of data, left {1} of zeros unwritten and did not read {2} of unallocated ranges",
+                    FormatBytes(mCopiedBytes - mSkippedBytes, 3), FormatBytes(mSkippedBytes, 3), FormatBytes(mUnreadBytes, 3));
+            }
+
+            if (mHasher != null)
+            {
+                mHasher.Dispose();
+                mHasher = null;
+            }
+
+            if (returnCode == SUCCESS && mCopyFailures > 0)
+            {
+                Logger.Error("{0} stream(s) could not be cloned completely", mCopyFailures);
+                returnCode = ERROR;
+            }
+
+            if (returnCode == SUCCESS && mVerifyFailures > 0)
+            {
+                Logger.Error("{0} cloned stream(s) do not match their source", mVerifyFailures);
+                returnCode = ERROR;
+            }
+
             if (returnCode == SUCCESS)
                 Logger.Fine("Finished!");
             else
@@ -249,7 +302,21 @@ namespace nDiscUtils.Modules
             if (mFullClone)
             {
                 Logger.Warn("Starting full clone...");
-                CloneStream(0, 0, mSourceStream, mDestinationStream);
+                CloneStream(0, 0, mSourceStream, mDestinationStream, mDestinationZeroed);
+
+                if (mHashListPath != null)
+                {
+                    var hash = mHasher.Hash(mDestinationStream, mDestinationStream.Length);
+                    if (!hash.Succeeded)
+                    {
+                        Logger.Error("Failed to hash destination at 0x{0:X}: {1}", hash.FailedPosition, hash.Failure);
+                        return ERROR;
+                    }
+
+                    HashList.FromHash(hash).Save(mHashListPath);
+                    Logger.Info("Saved hash list of destination to \"{0}\"", mHashListPath);
+                }
+
                 return SUCCESS;
             }
 
@@ -530,7 +597,7 @@ namespace nDiscUtils.Modules
                         srcPartition.Name, srcPartition.Identity,
                         srcPartition.FirstSector.ToString("X2"));
 
-                    CloneStream(i, taskId, srcPartitionStream, destPartitionStream);
+                    CloneStream(i, taskId, srcPartitionStream, destPartitionStream, mDestinationZeroed);
                 }
                 else
                 {
@@ -630,7 +697,7 @@ namespace nDiscUtils.Modules
                             if (!skipCopying)
                             {
                                 Logger.Info("[{0}/{1}] cp-file: {2}", i, taskId, destFile.FullName);
-                                CloneStream(i, taskId, sourceFileStream, destFileStream);
+                                CloneStream(i, taskId, sourceFileStream, destFileStream, false);
                             }
 
                             // clone basic file informationsdestFile
@@ -704,38 +771,74 @@ namespace nDiscUtils.Modules
             return SUCCESS;
         }
 
-        private static void CloneStream(int partition, long taskId, Stream source, Stream destination)
+        private static void CloneStream(int partition, long taskId, Stream source, Stream destination,
+            bool destinationZeroed)
         {
             var total = source.Length;
-            var buffer = new byte[mBufferSize];
+            if (total == 0)
+                return;
+
+            // Reads run ahead of the writes by up to queue-depth buffers; sparse
+            // clones skip whatever the source does not allocate
+            var allocated = (mSparse ? PlatformFileHandler.GetAllocatedRanges(source) : null);
+            var copy = mCopier.Copy(source, destination, total, allocated, destinationZeroed, (progress) =>
+                CloneProgressEvent?.Invoke(new CloneProgressEventArgs(partition, taskId, total,
+                    progress.CopiedBytes, progress.BytesPerSecond, progress.ReadLatency, progress.WriteLatency)));
+
+            mCopiedBytes += copy.CopiedBytes;
+            mSkippedBytes += copy.SkippedBytes;
+            mUnreadBytes += copy.UnreadBytes;
 
-            if (source.Length == 0)
+            if (!copy.Succeeded)
+            {
+                Logger.Error("[{0}/{1}] {2}-err @ 0x{3:X}: {4}", partition, taskId,
+                    (copy.FailedSide == CopySide.Source ? "read" : "write"), copy.FailedPosition, copy.Failure);
+                mCopyFailures++;
                 return;
+            }
 
-            source.Seek(0, SeekOrigin.Begin);
-            destination.Seek(0, SeekOrigin.Begin);
+            Logger.Verbose("[{0}/{1}] cp-ok  : {2} in {3:0.00}s, r {4:0.00}/{5:0.00} ms  w {6:0.00}/{7:0.00} ms (mean/max)",
+                partition, taskId, FormatBytes(total, 3), copy.Elapsed.TotalSeconds,
+                copy.ReadLatency.TotalMilliseconds, copy.MaxReadLatency.TotalMilliseconds,
+                copy.WriteLatency.TotalMilliseconds, copy.MaxWriteLatency.TotalMilliseconds);
+
+            if (mVerify)
+                VerifyStream(partition, taskId, source, destination);
+        }
 
-            do
+        private static void VerifyStream(int partition, long taskId, Stream source, Stream destination)
+        {
+            // Files on re-created file systems are opened write-only
+            if (!destination.CanRead)
             {
-                var buffSizeDiff = (total - source.Position);
-                if (buffSizeDiff < buffer.LongLength && buffSizeDiff > 0)
-                    buffer = new byte[buffSizeDiff];
+                Logger.Verbose("[{0}/{1}] vf-skip: destination is not readable", partition, taskId);
+                return;
+            }
 
-                var read = source.Read(buffer, 0, buffer.Length);
-                if (read <= 0 && source.Position < total)
-                {
-                    Logger.Error("[{0}/{1}] read-err @ 0x{2:X}+{3}", partition, taskId,
-                        source.Position, buffer.Length);
-                    continue;
-                }
+            var sourceHash = mHasher.Hash(source, source.Length);
+            var destinationHash = mHasher.Hash(destination, source.Length);
 
-                destination.Write(buffer, 0, read);
+            if (!sourceHash.Succeeded || !destinationHash.Succeeded)
+            {
+                var failed = (sourceHash.Succeeded ? destinationHash : sourceHash);
+                Logger.Error("[{0}/{1}] vf-err @ 0x{2:X}: {3}", partition, taskId,
+                    failed.FailedPosition, failed.Failure);
+                mVerifyFailures++;
+                return;
+            }
 
-                CloneProgressEvent?.Invoke(new CloneProgressEventArgs(partition, taskId,
-                    total, source.Position));
-            } while (source.Position < total);
+            var digestSize = sourceHash.DigestSize;
+            if (MemoryWrapper.FindMismatch(sourceHash.Digest, destinationHash.Digest, digestSize) != digestSize)
+            {
+                var blocks = HashList.FromHash(sourceHash).FindMismatchingBlocks(destinationHash);
+                Logger.Error("[{0}/{1}] vf-err : {2} block(s) differ, first @ 0x{3:X}", partition, taskId,
+                    blocks.Count, (blocks.Count > 0 ? (long)blocks[0] * sourceHash.BlockSize : 0));
+                mVerifyFailures++;
+                return;
+            }
 
-            destination.Flush();
+            Logger.Verbose("[{0}/{1}] vf-ok  : {2}", partition, taskId,
+                HashList.ToHex(destinationHash.Digest, 0, digestSize));
         }
         
         [Verb("clone", HelpText = "Performs intelligent or full clone")]
@@ -756,6 +859,12 @@ namespace nDiscUtils.Modules
                 get => ParseSizeString(BufferSizeString);
             }
 
+            [Option("queue-depth", Default = 4, HelpText = "Buffers read ahead while earlier ones are written")]
+            public int QueueDepth { get; set; }
+
+            [Option("sparse", Default = false, HelpText = "Skips unallocated ranges of the source and leaves zeros as holes in a new image file")]
+            public bool Sparse { get; set; }
+
             [Option('e', "force-exact", Default = false, HelpText = "Forces a byte-for-byte cloning of all data. Disables the possibility of fitting data onto smaller targets.")]
             public bool ForceExactCloning { get; set; }
 
@@ -765,6 +874,12 @@ namespace nDiscUtils.Modules
             [Option('g', "fast-refresh", Default = false, HelpText = "Fast-refresh the outputted progress. May slow down the erase process.", Required = false)]
             public bool FastRefresh { get; set; }
 
+            [Option("verify", Default = false, HelpText = "Hashes source and destination after copying each stream and fails on any mismatch")]
+            public bool Verify { get; set; }
+
+            [Option("hash-list", Default = null, HelpText = "File the block digests of the destination are saved to after a full clone")]
+            public string HashListFile { get; set; }
+
         }
 
     }
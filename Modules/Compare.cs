@@ -52,7 +52,8 @@ namespace nDiscUtils.Modules
         private static Stream mSummaryStream;
         private static StreamWriter mSummaryWriter;
 
-        private static long mBufferSize;
+        private static StreamComparer mComparer;
+        private static int mMaxRanges;
 
         private static long recordedWarnings;
         private static long recordedErrors;
@@ -61,6 +62,15 @@ namespace nDiscUtils.Modules
         public static int Run(Options opts)
         {
             RunHelpers(opts);
+
+            // The native comparer takes the chunk size as an int
+            if (opts.BufferSize <= 0 || opts.BufferSize > int.MaxValue)
+            {
+                Logger.Error("Buffer size has to be between one byte and 2G");
+                WaitForUserExit();
+                return INVALID_ARGUMENT;
+            }
+
             OpenNewConsoleBuffer();
             InitializeConsole();
 
@@ -68,13 +78,14 @@ namespace nDiscUtils.Modules
             mRightPath = opts.Right;
             mSummaryFile = opts.SummaryFile;
 
-            mLeftStream = OpenPath(mLeftPath, FileMode.Open, FileAccess.Read, FileShare.Read);
-            mRightStream = OpenPath(mRightPath, FileMode.Open, FileAccess.Read, FileShare.Read);
+            mLeftStream = OpenPathMapped(mLeftPath, FileShare.Read);
+            mRightStream = OpenPathMapped(mRightPath, FileShare.Read);
 
             mSummaryStream = OpenPath(mSummaryFile, FileMode.Create, FileAccess.ReadWrite, FileShare.Read);
             mSummaryWriter = new StreamWriter(mSummaryStream);
 
-            mBufferSize = opts.BufferSize;
+            mComparer = new StreamComparer((int)opts.BufferSize, opts.QueueDepth, opts.Threads, opts.MaxRanges);
+            mMaxRanges = opts.MaxRanges;
 
             recordedWarnings = 0;
             recordedErrors = 0;
@@ -88,6 +99,9 @@ namespace nDiscUtils.Modules
             var endDateTime = DateTime.Now;
             WriteEnd(beginDateTime, endDateTime);
 
+            mComparer.Dispose();
+            mComparer = null;
+
             if (returnCode == SUCCESS)
                 Logger.Fine("Finished!");
             else
@@ -620,9 +634,6 @@ namespace nDiscUtils.Modules
         private static void DoByteComparison(Stream left, Stream right, int partition, string file = null)
         {
             var total = left.Length;
-            var leftBuffer = new byte[mBufferSize];
-            var rightBuffer = new byte[mBufferSize];
-            var errored = false;
 
             var beginDateTime = DateTime.Now;
 
@@ -656,94 +667,61 @@ namespace nDiscUtils.Modules
             if (left.Length == 0)
                 return;
 
-            do
-            {
-                var leftBuffSizeDiff = (total - left.Position);
-                if (leftBuffSizeDiff < leftBuffer.LongLength && leftBuffSizeDiff > 0)
-                    leftBuffer = new byte[leftBuffSizeDiff];
-
-                var leftRead = left.Read(leftBuffer, 0, leftBuffer.Length);
-
-                DoingCheck();
-                if (leftRead <= 0 && (left.Position < left.Length || 
-                    (leftRead != 0 && left.Length + leftRead < left.Position)))
-                {
-                    if (file == null)
-                        Error("Partition{0}: Failed to read from left stream @ " +
-                            "(0x{1:X2}+{2})",
-                            partition, left.Position, leftBuffer.Length);
-                    else
-                        Error("Partition{0}:{1}: Failed to read from left stream @ " +
-                            "(0x{2:X2}+{3})",
-                            partition, file, left.Position, leftBuffer.Length);
-
-                    errored = true;
-                    break;
-                }
-
-                var rightBuffSizeDiff = (total - right.Position);
-                if (rightBuffSizeDiff < rightBuffer.LongLength && rightBuffSizeDiff > 0)
-                    rightBuffer = new byte[rightBuffSizeDiff];
-
-                var rightRead = right.Read(rightBuffer, 0, rightBuffer.Length);
+            var comparison = mComparer.Compare(left, right, total);
+            var endDateTime = DateTime.Now;
 
-                DoingCheck();
-                if (rightRead <= 0 && (right.Position < right.Length || 
-                    (rightRead != 0 && right.Length + rightRead < right.Position)))
-                {
-                    if (file == null)
-                        Error("Partition{0}: Failed to read from right stream @ " +
-                            "(0x{1:X2}+{2})",
-                            partition, right.Position, rightBuffer.Length);
-                    else
-                        Error("Partition{0}:{1}: Failed to read from right stream @ " +
-                            "(0x{2:X2}+{3})",
-                            partition, file, right.Position, rightBuffer.Length);
-
-                    errored = true;
-                    break;
-                }
+            DoingCheck();
+            if (comparison.FailedSide != CompareSide.None)
+            {
+                var side = (comparison.FailedSide == CompareSide.Left ? "left" : "right");
 
-                DoingCheck();
-                if (leftRead != rightRead)
-                {
-                    if (file == null)
-                        Error("Partition{0}: Non-matching data length @ " +
-                            "(Left: {1}, Right: {2})",
-                            partition, leftRead, rightRead);
-                    else
-                        Error("Partition{0}:{1}: Non-matching data length @ " +
-                            "(Left: {2}, Right: {3})",
-                            partition, file, leftRead, rightRead);
-
-                    errored = true;
-                    break;
-                }
+                if (file == null)
+                    Error("Partition{0}: Failed to read from {1} stream @ " +
+                        "(0x{2:X2}): {3}",
+                        partition, side, comparison.FailedPosition, comparison.Failure);
+                else
+                    Error("Partition{0}:{1}: Failed to read from {2} stream @ " +
+                        "(0x{3:X2}): {4}",
+                        partition, file, side, comparison.FailedPosition, comparison.Failure);
+            }
 
-                DoingCheck();
-                if (!EqualBytesLongUnrolled(leftBuffer, rightBuffer))
-                {
-                    if (file == null)
-                        Error("Partition{0}: Non-matching data @ " +
-                            "(Left: {1}, Right: {2})",
-                            partition, leftRead, rightRead);
-                    else
-                        Error("Partition{0}:{1}: Non-matching data @ " +
-                            "(Left: {2}, Right: {3})",
-                            partition, file, leftRead, rightRead);
-
-                    errored = true;
-                    break;
-                }
+            DoingCheck();
+            foreach (var range in comparison.Ranges)
+            {
+                if (file == null)
+                    Error("Partition{0}: Non-matching data @ (0x{1:X2}+{2})",
+                        partition, range.Offset, range.Length);
+                else
+                    Error("Partition{0}:{1}: Non-matching data @ (0x{2:X2}+{3})",
+                        partition, file, range.Offset, range.Length);
+            }
 
-            } while (left.Position < left.Length && right.Position < right.Length);
+            if (comparison.DifferingRangeCount > comparison.Ranges.Length)
+            {
+                if (file == null)
+                    Error("Partition{0}: {1} more non-matching range(s) beyond the first {2}",
+                        partition, comparison.DifferingRangeCount - comparison.Ranges.Length, mMaxRanges);
+                else
+                    Error("Partition{0}:{1}: {2} more non-matching range(s) beyond the first {3}",
+                        partition, file, comparison.DifferingRangeCount - comparison.Ranges.Length, mMaxRanges);
+            }
 
-            var endDateTime = DateTime.Now;
+            if (comparison.DifferingBytes != 0)
+            {
+                if (file == null)
+                    Info("Partition{0}: {1} differing byte(s) in {2} range(s) within the first {3}",
+                        partition, comparison.DifferingBytes, comparison.DifferingRangeCount,
+                        FormatBytes(comparison.ComparedBytes, 3));
+                else
+                    Info("Partition{0}:{1}: {2} differing byte(s) in {3} range(s) within the first {4}",
+                        partition, file, comparison.DifferingBytes, comparison.DifferingRangeCount,
+                        FormatBytes(comparison.ComparedBytes, 3));
+            }
 
-            if (!errored)
+            if (comparison.Equal)
             {
                 if (file == null)
-                    Info("Partition{0}: Byte-check passed! ({2:hh\\:mm\\:ss\\.fffffff})",
+                    Info("Partition{0}: Byte-check passed! ({1:hh\\:mm\\:ss\\.fffffff})",
                         partition, endDateTime.Subtract(beginDateTime));
                 else
                     Info("Partition{0}:{1}: Byte-check passed! ({2:hh\\:mm\\:ss\\.fffffff})",
@@ -877,7 +855,7 @@ namespace nDiscUtils.Modules
             [Value(2, Default = null, HelpText = "File which will contain the final summary about the comparison", Required = true)]
             public string SummaryFile { get; set; }
 
-            [Option('b', "buffer-size", Default = "64K", HelpText = "Size of I/O-buffer used for copying data", Required = true)]
+            [Option('b', "buffer-size", Default = "1M", HelpText = "Size of each chunk read from both targets", Required = true)]
             public string BufferSizeString { get; set; }
 
             public long BufferSize
@@ -885,6 +863,15 @@ namespace nDiscUtils.Modules
                 get => ParseSizeString(BufferSizeString);
             }
 
+            [Option("queue-depth", Default = 4, HelpText = "Chunks read ahead from both targets while earlier ones are compared")]
+            public int QueueDepth { get; set; }
+
+            [Option('t', "threads", Default = 0, HelpText = "Threads comparing chunks, zero for one per core")]
+            public int Threads { get; set; }
+
+            [Option("max-ranges", Default = 4096, HelpText = "Non-matching ranges reported per compared stream, further ones are only counted")]
+            public int MaxRanges { get; set; }
+
         }
 
     }
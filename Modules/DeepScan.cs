@@ -17,11 +17,9 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 using System;
+using System.Diagnostics;
 using System.IO;
-using System.Text;
-using System.Threading.Tasks;
 using CommandLine;
-using DiscUtils;
 using DiscUtils.Ext;
 using DiscUtils.Fat;
 using DiscUtils.Ntfs;
@@ -41,12 +39,35 @@ namespace nDiscUtils.Modules
         // DO NOT CHANGE THIS!!!
         private const int BLOCK_SIZE = 1024;
 
+        // Bytes handed to the detectors, covering the boot sector and the ext superblock
+        private const int VERIFY_SIZE = 4 * BLOCK_SIZE;
+
+        // Range scanned natively between two progress reports
+        private const long WINDOW_SIZE = 1L << 30;
+
         public static int Run(Options opts)
         {
             RunHelpers(opts);
 
+            var signatures = FileSystemSignature.None;
+            if (opts.ScanForNtfs)
+                signatures |= FileSystemSignature.Ntfs;
+            if (opts.ScanForFat)
+                signatures |= FileSystemSignature.Fat;
+            if (opts.ScanForExt)
+                signatures |= FileSystemSignature.Ext;
+            if (signatures == FileSystemSignature.None)
+                signatures = FileSystemSignature.All;
+
+            if (opts.ScanGranularity <= 0 || opts.BlockCount <= 0 || opts.BlockCount > (1 << 20))
+            {
+                Logger.Error("Scan granularity has to be positive and the block count between 1 and 1048576");
+                WaitForUserExit();
+                return INVALID_ARGUMENT;
+            }
+
             Logger.Info("Opening image \"{0}\"", opts.Path);
-            var imageStream = OpenPath(opts.Path, FileMode.Open, FileAccess.Read, FileShare.None);
+            var imageStream = OpenPathMapped(opts.Path, FileShare.None);
             if (imageStream == null)
             {
                 Logger.Error("Failed to open image!");
@@ -54,70 +75,96 @@ namespace nDiscUtils.Modules
                 return INVALID_ARGUMENT;
             }
 
-            var bufferSize = opts.BlockCount * BLOCK_SIZE;
-            var buffer = new byte[bufferSize];
-            var writeLock = new object();
-            var lastPositionReportLock = new object();
+            var imageLength = imageStream.Length;
+            var buffer = new byte[VERIFY_SIZE];
             var lastPositionReport = DateTime.Now;
+            var candidates = 0L;
+            var found = 0L;
+            var returnCode = SUCCESS;
 
-            Logger.Info("Starting deep scan of {0} (0x{1:X})", FormatBytes(imageStream.Length, 3), imageStream.Length);
-            while (imageStream.Position < imageStream.Length)
+            var watch = Stopwatch.StartNew();
+            Logger.Info("Starting deep scan of {0} (0x{1:X})", FormatBytes(imageLength, 3), imageLength);
+
+            using (var scanner = new StreamScanner(signatures, opts.ScanGranularity, opts.BlockCount * BLOCK_SIZE,
+                4, opts.Threads, int.MaxValue))
             {
-                var read = imageStream.Read(buffer, 0, buffer.Length);
-                if (read != buffer.Length)
+                for (var position = 0L; position < imageLength; position += WINDOW_SIZE)
                 {
-                    Logger.Error("Failed to read {0} of data, got {1} at position 0x{2:X}", 
-                        FormatBytes(buffer.Length, 3), FormatBytes(read, 3), imageStream.Position);
-                    break;
-                }
+                    var scan = scanner.Scan(imageStream, position, Math.Min(WINDOW_SIZE, imageLength - position));
+                    candidates += scan.HitCount;
+
+                    // Only the candidates are read again and handed to the detectors
+                    foreach (var hit in scan.Hits)
+                    {
+                        if (Verify(imageStream, imageLength, hit, buffer))
+                            found++;
+                    }
+
+                    if (!scan.Succeeded)
+                    {
+                        Logger.Error("Failed to read at position 0x{0:X}: {1}", scan.FailedPosition, scan.Failure);
+                        returnCode = ERROR;
+                        break;
+                    }
 
-                Parallel.For(0, bufferSize - BLOCK_SIZE + 1, new ParallelOptions() { MaxDegreeOfParallelism = opts.Threads },
-                    (i, l) =>
+                    var now = DateTime.Now;
+                    if (now.Subtract(lastPositionReport).TotalSeconds >= 10.0)
                     {
-                        var actualPosition = imageStream.Position - buffer.Length + i;
-
-                        if (i % opts.ScanGranularity != 0)
-                            return;
-
-                        Stream stream = new MemoryStream(BLOCK_SIZE);
-                        stream.Write(buffer, i, (stream as MemoryStream).Capacity);
-
-                        // assume file system is on the rest of the stream to fix file table position validating
-                        stream = new FixedLengthStream(stream, imageStream.Length - imageStream.Position, false);
-
-                        if (opts.ScanForNtfs && NtfsFileSystem.Detect(stream))
-                        {
-                            lock (writeLock)
-                                Logger.Info("Found NTFS file system at offset 0x{0:X} ({1})", actualPosition, FormatBytes(actualPosition, 3));
-                        }
-                        else if (opts.ScanForFat && FatFileSystem.Detect(stream))
-                        {
-                            lock (writeLock)
-                                Logger.Info("Found FAT file system at offset 0x{0:X} ({1})", actualPosition, FormatBytes(actualPosition, 3));
-                        }
-                        else if (opts.ScanForExt && ExtFileSystem.Detect(stream))
-                        {
-                            lock (writeLock)
-                                Logger.Info("Found EXT file system at offset 0x{0:X} ({1})", actualPosition, FormatBytes(actualPosition, 3));
-                        }
-
-                        lock(lastPositionReportLock)
-                        {
-                            var now = DateTime.Now;
-                            if (now.Subtract(lastPositionReport).TotalSeconds >= 10.0)
-                            {
-                                lock (writeLock)
-                                    Logger.Info("Currently scanning at offset 0x{0:X} ({1})", actualPosition, FormatBytes(actualPosition, 3));
-
-                                lastPositionReport = now;
-                            }
-                        }
-                    });
+                        var scanned = position + scan.ScannedBytes;
+                        Logger.Info("Currently scanning at offset 0x{0:X} ({1}) at {2}/s", scanned, FormatBytes(scanned, 3),
+                            FormatBytes(scanned / Math.Max(watch.Elapsed.TotalSeconds, 0.001), 3));
+
+                        lastPositionReport = now;
+                    }
+                }
             }
 
+            watch.Stop();
+            Logger.Info("Verified {0} candidate(s) and found {1} file system(s) in {2:0.00}s", candidates, found,
+                watch.Elapsed.TotalSeconds);
+
             Cleanup(imageStream);
             WaitForUserExit();
-            return SUCCESS;
+            return returnCode;
+        }
+
+        private static bool Verify(Stream imageStream, long imageLength, SignatureHit hit, byte[] buffer)
+        {
+            imageStream.Seek(hit.Position, SeekOrigin.Begin);
+
+            var read = 0;
+            while (read < buffer.Length)
+            {
+                var count = imageStream.Read(buffer, read, buffer.Length - read);
+                if (count <= 0)
+                    break;
+
+                read += count;
+            }
+
+            // assume file system is on the rest of the stream to fix file table position validating
+            Stream stream = new MemoryStream(buffer, 0, read, false);
+            stream = new FixedLengthStream(stream, imageLength - hit.Position, false);
+
+            if ((hit.Signatures & FileSystemSignature.Ntfs) != 0 && NtfsFileSystem.Detect(stream))
+            {
+                Logger.Info("Found NTFS file system at offset 0x{0:X} ({1})", hit.Position, FormatBytes(hit.Position, 3));
+                return true;
+            }
+
+            if ((hit.Signatures & FileSystemSignature.Fat) != 0 && FatFileSystem.Detect(stream))
+            {
+                Logger.Info("Found FAT file system at offset 0x{0:X} ({1})", hit.Position, FormatBytes(hit.Position, 3));
+                return true;
+            }
+
+            if ((hit.Signatures & FileSystemSignature.Ext) != 0 && ExtFileSystem.Detect(stream))
+            {
+                Logger.Info("Found EXT file system at offset 0x{0:X} ({1})", hit.Position, FormatBytes(hit.Position, 3));
+                return true;
+            }
+
+            return false;
         }
 
         [Verb("deepscan", HelpText = "Perform a full scan on images to find lost partitions and files")]
@@ -127,16 +174,16 @@ namespace nDiscUtils.Modules
             [Value(0, Default = null, HelpText = "Path to the image or the disk which should be used", Required = true)]
             public string Path { get; set; }
 
-            [Option('b', "block-count", Default = 64, HelpText = "Count of 1K-blocks buffered in memory", Required = false)]
+            [Option('b', "block-count", Default = 16384, HelpText = "Count of 1K-blocks read from the image per request", Required = false)]
             public int BlockCount { get; set; }
 
             [Option('s', "scan-granularity", Default = 1, HelpText = "Granularity of the scan process/Count of bytes to skip when scanning", Required = false)]
             public int ScanGranularity { get; set; }
 
-            [Option('t', "threads", Default = 2, HelpText = "Count of different threads deep scan operations run in", Required = false)]
+            [Option('t', "threads", Default = 2, HelpText = "Count of different threads deep scan operations run in, zero for one per core", Required = false)]
             public int Threads { get; set; }
 
-            [Option("ntfs", Default = false, HelpText = "Scan for NTFS file systems", Required = false)]
+            [Option("ntfs", Default = false, HelpText = "Scan for NTFS file systems; all file systems are scanned for if none is selected", Required = false)]
             public bool ScanForNtfs { get; set; }
 
             [Option("fat", Default = false, HelpText = "Scan for FAT file systems", Required = false)]
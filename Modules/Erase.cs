@@ -36,7 +36,7 @@ namespace nDiscUtils.Modules
     public static class Erase
     {
 
-        private static Random mRandom = new Random();
+        private static ulong mSeed;
 
         private static long mTotalPosition;
         private static long mTotalLength;
@@ -90,6 +90,12 @@ namespace nDiscUtils.Modules
 
         private static int StartInternal(Options opts)
         {
+            if (opts.Randomize)
+            {
+                mSeed = (opts.Seed != 0 ? opts.Seed : BitConverter.ToUInt64(Guid.NewGuid().ToByteArray(), 0));
+                Logger.Info("Generating random data from seed 0x{0:X16} with {1}", mSeed, Memory.RandomImplementation);
+            }
+
             if (opts.Cached)
             {
                 mOpenAction = new Func<string, Stream>((path)
@@ -171,11 +177,15 @@ namespace nDiscUtils.Modules
         {
             var buffer = new byte[opts.BufferSize];
 
-            if (opts.Randomize)
+            // Every loop writes its own stream; without --randomize-once the
+            // data at each position can be reproduced from the seed
+            var seed = mSeed + (ulong)loop;
+
+            if (opts.Randomize && opts.RandomizeOnce)
             {
-                mRandom.NextBytes(buffer);
+                MemoryWrapper.FillRandom(buffer, 0, buffer.Length, seed, 0, opts.FillThreads);
             }
-            else
+            else if (!opts.Randomize)
             {
                 MemoryWrapper.Set(buffer, 0, buffer.Length);
             }
@@ -190,13 +200,13 @@ namespace nDiscUtils.Modules
 
             while (destination.Position < destination.Length)
             {
-                if (opts.Randomize && !opts.RandomizeOnce)
-                    mRandom.NextBytes(buffer);
-
                 var writeCount = (int)Math.Min(
                     buffer.Length, 
                     destination.Length - destination.Position);
 
+                if (opts.Randomize && !opts.RandomizeOnce)
+                    MemoryWrapper.FillRandom(buffer, 0, writeCount, seed, destination.Position, opts.FillThreads);
+
                 destination.Write(buffer, 0, writeCount);
                 mTotalPosition += writeCount;
 
@@ -322,6 +332,12 @@ namespace nDiscUtils.Modules
             [Option('s', "randomize-once", Default = false, HelpText = "Just generate random data once when starting erase process", Required = false)]
             public bool RandomizeOnce { get; set; }
 
+            [Option("seed", Default = 0UL, HelpText = "Seed of the random data, zero to pick one", Required = false)]
+            public ulong Seed { get; set; }
+
+            [Option("fill-threads", Default = 0, HelpText = "Count of threads generating random data for large buffers, zero for one per core", Required = false)]
+            public int FillThreads { get; set; }
+
             [Option('t', "threads", Default = 2, HelpText = "If target is directory: Count of threads used to index files", Required = false)]
             public int Threads { get; set; }
 
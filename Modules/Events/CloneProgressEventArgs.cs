@@ -28,6 +28,9 @@ namespace nDiscUtils.Modules.Events
         private long mTaskId;
         private long mTotal;
         private long mCurrent;
+        private double mBytesPerSecond;
+        private TimeSpan mReadLatency;
+        private TimeSpan mWriteLatency;
 
         public int Partition
             => mPartition;
@@ -41,12 +44,26 @@ namespace nDiscUtils.Modules.Events
         public long Current
             => mCurrent;
 
-        internal CloneProgressEventArgs(int partition, long taskId, long total, long current)
+        // Throughput and mean request latencies since the previous event
+        public double BytesPerSecond
+            => mBytesPerSecond;
+
+        public TimeSpan ReadLatency
+            => mReadLatency;
+
+        public TimeSpan WriteLatency
+            => mWriteLatency;
+
+        internal CloneProgressEventArgs(int partition, long taskId, long total, long current,
+            double bytesPerSecond, TimeSpan readLatency, TimeSpan writeLatency)
         {
             mPartition = partition;
             mTaskId = taskId;
             mTotal = total;
             mCurrent = current;
+            mBytesPerSecond = bytesPerSecond;
+            mReadLatency = readLatency;
+            mWriteLatency = writeLatency;
         }
 
     }
@@ -0,0 +1,205 @@
+﻿/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+using System;
+using System.Diagnostics;
+using System.IO;
+
+using CommandLine;
+
+using nDiscUtils.Core;
+using nDiscUtils.IO;
+using nDiscUtils.Options;
+
+using static nDiscUtils.Core.ModuleHelpers;
+using static nDiscUtils.Core.ReturnCodes;
+
+namespace nDiscUtils.Modules
+{
+
+    public static class Hash
+    {
+
+        // Mismatching block ranges logged before the rest are only counted
+        private const int MaxReportedRanges = 64;
+
+        public static int Run(Options opts)
+        {
+            RunHelpers(opts);
+
+            HashList expected = null;
+            var algorithm = HashAlgorithm.XxHash3;
+            var blockSize = opts.BlockSize;
+
+            if (opts.VerifyFile != null)
+            {
+                try
+                {
+                    expected = HashList.Load(opts.VerifyFile);
+                }
+                catch (Exception ex) when (ex is IOException || ex is UnauthorizedAccessException)
+                {
+                    Logger.Error("Failed to load hash list \"{0}\": {1}", opts.VerifyFile, ex.Message);
+                    WaitForUserExit();
+                    return INVALID_ARGUMENT;
+                }
+
+                algorithm = expected.Algorithm;
+                blockSize = expected.BlockSize;
+            }
+            else if (!StreamHasher.TryParseAlgorithm(opts.AlgorithmString, out algorithm))
+            {
+                Logger.Error("Unknown hash algorithm \"{0}\", expected crc32c, xxh3 or sha256", opts.AlgorithmString);
+                WaitForUserExit();
+                return INVALID_ARGUMENT;
+            }
+
+            if (blockSize <= 0 || blockSize > int.MaxValue)
+            {
+                Logger.Error("Block size has to be between one byte and 2G");
+                WaitForUserExit();
+                return INVALID_ARGUMENT;
+            }
+
+            var stream = OpenPath(opts.Path, FileMode.Open, FileAccess.Read, FileShare.Read);
+            if (stream == null)
+            {
+                Logger.Error("Failed to open \"{0}\"", opts.Path);
+                WaitForUserExit();
+                return INVALID_ARGUMENT;
+            }
+
+            var length = expected != null ? expected.Length : stream.Length;
+            Logger.Info("Hashing {0} of \"{1}\" with {2} in blocks of {3}", FormatBytes(length, 3), opts.Path,
+                StreamHasher.AlgorithmName(algorithm), FormatBytes(blockSize, 3));
+
+            StreamHash hash;
+            var watch = Stopwatch.StartNew();
+            using (var hasher = new StreamHasher(algorithm, (int)blockSize,
+                (int)Math.Max(blockSize, opts.ChunkSize), opts.QueueDepth, opts.Threads))
+            {
+                hash = hasher.Hash(stream, length);
+            }
+            watch.Stop();
+
+            Cleanup(stream);
+
+            Logger.Info("Hashed {0} in {1:0.00}s at {2}/s", FormatBytes(hash.HashedBytes, 3), watch.Elapsed.TotalSeconds,
+                FormatBytes(hash.HashedBytes / Math.Max(watch.Elapsed.TotalSeconds, 0.001), 3));
+
+            if (!hash.Succeeded)
+            {
+                Logger.Error("Failed to read at 0x{0:X}: {1}", hash.FailedPosition, hash.Failure);
+                WaitForUserExit();
+                return ERROR;
+            }
+
+            Logger.Info("{0} {1}", StreamHasher.AlgorithmName(algorithm), HashList.ToHex(hash.Digest, 0, hash.Digest.Length));
+
+            var returnCode = SUCCESS;
+            if (expected != null)
+                returnCode = Verify(expected, hash);
+
+            if (opts.SaveFile != null)
+            {
+                HashList.FromHash(hash).Save(opts.SaveFile);
+                Logger.Info("Saved {0} block digest(s) to \"{1}\"", hash.BlockCount, opts.SaveFile);
+            }
+
+            if (returnCode == SUCCESS)
+                Logger.Fine("Finished!");
+
+            WaitForUserExit();
+            return returnCode;
+        }
+
+        private static int Verify(HashList expected, StreamHash hash)
+        {
+            var mismatching = expected.FindMismatchingBlocks(hash);
+            if (mismatching.Count == 0 && MemoryWrapper.FindMismatch(expected.Digest, hash.Digest, hash.Digest.Length) == hash.Digest.Length)
+            {
+                Logger.Fine("All {0} block(s) match the hash list", expected.BlockCount);
+                return SUCCESS;
+            }
+
+            // Consecutive blocks are reported as one range
+            var ranges = 0;
+            for (int i = 0; i < mismatching.Count; i++)
+            {
+                var first = mismatching[i];
+                while (i + 1 < mismatching.Count && mismatching[i + 1] == mismatching[i] + 1)
+                    i++;
+
+                if (++ranges > MaxReportedRanges)
+                    continue;
+
+                var start = (long)first * expected.BlockSize;
+                var end = Math.Min((long)(mismatching[i] + 1) * expected.BlockSize, expected.Length);
+                Logger.Error("Data at 0x{0:X}-0x{1:X} does not match the hash list ({2})", start, end - 1, FormatBytes(end - start, 3));
+            }
+
+            if (ranges > MaxReportedRanges)
+                Logger.Error("{0} further mismatching range(s) were not listed", ranges - MaxReportedRanges);
+
+            Logger.Error("{0} of {1} block(s) do not match the hash list", mismatching.Count, expected.BlockCount);
+            return ERROR;
+        }
+
+        [Verb("hash", HelpText = "Hashes a disk or an image and optionally saves or verifies its block digests")]
+        public sealed class Options : BaseOptions
+        {
+
+            [Value(0, Default = null, HelpText = "Path to the disk or image which will be hashed", Required = true)]
+            public string Path { get; set; }
+
+            [Option('a', "algorithm", Default = "xxh3", HelpText = "Hash algorithm: crc32c, xxh3 or sha256")]
+            public string AlgorithmString { get; set; }
+
+            [Option('b', "block-size", Default = "1M", HelpText = "Bytes covered by each block digest")]
+            public string BlockSizeString { get; set; }
+
+            public long BlockSize
+            {
+                get => ParseSizeString(BlockSizeString);
+            }
+
+            [Option("chunk-size", Default = "4M", HelpText = "Size of each chunk read from the target, rounded up to whole blocks")]
+            public string ChunkSizeString { get; set; }
+
+            public long ChunkSize
+            {
+                get => Math.Min(ParseSizeString(ChunkSizeString), 1L << 30);
+            }
+
+            [Option("queue-depth", Default = 4, HelpText = "Chunks read ahead while earlier ones are hashed")]
+            public int QueueDepth { get; set; }
+
+            [Option('t', "threads", Default = 0, HelpText = "Threads hashing chunks, zero for one per core")]
+            public int Threads { get; set; }
+
+            [Option("save", Default = null, HelpText = "File the block digests are saved to")]
+            public string SaveFile { get; set; }
+
+            [Option("verify", Default = null, HelpText = "Hash list to verify against; its algorithm and block size are used")]
+            public string VerifyFile { get; set; }
+
+        }
+
+    }
+
+}
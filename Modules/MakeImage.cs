@@ -17,6 +17,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 using System.IO;
+using System.Linq;
 
 using CommandLine;
 
@@ -50,12 +51,50 @@ namespace nDiscUtils.Modules
                 return INVALID_ARGUMENT;
             }
 
+            // Formatting only writes the file system's metadata, the rest of
+            // a sparse image stays unallocated
+            var fileStream = imageStream;
+            if (opts.Sparse && !PlatformFileHandler.MakeSparse(fileStream))
+                Logger.Warn("Image \"{0}\" cannot be made sparse", opts.Path);
+
             if (opts.Offset > 0)
                 imageStream = new OffsetableStream(imageStream, opts.Offset);
 
             if (FormatStream(opts.FileSystem, imageStream, opts.Size, "nDiscUtils Image") == null)
                 return INVALID_ARGUMENT;
 
+            if (opts.Sparse)
+            {
+                fileStream.Flush();
+
+                var allocated = PlatformFileHandler.GetAllocatedRanges(fileStream);
+                if (allocated != null)
+                {
+                    var allocatedBytes = allocated.Sum((extent) => extent.Length);
+                    Logger.Info("Image allocates {0} of {1}, {2} are left as holes",
+                        FormatBytes(allocatedBytes, 3), FormatBytes(fileStream.Length, 3),
+                        FormatBytes(fileStream.Length - allocatedBytes, 3));
+                }
+            }
+
+            if (opts.HashListFile != null)
+            {
+                using (var hasher = new StreamHasher(HashAlgorithm.XxHash3, 1 << 20))
+                {
+                    var hash = hasher.Hash(imageStream, imageStream.Length);
+                    if (!hash.Succeeded)
+                    {
+                        Logger.Error("Failed to hash image at 0x{0:X}: {1}", hash.FailedPosition, hash.Failure);
+                        Cleanup(imageStream);
+                        WaitForUserExit();
+                        return ERROR;
+                    }
+
+                    HashList.FromHash(hash).Save(opts.HashListFile);
+                    Logger.Info("Saved hash list of the image to \"{0}\"", opts.HashListFile);
+                }
+            }
+
             Cleanup(imageStream);
             WaitForUserExit();
             return SUCCESS;
@@ -87,6 +126,12 @@ namespace nDiscUtils.Modules
                 get => ParseSizeString(OffsetString);
             }
 
+            [Option("hash-list", Default = null, HelpText = "File the block digests of the formatted image are saved to")]
+            public string HashListFile { get; set; }
+
+            [Option("sparse", Default = false, HelpText = "Creates the image as a sparse file which only allocates written ranges")]
+            public bool Sparse { get; set; }
+
         }
 
     }
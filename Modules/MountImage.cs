@@ -38,10 +38,10 @@ namespace nDiscUtils.Modules
             RunHelpers(opts);
 
             Logger.Info("Opening image \"{0}\"", opts.Path);
-            var imageStream = OpenPath(opts.Path,
-                FileMode.Open,
-                FileAccess.Read | (opts.ReadOnly ? 0 : FileAccess.Write),
-                FileShare.None);
+            // Read-only images are served from the system cache in place
+            var imageStream = opts.ReadOnly ?
+                OpenPathMapped(opts.Path, FileShare.None, true) :
+                OpenPath(opts.Path, FileMode.Open, FileAccess.Read | FileAccess.Write, FileShare.None);
 
             if (imageStream == null)
             {
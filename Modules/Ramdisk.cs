@@ -16,7 +16,10 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
+using System;
+using System.Diagnostics;
 using System.IO;
+using System.Threading;
 
 using CommandLine;
 
@@ -51,16 +54,110 @@ namespace nDiscUtils.Modules
                 return INVALID_ARGUMENT;
             }
 
-            Logger.Info("Creating memory stream with size 0x{0:X}", opts.Size);
+            if (opts.Image != null && opts.MemoryFull)
+            {
+                Logger.Error("Images can only be used with dynamically allocated ramdisks");
+                WaitForUserExit();
+                return INVALID_ARGUMENT;
+            }
+
+            if (opts.MemoryBudget != 0 && opts.MemoryFull)
+            {
+                Logger.Error("Memory budgets can only be used with dynamically allocated ramdisks");
+                WaitForUserExit();
+                return INVALID_ARGUMENT;
+            }
+
+            if (!ParseNumaPlacement(opts.NumaString, out var placement, out var numaNode))
+            {
+                Logger.Error("Unknown NUMA placement \"{0}\", expected default, interleave, local or a node number", opts.NumaString);
+                WaitForUserExit();
+                return INVALID_ARGUMENT;
+            }
+
+            if (opts.LargePages && (!opts.MemoryFull || placement != NumaPlacement.Default))
+            {
+                Logger.Error("Large pages can only be used with fully allocated ramdisks and the default NUMA placement");
+                WaitForUserExit();
+                return INVALID_ARGUMENT;
+            }
+
+            var dynamicOptions = new DynamicMemoryStreamOptions()
+            {
+                Deduplicate = opts.Deduplicate,
+                Compress = opts.Compress,
+                HotSize = opts.HotSize,
+                ColdAfter = opts.ColdAfter,
+                Placement = placement,
+                NumaNode = numaNode,
+                MemoryBudget = opts.MemoryBudget,
+                SpillPath = opts.SpillFile ??
+                    Path.Combine(Path.GetTempPath(), string.Format("nDiscUtils-ramdisk-{0}.spill", Guid.NewGuid()))
+            };
+
+            if (opts.MemoryBudget != 0)
+                Logger.Info("Blocks beyond {0} of memory are spilled to \"{1}\"", FormatBytes(opts.MemoryBudget, 3), dynamicOptions.SpillPath);
+
             Stream memoryStream = null;
 
-            if (opts.MemoryFull)
-                memoryStream = new StaticMemoryStream(opts.Size);
+            if (opts.Image != null && File.Exists(opts.Image))
+            {
+                Logger.Info("Restoring ramdisk from image \"{0}\"", opts.Image);
+
+                DynamicMemoryStream loadedStream;
+                try
+                {
+                    loadedStream = DynamicMemoryStream.Load(opts.Image, dynamicOptions);
+                }
+                catch (IOException ex)
+                {
+                    Logger.Error("Failed to restore the ramdisk: {0}", ex.Message);
+                    WaitForUserExit();
+                    return ERROR;
+                }
+
+                if (loadedStream.Length != opts.Size)
+                    Logger.Warn("Image holds a ramdisk of {0}, the requested size is ignored", FormatBytes(loadedStream.Length, 3));
+
+                Logger.Info("Image provides {0} of data, blocks are read on first access", FormatBytes(loadedStream.LogicalSize, 3));
+                memoryStream = loadedStream;
+            }
             else
-                memoryStream = new DynamicMemoryStream(opts.Size, opts.BlockSize);
+            {
+                Logger.Info("Creating memory stream with size 0x{0:X}", opts.Size);
 
-            if (FormatStream(opts.FileSystem, memoryStream, opts.Size, "nDiscUtils Ramdisk") == null)
-                return INVALID_ARGUMENT;
+                if (opts.MemoryFull)
+                {
+                    var staticOptions = new StaticMemoryStreamOptions()
+                    {
+                        Placement = placement,
+                        NumaNode = numaNode,
+                        LargePages = opts.LargePages,
+                        Prefault = true
+                    };
+
+                    var allocateWatch = Stopwatch.StartNew();
+                    var staticStream = new StaticMemoryStream(opts.Size, staticOptions);
+                    Logger.Verbose("Allocated the ramdisk in {0:0.000} s", allocateWatch.Elapsed.TotalSeconds);
+
+                    if (opts.LargePages && !staticStream.LargePages)
+                        Logger.Warn("Large pages are unavailable, the ramdisk uses regular pages");
+
+                    memoryStream = staticStream;
+                }
+                else
+                {
+                    var dynamicStream = new DynamicMemoryStream(opts.Size, opts.BlockSize, dynamicOptions);
+                    Logger.Verbose("Block index initially uses {0}", FormatBytes(dynamicStream.IndexSize, 3));
+                    memoryStream = dynamicStream;
+                }
+
+                if (FormatStream(opts.FileSystem, memoryStream, opts.Size, "nDiscUtils Ramdisk") == null)
+                    return INVALID_ARGUMENT;
+
+                if (memoryStream is DynamicMemoryStream formattedStream)
+                    Logger.Info("Formatted ramdisk occupies {0} of memory", FormatBytes(formattedStream.Size, 3));
+            }
 
             if (opts.FileSystem == "FAT")
             {
@@ -75,13 +172,143 @@ namespace nDiscUtils.Modules
                 Logger.Warn("*************************************************");
             }
 
+            Timer checkpointTimer = null;
+            if (opts.Image != null && opts.CheckpointInterval > 0)
+            {
+                var interval = TimeSpan.FromSeconds(opts.CheckpointInterval);
+                checkpointTimer = new Timer((state) => Checkpoint((DynamicMemoryStream)state, opts.Image),
+                    memoryStream, interval, interval);
+            }
+
+            Timer statisticsTimer = null;
+            if (opts.StatisticsInterval > 0)
+            {
+                var interval = TimeSpan.FromSeconds(opts.StatisticsInterval);
+                statisticsTimer = new Timer((state) => ReportCounters((Stream)state, opts.StatisticsFile),
+                    memoryStream, interval, interval);
+            }
+
+            var mountWatch = Stopwatch.StartNew();
             MountStream(memoryStream, opts);
+            mountWatch.Stop();
+
+            foreach (var timer in new[] { checkpointTimer, statisticsTimer })
+            {
+                if (timer == null)
+                    continue;
+
+                // Waits for a checkpoint or report which might still be running
+                using (var disposed = new ManualResetEvent(false))
+                {
+                    timer.Dispose(disposed);
+                    disposed.WaitOne();
+                }
+            }
+
+            if (opts.StatisticsInterval > 0 || opts.StatisticsFile != null)
+                ReportCounters(memoryStream, opts.StatisticsFile);
+
+            if (opts.Image != null)
+                Checkpoint((DynamicMemoryStream)memoryStream, opts.Image);
+
+            if (memoryStream is DynamicMemoryStream mountedStream)
+            {
+                Logger.Info("Ramdisk held {0} of data in {1} of memory",
+                    FormatBytes(mountedStream.LogicalSize, 3), FormatBytes(mountedStream.Size, 3));
+
+                if (opts.Compress)
+                {
+                    Logger.Info("Compressed blocks occupied {0} at a ratio of {1:0.00}, {2:P1} of all accesses hit the hot set",
+                        FormatBytes(mountedStream.CompressedSize, 3), mountedStream.CompressionRatio, mountedStream.HotHitRate);
+                }
+
+                if (opts.MemoryBudget != 0)
+                {
+                    Logger.Info("{0} of blocks were resident and {1} spilled, {2} eviction(s) at {3:0.0}/s and {4} read(s) back",
+                        FormatBytes(mountedStream.ResidentSize, 3), FormatBytes(mountedStream.SpilledSize, 3),
+                        mountedStream.Evictions, mountedStream.Evictions / Math.Max(mountWatch.Elapsed.TotalSeconds, 1.0),
+                        mountedStream.SpillReads);
+                }
+            }
 
             Cleanup(memoryStream);
             WaitForUserExit();
             return SUCCESS;
         }
 
+        private static bool ParseNumaPlacement(string value, out NumaPlacement placement, out int node)
+        {
+            node = 0;
+
+            switch (value.ToLowerInvariant())
+            {
+                case "default": placement = NumaPlacement.Default; return true;
+                case "interleave": placement = NumaPlacement.Interleave; return true;
+                case "local": placement = NumaPlacement.Local; return true;
+            }
+
+            placement = NumaPlacement.Node;
+            return int.TryParse(value, out node) && node >= 0;
+        }
+
+        private static void Checkpoint(DynamicMemoryStream stream, string image)
+        {
+            try
+            {
+                var statistics = stream.Checkpoint(image);
+
+                Logger.Info("{0} checkpoint of the ramdisk wrote {1} block(s) and cleared {2}, image holds {3} block(s)",
+                    statistics.Incremental ? "Incremental" : "Full", statistics.WrittenBlocks,
+                    statistics.ClearedBlocks, statistics.BackedBlocks);
+            }
+            catch (Exception ex)
+            {
+                Logger.Error("Failed to checkpoint the ramdisk into \"{0}\": {1}", image, ex.Message);
+            }
+        }
+
+        private static readonly object StatisticsFileLock = new object();
+
+        private static void ReportCounters(Stream stream, string statisticsFile)
+        {
+            MemoryStreamCounters counters;
+            if (stream is StaticMemoryStream staticStream)
+                counters = staticStream.Counters;
+            else
+                counters = ((DynamicMemoryStream)stream).Counters;
+
+            if (!MemoryStreamCounters.Enabled)
+                Logger.Verbose("Ramdisk counters were compiled out, only the committed memory is reported");
+
+            Logger.Info("{0} read(s) of {1} at p50 {2}, p99 {3}, {4} answered with zeros; {5} write(s) of {6} at p50 {7}, p99 {8}",
+                counters.Reads, FormatBytes(counters.ReadBytes, 3), FormatLatency(counters.ReadLatency.P50),
+                FormatLatency(counters.ReadLatency.P99), counters.ZeroReads, counters.Writes,
+                FormatBytes(counters.WrittenBytes, 3), FormatLatency(counters.WriteLatency.P50),
+                FormatLatency(counters.WriteLatency.P99));
+            Logger.Info("{0} discard(s) of {1} at p50 {2}, p99 {3}",
+                counters.Discards, FormatBytes(counters.DiscardedBytes, 3), FormatLatency(counters.DiscardLatency.P50),
+                FormatLatency(counters.DiscardLatency.P99));
+            Logger.Info("{0} block(s) allocated and {1} freed, {2} of memory committed",
+                counters.BlocksAllocated, counters.BlocksFreed, FormatBytes(counters.CommittedBytes, 3));
+
+            if (statisticsFile == null)
+                return;
+
+            try
+            {
+                // One JSON object per line and report
+                lock (StatisticsFileLock)
+                {
+                    File.AppendAllText(statisticsFile, string.Format("{{ \"time\": \"{0:o}\", \"counters\": {1} }}{2}",
+                        DateTime.UtcNow, counters.ToJson(), Environment.NewLine));
+                }
+            }
+            catch (Exception ex)
+            {
+                Logger.Error("Failed to write the ramdisk counters into \"{0}\": {1}", statisticsFile, ex.Message);
+            }
+        }
+
         [Verb("ramdisk", HelpText = "Create a memory-located mount point")]
         public sealed class Options : BaseMountOptions
         {
@@ -108,6 +335,52 @@ namespace nDiscUtils.Modules
             [Option('m', "memory-full", Default = false, HelpText = "Allocate the full memory region at once")]
             public bool MemoryFull { get; set; }
 
+            [Option("large-pages", Default = false, HelpText = "Back a fully allocated ramdisk with large pages, which needs the \"Lock pages in memory\" privilege")]
+            public bool LargePages { get; set; }
+
+            [Option("dedup", Default = false, HelpText = "Share memory between blocks with identical contents")]
+            public bool Deduplicate { get; set; }
+
+            [Option("compress", Default = false, HelpText = "Keep rarely used blocks compressed")]
+            public bool Compress { get; set; }
+
+            [Option("hot-size", Default = "256M", HelpText = "Memory kept uncompressed for recently used blocks when compressing")]
+            public string HotSizeString { get; set; }
+
+            public long HotSize
+            {
+                get => ParseSizeString(HotSizeString);
+            }
+
+            [Option("cold-after", Default = 30, HelpText = "Seconds after which untouched blocks get compressed")]
+            public int ColdAfter { get; set; }
+
+            [Option("numa", Default = "default", HelpText = "NUMA placement of the memory: default, interleave across all nodes, local to the writing thread or a node number")]
+            public string NumaString { get; set; }
+
+            [Option("memory-budget", Default = "0", HelpText = "Memory the ramdisk may occupy before blocks are spilled to a file, zero for no limit")]
+            public string MemoryBudgetString { get; set; }
+
+            public long MemoryBudget
+            {
+                get => ParseSizeString(MemoryBudgetString);
+            }
+
+            [Option("spill-file", Default = null, HelpText = "File receiving blocks beyond the memory budget, a temporary file by default")]
+            public string SpillFile { get; set; }
+
+            [Option("image", Default = null, HelpText = "Sparse image the ramdisk is restored from if it exists and saved to on exit")]
+            public string Image { get; set; }
+
+            [Option("checkpoint-interval", Default = 0, HelpText = "Seconds between incremental checkpoints into the image while mounted, zero to only save on exit")]
+            public int CheckpointInterval { get; set; }
+
+            [Option("stats-interval", Default = 0, HelpText = "Seconds between reports of request, allocation and latency counters while mounted, zero to only report on exit with --stats-file")]
+            public int StatisticsInterval { get; set; }
+
+            [Option("stats-file", Default = null, HelpText = "File the counters are appended to as one JSON object per report")]
+            public string StatisticsFile { get; set; }
+
         }
 
     }
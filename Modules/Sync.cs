@@ -247,7 +247,7 @@ namespace nDiscUtils.Modules
                                             if (needsUpdate)
                                                 break;
 
-                                            needsUpdate = EqualBytesLongUnrolled(sourceBuffer, targetBuffer);
+                                            needsUpdate = !EqualBytes(sourceBuffer, targetBuffer);
                                             if (needsUpdate)
                                                 break;
                                         }
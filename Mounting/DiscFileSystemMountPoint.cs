@@ -36,6 +36,7 @@ using DiscUtils.Xfs;
 using DokanNet;
 
 using nDiscUtils.Core;
+using nDiscUtils.IO;
 using nDiscUtils.Options;
 
 namespace nDiscUtils.Mounting
@@ -102,7 +103,7 @@ namespace nDiscUtils.Mounting
         public DiscFileSystemMountPoint(Stream stream, BaseMountOptions options)
         {
             mStream = stream;
-            mFileSystem = GetFileSystem(stream);
+            mFileSystem = GetFileSystem(DiscardingStream.IsDiscardable(stream) ? new DiscardingStream(stream) : stream);
             mOptions = options;
             mFileSystemSupportsRW = !IsFileSystemReadOnly(mFileSystem);
             mIsReadOnly = (options.ReadOnly || !mFileSystemSupportsRW);
@@ -114,6 +115,9 @@ namespace nDiscUtils.Mounting
                 ntfsFileSystem.NtfsOptions.HideHiddenFiles = false;
                 ntfsFileSystem.NtfsOptions.HideSystemFiles = false;
                 ntfsFileSystem.NtfsOptions.HideMetafiles = !options.ShowHiddenFiles;
+
+                // Hand the memory of freed clusters back when the stream supports it
+                ntfsFileSystem.NtfsOptions.DiscardFreedClusters = !mIsReadOnly && DiscardingStream.IsDiscardable(stream);
             }
 
             if (mFileSystem is DiscFileSystem discFileSystem)
@@ -123,6 +127,9 @@ namespace nDiscUtils.Mounting
             Logger.Info("File system R/W support: {0}", mFileSystemSupportsRW);
             Logger.Info("File system R/W enabled: {0}", !mIsReadOnly);
             Logger.Info("File system volume label: {0}", VolumeLabel);
+
+            if (mFileSystemIsNTFS)
+                Logger.Info("File system discards freed clusters: {0}", ((NtfsFileSystem)mFileSystem).NtfsOptions.DiscardFreedClusters);
         }
 
         public void Flush()
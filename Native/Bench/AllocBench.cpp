@@ -0,0 +1,146 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "BenchUtils.h"
+
+#include "../Core/DynamicMemoryStore.h"
+#include "../Core/NativeException.h"
+
+#include <memory>
+#include <vector>
+
+using namespace nDiscUtils::Bench;
+using namespace nDiscUtils::Native;
+
+namespace {
+
+    struct Options
+    {
+        uint64_t Size = 256ull << 20;
+        uint64_t ChunkSize = 64ull << 20;
+        std::vector<uint64_t> BlockSizes;
+    };
+
+    void PrintUsage()
+    {
+        std::printf(
+            "Usage: AllocBench [options]\n"
+            "Compares allocation-bound writes of DynamicMemoryStore with per-block\n"
+            "page provider allocations against the chunked block arena.\n"
+            "  --size <n>          Capacity of the store (default: 256M)\n"
+            "  --chunk-size <n>    Largest arena chunk (default: 64M)\n"
+            "  --block-size <n>    Block size to measure, may be repeated (default: 4K, 16K, 64K)\n");
+    }
+
+    bool ParseOptions(int argc, char** argv, Options& opts)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            auto hasValue = (i + 1 < argc);
+
+            if (arg == "--size" && hasValue)
+                opts.Size = ParseSize(argv[++i]);
+            else if (arg == "--chunk-size" && hasValue)
+                opts.ChunkSize = ParseSize(argv[++i]);
+            else if (arg == "--block-size" && hasValue)
+                opts.BlockSizes.push_back(ParseSize(argv[++i]));
+            else
+                return false;
+        }
+
+        if (opts.BlockSizes.empty())
+            opts.BlockSizes = { 4ull << 10, 16ull << 10, 64ull << 10 };
+
+        for (auto blockSize : opts.BlockSizes)
+        {
+            if (blockSize == 0 || (opts.Size % blockSize) != 0)
+                return false;
+        }
+
+        return opts.Size > 0 && opts.ChunkSize > 0;
+    }
+
+    // Writes every block once; the first pass allocates each of them
+    double Fill(DynamicMemoryStore& store, const std::vector<unsigned char>& buffer)
+    {
+        Stopwatch watch;
+        for (uint64_t offset = 0; offset < store.Capacity(); offset += buffer.size())
+            store.Write(offset, buffer.data(), buffer.size());
+
+        return watch.Seconds();
+    }
+
+    void Run(const Options& opts, uint64_t blockSize, size_t maxChunk)
+    {
+        std::vector<unsigned char> pattern(blockSize);
+        std::vector<unsigned char> zero(blockSize);
+        FillPattern(pattern.data(), 0, pattern.size(), 0x416C6C6Full);
+
+        DynamicMemoryStoreOptions storeOptions;
+        storeOptions.MaxChunkBytes = maxChunk;
+
+        std::unique_ptr<DynamicMemoryStore> store(
+            new DynamicMemoryStore((size_t)opts.Size, (size_t)blockSize, storeOptions));
+
+        auto fill = Fill(*store, pattern);
+        auto reserved = store->ReservedBytes();
+        auto release = Fill(*store, zero);
+        auto refill = Fill(*store, pattern);
+
+        Stopwatch watch;
+        store.reset();
+        auto teardown = watch.Seconds();
+
+        std::printf("%-8s %-8s %10.1f %10.1f %10.1f %10.3f %10s\n",
+            FormatSize(blockSize).c_str(), maxChunk != 0 ? "arena" : "provider",
+            MegabytesPerSecond(opts.Size, fill), MegabytesPerSecond(opts.Size, release),
+            MegabytesPerSecond(opts.Size, refill), teardown, FormatSize(reserved).c_str());
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options opts;
+    if (!ParseOptions(argc, argv, opts))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    std::printf("size=%s chunk-size=%s\n", FormatSize(opts.Size).c_str(), FormatSize(opts.ChunkSize).c_str());
+    std::printf("%-8s %-8s %10s %10s %10s %10s %10s\n",
+        "block", "alloc", "fill MiB/s", "free MiB/s", "reuse MiB/s", "teardown s", "reserved");
+
+    try
+    {
+        for (auto blockSize : opts.BlockSizes)
+        {
+            Run(opts, blockSize, 0);
+            Run(opts, blockSize, (size_t)opts.ChunkSize);
+        }
+    }
+    catch (const NativeException& ex)
+    {
+        std::fprintf(stderr, "error: %s\n", ex.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace nDiscUtils {
+namespace Bench {
+
+    // Same syntax as ModuleHelpers.ParseSizeString: plain, 0x-prefixed or B/K/M/G suffixed
+    inline uint64_t ParseSize(const std::string& sizeString)
+    {
+        if (sizeString.empty())
+            return 0;
+
+        if (sizeString.compare(0, 2, "0x") == 0)
+            return std::strtoull(sizeString.c_str() + 2, nullptr, 16);
+
+        auto size = std::strtoull(sizeString.c_str(), nullptr, 10);
+        switch (sizeString[sizeString.size() - 1])
+        {
+            case 'K': return size << 10;
+            case 'M': return size << 20;
+            case 'G': return size << 30;
+            case 'T': return size << 40;
+            default: return size;
+        }
+    }
+
+    inline std::string FormatSize(uint64_t size)
+    {
+        static const char* suffixes[] = { "", "K", "M", "G", "T" };
+        auto suffix = 0;
+
+        while (size >= 1024 && (size % 1024) == 0 && suffix < 4)
+        {
+            size /= 1024;
+            suffix++;
+        }
+
+        return std::to_string(size) + suffixes[suffix];
+    }
+
+    class Stopwatch
+    {
+
+    public:
+        Stopwatch() :
+            mStart(std::chrono::steady_clock::now()) { }
+
+        void Restart()
+        {
+            mStart = std::chrono::steady_clock::now();
+        }
+
+        double Seconds() const
+        {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+        }
+
+    private:
+        std::chrono::steady_clock::time_point mStart;
+
+    };
+
+    inline double MegabytesPerSecond(uint64_t bytes, double seconds)
+    {
+        return seconds > 0 ? (bytes / (1024.0 * 1024.0)) / seconds : 0.0;
+    }
+
+    // Cheap deterministic generator for offsets and verification patterns
+    class SplitMix64
+    {
+
+    public:
+        explicit SplitMix64(uint64_t seed) :
+            mState(seed) { }
+
+        uint64_t Next()
+        {
+            auto z = (mState += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+    private:
+        uint64_t mState;
+
+    };
+
+    // Fills a buffer with a pattern which depends on the absolute offset and a seed,
+    // so a stress run can verify any range without keeping a shadow copy. The mask
+    // is applied to every generated word to lower the entropy of the pattern.
+    inline void FillPattern(unsigned char* buffer, uint64_t offset, size_t count, uint64_t seed,
+        uint64_t mask = ~0ull)
+    {
+        for (size_t i = 0; i < count; i += 8)
+        {
+            SplitMix64 generator(seed ^ ((offset + i) >> 3));
+            auto value = generator.Next() & mask;
+            auto chunk = (count - i) < 8 ? (count - i) : 8;
+            std::memcpy(buffer + i, &value, chunk);
+        }
+    }
+
+} // Bench
+} // nDiscUtils
@@ -0,0 +1,368 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "BenchUtils.h"
+
+#include "../Core/AlignedBuffer.h"
+#include "../Core/CopyEngine.h"
+#include "../Core/ImageFile.h"
+#include "../Core/NativeException.h"
+
+#include <algorithm>
+#include <memory>
+
+using namespace nDiscUtils::Bench;
+using namespace nDiscUtils::Native;
+
+namespace {
+
+    struct Options
+    {
+        uint64_t Size = 256ull << 20;
+        uint64_t ChunkSize = 1ull << 20;
+        uint64_t Depth = 8;
+        std::string Directory = ".";
+        bool Unbuffered = false;
+        uint64_t SparseSize = 0;
+    };
+
+    void PrintUsage()
+    {
+        std::printf(
+            "Usage: CopyBench [options]\n"
+            "Copies a file once with a synchronous read/write loop and then with the copy\n"
+            "engine at depth one and at the given depth, with both files driven by a single\n"
+            "thread and with concurrent requests, and verifies every copy. Sparse sources\n"
+            "only hold data in every fourth chunk, half of which is zero, and are copied\n"
+            "once more skipping holes and zeros.\n"
+            "  --size <n>          Size of the copied file (default: 256M)\n"
+            "  --chunk-size <n>    Bytes per request (default: 1M)\n"
+            "  --depth <n>         Chunks in flight (default: 8)\n"
+            "  --directory <path>  Directory the files are created in (default: .)\n"
+            "  --unbuffered        Bypass the system cache\n"
+            "  --sparse <n>        Create a sparse source and skip zeros at this granularity\n");
+    }
+
+    bool ParseOptions(int argc, char** argv, Options& opts)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            auto hasValue = (i + 1 < argc);
+
+            if (arg == "--size" && hasValue)
+                opts.Size = ParseSize(argv[++i]);
+            else if (arg == "--chunk-size" && hasValue)
+                opts.ChunkSize = ParseSize(argv[++i]);
+            else if (arg == "--depth" && hasValue)
+                opts.Depth = std::strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--directory" && hasValue)
+                opts.Directory = argv[++i];
+            else if (arg == "--unbuffered")
+                opts.Unbuffered = true;
+            else if (arg == "--sparse" && hasValue)
+                opts.SparseSize = ParseSize(argv[++i]);
+            else
+                return false;
+        }
+
+        // Unbuffered requests have to stay page-aligned, including the last one
+        return opts.Size != 0 && opts.ChunkSize != 0 && opts.Depth != 0 &&
+            (opts.Size % 4096) == 0 && (opts.ChunkSize % 4096) == 0 &&
+            (opts.SparseSize == 0 || ((opts.SparseSize % 4096) == 0 && (opts.ChunkSize % opts.SparseSize) == 0));
+    }
+
+    class FileSource : public ReadSource
+    {
+
+    public:
+        FileSource(ImageFile* file, uint64_t length, bool concurrent) :
+            mFile(file),
+            mLength(length),
+            mConcurrent(concurrent) { }
+
+        size_t Read(uint64_t offset, void* buffer, size_t count) override
+        {
+            auto available = (size_t)std::min<uint64_t>(count, mLength - std::min(offset, mLength));
+            mFile->ReadAt(offset, buffer, available);
+            return available;
+        }
+
+        DataExtent NextData(uint64_t offset) override
+        {
+            return mFile->NextData(offset);
+        }
+
+        bool Concurrent() const override
+        {
+            return mConcurrent;
+        }
+
+    private:
+        ImageFile* mFile;
+        uint64_t mLength;
+        bool mConcurrent;
+
+    };
+
+    class FileTarget : public WriteTarget
+    {
+
+    public:
+        FileTarget(ImageFile* file, bool concurrent) :
+            mFile(file),
+            mConcurrent(concurrent) { }
+
+        void Write(uint64_t offset, const void* buffer, size_t count) override
+        {
+            mFile->WriteAt(offset, buffer, count);
+        }
+
+        bool Discard(uint64_t offset, uint64_t count) override
+        {
+            mFile->Deallocate(offset, count);
+            return true;
+        }
+
+        void Flush() override
+        {
+            mFile->Flush();
+        }
+
+        bool Concurrent() const override
+        {
+            return mConcurrent;
+        }
+
+    private:
+        ImageFile* mFile;
+        bool mConcurrent;
+
+    };
+
+    void Row(const char* method, uint64_t depth, const char* requests, uint64_t size, const CopyResult& result)
+    {
+        std::printf("%-8s %6llu %-11s %10.1f %10.3f %10.3f %10.3f %10.3f\n", method, (unsigned long long)depth,
+            requests, MegabytesPerSecond(size, result.Seconds),
+            result.Read.MeanSeconds() * 1000.0, result.Read.MaxSeconds * 1000.0,
+            result.Write.MeanSeconds() * 1000.0, result.Write.MaxSeconds * 1000.0);
+        std::fflush(stdout);
+    }
+
+    // Contents of the source at a chunk; sparse sources leave three of four
+    // chunks unallocated and zero the second half of the others
+    bool Expected(unsigned char* buffer, uint64_t offset, size_t count, size_t chunkBytes, bool sparse)
+    {
+        if (sparse && ((offset / chunkBytes) % 4) != 0)
+        {
+            std::memset(buffer, 0, count);
+            return false;
+        }
+
+        FillPattern(buffer, offset, count, 0x436F7079ull);
+        if (sparse && count > chunkBytes / 2)
+            std::memset(buffer + chunkBytes / 2, 0, count - chunkBytes / 2);
+
+        return true;
+    }
+
+    uint64_t AllocatedBytes(ImageFile* file)
+    {
+        auto allocated = (uint64_t)0;
+        for (auto extent = file->NextData(0); extent.Length != 0; extent = file->NextData(extent.Offset + extent.Length))
+            allocated += extent.Length;
+
+        return allocated;
+    }
+
+    // Reads and writes one chunk after the other, as Clone used to
+    CopyResult CopySynchronously(ImageFile* source, ImageFile* target, uint64_t size, size_t chunkBytes)
+    {
+        AlignedBuffer buffer(chunkBytes);
+        CopyResult result;
+        Stopwatch total;
+
+        for (uint64_t offset = 0; offset < size; offset += chunkBytes)
+        {
+            auto count = (size_t)std::min<uint64_t>(chunkBytes, size - offset);
+
+            Stopwatch watch;
+            source->ReadAt(offset, buffer.Data(), count);
+            result.Read.Add(watch.Seconds());
+
+            watch.Restart();
+            target->WriteAt(offset, buffer.Data(), count);
+            result.Write.Add(watch.Seconds());
+        }
+
+        target->Flush();
+        result.CopiedBytes = size;
+        result.Seconds = total.Seconds();
+        return result;
+    }
+
+    bool Verify(ImageFile* file, uint64_t size, size_t chunkBytes, bool sparse)
+    {
+        AlignedBuffer actual(chunkBytes);
+        AlignedBuffer expected(chunkBytes);
+
+        for (uint64_t offset = 0; offset < size; offset += chunkBytes)
+        {
+            auto count = (size_t)std::min<uint64_t>(chunkBytes, size - offset);
+            file->ReadAt(offset, actual.Data(), count);
+            Expected(expected.Data(), offset, count, chunkBytes, sparse);
+
+            if (std::memcmp(actual.Data(), expected.Data(), count) != 0)
+                return false;
+        }
+
+        return true;
+    }
+
+    bool Run(const Options& opts)
+    {
+        auto sourcePath = opts.Directory + "/CopyBench.source";
+        auto targetPath = opts.Directory + "/CopyBench.target";
+        auto chunkBytes = (size_t)opts.ChunkSize;
+        auto sparse = (opts.SparseSize != 0);
+
+        std::unique_ptr<ImageFile> source(ImageFile::Open(sourcePath, ImageFileMode::Create, opts.Unbuffered));
+        std::unique_ptr<ImageFile> target(ImageFile::Open(targetPath, ImageFileMode::Create, opts.Unbuffered));
+
+        {
+            AlignedBuffer buffer(chunkBytes);
+            source->SetLength(opts.Size);
+            target->SetLength(opts.Size);
+
+            for (uint64_t offset = 0; offset < opts.Size; offset += chunkBytes)
+            {
+                auto count = (size_t)std::min<uint64_t>(chunkBytes, opts.Size - offset);
+                if (Expected(buffer.Data(), offset, count, chunkBytes, sparse))
+                    source->WriteAt(offset, buffer.Data(), count);
+            }
+
+            source->Flush();
+        }
+
+        std::printf("%-8s %6s %-11s %10s %10s %10s %10s %10s\n", "method", "depth", "requests", "MiB/s",
+            "read ms", "read max", "write ms", "write max");
+
+        auto verified = true;
+        auto check = [&]()
+        {
+            verified = Verify(target.get(), opts.Size, chunkBytes, sparse) && verified;
+            target->SetLength(0);
+            target->SetLength(opts.Size);
+        };
+
+        Row("sync", 1, "serial", opts.Size, CopySynchronously(source.get(), target.get(), opts.Size, chunkBytes));
+        check();
+
+        for (auto concurrent : { false, true })
+        {
+            for (auto depth : { (uint64_t)1, opts.Depth })
+            {
+                if (depth == 1 && concurrent)
+                    continue;
+
+                CopyEngineOptions options;
+                options.ChunkBytes = chunkBytes;
+                options.Depth = (size_t)depth;
+
+                FileSource fileSource(source.get(), opts.Size, concurrent);
+                FileTarget fileTarget(target.get(), concurrent);
+
+                auto result = CopyEngine(options).Copy(fileSource, fileTarget, opts.Size);
+                if (result.FailedSide != CopySide::None)
+                {
+                    std::fprintf(stderr, "error: copy failed at %llu: %s\n",
+                        (unsigned long long)result.FailedOffset, result.Failure.c_str());
+                    return false;
+                }
+
+                Row("engine", depth, concurrent ? "concurrent" : "serial", opts.Size, result);
+                check();
+            }
+        }
+
+        if (sparse)
+        {
+            CopyEngineOptions options;
+            options.ChunkBytes = chunkBytes;
+            options.Depth = (size_t)opts.Depth;
+            options.SparseBytes = (size_t)opts.SparseSize;
+
+            FileSource fileSource(source.get(), opts.Size, false);
+            FileTarget fileTarget(target.get(), false);
+
+            auto result = CopyEngine(options).Copy(fileSource, fileTarget, opts.Size);
+            if (result.FailedSide != CopySide::None)
+            {
+                std::fprintf(stderr, "error: sparse copy failed at %llu: %s\n",
+                    (unsigned long long)result.FailedOffset, result.Failure.c_str());
+                return false;
+            }
+
+            Row("sparse", opts.Depth, "serial", opts.Size, result);
+            std::printf("sparse copy read %s of %s, skipped %s, target allocates %s of %s allocated in the source\n",
+                FormatSize(opts.Size - result.UnreadBytes).c_str(), FormatSize(opts.Size).c_str(),
+                FormatSize(result.SkippedBytes).c_str(), FormatSize(AllocatedBytes(target.get())).c_str(),
+                FormatSize(AllocatedBytes(source.get())).c_str());
+            check();
+        }
+
+        source.reset();
+        target.reset();
+        ImageFile::Delete(sourcePath);
+        ImageFile::Delete(targetPath);
+
+        if (!verified)
+            std::fprintf(stderr, "error: a copy does not match its source\n");
+
+        return verified;
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options opts;
+    if (!ParseOptions(argc, argv, opts))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        if (!Run(opts))
+            return 1;
+    }
+    catch (const NativeException& ex)
+    {
+        std::fprintf(stderr, "error: %s\n", ex.what());
+        return 1;
+    }
+    catch (const std::bad_alloc&)
+    {
+        std::fprintf(stderr, "error: out of memory\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,326 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "BenchUtils.h"
+
+#include "../Core/AlignedBuffer.h"
+#include "../Core/BenchmarkEngine.h"
+#include "../Core/ImageFile.h"
+#include "../Core/NativeException.h"
+#include "../Core/StaticMemoryStore.h"
+
+#include <memory>
+
+using namespace nDiscUtils::Bench;
+using namespace nDiscUtils::Native;
+
+namespace {
+
+    struct Options
+    {
+        uint64_t Size = 256ull << 20;
+        uint64_t BlockSize = 4096;
+        uint64_t Threads = 1;
+        uint64_t Depth = 1;
+        double Seconds = 2.0;
+        double ZipfTheta = 1.2;
+        std::string Directory = ".";
+        std::string Device;
+        bool Memory = false;
+        bool Unbuffered = false;
+        bool Intervals = false;
+    };
+
+    void PrintUsage()
+    {
+        std::printf(
+            "Usage: IoBench [options]\n"
+            "Runs the benchmark engine with every access pattern as reads, writes and a\n"
+            "70/30 mix against a file, a device or memory and prints IOPS, bandwidth and\n"
+            "latency percentiles of each run. The target is written first, so devices\n"
+            "lose their contents.\n"
+            "  --size <n>          Bytes of the target used (default: 256M)\n"
+            "  --block-size <n>    Bytes per request (default: 4K)\n"
+            "  --threads <n>       Threads issuing requests (default: 1)\n"
+            "  --depth <n>         Requests in flight per thread (default: 1)\n"
+            "  --seconds <n>       Duration of each run (default: 2)\n"
+            "  --zipf-theta <n>    Skew of the zipfian pattern (default: 1.2)\n"
+            "  --directory <path>  Directory the file is created in (default: .)\n"
+            "  --device <path>     Existing file or raw device used instead\n"
+            "  --memory            Use a static memory store instead\n"
+            "  --unbuffered        Bypass the system cache\n"
+            "  --intervals         Print every one second interval as well\n");
+    }
+
+    bool ParseOptions(int argc, char** argv, Options& opts)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            auto hasValue = (i + 1 < argc);
+
+            if (arg == "--size" && hasValue)
+                opts.Size = ParseSize(argv[++i]);
+            else if (arg == "--block-size" && hasValue)
+                opts.BlockSize = ParseSize(argv[++i]);
+            else if (arg == "--threads" && hasValue)
+                opts.Threads = std::strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--depth" && hasValue)
+                opts.Depth = std::strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--seconds" && hasValue)
+                opts.Seconds = std::strtod(argv[++i], nullptr);
+            else if (arg == "--zipf-theta" && hasValue)
+                opts.ZipfTheta = std::strtod(argv[++i], nullptr);
+            else if (arg == "--directory" && hasValue)
+                opts.Directory = argv[++i];
+            else if (arg == "--device" && hasValue)
+                opts.Device = argv[++i];
+            else if (arg == "--memory")
+                opts.Memory = true;
+            else if (arg == "--unbuffered")
+                opts.Unbuffered = true;
+            else if (arg == "--intervals")
+                opts.Intervals = true;
+            else
+                return false;
+        }
+
+        // Unbuffered requests have to stay page-aligned
+        return opts.Size != 0 && opts.BlockSize != 0 && opts.Threads != 0 && opts.Depth != 0 &&
+            opts.Seconds > 0.0 && opts.ZipfTheta > 0.0 && (opts.BlockSize % 4096) == 0 &&
+            opts.Size / opts.BlockSize >= opts.Threads;
+    }
+
+    class FileTarget : public BenchmarkTarget
+    {
+
+    public:
+        explicit FileTarget(ImageFile* file) :
+            mFile(file) { }
+
+        void Read(uint64_t offset, void* buffer, size_t count) override
+        {
+            mFile->ReadAt(offset, buffer, count);
+        }
+
+        void Write(uint64_t offset, const void* buffer, size_t count) override
+        {
+            mFile->WriteAt(offset, buffer, count);
+        }
+
+        bool Concurrent() const override
+        {
+            return true;
+        }
+
+    private:
+        ImageFile* mFile;
+
+    };
+
+    class StoreTarget : public BenchmarkTarget
+    {
+
+    public:
+        explicit StoreTarget(MemoryStore* store) :
+            mStore(store) { }
+
+        void Read(uint64_t offset, void* buffer, size_t count) override
+        {
+            mStore->Read((size_t)offset, buffer, count);
+        }
+
+        void Write(uint64_t offset, const void* buffer, size_t count) override
+        {
+            mStore->Write((size_t)offset, buffer, count);
+        }
+
+        bool Concurrent() const override
+        {
+            return true;
+        }
+
+    private:
+        MemoryStore* mStore;
+
+    };
+
+    const char* PatternName(AccessPattern pattern)
+    {
+        switch (pattern)
+        {
+            case AccessPattern::Sequential: return "seq";
+            case AccessPattern::Zipfian: return "zipf";
+            default: return "random";
+        }
+    }
+
+    double Microseconds(uint64_t nanoseconds)
+    {
+        return nanoseconds / 1000.0;
+    }
+
+    void Latencies(const BenchmarkCounters& counters)
+    {
+        std::printf(" %9llu %9.1f %9.1f %9.1f %9.1f %9.1f", (unsigned long long)counters.Requests,
+            counters.Latency.Mean() / 1000.0, Microseconds(counters.Latency.Percentile(50.0)),
+            Microseconds(counters.Latency.Percentile(99.0)), Microseconds(counters.Latency.Percentile(99.9)),
+            Microseconds(counters.Latency.Max()));
+    }
+
+    class IntervalPrinter : public BenchmarkProgressSink
+    {
+
+    public:
+        void Report(const BenchmarkProgress& progress) override
+        {
+            if (progress.IntervalSeconds <= 0.0)
+                return;
+
+            auto requests = progress.Read.Requests + progress.Write.Requests;
+            auto bytes = progress.Read.Bytes + progress.Write.Bytes;
+
+            BenchmarkCounters all;
+            all.Merge(progress.Read);
+            all.Merge(progress.Write);
+
+            std::printf("  %6.1fs %10.0f IOPS %10.1f MiB/s  p50 %9.1f  p99 %9.1f  p99.9 %9.1f us\n",
+                progress.ElapsedSeconds, requests / progress.IntervalSeconds,
+                MegabytesPerSecond(bytes, progress.IntervalSeconds), Microseconds(all.Latency.Percentile(50.0)),
+                Microseconds(all.Latency.Percentile(99.0)), Microseconds(all.Latency.Percentile(99.9)));
+            std::fflush(stdout);
+        }
+
+    };
+
+    bool Run(const Options& opts)
+    {
+        std::unique_ptr<ImageFile> file;
+        std::unique_ptr<StaticMemoryStore> store;
+        std::unique_ptr<BenchmarkTarget> target;
+        std::string createdPath;
+
+        if (opts.Memory)
+        {
+            store.reset(new StaticMemoryStore((size_t)opts.Size));
+            target.reset(new StoreTarget(store.get()));
+        }
+        else
+        {
+            if (opts.Device.empty())
+            {
+                createdPath = opts.Directory + "/IoBench.target";
+                file.reset(ImageFile::Open(createdPath, ImageFileMode::Create, opts.Unbuffered));
+                file->SetLength(opts.Size);
+            }
+            else
+            {
+                file.reset(ImageFile::Open(opts.Device, ImageFileMode::Write, opts.Unbuffered));
+            }
+
+            target.reset(new FileTarget(file.get()));
+        }
+
+        // Reads of holes or untouched memory would not reach the device
+        {
+            BenchmarkEngineOptions options;
+            options.BlockBytes = (size_t)opts.BlockSize;
+            options.ReadPercent = 0;
+            options.Pattern = AccessPattern::Sequential;
+            options.Bytes = opts.Size / opts.BlockSize * opts.BlockSize;
+            BenchmarkEngine(options).Run(*target, opts.Size);
+        }
+
+        std::printf("%-7s %-6s %7s %6s %10s %10s %9s %9s %9s %9s %9s %9s\n", "pattern", "mix", "threads", "depth",
+            "IOPS", "MiB/s", "requests", "mean us", "p50 us", "p99 us", "p99.9 us", "max us");
+
+        IntervalPrinter printer;
+        for (auto pattern : { AccessPattern::Sequential, AccessPattern::Random, AccessPattern::Zipfian })
+        {
+            for (auto readPercent : { 100u, 0u, 70u })
+            {
+                BenchmarkEngineOptions options;
+                options.Threads = (size_t)opts.Threads;
+                options.Depth = (size_t)opts.Depth;
+                options.BlockBytes = (size_t)opts.BlockSize;
+                options.ReadPercent = readPercent;
+                options.Pattern = pattern;
+                options.ZipfTheta = opts.ZipfTheta;
+                options.Seconds = opts.Seconds;
+                options.Seed = 0x496F42656E6368ull;
+
+                auto result = BenchmarkEngine(options).Run(*target, opts.Size, opts.Intervals ? &printer : nullptr);
+                if (result.Failed)
+                {
+                    std::fprintf(stderr, "error: %s run failed at %llu: %s\n", PatternName(pattern),
+                        (unsigned long long)result.FailedOffset, result.Failure.c_str());
+                    return false;
+                }
+
+                BenchmarkCounters all;
+                all.Merge(result.Read);
+                all.Merge(result.Write);
+
+                auto mix = (readPercent == 100 ? std::string("read") : readPercent == 0 ? std::string("write") :
+                    std::to_string(readPercent) + "/" + std::to_string(100 - readPercent));
+
+                std::printf("%-7s %-6s %7llu %6llu %10.0f %10.1f", PatternName(pattern), mix.c_str(),
+                    (unsigned long long)opts.Threads, (unsigned long long)opts.Depth, all.Requests / result.Seconds,
+                    MegabytesPerSecond(all.Bytes, result.Seconds));
+                Latencies(all);
+                std::printf("\n");
+                std::fflush(stdout);
+            }
+        }
+
+        file.reset();
+        if (!createdPath.empty())
+            ImageFile::Delete(createdPath);
+
+        return true;
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options opts;
+    if (!ParseOptions(argc, argv, opts))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        if (!Run(opts))
+            return 1;
+    }
+    catch (const NativeException& ex)
+    {
+        std::fprintf(stderr, "error: %s\n", ex.what());
+        return 1;
+    }
+    catch (const std::bad_alloc&)
+    {
+        std::fprintf(stderr, "error: out of memory\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,255 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "BenchUtils.h"
+
+#include "../Core/MemoryKernels.h"
+#include "../Core/RandomFill.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+using namespace nDiscUtils::Bench;
+using namespace nDiscUtils::Native;
+
+namespace {
+
+    struct Options
+    {
+        std::vector<uint64_t> Sizes;
+        uint64_t Threshold = 0;
+        bool HasThreshold = false;
+        double Seconds = 0.25;
+    };
+
+    void PrintUsage()
+    {
+        std::printf(
+            "Usage: KernelBench [options]\n"
+            "Compares the memory kernels at every supported instruction set against\n"
+            "the C runtime (copy, fill, compare) or the scalar kernels (zero test,\n"
+            "population count), followed by the random data generator. Rows suffixed\n"
+            "with -nt force streaming stores.\n"
+            "  --size <n>          Buffer size to measure, may be repeated (default: 4K, 64K, 1M, 16M, 256M)\n"
+            "  --nt-threshold <n>  Smallest copy or fill using streaming stores (default: last level cache)\n"
+            "  --seconds <n>       Minimum time spent on each measurement (default: 0.25)\n");
+    }
+
+    bool ParseOptions(int argc, char** argv, Options& opts)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            auto hasValue = (i + 1 < argc);
+
+            if (arg == "--size" && hasValue)
+                opts.Sizes.push_back(ParseSize(argv[++i]));
+            else if (arg == "--nt-threshold" && hasValue)
+            {
+                opts.Threshold = ParseSize(argv[++i]);
+                opts.HasThreshold = true;
+            }
+            else if (arg == "--seconds" && hasValue)
+                opts.Seconds = std::strtod(argv[++i], nullptr);
+            else
+                return false;
+        }
+
+        if (opts.Sizes.empty())
+            opts.Sizes = { 4ull << 10, 64ull << 10, 1ull << 20, 16ull << 20, 256ull << 20 };
+
+        for (auto size : opts.Sizes)
+        {
+            if (size == 0)
+                return false;
+        }
+
+        return opts.Seconds > 0;
+    }
+
+    // Keeps the results of otherwise unused kernel calls alive
+    volatile uint64_t gSink;
+
+    // Repeats the operation until enough time has passed and returns GiB/s
+    double Measure(const Options& opts, uint64_t size, const std::function<uint64_t()>& operation)
+    {
+        gSink = operation();
+
+        auto iterations = (uint64_t)0;
+        Stopwatch watch;
+        double seconds;
+
+        do
+        {
+            gSink = gSink + operation();
+            iterations++;
+        }
+        while ((seconds = watch.Seconds()) < opts.Seconds);
+
+        return MegabytesPerSecond(size * iterations, seconds) / 1024.0;
+    }
+
+    typedef std::function<uint64_t(unsigned char* destination, const unsigned char* source, size_t size)> Kernel;
+
+    void Row(const Options& opts, const char* kernel, const std::string& implementation,
+        unsigned char* destination, const unsigned char* source, const Kernel& operation)
+    {
+        std::printf("%-10s %-12s", kernel, implementation.c_str());
+
+        for (auto size : opts.Sizes)
+        {
+            auto throughput = Measure(opts, size,
+                [&]() { return operation(destination, source, (size_t)size); });
+            std::printf(" %9.2f", throughput);
+        }
+
+        std::printf("\n");
+        std::fflush(stdout);
+    }
+
+    std::vector<SimdLevel> Levels()
+    {
+        std::vector<SimdLevel> levels;
+        for (auto level = (int)SimdLevel::Scalar; level <= (int)MemoryKernels::SupportedLevel(); level++)
+            levels.push_back((SimdLevel)level);
+
+        return levels;
+    }
+
+    void Run(const Options& opts)
+    {
+        auto largest = (size_t)0;
+        for (auto size : opts.Sizes)
+            largest = std::max(largest, (size_t)size);
+
+        std::unique_ptr<unsigned char[]> source(new unsigned char[largest]);
+        std::unique_ptr<unsigned char[]> destination(new unsigned char[largest]);
+        std::unique_ptr<unsigned char[]> zero(new unsigned char[largest]);
+
+        // Touch everything up front so no measurement pays for page faults
+        FillPattern(source.get(), 0, largest, 0x4B65726Eull);
+        std::memcpy(destination.get(), source.get(), largest);
+        std::memset(zero.get(), 0, largest);
+
+        auto threshold = opts.HasThreshold ? (size_t)opts.Threshold : MemoryKernels::NonTemporalThreshold();
+        auto levels = Levels();
+
+        std::printf("%-10s %-12s", "kernel", "GiB/s");
+        for (auto size : opts.Sizes)
+            std::printf(" %9s", FormatSize(size).c_str());
+        std::printf("\n");
+
+        Row(opts, "copy", "memcpy", destination.get(), source.get(),
+            [](unsigned char* dst, const unsigned char* src, size_t size) { std::memcpy(dst, src, size); return (uint64_t)dst[0]; });
+        for (auto level : levels)
+        {
+            MemoryKernels::SetLevel(level);
+            MemoryKernels::SetNonTemporalThreshold(threshold);
+            Row(opts, "copy", MemoryKernels::LevelName(level), destination.get(), source.get(),
+                [](unsigned char* dst, const unsigned char* src, size_t size) { MemoryKernels::Copy(dst, src, size); return (uint64_t)dst[0]; });
+
+            if (level == SimdLevel::Scalar)
+                continue;
+
+            MemoryKernels::SetNonTemporalThreshold(0);
+            Row(opts, "copy", std::string(MemoryKernels::LevelName(level)) + "-nt", destination.get(), source.get(),
+                [](unsigned char* dst, const unsigned char* src, size_t size) { MemoryKernels::Copy(dst, src, size); return (uint64_t)dst[0]; });
+        }
+
+        Row(opts, "fill", "memset", destination.get(), source.get(),
+            [](unsigned char* dst, const unsigned char*, size_t size) { std::memset(dst, 0x5A, size); return (uint64_t)dst[0]; });
+        for (auto level : levels)
+        {
+            MemoryKernels::SetLevel(level);
+            MemoryKernels::SetNonTemporalThreshold(threshold);
+            Row(opts, "fill", MemoryKernels::LevelName(level), destination.get(), source.get(),
+                [](unsigned char* dst, const unsigned char*, size_t size) { MemoryKernels::Fill(dst, 0x5A, size); return (uint64_t)dst[0]; });
+
+            if (level == SimdLevel::Scalar)
+                continue;
+
+            MemoryKernels::SetNonTemporalThreshold(0);
+            Row(opts, "fill", std::string(MemoryKernels::LevelName(level)) + "-nt", destination.get(), source.get(),
+                [](unsigned char* dst, const unsigned char*, size_t size) { MemoryKernels::Fill(dst, 0x5A, size); return (uint64_t)dst[0]; });
+        }
+
+        // Compare equal buffers, so every byte has to be looked at
+        std::memcpy(destination.get(), source.get(), largest);
+
+        Row(opts, "mismatch", "memcmp", destination.get(), source.get(),
+            [](unsigned char* dst, const unsigned char* src, size_t size) { return (uint64_t)std::memcmp(dst, src, size); });
+        for (auto level : levels)
+        {
+            MemoryKernels::SetLevel(level);
+            Row(opts, "mismatch", MemoryKernels::LevelName(level), destination.get(), source.get(),
+                [](unsigned char* dst, const unsigned char* src, size_t size) { return (uint64_t)MemoryKernels::FindMismatch(dst, src, size); });
+        }
+
+        for (auto level : levels)
+        {
+            MemoryKernels::SetLevel(level);
+            Row(opts, "zero", MemoryKernels::LevelName(level), zero.get(), nullptr,
+                [](unsigned char* dst, const unsigned char*, size_t size) { return (uint64_t)MemoryKernels::IsZero(dst, size); });
+        }
+
+        for (auto level : levels)
+        {
+            MemoryKernels::SetLevel(level);
+            Row(opts, "popcount", MemoryKernels::LevelName(level), nullptr, source.get(),
+                [](unsigned char*, const unsigned char* src, size_t size) { return MemoryKernels::PopCount(src, size); });
+        }
+
+        MemoryKernels::SetLevel(MemoryKernels::SupportedLevel());
+
+        // Random data on one thread, named after the cipher implementation,
+        // which is picked once regardless of the kernel level
+        Row(opts, "random", RandomFill::Implementation(), destination.get(), nullptr,
+            [](unsigned char* dst, const unsigned char*, size_t size) { RandomFill(1).Fill(dst, size, 0); return (uint64_t)dst[0]; });
+
+        MemoryKernels::SetNonTemporalThreshold(threshold);
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options opts;
+    if (!ParseOptions(argc, argv, opts))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    auto threshold = opts.HasThreshold ? opts.Threshold : (uint64_t)MemoryKernels::NonTemporalThreshold();
+    std::printf("level=%s cache=%s nt-threshold=%s\n",
+        MemoryKernels::LevelName(MemoryKernels::SupportedLevel()),
+        FormatSize(MemoryKernels::CacheBytes()).c_str(), FormatSize(threshold).c_str());
+
+    try
+    {
+        Run(opts);
+    }
+    catch (const std::bad_alloc&)
+    {
+        std::fprintf(stderr, "error: out of memory\n");
+        return 1;
+    }
+
+    return 0;
+}
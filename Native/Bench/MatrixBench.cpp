@@ -0,0 +1,473 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "BenchUtils.h"
+
+#include "../Core/AlignedBuffer.h"
+#include "../Core/DynamicMemoryStore.h"
+#include "../Core/MemoryKernels.h"
+#include "../Core/NativeException.h"
+#include "../Core/StaticMemoryStore.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace nDiscUtils::Bench;
+using namespace nDiscUtils::Native;
+
+namespace {
+
+    struct Options
+    {
+        uint64_t Size = 64ull << 20;
+        std::vector<uint64_t> BlockSizes;
+        std::vector<uint64_t> IoSizes;
+        std::vector<uint64_t> Threads;
+        std::vector<std::string> Targets;
+        double Seconds = 0.25;
+        std::string Csv;
+        std::string Json;
+    };
+
+    const char* const AllTargets[] = { "static", "dynamic", "copy", "fill" };
+
+    void PrintUsage()
+    {
+        std::printf(
+            "Usage: MatrixBench [options]\n"
+            "Measures the static and dynamic memory stores behind the ramdisk streams and\n"
+            "the copy and fill kernels over a matrix of block sizes, request sizes,\n"
+            "sequential and random order, cold and warm memory, reads and writes and\n"
+            "thread counts. Cold rows make one pass over fresh memory, so they include\n"
+            "first-touch faults and block allocation; warm rows repeat passes over\n"
+            "memory which was written before. Lists may be given by repeating options.\n"
+            "  --size <n>          Bytes of memory each row covers (default: 64M)\n"
+            "  --block-size <n>    Block size of the dynamic store (default: 4K to 2M)\n"
+            "  --io-size <n>       Bytes per request (default: 512, 4K, 64K, 1M, 16M)\n"
+            "  --threads <n>       Threads issuing requests (default: 1 and every core)\n"
+            "  --target <name>     static, dynamic, copy or fill (default: all)\n"
+            "  --seconds <n>       Minimum time spent on each warm row (default: 0.25)\n"
+            "  --csv <path>        Write all rows as CSV\n"
+            "  --json <path>       Write all rows and the machine as JSON\n");
+    }
+
+    bool ParseOptions(int argc, char** argv, Options& opts)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            auto hasValue = (i + 1 < argc);
+
+            if (arg == "--size" && hasValue)
+                opts.Size = ParseSize(argv[++i]);
+            else if (arg == "--block-size" && hasValue)
+                opts.BlockSizes.push_back(ParseSize(argv[++i]));
+            else if (arg == "--io-size" && hasValue)
+                opts.IoSizes.push_back(ParseSize(argv[++i]));
+            else if (arg == "--threads" && hasValue)
+                opts.Threads.push_back(ParseSize(argv[++i]));
+            else if (arg == "--target" && hasValue)
+                opts.Targets.push_back(argv[++i]);
+            else if (arg == "--seconds" && hasValue)
+                opts.Seconds = std::strtod(argv[++i], nullptr);
+            else if (arg == "--csv" && hasValue)
+                opts.Csv = argv[++i];
+            else if (arg == "--json" && hasValue)
+                opts.Json = argv[++i];
+            else
+                return false;
+        }
+
+        if (opts.BlockSizes.empty())
+            opts.BlockSizes = { 4ull << 10, 16ull << 10, 64ull << 10, 256ull << 10, 1ull << 20, 2ull << 20 };
+        if (opts.IoSizes.empty())
+            opts.IoSizes = { 512, 4ull << 10, 64ull << 10, 1ull << 20, 16ull << 20 };
+        if (opts.Threads.empty())
+        {
+            opts.Threads = { 1 };
+            if (std::thread::hardware_concurrency() > 1)
+                opts.Threads.push_back(std::thread::hardware_concurrency());
+        }
+        if (opts.Targets.empty())
+            opts.Targets.assign(std::begin(AllTargets), std::end(AllTargets));
+
+        for (auto& target : opts.Targets)
+        {
+            if (std::find(std::begin(AllTargets), std::end(AllTargets), target) == std::end(AllTargets))
+                return false;
+        }
+
+        // Stores are page-granular and every request size has to tile them
+        for (auto blockSize : opts.BlockSizes)
+        {
+            if (blockSize == 0 || (blockSize % 4096) != 0 || (opts.Size % blockSize) != 0)
+                return false;
+        }
+
+        for (auto ioSize : opts.IoSizes)
+        {
+            if (ioSize == 0 || ioSize > opts.Size || (opts.Size % ioSize) != 0)
+                return false;
+        }
+
+        for (auto threads : opts.Threads)
+        {
+            if (threads == 0)
+                return false;
+        }
+
+        return opts.Size != 0 && (opts.Size % 4096) == 0 && opts.Seconds > 0;
+    }
+
+    struct Row
+    {
+        std::string Target;
+        uint64_t BlockSize;
+        uint64_t IoSize;
+        const char* Pattern;
+        const char* State;
+        const char* Operation;
+        uint64_t Threads;
+        uint64_t Requests;
+        double Seconds;
+    };
+
+    // Performs one request of the row on a thread with its own buffer
+    typedef std::function<void(uint64_t offset, size_t count, unsigned char* buffer)> Request;
+
+    // Offsets of all requests of a pass, in order or shuffled
+    std::vector<uint64_t> Order(uint64_t size, uint64_t ioSize, bool random)
+    {
+        std::vector<uint64_t> order((size_t)(size / ioSize));
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = i * ioSize;
+
+        if (random)
+        {
+            SplitMix64 generator(0x4D617472ull ^ ioSize);
+            for (size_t i = order.size(); i > 1; i--)
+                std::swap(order[i - 1], order[(size_t)(generator.Next() % i)]);
+        }
+
+        return order;
+    }
+
+    // Runs passes over the order on all threads, each taking a contiguous
+    // share of it, and returns the seconds between the start of the first
+    // and the end of the last thread
+    double Passes(const std::vector<uint64_t>& order, uint64_t ioSize, uint64_t threads, uint64_t passes,
+        const Request& request)
+    {
+        std::vector<std::unique_ptr<AlignedBuffer>> buffers;
+        for (uint64_t thread = 0; thread < threads; thread++)
+        {
+            buffers.emplace_back(new AlignedBuffer((size_t)ioSize));
+            FillPattern(buffers.back()->Data(), thread, (size_t)ioSize, 0x4D617472ull);
+        }
+
+        std::atomic<bool> started(false);
+        std::vector<std::thread> workers;
+        std::vector<std::exception_ptr> errors((size_t)threads);
+
+        for (uint64_t thread = 0; thread < threads; thread++)
+        {
+            workers.emplace_back([&, thread]()
+            {
+                try
+                {
+                    auto first = order.size() * thread / threads;
+                    auto last = order.size() * (thread + 1) / threads;
+                    auto buffer = buffers[(size_t)thread]->Data();
+
+                    while (!started.load(std::memory_order_acquire))
+                        std::this_thread::yield();
+
+                    for (uint64_t pass = 0; pass < passes; pass++)
+                    {
+                        for (auto i = first; i < last; i++)
+                            request(order[i], (size_t)ioSize, buffer);
+                    }
+                }
+                catch (...)
+                {
+                    errors[(size_t)thread] = std::current_exception();
+                }
+            });
+        }
+
+        Stopwatch watch;
+        started.store(true, std::memory_order_release);
+
+        for (auto& worker : workers)
+            worker.join();
+
+        auto seconds = watch.Seconds();
+        for (auto& error : errors)
+        {
+            if (error != nullptr)
+                std::rethrow_exception(error);
+        }
+
+        return seconds;
+    }
+
+    class Matrix
+    {
+
+    public:
+        explicit Matrix(const Options& opts) :
+            mOptions(opts) { }
+
+        const std::vector<Row>& Rows() const
+        {
+            return mRows;
+        }
+
+        // Measures all request sizes, orders and thread counts of one
+        // operation. The cold request is called on memory returned by
+        // prepare(true), which has to be fresh every time; warm requests get
+        // memory which was written once and measure at least Seconds.
+        void Measure(const std::string& target, uint64_t blockSize, const char* operation,
+            const std::function<void(bool cold)>& prepare, const Request& request)
+        {
+            for (auto ioSize : mOptions.IoSizes)
+            {
+                for (auto random : { false, true })
+                {
+                    auto order = Order(mOptions.Size, ioSize, random);
+
+                    for (auto threads : mOptions.Threads)
+                    {
+                        if (threads > order.size())
+                            continue;
+
+                        for (auto cold : { true, false })
+                        {
+                            prepare(cold);
+
+                            auto passes = (uint64_t)1;
+                            if (!cold)
+                            {
+                                // A first pass settles caches and tells how many are needed
+                                auto seconds = Passes(order, ioSize, threads, 1, request);
+                                passes = std::max<uint64_t>(1, (uint64_t)(mOptions.Seconds / std::max(seconds, 1e-6)) + 1);
+                            }
+
+                            auto seconds = Passes(order, ioSize, threads, passes, request);
+                            Add(Row { target, blockSize, ioSize, random ? "random" : "seq", cold ? "cold" : "warm",
+                                operation, threads, order.size() * passes, seconds });
+                        }
+                    }
+                }
+            }
+        }
+
+    private:
+        void Add(const Row& row)
+        {
+            std::printf("%-8s %6s %6s %-7s %-5s %-6s %7llu %10.1f %12.0f %10.3f\n", row.Target.c_str(),
+                row.BlockSize != 0 ? FormatSize(row.BlockSize).c_str() : "-", FormatSize(row.IoSize).c_str(),
+                row.Pattern, row.State, row.Operation, (unsigned long long)row.Threads,
+                MegabytesPerSecond(row.Requests * row.IoSize, row.Seconds), row.Requests / row.Seconds,
+                row.Seconds * 1e6 * row.Threads / row.Requests);
+            std::fflush(stdout);
+
+            mRows.push_back(row);
+        }
+
+        const Options& mOptions;
+        std::vector<Row> mRows;
+
+    };
+
+    void MeasureStore(Matrix& matrix, const Options& opts, const std::string& target, uint64_t blockSize)
+    {
+        std::unique_ptr<MemoryStore> store;
+
+        auto create = [&]()
+        {
+            store.reset();
+            if (blockSize == 0)
+                store.reset(new StaticMemoryStore((size_t)opts.Size));
+            else
+                store.reset(new DynamicMemoryStore((size_t)opts.Size, (size_t)blockSize));
+        };
+
+        // Warm stores are written once with data, so every block is backed
+        auto prepare = [&](bool cold)
+        {
+            create();
+            if (!cold)
+            {
+                auto fillBytes = std::min<uint64_t>(opts.Size, 1ull << 20);
+                Passes(Order(opts.Size, fillBytes, false), fillBytes, 1, 1,
+                    [&](uint64_t offset, size_t count, unsigned char* buffer) { store->Write((size_t)offset, buffer, count); });
+            }
+        };
+
+        matrix.Measure(target, blockSize, "read", prepare,
+            [&](uint64_t offset, size_t count, unsigned char* buffer) { store->Read((size_t)offset, buffer, count); });
+        matrix.Measure(target, blockSize, "write", prepare,
+            [&](uint64_t offset, size_t count, unsigned char* buffer) { store->Write((size_t)offset, buffer, count); });
+    }
+
+    void MeasureKernels(Matrix& matrix, const Options& opts, const std::string& target)
+    {
+        AlignedBuffer source((size_t)opts.Size);
+        FillPattern(source.Data(), 0, (size_t)opts.Size, 0x4D617472ull);
+
+        std::unique_ptr<AlignedBuffer> destination;
+        auto prepare = [&](bool cold)
+        {
+            destination.reset();
+            destination.reset(new AlignedBuffer((size_t)opts.Size));
+            if (!cold)
+                MemoryKernels::Fill(destination->Data(), 0xA5, (size_t)opts.Size);
+        };
+
+        if (target == "copy")
+        {
+            matrix.Measure(target, 0, "write", prepare, [&](uint64_t offset, size_t count, unsigned char*)
+            {
+                MemoryKernels::Copy(destination->Data() + offset, source.Data() + offset, count);
+            });
+        }
+        else
+        {
+            matrix.Measure(target, 0, "write", prepare, [&](uint64_t offset, size_t count, unsigned char*)
+            {
+                MemoryKernels::Fill(destination->Data() + offset, 0x5A, count);
+            });
+        }
+    }
+
+    bool WriteCsv(const std::string& path, const std::vector<Row>& rows)
+    {
+        auto file = std::fopen(path.c_str(), "w");
+        if (file == nullptr)
+            return false;
+
+        std::fprintf(file, "target,block_size,io_size,pattern,state,operation,threads,requests,bytes,seconds,mib_per_second,iops\n");
+        for (auto& row : rows)
+        {
+            std::fprintf(file, "%s,%llu,%llu,%s,%s,%s,%llu,%llu,%llu,%.6f,%.3f,%.1f\n", row.Target.c_str(),
+                (unsigned long long)row.BlockSize, (unsigned long long)row.IoSize, row.Pattern, row.State,
+                row.Operation, (unsigned long long)row.Threads, (unsigned long long)row.Requests,
+                (unsigned long long)(row.Requests * row.IoSize), row.Seconds,
+                MegabytesPerSecond(row.Requests * row.IoSize, row.Seconds), row.Requests / row.Seconds);
+        }
+
+        return std::fclose(file) == 0;
+    }
+
+    bool WriteJson(const std::string& path, const Options& opts, const std::vector<Row>& rows)
+    {
+        auto file = std::fopen(path.c_str(), "w");
+        if (file == nullptr)
+            return false;
+
+        std::fprintf(file, "{\n  \"benchmark\": \"MatrixBench\",\n  \"simd\": \"%s\",\n  \"cache_bytes\": %llu,\n"
+            "  \"hardware_threads\": %u,\n  \"size\": %llu,\n  \"rows\": [\n",
+            MemoryKernels::LevelName(MemoryKernels::Level()), (unsigned long long)MemoryKernels::CacheBytes(),
+            std::thread::hardware_concurrency(), (unsigned long long)opts.Size);
+
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            auto& row = rows[i];
+            std::fprintf(file, "    { \"target\": \"%s\", \"block_size\": %llu, \"io_size\": %llu, \"pattern\": \"%s\", "
+                "\"state\": \"%s\", \"operation\": \"%s\", \"threads\": %llu, \"requests\": %llu, \"bytes\": %llu, "
+                "\"seconds\": %.6f, \"mib_per_second\": %.3f, \"iops\": %.1f }%s\n", row.Target.c_str(),
+                (unsigned long long)row.BlockSize, (unsigned long long)row.IoSize, row.Pattern, row.State,
+                row.Operation, (unsigned long long)row.Threads, (unsigned long long)row.Requests,
+                (unsigned long long)(row.Requests * row.IoSize), row.Seconds,
+                MegabytesPerSecond(row.Requests * row.IoSize, row.Seconds), row.Requests / row.Seconds,
+                i + 1 < rows.size() ? "," : "");
+        }
+
+        std::fprintf(file, "  ]\n}\n");
+        return std::fclose(file) == 0;
+    }
+
+    bool Run(const Options& opts)
+    {
+        std::printf("%-8s %6s %6s %-7s %-5s %-6s %7s %10s %12s %10s\n", "target", "block", "io", "pattern", "state",
+            "op", "threads", "MiB/s", "IOPS", "us/op");
+
+        Matrix matrix(opts);
+        for (auto& target : opts.Targets)
+        {
+            if (target == "static")
+                MeasureStore(matrix, opts, target, 0);
+            else if (target == "dynamic")
+            {
+                for (auto blockSize : opts.BlockSizes)
+                    MeasureStore(matrix, opts, target, blockSize);
+            }
+            else
+                MeasureKernels(matrix, opts, target);
+        }
+
+        if (!opts.Csv.empty() && !WriteCsv(opts.Csv, matrix.Rows()))
+        {
+            std::fprintf(stderr, "error: failed to write \"%s\"\n", opts.Csv.c_str());
+            return false;
+        }
+
+        if (!opts.Json.empty() && !WriteJson(opts.Json, opts, matrix.Rows()))
+        {
+            std::fprintf(stderr, "error: failed to write \"%s\"\n", opts.Json.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options opts;
+    if (!ParseOptions(argc, argv, opts))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        if (!Run(opts))
+            return 1;
+    }
+    catch (const NativeException& ex)
+    {
+        std::fprintf(stderr, "error: %s\n", ex.what());
+        return 1;
+    }
+    catch (const std::bad_alloc&)
+    {
+        std::fprintf(stderr, "error: out of memory\n");
+        return 1;
+    }
+
+    return 0;
+}
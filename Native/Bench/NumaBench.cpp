@@ -0,0 +1,279 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "BenchUtils.h"
+
+#include "../Core/DynamicMemoryStore.h"
+#include "../Core/NativeException.h"
+#include "../Core/NumaTopology.h"
+#include "../Core/StaticMemoryStore.h"
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace nDiscUtils::Bench;
+using namespace nDiscUtils::Native;
+
+namespace {
+
+    struct Options
+    {
+        uint64_t Size = 512ull << 20;
+        uint64_t BlockSize = 64ull << 10;
+        uint64_t IoSize = 1ull << 20;
+        uint64_t Threads = 2;
+        uint64_t Passes = 3;
+        int64_t FillNode = -1;
+    };
+
+    struct Policy
+    {
+        std::string Name;
+        NumaPolicy Numa;
+    };
+
+    void PrintUsage()
+    {
+        std::printf(
+            "Usage: NumaBench [options]\n"
+            "Fills the memory stores with every NUMA placement policy and measures the\n"
+            "read bandwidth of threads bound to each node, and of all nodes at once.\n"
+            "  --size <n>          Capacity of the stores (default: 512M)\n"
+            "  --block-size <n>    Block size of the dynamic store (default: 64K)\n"
+            "  --io-size <n>       Size of each read/write request (default: 1M)\n"
+            "  --threads <n>       Threads per node (default: 2)\n"
+            "  --passes <n>        Reads of the whole store per measurement (default: 3)\n"
+            "  --fill-node <n>     Fill from a single thread on this node instead of one\n"
+            "                      thread per node writing its share of the store\n");
+    }
+
+    bool ParseOptions(int argc, char** argv, Options& opts)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            auto hasValue = (i + 1 < argc);
+
+            if (arg == "--size" && hasValue)
+                opts.Size = ParseSize(argv[++i]);
+            else if (arg == "--block-size" && hasValue)
+                opts.BlockSize = ParseSize(argv[++i]);
+            else if (arg == "--io-size" && hasValue)
+                opts.IoSize = ParseSize(argv[++i]);
+            else if (arg == "--threads" && hasValue)
+                opts.Threads = ParseSize(argv[++i]);
+            else if (arg == "--passes" && hasValue)
+                opts.Passes = ParseSize(argv[++i]);
+            else if (arg == "--fill-node" && hasValue)
+                opts.FillNode = (int64_t)ParseSize(argv[++i]);
+            else
+                return false;
+        }
+
+        return opts.Size > 0 && opts.IoSize > 0 && opts.Threads > 0 && opts.Passes > 0 &&
+            opts.BlockSize > 0 && (opts.Size % opts.IoSize) == 0 && (opts.Size % opts.BlockSize) == 0 &&
+            (opts.FillNode < 0 || (uint64_t)opts.FillNode < NumaTopology::NodeCount());
+    }
+
+    // Runs fn(thread, threads) on threadsPerNode threads bound to each of the
+    // nodes, starting them at once; returns the seconds until all finished
+    // and rethrows the first exception any of them raised
+    template <typename TCallback>
+    double RunOnNodes(const std::vector<size_t>& nodes, uint64_t threadsPerNode, TCallback fn)
+    {
+        auto threads = nodes.size() * threadsPerNode;
+        std::vector<std::thread> workers;
+        std::vector<std::exception_ptr> errors(threads);
+        std::atomic<size_t> ready(0);
+        std::atomic<bool> start(false);
+
+        for (size_t thread = 0; thread < threads; thread++)
+        {
+            workers.emplace_back([&, thread]()
+            {
+                NumaTopology::BindThread(nodes[thread / threadsPerNode]);
+
+                ready++;
+                while (!start.load(std::memory_order_acquire))
+                    std::this_thread::yield();
+
+                try
+                {
+                    fn(thread, threads);
+                }
+                catch (...)
+                {
+                    errors[thread] = std::current_exception();
+                }
+            });
+        }
+
+        while (ready.load() != threads)
+            std::this_thread::yield();
+
+        Stopwatch watch;
+        start.store(true, std::memory_order_release);
+
+        for (auto& worker : workers)
+            worker.join();
+
+        auto seconds = watch.Seconds();
+
+        for (auto& error : errors)
+        {
+            if (error != nullptr)
+                std::rethrow_exception(error);
+        }
+
+        return seconds;
+    }
+
+    // Every thread handles one contiguous share of the store
+    void ForShare(const Options& opts, size_t thread, size_t threads, std::vector<unsigned char>& buffer,
+        MemoryStore& store, bool write)
+    {
+        auto requests = opts.Size / opts.IoSize;
+        for (auto request = requests * thread / threads; request < requests * (thread + 1) / threads; request++)
+        {
+            if (write)
+            {
+                FillPattern(buffer.data(), request * opts.IoSize, buffer.size(), 0x4E756D61ull);
+                store.Write((size_t)(request * opts.IoSize), buffer.data(), buffer.size());
+            }
+            else
+            {
+                store.Read((size_t)(request * opts.IoSize), buffer.data(), buffer.size());
+            }
+        }
+    }
+
+    double Fill(MemoryStore& store, const Options& opts)
+    {
+        std::vector<size_t> nodes;
+        if (opts.FillNode >= 0)
+            nodes.push_back((size_t)opts.FillNode);
+        else
+            for (size_t node = 0; node < NumaTopology::NodeCount(); node++)
+                nodes.push_back(node);
+
+        auto seconds = RunOnNodes(nodes, 1, [&](size_t thread, size_t threads)
+        {
+            std::vector<unsigned char> buffer((size_t)opts.IoSize);
+            ForShare(opts, thread, threads, buffer, store, true);
+        });
+
+        return MegabytesPerSecond(opts.Size, seconds);
+    }
+
+    double ReadFrom(MemoryStore& store, const Options& opts, const std::vector<size_t>& nodes)
+    {
+        auto seconds = RunOnNodes(nodes, opts.Threads, [&](size_t thread, size_t threads)
+        {
+            std::vector<unsigned char> buffer((size_t)opts.IoSize);
+            for (uint64_t pass = 0; pass < opts.Passes; pass++)
+                ForShare(opts, thread, threads, buffer, store, false);
+        });
+
+        return MegabytesPerSecond(opts.Size * opts.Passes, seconds);
+    }
+
+    void Run(const char* kind, const Policy& policy, MemoryStore& store, const Options& opts)
+    {
+        auto fill = Fill(store, opts);
+        std::printf("%-8s %-12s %10.1f", kind, policy.Name.c_str(), fill);
+
+        std::vector<size_t> all;
+        for (size_t node = 0; node < NumaTopology::NodeCount(); node++)
+        {
+            std::printf(" %10.1f", ReadFrom(store, opts, { node }));
+            all.push_back(node);
+        }
+
+        std::printf(" %10.1f\n", ReadFrom(store, opts, all));
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options opts;
+    if (!ParseOptions(argc, argv, opts))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    auto nodes = NumaTopology::NodeCount();
+
+    std::vector<Policy> policies;
+    policies.push_back({ "default", NumaPolicy() });
+    policies.push_back({ "interleave", NumaPolicy() });
+    policies.back().Numa.Placement = NumaPlacement::Interleave;
+    policies.push_back({ "local", NumaPolicy() });
+    policies.back().Numa.Placement = NumaPlacement::Local;
+
+    for (size_t node = 0; node < nodes; node++)
+    {
+        policies.push_back({ "node " + std::to_string(node), NumaPolicy() });
+        policies.back().Numa.Placement = NumaPlacement::Node;
+        policies.back().Numa.Node = node;
+    }
+
+    std::printf("nodes=%llu size=%s block-size=%s io-size=%s threads/node=%llu passes=%llu fill=%s\n",
+        (unsigned long long)nodes, FormatSize(opts.Size).c_str(), FormatSize(opts.BlockSize).c_str(),
+        FormatSize(opts.IoSize).c_str(), (unsigned long long)opts.Threads, (unsigned long long)opts.Passes,
+        opts.FillNode >= 0 ? ("node " + std::to_string(opts.FillNode)).c_str() : "per node");
+
+    if (!NumaTopology::BindThread(0))
+        std::printf("threads cannot be bound to nodes, per-node figures only show the average placement\n");
+
+    std::printf("%-8s %-12s %10s", "store", "policy", "fill MiB/s");
+    for (size_t node = 0; node < nodes; node++)
+        std::printf(" %10s", ("node " + std::to_string(node)).c_str());
+    std::printf(" %10s\n", "all MiB/s");
+
+    try
+    {
+        for (auto& policy : policies)
+        {
+            DynamicMemoryStoreOptions storeOptions;
+            storeOptions.Numa = policy.Numa;
+
+            std::unique_ptr<MemoryStore> store(
+                new DynamicMemoryStore((size_t)opts.Size, (size_t)opts.BlockSize, storeOptions));
+            Run("dynamic", policy, *store, opts);
+        }
+
+        for (auto& policy : policies)
+        {
+            std::unique_ptr<MemoryStore> store(new StaticMemoryStore((size_t)opts.Size, policy.Numa));
+            Run("static", policy, *store, opts);
+        }
+    }
+    catch (const NativeException& ex)
+    {
+        std::fprintf(stderr, "error: %s\n", ex.what());
+        return 1;
+    }
+
+    return 0;
+}
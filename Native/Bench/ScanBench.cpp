@@ -0,0 +1,273 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "BenchUtils.h"
+
+#include "../Core/ImageFile.h"
+#include "../Core/MappedImage.h"
+#include "../Core/MemoryKernels.h"
+#include "../Core/NativeException.h"
+#include "../Core/SignatureScanner.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace nDiscUtils::Bench;
+using namespace nDiscUtils::Native;
+
+namespace {
+
+    struct Options
+    {
+        uint64_t Size = 1ull << 30;
+        uint64_t Granularity = 1;
+        uint64_t Planted = 64;
+        int Threads = 0;
+        std::string File;
+    };
+
+    void PrintUsage()
+    {
+        std::printf(
+            "Usage: ScanBench [options]\n"
+            "Scans a synthetic image holding random data and planted NTFS, FAT and ext\n"
+            "boot sectors for file system signatures, once by testing every offset and\n"
+            "once with the anchor kernels at every supported instruction set.\n"
+            "  --size <n>         Size of the image (default: 1G)\n"
+            "  --granularity <n>  Only offsets which are a multiple of this are reported (default: 1)\n"
+            "  --planted <n>      Signatures of each kind written into the image (default: 64)\n"
+            "  --threads <n>      Threads of the pipelined scan, zero for one per core (default: 0)\n"
+            "  --file <path>      Also write the image to this file and scan it once read into\n"
+            "                     buffers and once in place through a MappedImage\n");
+    }
+
+    bool ParseOptions(int argc, char** argv, Options& opts)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            auto hasValue = (i + 1 < argc);
+
+            if (arg == "--size" && hasValue)
+                opts.Size = ParseSize(argv[++i]);
+            else if (arg == "--granularity" && hasValue)
+                opts.Granularity = ParseSize(argv[++i]);
+            else if (arg == "--planted" && hasValue)
+                opts.Planted = std::strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--threads" && hasValue)
+                opts.Threads = std::atoi(argv[++i]);
+            else if (arg == "--file" && hasValue)
+                opts.File = argv[++i];
+            else
+                return false;
+        }
+
+        return opts.Size > SignatureScanner::Overlap && opts.Granularity != 0 && opts.Threads >= 0;
+    }
+
+    class MemorySource : public ReadSource
+    {
+
+    public:
+        MemorySource(const unsigned char* data, uint64_t length) :
+            mData(data),
+            mLength(length) { }
+
+        size_t Read(uint64_t offset, void* buffer, size_t count) override
+        {
+            auto available = (size_t)std::min<uint64_t>(count, mLength - std::min(offset, mLength));
+            std::memcpy(buffer, mData + offset, available);
+            return available;
+        }
+
+    private:
+        const unsigned char* mData;
+        uint64_t mLength;
+
+    };
+
+    // Reads the image file into the scanner's buffers
+    class FileSource : public ReadSource
+    {
+
+    public:
+        explicit FileSource(const std::string& path) :
+            mFile(ImageFile::Open(path, ImageFileMode::Read)),
+            mLength(mFile->Length()) { }
+
+        size_t Read(uint64_t offset, void* buffer, size_t count) override
+        {
+            auto available = (size_t)std::min<uint64_t>(count, mLength - std::min(offset, mLength));
+            mFile->ReadAt(offset, buffer, available);
+            return available;
+        }
+
+        bool Concurrent() const override
+        {
+            return true;
+        }
+
+    private:
+        std::unique_ptr<ImageFile> mFile;
+        uint64_t mLength;
+
+    };
+
+    // Writes the fields each detector looks at to sector-aligned offsets
+    void Plant(unsigned char* image, uint64_t size, uint64_t count)
+    {
+        SplitMix64 generator(0x5363616E);
+        auto sectors = (size - SignatureScanner::Overlap) / 512;
+
+        for (uint64_t i = 0; i < count; i++)
+        {
+            auto ntfs = image + (generator.Next() % sectors) * 512;
+            std::memcpy(ntfs + 3, "NTFS    ", 8);
+
+            auto fat = image + (generator.Next() % sectors) * 512;
+            const unsigned char bpb[] = { 0x00, 0x02, 0x08, 0x20, 0x00, 0x02 };
+            std::memcpy(fat + 11, bpb, sizeof(bpb));
+            fat[21] = 0xF8;
+            fat[510] = 0x55;
+            fat[511] = 0xAA;
+
+            auto ext = image + (generator.Next() % sectors) * 512 + 1024;
+            const unsigned char logBlockSize[] = { 0x02, 0x00, 0x00, 0x00 };
+            const unsigned char perGroup[] = { 0x00, 0x80, 0x00, 0x00 };
+            std::memcpy(ext + 24, logBlockSize, 4);
+            std::memcpy(ext + 32, perGroup, 4);
+            std::memcpy(ext + 40, perGroup, 4);
+            ext[56] = 0x53;
+            ext[57] = 0xEF;
+        }
+    }
+
+    // Tests every offset on its own, as the managed scan used to
+    uint64_t ScanEveryOffset(const unsigned char* image, uint64_t size, uint64_t granularity)
+    {
+        std::vector<SignatureHit> hits;
+        auto window = SignatureScanner::Overlap + 1;
+        auto found = (uint64_t)0;
+
+        for (uint64_t offset = 0; offset < size; offset += granularity)
+        {
+            hits.clear();
+            SignatureScanner::ScanBuffer(image + offset, (size_t)std::min<uint64_t>(window, size - offset), 1,
+                offset, SignatureAll, 1, hits);
+            found += hits.size();
+        }
+
+        return found;
+    }
+
+    void Row(const char* method, const std::string& implementation, uint64_t size, double seconds, uint64_t hits)
+    {
+        std::printf("%-10s %-12s %10.2f %10.3f %8llu\n", method, implementation.c_str(),
+            MegabytesPerSecond(size, seconds) / 1024.0, seconds, (unsigned long long)hits);
+        std::fflush(stdout);
+    }
+
+    void Run(const Options& opts)
+    {
+        std::unique_ptr<unsigned char[]> image(new unsigned char[(size_t)opts.Size]);
+        FillPattern(image.get(), 0, (size_t)opts.Size, 0x496D6167ull);
+        Plant(image.get(), opts.Size, opts.Planted);
+
+        std::printf("%-10s %-12s %10s %10s %8s\n", "method", "level", "GiB/s", "seconds", "hits");
+
+        // Testing every offset is slow enough to only look at a slice of the image
+        auto slice = std::min<uint64_t>(opts.Size, 64ull << 20);
+        Stopwatch watch;
+        auto hits = ScanEveryOffset(image.get(), slice, opts.Granularity);
+        Row("offsets", "scalar", slice, watch.Seconds(), hits);
+
+        for (auto level = (int)SimdLevel::Scalar; level <= (int)MemoryKernels::SupportedLevel(); level++)
+        {
+            MemoryKernels::SetLevel((SimdLevel)level);
+
+            std::vector<SignatureHit> found;
+            watch.Restart();
+            SignatureScanner::ScanBuffer(image.get(), (size_t)opts.Size, (size_t)opts.Size, 0,
+                SignatureAll, (size_t)opts.Granularity, found);
+            Row("anchors", MemoryKernels::LevelName((SimdLevel)level), opts.Size, watch.Seconds(), found.size());
+        }
+
+        SignatureScannerOptions options;
+        options.Granularity = (size_t)opts.Granularity;
+        options.Threads = (size_t)opts.Threads;
+
+        SignatureScanner scanner(options);
+        MemorySource source(image.get(), opts.Size);
+
+        watch.Restart();
+        auto result = scanner.Scan(source, opts.Size, 0, opts.Size);
+        Row("pipeline", MemoryKernels::LevelName(MemoryKernels::Level()), opts.Size, watch.Seconds(), result.HitCount);
+
+        if (opts.File.empty())
+            return;
+
+        {
+            std::unique_ptr<ImageFile> file(ImageFile::Open(opts.File, ImageFileMode::Create));
+            file->WriteAt(0, image.get(), (size_t)opts.Size);
+        }
+
+        image.reset();
+
+        // Both scans find the file in the system cache, so the difference is
+        // the copy into the buffers which the mapping avoids
+        FileSource fileSource(opts.File);
+        watch.Restart();
+        result = scanner.Scan(fileSource, opts.Size, 0, opts.Size);
+        Row("file", "read", opts.Size, watch.Seconds(), result.HitCount);
+
+        MappedImage mappedSource(opts.File);
+        watch.Restart();
+        result = scanner.Scan(mappedSource, opts.Size, 0, opts.Size);
+        Row("file", "mapped", opts.Size, watch.Seconds(), result.HitCount);
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options opts;
+    if (!ParseOptions(argc, argv, opts))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        Run(opts);
+    }
+    catch (const std::bad_alloc&)
+    {
+        std::fprintf(stderr, "error: out of memory\n");
+        return 1;
+    }
+    catch (const NativeException& ex)
+    {
+        std::fprintf(stderr, "error: %s\n", ex.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,468 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "BenchUtils.h"
+
+#include "../Core/DynamicMemoryStore.h"
+#include "../Core/NativeException.h"
+#include "../Core/StaticMemoryStore.h"
+#include "../Core/StoreImage.h"
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace nDiscUtils::Bench;
+using namespace nDiscUtils::Native;
+
+namespace {
+
+    struct Options
+    {
+        bool Static = false;
+        bool Stress = false;
+        bool Deduplicate = false;
+        bool Compress = false;
+        bool Compressible = false;
+        bool Snapshot = false;
+        bool LargePages = false;
+        bool Prefault = false;
+        uint64_t HotSize = 0;
+        uint64_t ColdAfter = 0;
+        uint64_t Budget = 0;
+        uint64_t Period = 0;
+        uint64_t Size = 256ull << 20;
+        uint64_t BlockSize = 64ull << 10;
+        uint64_t IoSize = 64ull << 10;
+        uint64_t Iterations = 4;
+        uint64_t Threads = 1;
+        uint64_t Seed = 0x6E446973ull;
+        std::string Image;
+        std::string Spill;
+    };
+
+    void PrintUsage()
+    {
+        std::printf(
+            "Usage: StoreBench [options]\n"
+            "  --static            Benchmark StaticMemoryStore instead of DynamicMemoryStore\n"
+            "  --large-pages       Back the static store with large pages where available\n"
+            "  --prefault          Fault the static store in on all processors while creating it\n"
+            "  --size <n>          Capacity of the store (default: 256M)\n"
+            "  --block-size <n>    Block size of the dynamic store (default: 64K)\n"
+            "  --io-size <n>       Size of each read/write request (default: 64K)\n"
+            "  --iterations <n>    Passes of the random/stress phases (default: 4)\n"
+            "  --threads <n>       Threads issuing requests concurrently (default: 1)\n"
+            "  --seed <n>          Seed of offsets and verification patterns\n"
+            "  --stress            Verify every read against the written pattern\n"
+            "  --dedup             Enable block deduplication of the dynamic store\n"
+            "  --period <n>        Repeat the written patterns every n bytes\n"
+            "  --compress          Enable the compressed cold-block tier of the dynamic store\n"
+            "  --hot-size <n>      Uncompressed blocks kept by the compressed tier (default: unbounded)\n"
+            "  --cold-after <ms>   Compress blocks idle for this long in the background (default: off)\n"
+            "  --compressible      Write low-entropy patterns instead of random ones\n"
+            "  --budget <n>        Memory budget of the dynamic store, spilling beyond it (default: none)\n"
+            "  --spill <path>      Spill file used with --budget (default: StoreBench.spill)\n"
+            "  --snapshot          Snapshot the filled store, overwrite it and restore the snapshot\n"
+            "  --image <path>      Checkpoint the filled store into an image and read it back mapped\n");
+    }
+
+    bool ParseOptions(int argc, char** argv, Options& opts)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            auto hasValue = (i + 1 < argc);
+
+            if (arg == "--static")
+                opts.Static = true;
+            else if (arg == "--large-pages")
+                opts.LargePages = true;
+            else if (arg == "--prefault")
+                opts.Prefault = true;
+            else if (arg == "--stress")
+                opts.Stress = true;
+            else if (arg == "--dedup")
+                opts.Deduplicate = true;
+            else if (arg == "--compress")
+                opts.Compress = true;
+            else if (arg == "--compressible")
+                opts.Compressible = true;
+            else if (arg == "--snapshot")
+                opts.Snapshot = true;
+            else if (arg == "--hot-size" && hasValue)
+                opts.HotSize = ParseSize(argv[++i]);
+            else if (arg == "--cold-after" && hasValue)
+                opts.ColdAfter = ParseSize(argv[++i]);
+            else if (arg == "--budget" && hasValue)
+                opts.Budget = ParseSize(argv[++i]);
+            else if (arg == "--spill" && hasValue)
+                opts.Spill = argv[++i];
+            else if (arg == "--period" && hasValue)
+                opts.Period = ParseSize(argv[++i]);
+            else if (arg == "--size" && hasValue)
+                opts.Size = ParseSize(argv[++i]);
+            else if (arg == "--block-size" && hasValue)
+                opts.BlockSize = ParseSize(argv[++i]);
+            else if (arg == "--io-size" && hasValue)
+                opts.IoSize = ParseSize(argv[++i]);
+            else if (arg == "--iterations" && hasValue)
+                opts.Iterations = ParseSize(argv[++i]);
+            else if (arg == "--threads" && hasValue)
+                opts.Threads = ParseSize(argv[++i]);
+            else if (arg == "--seed" && hasValue)
+                opts.Seed = ParseSize(argv[++i]);
+            else if (arg == "--image" && hasValue)
+                opts.Image = argv[++i];
+            else
+                return false;
+        }
+
+        if (opts.Budget != 0 && opts.Spill.empty())
+            opts.Spill = "StoreBench.spill";
+
+        return ((!opts.Snapshot && opts.Image.empty() && opts.Budget == 0) || !opts.Static) && opts.Size > 0 && opts.IoSize > 0 && opts.Threads > 0 && opts.IoSize <= opts.Size &&
+            (opts.IoSize % 8) == 0 && (opts.Size % opts.IoSize) == 0 &&
+            (opts.Period == 0 || (opts.Period % opts.IoSize) == 0);
+    }
+
+    uint64_t gPeriod = 0;
+    uint64_t gMask = ~0ull;
+
+    // Evictions up to the previous report
+    uint64_t gEvictions = 0;
+
+    void Report(const char* phase, uint64_t bytes, double seconds, const MemoryStore& store)
+    {
+        auto dynamicStore = dynamic_cast<const DynamicMemoryStore*>(&store);
+
+        std::printf("%-18s %10.1f MiB/s  %8.3f s  committed=%s logical=%s index=%s\n",
+            phase, MegabytesPerSecond(bytes, seconds), seconds,
+            FormatSize(store.CommittedBytes()).c_str(),
+            FormatSize(dynamicStore != nullptr ? dynamicStore->LogicalBytes() : store.CommittedBytes()).c_str(),
+            FormatSize(dynamicStore != nullptr ? dynamicStore->IndexBytes() : 0).c_str());
+
+        if (dynamicStore != nullptr && dynamicStore->Options().Compress)
+        {
+            auto statistics = dynamicStore->Statistics();
+            auto accesses = statistics.HotHits + statistics.HotMisses;
+
+            std::printf("%-18s hot=%s compressed=%s in %s ratio=%.2f hit-rate=%.1f%%\n", "",
+                FormatSize((uint64_t)statistics.HotBlocks * dynamicStore->BlockSize()).c_str(),
+                FormatSize((uint64_t)statistics.CompressedBlocks * dynamicStore->BlockSize()).c_str(),
+                FormatSize(statistics.CompressedBytes).c_str(),
+                statistics.CompressedBytes != 0 ?
+                    (double)statistics.CompressedBlocks * dynamicStore->BlockSize() / statistics.CompressedBytes : 1.0,
+                accesses != 0 ? 100.0 * statistics.HotHits / accesses : 100.0);
+        }
+
+        if (dynamicStore != nullptr && dynamicStore->Options().MemoryBudget != 0)
+        {
+            auto statistics = dynamicStore->Statistics();
+
+            std::printf("%-18s resident=%s spilled=%s evictions=%llu (%.0f/s) read-back=%llu failures=%llu\n", "",
+                FormatSize(statistics.ResidentBytes).c_str(), FormatSize(statistics.SpilledBytes).c_str(),
+                (unsigned long long)(statistics.Evictions - gEvictions),
+                seconds > 0 ? (statistics.Evictions - gEvictions) / seconds : 0.0,
+                (unsigned long long)statistics.SpillReads, (unsigned long long)statistics.SpillFailures);
+
+            gEvictions = statistics.Evictions;
+        }
+    }
+
+    // Expected content of a request: the pattern of its seed, or zero if no seed is set
+    void Expect(unsigned char* buffer, uint64_t offset, size_t count, const uint64_t* seed)
+    {
+        if (seed == nullptr)
+            std::memset(buffer, 0, count);
+        else
+            FillPattern(buffer, gPeriod != 0 ? offset % gPeriod : offset, count, *seed, gMask);
+    }
+
+    // Runs fn(thread) on the given number of threads and rethrows the first
+    // exception any of them raised
+    template <typename TCallback>
+    void RunThreads(uint64_t threads, TCallback fn)
+    {
+        std::vector<std::thread> workers;
+        std::vector<std::exception_ptr> errors(threads);
+
+        for (uint64_t thread = 0; thread < threads; thread++)
+        {
+            workers.emplace_back([&fn, &errors, thread]()
+            {
+                try
+                {
+                    fn(thread);
+                }
+                catch (...)
+                {
+                    errors[thread] = std::current_exception();
+                }
+            });
+        }
+
+        for (auto& worker : workers)
+            worker.join();
+
+        for (auto& error : errors)
+        {
+            if (error != nullptr)
+                std::rethrow_exception(error);
+        }
+    }
+
+    // Returns the number of mismatching requests. Threads take turns request
+    // by request, so requests smaller than a block race for the same block.
+    uint64_t Sequential(MemoryStore& store, const Options& opts, bool write, const uint64_t* seed, const char* phase)
+    {
+        std::atomic<uint64_t> mismatches(0);
+
+        Stopwatch watch;
+        RunThreads(opts.Threads, [&](uint64_t thread)
+        {
+            std::vector<unsigned char> buffer(opts.IoSize);
+            std::vector<unsigned char> expected(opts.Stress ? opts.IoSize : 0);
+
+            if (write && !opts.Stress)
+                Expect(buffer.data(), 0, buffer.size(), seed);
+
+            for (uint64_t offset = thread * opts.IoSize; offset < opts.Size; offset += opts.Threads * opts.IoSize)
+            {
+                if (write)
+                {
+                    if (opts.Stress)
+                        Expect(buffer.data(), offset, buffer.size(), seed);
+
+                    store.Write(offset, buffer.data(), buffer.size());
+                }
+                else
+                {
+                    store.Read(offset, buffer.data(), buffer.size());
+
+                    if (opts.Stress)
+                    {
+                        Expect(expected.data(), offset, expected.size(), seed);
+                        if (std::memcmp(buffer.data(), expected.data(), buffer.size()) != 0)
+                            mismatches++;
+                    }
+                }
+            }
+        });
+
+        Report(phase, opts.Size, watch.Seconds(), store);
+        return mismatches;
+    }
+
+    // Rewrites a random half of all request-sized slots per pass and reads the
+    // whole store back; the shadow table keeps the seed of each slot's latest
+    // write. Every thread owns the slots congruent to its number.
+    uint64_t Random(MemoryStore& store, const Options& opts, uint64_t seed)
+    {
+        auto slots = opts.Size / opts.IoSize;
+        std::vector<uint64_t> shadow(opts.Stress ? slots : 0, seed);
+        std::atomic<uint64_t> mismatches(0);
+        std::atomic<uint64_t> bytes(0);
+
+        Stopwatch watch;
+        RunThreads(opts.Threads, [&](uint64_t thread)
+        {
+            std::vector<unsigned char> buffer(opts.IoSize);
+            std::vector<unsigned char> expected(opts.IoSize);
+            auto ownedSlots = (slots - thread + opts.Threads - 1) / opts.Threads;
+            uint64_t threadBytes = 0;
+
+            for (uint64_t pass = 1; pass <= opts.Iterations; pass++)
+            {
+                SplitMix64 generator((seed + pass) ^ (thread << 32));
+
+                for (uint64_t i = 0; i < ownedSlots / 2; i++)
+                {
+                    auto slot = (generator.Next() % ownedSlots) * opts.Threads + thread;
+                    auto slotSeed = seed + pass;
+
+                    Expect(buffer.data(), slot * opts.IoSize, buffer.size(), &slotSeed);
+                    store.Write(slot * opts.IoSize, buffer.data(), buffer.size());
+                    threadBytes += buffer.size();
+
+                    if (opts.Stress)
+                        shadow[slot] = slotSeed;
+                }
+
+                for (uint64_t i = 0; i < ownedSlots; i++)
+                {
+                    auto slot = (opts.Stress ? i : generator.Next() % ownedSlots) * opts.Threads + thread;
+
+                    store.Read(slot * opts.IoSize, buffer.data(), buffer.size());
+                    threadBytes += buffer.size();
+
+                    if (opts.Stress)
+                    {
+                        Expect(expected.data(), slot * opts.IoSize, expected.size(), &shadow[slot]);
+                        if (std::memcmp(buffer.data(), expected.data(), buffer.size()) != 0)
+                            mismatches++;
+                    }
+                }
+            }
+
+            bytes += threadBytes;
+        });
+
+        Report("random r/w", bytes, watch.Seconds(), store);
+        return mismatches;
+    }
+
+    // Discards the store request by request, interleaved across threads like Sequential()
+    void Discard(MemoryStore& store, const Options& opts)
+    {
+        Stopwatch watch;
+        RunThreads(opts.Threads, [&](uint64_t thread)
+        {
+            for (uint64_t offset = thread * opts.IoSize; offset < opts.Size; offset += opts.Threads * opts.IoSize)
+                store.Discard(offset, opts.IoSize);
+        });
+
+        Report("discard", opts.Size, watch.Seconds(), store);
+    }
+
+    // Times taking a snapshot, diverging from it and restoring it; returns
+    // the number of mismatching requests read back after the restore
+    uint64_t SnapshotRestore(DynamicMemoryStore& store, const Options& opts)
+    {
+        Stopwatch watch;
+        std::unique_ptr<DynamicMemorySnapshot> snapshot(store.Snapshot());
+        std::printf("%-18s %23.6f s\n", "snapshot", watch.Seconds());
+
+        auto divergedSeed = opts.Seed + 1;
+        auto mismatches = Sequential(store, opts, true, &divergedSeed, "write (diverged)");
+
+        watch.Restart();
+        store.Restore(*snapshot);
+        Report("restore", 0, watch.Seconds(), store);
+
+        mismatches += Sequential(store, opts, false, &opts.Seed, "read (restored)");
+        return mismatches;
+    }
+
+    // Times a full and an empty incremental checkpoint, loading the image
+    // and reading it back through the mapping; returns the number of
+    // mismatching requests of the read
+    uint64_t CheckpointLoad(DynamicMemoryStore& store, const Options& opts, const DynamicMemoryStoreOptions& storeOptions)
+    {
+        StoreImage image(opts.Image);
+
+        Stopwatch watch;
+        auto statistics = image.Checkpoint(store);
+        Report("checkpoint (full)", (uint64_t)statistics.WrittenBlocks * store.BlockSize(), watch.Seconds(), store);
+
+        watch.Restart();
+        statistics = image.Checkpoint(store);
+        Report("checkpoint (none)", (uint64_t)statistics.WrittenBlocks * store.BlockSize(), watch.Seconds(), store);
+
+        StoreImage loadedImage(opts.Image);
+
+        watch.Restart();
+        std::unique_ptr<DynamicMemoryStore> loaded(loadedImage.Load(storeOptions));
+        Report("load (mapped)", 0, watch.Seconds(), *loaded);
+
+        return Sequential(*loaded, opts, false, &opts.Seed, "read (mapped)");
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options opts;
+    if (!ParseOptions(argc, argv, opts))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        Stopwatch watch;
+        std::unique_ptr<MemoryStore> store;
+
+        DynamicMemoryStoreOptions storeOptions;
+        storeOptions.Deduplicate = opts.Deduplicate;
+        storeOptions.Compress = opts.Compress;
+        storeOptions.HotBytes = (size_t)opts.HotSize;
+        storeOptions.ColdAfter = (uint32_t)opts.ColdAfter;
+        storeOptions.MemoryBudget = (size_t)opts.Budget;
+        storeOptions.SpillPath = opts.Spill;
+        gPeriod = opts.Period;
+        gMask = opts.Compressible ? 0x0F0Full : ~0ull;
+
+        StaticMemoryStoreOptions staticOptions;
+        staticOptions.LargePages = opts.LargePages;
+        staticOptions.Prefault = opts.Prefault;
+
+        if (opts.Static)
+            store.reset(new StaticMemoryStore((size_t)opts.Size, staticOptions));
+        else
+            store.reset(new DynamicMemoryStore((size_t)opts.Size, (size_t)opts.BlockSize, storeOptions));
+
+        std::printf("store=%s provider=%s size=%s block-size=%s io-size=%s threads=%llu stress=%d dedup=%d compress=%d period=%s\n",
+            opts.Static ? "static" : "dynamic", store->Provider()->Name(),
+            FormatSize(opts.Size).c_str(), FormatSize(opts.BlockSize).c_str(),
+            FormatSize(opts.IoSize).c_str(), (unsigned long long)opts.Threads, opts.Stress ? 1 : 0,
+            opts.Deduplicate ? 1 : 0, opts.Compress ? 1 : 0, FormatSize(opts.Period).c_str());
+        if (opts.Static)
+            std::printf("large-pages=%d prefault=%d\n", static_cast<StaticMemoryStore&>(*store).LargePages() ? 1 : 0,
+                opts.Prefault ? 1 : 0);
+
+        std::printf("%-18s %23.3f s\n", "create", watch.Seconds());
+
+        uint64_t mismatches = 0;
+
+        mismatches += Sequential(*store, opts, false, nullptr, "read (empty)");
+        mismatches += Sequential(*store, opts, true, &opts.Seed, "write (first)");
+        mismatches += Sequential(*store, opts, true, &opts.Seed, "write (steady)");
+        mismatches += Sequential(*store, opts, false, &opts.Seed, "read");
+
+        if (opts.Snapshot)
+            mismatches += SnapshotRestore(static_cast<DynamicMemoryStore&>(*store), opts);
+
+        if (!opts.Image.empty())
+            mismatches += CheckpointLoad(static_cast<DynamicMemoryStore&>(*store), opts, storeOptions);
+
+        mismatches += Random(*store, opts, opts.Seed);
+        mismatches += Sequential(*store, opts, true, nullptr, "write (zero)");
+        mismatches += Sequential(*store, opts, false, nullptr, "read (zero)");
+        mismatches += Sequential(*store, opts, true, &opts.Seed, "write (refill)");
+        Discard(*store, opts);
+        mismatches += Sequential(*store, opts, false, nullptr, "read (discarded)");
+
+        if (opts.Stress)
+        {
+            std::printf("stress: %llu mismatching request(s)\n", (unsigned long long)mismatches);
+            return mismatches == 0 ? 0 : 2;
+        }
+    }
+    catch (const NativeException& ex)
+    {
+        std::fprintf(stderr, "error: %s\n", ex.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+using namespace System;
+
+namespace nDiscUtils {
+namespace IO {
+
+    // Outcome of DynamicMemoryStream::Checkpoint
+    public value struct CheckpointStatistics
+    {
+
+    public:
+        // Only blocks changed since the previous checkpoint were written
+        bool Incremental;
+
+        long long WrittenBlocks;
+        long long ClearedBlocks;
+
+        // Blocks held by the image after the checkpoint
+        long long BackedBlocks;
+
+    };
+
+} // IO
+} // nDiscUtils
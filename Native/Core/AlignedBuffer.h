@@ -0,0 +1,71 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "NativeException.h"
+#include "PageProvider.h"
+
+#include <string>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Unbuffered files need page-aligned transfers, so I/O buffers are
+    // taken from the page provider, rounded up to its granularity
+    class AlignedBuffer
+    {
+
+    public:
+        explicit AlignedBuffer(size_t size) :
+            mProvider(PageProvider::Default()),
+            mSize((size + mProvider->Granularity() - 1) / mProvider->Granularity() * mProvider->Granularity())
+        {
+            mData = (unsigned char*)mProvider->Allocate(mSize);
+            if (mData == nullptr)
+                throw NativeException(NativeError::OutOfMemory,
+                    "Failed to allocate " + std::to_string(mSize) + " bytes of memory");
+        }
+
+        ~AlignedBuffer()
+        {
+            mProvider->Release(mData, mSize);
+        }
+
+        AlignedBuffer(const AlignedBuffer&) = delete;
+        AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+        unsigned char* Data() const
+        {
+            return mData;
+        }
+
+        size_t Size() const
+        {
+            return mSize;
+        }
+
+    private:
+        PageProvider* mProvider;
+        size_t mSize;
+        unsigned char* mData;
+
+    };
+
+} // Native
+} // nDiscUtils
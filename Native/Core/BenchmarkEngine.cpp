@@ -0,0 +1,399 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "BenchmarkEngine.h"
+#include "AlignedBuffer.h"
+#include "NativeException.h"
+#include "RandomFill.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        using Clock = std::chrono::steady_clock;
+
+        double SecondsSince(Clock::time_point start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        uint64_t Mix(uint64_t value)
+        {
+            value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+            value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+            return value ^ (value >> 31);
+        }
+
+        // SplitMix64, one state per worker
+        uint64_t Next(uint64_t& state)
+        {
+            state += 0x9E3779B97F4A7C15ull;
+            return Mix(state);
+        }
+
+        // Uniform in [0, 1)
+        double NextUnit(uint64_t& state)
+        {
+            return (double)(Next(state) >> 11) * (1.0 / 9007199254740992.0);
+        }
+
+        // Draws ranks 0 to count - 1 where rank k is chosen with probability
+        // proportional to 1 / (k + 1)^theta, in constant time and without
+        // any table, by rejection-inversion (Hormann and Derflinger, 1996)
+        class ZipfSampler
+        {
+
+        public:
+            ZipfSampler(uint64_t count, double theta) :
+                mCount(count),
+                mTheta(theta)
+            {
+                mIntegralFirst = Integral(1.5) - 1.0;
+                mIntegralLast = Integral((double)count + 0.5);
+                mSquash = 2.0 - InverseIntegral(Integral(2.5) - Density(2.0));
+            }
+
+            uint64_t Next(uint64_t& state) const
+            {
+                for (;;)
+                {
+                    auto u = mIntegralLast + NextUnit(state) * (mIntegralFirst - mIntegralLast);
+                    auto x = InverseIntegral(u);
+
+                    auto k = std::floor(x + 0.5);
+                    if (k < 1.0)
+                        k = 1.0;
+                    else if (k > (double)mCount)
+                        k = (double)mCount;
+
+                    if (k - x <= mSquash || u >= Integral(k + 0.5) - Density(k))
+                        return (uint64_t)k - 1;
+                }
+            }
+
+        private:
+            // log1p(x) / x and expm1(x) / x, continued through zero
+            static double Log1pRatio(double x)
+            {
+                return (std::fabs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x)));
+            }
+
+            static double Expm1Ratio(double x)
+            {
+                return (std::fabs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x)));
+            }
+
+            double Density(double x) const
+            {
+                return std::exp(-mTheta * std::log(x));
+            }
+
+            double Integral(double x) const
+            {
+                auto logX = std::log(x);
+                return Expm1Ratio((1.0 - mTheta) * logX) * logX;
+            }
+
+            double InverseIntegral(double x) const
+            {
+                auto t = std::max(x * (1.0 - mTheta), -1.0);
+                return std::exp(Log1pRatio(t) * x);
+            }
+
+            uint64_t mCount;
+            double mTheta;
+            double mIntegralFirst;
+            double mIntegralLast;
+            double mSquash;
+
+        };
+
+        // State shared by the workers of one thread
+        struct Job
+        {
+            std::mutex Lock;
+            BenchmarkCounters Read;
+            BenchmarkCounters Write;
+
+            // Share of the target walked by the sequential pattern
+            uint64_t FirstBlock = 0;
+            uint64_t Blocks = 0;
+            std::atomic<uint64_t> Cursor { 0 };
+        };
+
+    } // namespace
+
+    BenchmarkEngine::BenchmarkEngine(const BenchmarkEngineOptions& options) :
+        mOptions(options)
+    {
+        if (options.Threads == 0 || options.Depth == 0 || options.BlockBytes == 0)
+            throw NativeException(NativeError::InvalidArgument, "Threads, depth and block size of a benchmark may not be zero");
+        if (options.ReadPercent > 100)
+            throw NativeException(NativeError::InvalidArgument, "Read share of a benchmark may not exceed 100 percent");
+        if (options.Pattern == AccessPattern::Zipfian && !(options.ZipfTheta > 0.0))
+            throw NativeException(NativeError::InvalidArgument, "Zipf theta of a benchmark has to be positive");
+        if (!(options.Seconds >= 0.0) || (options.Seconds == 0.0 && options.Bytes == 0))
+            throw NativeException(NativeError::InvalidArgument, "Benchmark needs a duration or a number of bytes");
+        if (!(options.ProgressInterval > 0.0))
+            throw NativeException(NativeError::InvalidArgument, "Progress interval of a benchmark has to be positive");
+    }
+
+    BenchmarkResult BenchmarkEngine::Run(BenchmarkTarget& target, uint64_t length, BenchmarkProgressSink* progress) const
+    {
+        auto blockBytes = (uint64_t)mOptions.BlockBytes;
+        auto blocks = length / blockBytes;
+        auto threads = (uint64_t)mOptions.Threads;
+        if (blocks < threads)
+            throw NativeException(NativeError::InvalidArgument, "Benchmark target is smaller than one block per thread");
+
+        std::vector<std::unique_ptr<Job>> jobs;
+        for (uint64_t i = 0; i < threads; i++)
+        {
+            jobs.emplace_back(new Job());
+            jobs.back()->FirstBlock = (blocks / threads) * i + std::min(i, blocks % threads);
+            jobs.back()->Blocks = blocks / threads + (i < blocks % threads ? 1 : 0);
+        }
+
+        ZipfSampler zipf(blocks, (mOptions.Pattern == AccessPattern::Zipfian ? mOptions.ZipfTheta : 1.0));
+        RandomFill fill(mOptions.Seed);
+
+        auto workers = mOptions.Threads * mOptions.Depth;
+        auto serialize = !target.Concurrent();
+        std::mutex targetLock;
+
+        // Bytes of the requests handed out so far, for the byte limit
+        std::atomic<uint64_t> claimed(0);
+        std::atomic<bool> stopping(false);
+
+        std::mutex lock;
+        std::condition_variable finished;
+        size_t running = workers;
+        std::exception_ptr error;
+
+        BenchmarkResult result;
+
+        auto started = Clock::now();
+        auto deadline = started + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(mOptions.Seconds));
+        auto reported = started;
+
+        // Called with the lock held
+        auto stop = [&](std::exception_ptr exception)
+        {
+            if (exception && !error)
+                error = exception;
+
+            stopping.store(true, std::memory_order_relaxed);
+            finished.notify_all();
+        };
+
+        auto worker = [&](size_t index)
+        {
+            auto& job = *jobs[index % mOptions.Threads];
+            AlignedBuffer buffer(mOptions.BlockBytes);
+
+            auto state = mOptions.Seed ^ Mix(index + 1);
+            auto generated = (uint64_t)index << 48;
+            auto offset = (uint64_t)0;
+
+            try
+            {
+                while (!stopping.load(std::memory_order_relaxed))
+                {
+                    if (mOptions.Bytes != 0 && claimed.fetch_add(blockBytes, std::memory_order_relaxed) >= mOptions.Bytes)
+                        break;
+
+                    uint64_t block;
+                    switch (mOptions.Pattern)
+                    {
+                        case AccessPattern::Sequential:
+                            block = job.FirstBlock + job.Cursor.fetch_add(1, std::memory_order_relaxed) % job.Blocks;
+                            break;
+
+                        case AccessPattern::Zipfian:
+                            // Ranks are scattered with the same hash on every
+                            // worker, so all of them share the hot blocks
+                            block = Mix(zipf.Next(state) ^ mOptions.Seed) % blocks;
+                            break;
+
+                        default:
+                            block = Next(state) % blocks;
+                            break;
+                    }
+
+                    offset = block * blockBytes;
+                    auto read = (mOptions.ReadPercent == 100 ||
+                        (mOptions.ReadPercent != 0 && Next(state) % 100 < mOptions.ReadPercent));
+
+                    if (!read)
+                    {
+                        fill.Fill(buffer.Data(), mOptions.BlockBytes, generated);
+                        generated += blockBytes;
+                    }
+
+                    auto start = Clock::now();
+                    {
+                        std::unique_lock<std::mutex> serialized(targetLock, std::defer_lock);
+                        if (serialize)
+                            serialized.lock();
+
+                        if (read)
+                            target.Read(offset, buffer.Data(), mOptions.BlockBytes);
+                        else
+                            target.Write(offset, buffer.Data(), mOptions.BlockBytes);
+                    }
+                    auto end = Clock::now();
+
+                    {
+                        std::lock_guard<std::mutex> guard(job.Lock);
+                        auto& counters = (read ? job.Read : job.Write);
+                        counters.Requests++;
+                        counters.Bytes += blockBytes;
+                        counters.Latency.Record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+                    }
+
+                    if (mOptions.Seconds != 0.0 && end >= deadline)
+                        break;
+                }
+            }
+            catch (const NativeException& ex)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (!result.Failed)
+                {
+                    result.Failed = true;
+                    result.FailedOffset = offset;
+                    result.Failure = ex.what();
+                }
+
+                stop(nullptr);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stop(std::current_exception());
+            }
+
+            std::lock_guard<std::mutex> guard(lock);
+            if (--running == 0)
+                finished.notify_all();
+        };
+
+        // Moves the counters of all jobs into a report and the totals
+        auto takeProgress = [&]()
+        {
+            auto now = Clock::now();
+
+            BenchmarkProgress snapshot;
+            snapshot.ElapsedSeconds = std::chrono::duration<double>(now - started).count();
+            snapshot.IntervalSeconds = std::chrono::duration<double>(now - reported).count();
+
+            for (auto& job : jobs)
+            {
+                std::lock_guard<std::mutex> guard(job->Lock);
+                snapshot.Read.Merge(job->Read);
+                snapshot.Write.Merge(job->Write);
+                job->Read.Reset();
+                job->Write.Reset();
+            }
+
+            result.Read.Merge(snapshot.Read);
+            result.Write.Merge(snapshot.Write);
+            reported = now;
+            return snapshot;
+        };
+
+        std::vector<std::thread> pool;
+        try
+        {
+            for (size_t i = 0; i < workers; i++)
+                pool.emplace_back(worker, i);
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                running -= workers - pool.size();
+                stop(nullptr);
+            }
+
+            for (auto& thread : pool)
+                thread.join();
+
+            throw;
+        }
+
+        // The calling thread reports the progress, outside of the lock
+        auto interval = std::chrono::duration<double>(mOptions.ProgressInterval);
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                auto done = [&]() { return running == 0; };
+
+                if (progress == nullptr)
+                {
+                    finished.wait(guard, done);
+                    break;
+                }
+
+                if (finished.wait_for(guard, interval, done))
+                    break;
+            }
+
+            try
+            {
+                progress->Report(takeProgress());
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stop(std::current_exception());
+                break;
+            }
+        }
+
+        for (auto& thread : pool)
+            thread.join();
+
+        if (error)
+            std::rethrow_exception(error);
+
+        result.Seconds = SecondsSince(started);
+
+        // The last report covers the remainder and is made after any failure
+        auto remainder = takeProgress();
+        if (progress != nullptr)
+            progress->Report(remainder);
+
+        return result;
+    }
+
+} // Native
+} // nDiscUtils
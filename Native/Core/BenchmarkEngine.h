@@ -0,0 +1,183 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "LatencyHistogram.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Device, file or stream the benchmark engine issues requests to. Both
+    // calls transfer all of count or throw a NativeException; they are only
+    // called concurrently if Concurrent() is true and are serialized by the
+    // engine otherwise.
+    class BenchmarkTarget
+    {
+
+    public:
+        virtual ~BenchmarkTarget() { }
+
+        virtual void Read(uint64_t offset, void* buffer, size_t count) = 0;
+
+        virtual void Write(uint64_t offset, const void* buffer, size_t count) = 0;
+
+        virtual bool Concurrent() const
+        {
+            return false;
+        }
+
+    };
+
+    enum class AccessPattern
+    {
+        // Each thread walks its own share of the target block by block and
+        // starts over at its end
+        Sequential,
+
+        // Uniformly distributed blocks
+        Random,
+
+        // A few hot blocks take most requests; the blocks are scattered
+        // across the target rather than packed at its start
+        Zipfian
+    };
+
+    struct BenchmarkEngineOptions
+    {
+        // Threads issuing requests, each with its own sequence of blocks
+        size_t Threads = 1;
+
+        // Requests each thread keeps in flight
+        size_t Depth = 1;
+
+        // Bytes per request, which are aligned to it
+        size_t BlockBytes = 4096;
+
+        // Share of reads among all requests, 0 to 100
+        unsigned ReadPercent = 100;
+
+        AccessPattern Pattern = AccessPattern::Random;
+
+        // Skew of the zipfian pattern, larger values concentrate the
+        // requests on fewer blocks
+        double ZipfTheta = 1.2;
+
+        // The run ends after this many seconds or once Bytes were
+        // transferred, whichever comes first; zero disables either limit,
+        // but not both
+        double Seconds = 0.0;
+        uint64_t Bytes = 0;
+
+        // Seconds between two progress reports
+        double ProgressInterval = 1.0;
+
+        // Selects the blocks and the data written to them
+        uint64_t Seed = 0;
+    };
+
+    // Completed requests of one kind
+    struct BenchmarkCounters
+    {
+        uint64_t Requests = 0;
+        uint64_t Bytes = 0;
+        LatencyHistogram Latency;
+
+        void Merge(const BenchmarkCounters& other)
+        {
+            Requests += other.Requests;
+            Bytes += other.Bytes;
+            Latency.Merge(other.Latency);
+        }
+
+        void Reset()
+        {
+            Requests = 0;
+            Bytes = 0;
+            Latency.Reset();
+        }
+    };
+
+    // Snapshot passed to the progress sink, covering the time since the
+    // previous report
+    struct BenchmarkProgress
+    {
+        double ElapsedSeconds = 0.0;
+        double IntervalSeconds = 0.0;
+
+        BenchmarkCounters Read;
+        BenchmarkCounters Write;
+    };
+
+    // Receives the progress on the thread calling BenchmarkEngine::Run(); a
+    // NativeException thrown from it aborts the run and is passed on
+    class BenchmarkProgressSink
+    {
+
+    public:
+        virtual ~BenchmarkProgressSink() { }
+
+        virtual void Report(const BenchmarkProgress& progress) = 0;
+
+    };
+
+    struct BenchmarkResult
+    {
+        double Seconds = 0.0;
+
+        BenchmarkCounters Read;
+        BenchmarkCounters Write;
+
+        // Offset of the request which failed and the reason; the run stops
+        // at the first failure
+        bool Failed = false;
+        uint64_t FailedOffset = 0;
+        std::string Failure;
+    };
+
+    // Measures a target in the manner of fio: Threads * Depth workers each
+    // keep one blocking request in flight, so the target sees Depth
+    // requests per thread at any time. Write data is generated by
+    // RandomFill for every request, so it can neither be compressed nor
+    // deduplicated; generating it is not part of the measured latency.
+    class BenchmarkEngine
+    {
+
+    public:
+        explicit BenchmarkEngine(const BenchmarkEngineOptions& options = BenchmarkEngineOptions());
+
+        const BenchmarkEngineOptions& Options() const
+        {
+            return mOptions;
+        }
+
+        // Issues requests to the first length bytes of the target, which
+        // have to hold at least one block per thread
+        BenchmarkResult Run(BenchmarkTarget& target, uint64_t length, BenchmarkProgressSink* progress = nullptr) const;
+
+    private:
+        BenchmarkEngineOptions mOptions;
+
+    };
+
+} // Native
+} // nDiscUtils
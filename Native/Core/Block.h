@@ -0,0 +1,70 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Physical block of a DynamicMemoryStore. Directory slots point to these
+    // descriptors; a block referenced by more than one slot is shared and
+    // has to be copied before it is modified. Cold blocks may be held in
+    // compressed form only, Data is nullptr until they are unpacked again.
+    //
+    // Blocks of a store loaded from an image point into a read-only mapping
+    // of it (Mapped) and are copied into memory before they are modified.
+    // Their descriptors are embedded in the image table of the pool rather
+    // than allocated on their own (Embedded).
+    //
+    // Blocks evicted beyond the memory budget live in a slot of the spill
+    // file only (Spilled); both Data and Packed are nullptr then, and a
+    // non-zero PackedSize tells that the slot holds the packed form.
+    struct Block
+    {
+        static constexpr uint32_t Indexed = 1 << 0;
+        static constexpr uint32_t Hot = 1 << 1;
+        static constexpr uint32_t Accessed = 1 << 2;
+        static constexpr uint32_t Incompressible = 1 << 3;
+        static constexpr uint32_t Mapped = 1 << 4;
+        static constexpr uint32_t Embedded = 1 << 5;
+        static constexpr uint32_t Cold = 1 << 6;
+        static constexpr uint32_t Spilling = 1 << 7;
+        static constexpr uint32_t Spilled = 1 << 8;
+
+        unsigned char* Data;
+        uint32_t References;
+        uint32_t Flags;
+        uint64_t Hash;
+
+        unsigned char* Packed;
+        uint32_t PackedSize;
+        // Index in the hot set, or in the cold set once it left it
+        uint32_t HotSlot;
+        uint32_t Touched;
+
+        // NUMA node of the arena pool Data was taken from
+        uint32_t Node;
+
+        // Slot in the spill file holding the block while it is Spilled
+        uint32_t SpillSlot;
+    };
+
+} // Native
+} // nDiscUtils
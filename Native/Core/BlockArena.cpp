@@ -0,0 +1,170 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "BlockArena.h"
+#include "NativeException.h"
+#include "NumaTopology.h"
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+
+namespace nDiscUtils {
+namespace Native {
+
+    BlockArena::BlockArena(size_t blockSize, size_t maxChunk, size_t limit, PageProvider* provider, bool placed) :
+        mBlockSize(blockSize),
+        mMaxChunk(maxChunk != 0 ? std::max(maxChunk - (maxChunk % blockSize), blockSize) : 0),
+        mLimit(limit),
+        mProvider(provider),
+        mPlaced(placed),
+        mPools(placed ? NumaTopology::NodeCount() : 1),
+        mReservedBytes(0)
+    {
+        // Start small and double with every chunk, so small stores do not
+        // reserve far more than they use
+        auto firstChunk = std::max(MinChunkBytes, blockSize);
+        for (auto& pool : mPools)
+            pool.NextChunk = std::min(firstChunk - (firstChunk % blockSize), mMaxChunk);
+    }
+
+    BlockArena::~BlockArena()
+    {
+        for (auto& pool : mPools)
+        {
+            for (auto& chunk : pool.Chunks)
+                mProvider->Release(chunk.Memory, chunk.Size);
+        }
+    }
+
+    void* BlockArena::Allocate(size_t node)
+    {
+        if (mMaxChunk == 0)
+        {
+            auto block = AllocateMemory(mBlockSize, node);
+            if (block != nullptr)
+                mReservedBytes += mBlockSize;
+
+            return block;
+        }
+
+        auto& pool = mPools[node];
+        std::lock_guard<SpinLock> lock(pool.Lock);
+
+        if (!pool.Free.empty())
+        {
+            auto block = pool.Free.back();
+            pool.Free.pop_back();
+            return block;
+        }
+
+        if (pool.Cursor == pool.CursorEnd && !Grow(pool, node))
+            return nullptr;
+
+        auto block = pool.Cursor;
+        pool.Cursor += mBlockSize;
+        return block;
+    }
+
+    void BlockArena::Release(void* block, size_t node)
+    {
+        if (mMaxChunk == 0)
+        {
+            mProvider->Release(block, mBlockSize);
+            mReservedBytes -= mBlockSize;
+            return;
+        }
+
+        // Releasing runs while tearing down and unwinding, so it must not
+        // throw; a block whose pages could not be recommitted stays unused
+        // until its chunk is released
+        try
+        {
+            mProvider->Discard(block, mBlockSize);
+        }
+        catch (const NativeException&)
+        {
+            return;
+        }
+
+        auto& pool = mPools[node];
+        std::lock_guard<SpinLock> lock(pool.Lock);
+        pool.Free.push_back(block);
+    }
+
+    void BlockArena::Abandon(void* block)
+    {
+        if (mMaxChunk == 0)
+        {
+            mProvider->Release(block, mBlockSize);
+            mReservedBytes -= mBlockSize;
+        }
+    }
+
+    void* BlockArena::AllocateMemory(size_t size, size_t node)
+    {
+        if (!mPlaced)
+            return mProvider->Allocate(size);
+
+        return mProvider->AllocateOnNode(size, node);
+    }
+
+    bool BlockArena::Grow(Pool& pool, size_t node)
+    {
+        // The chunk crossing the limit is trimmed to end on it; pools which
+        // need more than the limit carry on with regular chunks
+        auto reserved = mReservedBytes.load(std::memory_order_relaxed);
+        auto size = pool.NextChunk;
+        if (reserved < mLimit && reserved + size > mLimit)
+            size = mLimit > reserved + mBlockSize ? mLimit - reserved : mBlockSize;
+
+        size -= size % mBlockSize;
+        auto blocks = size / mBlockSize;
+
+        // Every carved block may end up on the free list; reserving its slot
+        // now keeps Release() from having to allocate
+        try
+        {
+            pool.Chunks.reserve(pool.Chunks.size() + 1);
+            pool.Free.reserve(pool.Bytes / mBlockSize + blocks);
+        }
+        catch (const std::bad_alloc&)
+        {
+            return false;
+        }
+
+        auto memory = (unsigned char*)AllocateMemory(size, node);
+        if (memory == nullptr)
+            return false;
+
+        pool.Chunks.push_back({ memory, size });
+        pool.Cursor = memory;
+        pool.CursorEnd = memory + size;
+        pool.Bytes += size;
+        mReservedBytes += size;
+
+        if (pool.NextChunk <= mMaxChunk / 2)
+            pool.NextChunk *= 2;
+        else
+            pool.NextChunk = mMaxChunk;
+
+        return true;
+    }
+
+} // Native
+} // nDiscUtils
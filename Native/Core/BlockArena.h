@@ -0,0 +1,111 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "PageProvider.h"
+#include "SpinLock.h"
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Fixed-size block allocator on top of a PageProvider. Chunks of up to
+    // maxChunk bytes are requested from the provider and carved into
+    // blocks; released blocks are discarded and kept on a free list for
+    // reuse, the chunks themselves are only returned on destruction. A
+    // maxChunk of zero requests every block from the provider on its own.
+    // Chunks are sized to not reserve more than limit bytes in total, unless
+    // more blocks than that are in use at once.
+    // Arenas placing their blocks keep chunks and free blocks per NUMA node;
+    // blocks have to be released with the node they were allocated on.
+    // Allocate() and Release() may be called concurrently.
+    class BlockArena
+    {
+
+    public:
+        static constexpr size_t MinChunkBytes = (size_t)2 << 20;
+
+        BlockArena(size_t blockSize, size_t maxChunk, size_t limit, PageProvider* provider, bool placed = false);
+
+        ~BlockArena();
+
+        BlockArena(const BlockArena&) = delete;
+        BlockArena& operator=(const BlockArena&) = delete;
+
+        // Bytes requested from the provider, including free blocks
+        size_t ReservedBytes() const
+        {
+            return mReservedBytes.load(std::memory_order_relaxed);
+        }
+
+        // Nodes the blocks are placed on, one if the arena does not place them
+        size_t NodeCount() const
+        {
+            return mPools.size();
+        }
+
+        // Returns a zero-filled block or nullptr if no memory is left
+        void* Allocate(size_t node = 0);
+
+        // Returns a block for reuse; it reads as zero once handed out again.
+        // Never throws, blocks which cannot be discarded are not reused.
+        void Release(void* block, size_t node = 0);
+
+        // Returns a block while tearing down, pooled blocks are not touched
+        // as their chunks are released as a whole afterwards
+        void Abandon(void* block);
+
+    private:
+        struct Chunk
+        {
+            unsigned char* Memory;
+            size_t Size;
+        };
+
+        struct alignas(64) Pool
+        {
+            std::vector<Chunk> Chunks;
+            std::vector<void*> Free;
+            unsigned char* Cursor = nullptr;
+            unsigned char* CursorEnd = nullptr;
+            size_t Bytes = 0;
+            size_t NextChunk = 0;
+            SpinLock Lock;
+        };
+
+        void* AllocateMemory(size_t size, size_t node);
+
+        bool Grow(Pool& pool, size_t node);
+
+        size_t mBlockSize;
+        size_t mMaxChunk;
+        size_t mLimit;
+        PageProvider* mProvider;
+        bool mPlaced;
+
+        std::vector<Pool> mPools;
+        std::atomic<size_t> mReservedBytes;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,89 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "BlockBitmap.h"
+#include "NativeException.h"
+
+#include <new>
+
+namespace nDiscUtils {
+namespace Native {
+
+    BlockBitmap::BlockBitmap(size_t count) :
+        mCount(count),
+        mWordCount((count + WordBits - 1) / WordBits)
+    {
+        mWords = new (std::nothrow) std::atomic<uint64_t>[mWordCount == 0 ? 1 : mWordCount];
+        if (mWords == nullptr)
+            throw NativeException(NativeError::OutOfMemory, "Failed to allocate block bitmap");
+
+        ClearAll();
+    }
+
+    BlockBitmap::~BlockBitmap()
+    {
+        delete[] mWords;
+    }
+
+    void BlockBitmap::SetAll()
+    {
+        for (size_t index = 0; index < mWordCount; index++)
+            mWords[index].store(~(uint64_t)0, std::memory_order_relaxed);
+
+        // Bits past the count stay clear, so Population() needs no masking
+        if (mCount % WordBits != 0)
+            mWords[mWordCount - 1].store(((uint64_t)1 << (mCount % WordBits)) - 1, std::memory_order_relaxed);
+    }
+
+    void BlockBitmap::ClearAll()
+    {
+        for (size_t index = 0; index < mWordCount; index++)
+            mWords[index].store(0, std::memory_order_relaxed);
+    }
+
+    size_t BlockBitmap::Population() const
+    {
+        size_t population = 0;
+        for (size_t index = 0; index < mWordCount; index++)
+        {
+            auto word = mWords[index].load(std::memory_order_relaxed);
+            while (word != 0)
+            {
+                word &= word - 1;
+                population++;
+            }
+        }
+
+        return population;
+    }
+
+    void BlockBitmap::MoveTo(BlockBitmap& target)
+    {
+        if (target.mCount != mCount)
+            throw NativeException(NativeError::InvalidArgument, "Block bitmaps differ in size");
+
+        for (size_t index = 0; index < mWordCount; index++)
+        {
+            auto word = mWords[index].exchange(0, std::memory_order_relaxed);
+            if (word != 0)
+                target.mWords[index].fetch_or(word, std::memory_order_relaxed);
+        }
+    }
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,105 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // One bit per block, used to track changed and backed blocks of a store.
+    // Bits may be set, cleared and tested concurrently.
+    class BlockBitmap
+    {
+
+    public:
+        static constexpr size_t WordBits = 64;
+
+        explicit BlockBitmap(size_t count);
+
+        ~BlockBitmap();
+
+        BlockBitmap(const BlockBitmap&) = delete;
+        BlockBitmap& operator=(const BlockBitmap&) = delete;
+
+        size_t Count() const
+        {
+            return mCount;
+        }
+
+        size_t WordCount() const
+        {
+            return mWordCount;
+        }
+
+        bool Test(size_t index) const
+        {
+            return (mWords[index / WordBits].load(std::memory_order_relaxed) & Mask(index)) != 0;
+        }
+
+        void Set(size_t index)
+        {
+            // Testing first keeps the line shared while the bit is set already
+            auto& word = mWords[index / WordBits];
+            if ((word.load(std::memory_order_relaxed) & Mask(index)) == 0)
+                word.fetch_or(Mask(index), std::memory_order_relaxed);
+        }
+
+        void Clear(size_t index)
+        {
+            mWords[index / WordBits].fetch_and(~Mask(index), std::memory_order_relaxed);
+        }
+
+        uint64_t Word(size_t index) const
+        {
+            return mWords[index].load(std::memory_order_relaxed);
+        }
+
+        void SetWord(size_t index, uint64_t value)
+        {
+            mWords[index].store(value, std::memory_order_relaxed);
+        }
+
+        void SetAll();
+
+        void ClearAll();
+
+        // Number of set bits
+        size_t Population() const;
+
+        // Adds all bits to target and clears them here; bits set concurrently
+        // end up on either side
+        void MoveTo(BlockBitmap& target);
+
+    private:
+        static uint64_t Mask(size_t index)
+        {
+            return (uint64_t)1 << (index % WordBits);
+        }
+
+        size_t mCount;
+        size_t mWordCount;
+        std::atomic<uint64_t>* mWords;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,158 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "BlockDirectory.h"
+#include "NativeException.h"
+
+#include <cstdlib>
+#include <string>
+
+namespace nDiscUtils {
+namespace Native {
+
+    BlockDirectory::BlockDirectory(size_t blockCount) :
+        mBlockCount(blockCount),
+        mRootCount((blockCount + LeafEntries - 1) >> LeafShift),
+        mLeafCount(0),
+        mRoot(nullptr)
+    {
+        // calloc() hands out large tables as untouched zero pages, so
+        // even the root of a huge store costs nothing until it is used;
+        // all-zero bits are a valid null pointer for lock-free atomics
+        static_assert(std::atomic<Leaf*>::is_always_lock_free, "Leaf pointers have to be lock-free");
+        mRoot = (std::atomic<Leaf*>*)std::calloc(mRootCount, sizeof(std::atomic<Leaf*>));
+        if (mRoot == nullptr)
+            throw NativeException(NativeError::OutOfMemory,
+                "Failed to allocate block directory for " + std::to_string(blockCount) + " blocks");
+    }
+
+    BlockDirectory::~BlockDirectory()
+    {
+        // Leaves still shared with other directories stay with them
+        for (size_t root = 0; root < mRootCount; root++)
+        {
+            auto leaf = mRoot[root].load(std::memory_order_relaxed);
+            if (leaf != nullptr && leaf->Owners.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                std::free(leaf);
+        }
+
+        std::free(mRoot);
+        mRoot = nullptr;
+    }
+
+    BlockDirectory::Leaf* BlockDirectory::AcquireLeaf(size_t root)
+    {
+        auto leaf = mRoot[root].load(std::memory_order_acquire);
+        if (leaf != nullptr)
+            return leaf;
+
+        auto fresh = (Leaf*)std::calloc(1, sizeof(Leaf));
+        if (fresh == nullptr)
+            throw NativeException(NativeError::OutOfMemory, "Failed to allocate block directory leaf");
+
+        fresh->Owners.store(1, std::memory_order_relaxed);
+
+        // Another thread may have installed the leaf in the meantime
+        if (!mRoot[root].compare_exchange_strong(leaf, fresh, std::memory_order_acq_rel))
+        {
+            std::free(fresh);
+            return leaf;
+        }
+
+        mLeafCount.fetch_add(1, std::memory_order_relaxed);
+        return fresh;
+    }
+
+    BlockDirectory::Leaf* BlockDirectory::CopyLeaf(const Leaf* leaf)
+    {
+        auto copy = (Leaf*)std::malloc(sizeof(Leaf));
+        if (copy == nullptr)
+            throw NativeException(NativeError::OutOfMemory, "Failed to allocate block directory leaf");
+
+        copy->Owners.store(1, std::memory_order_relaxed);
+        copy->Used.store(leaf->Used.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        for (size_t entry = 0; entry < LeafEntries; entry++)
+            copy->Slots[entry].store(leaf->Slots[entry].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+        return copy;
+    }
+
+    void BlockDirectory::ShareFrom(const BlockDirectory& source)
+    {
+        if (source.mRootCount != mRootCount)
+            throw NativeException(NativeError::InvalidArgument, "Block directories have different geometries");
+
+        for (size_t root = 0; root < mRootCount; root++)
+        {
+            auto leaf = source.mRoot[root].load(std::memory_order_acquire);
+            if (leaf == nullptr)
+                continue;
+
+            leaf->Owners.fetch_add(1, std::memory_order_relaxed);
+            mRoot[root].store(leaf, std::memory_order_release);
+            mLeafCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void BlockDirectory::Set(size_t index, void* value)
+    {
+        auto root = index >> LeafShift;
+        auto leaf = mRoot[root].load(std::memory_order_acquire);
+        if (leaf == nullptr)
+        {
+            if (value == nullptr)
+                return;
+
+            leaf = AcquireLeaf(root);
+        }
+
+        auto& slot = leaf->Slots[index & LeafMask];
+        auto previous = slot.load(std::memory_order_relaxed);
+        if (previous == nullptr && value != nullptr)
+            leaf->Used.fetch_add(1, std::memory_order_relaxed);
+        else if (previous != nullptr && value == nullptr)
+            leaf->Used.fetch_sub(1, std::memory_order_relaxed);
+
+        slot.store(value, std::memory_order_release);
+
+        if (leaf->Used.load(std::memory_order_relaxed) == 0)
+        {
+            mRoot[root].store(nullptr, std::memory_order_release);
+            mLeafCount.fetch_sub(1, std::memory_order_relaxed);
+            std::free(leaf);
+        }
+    }
+
+    bool BlockDirectory::CompareExchange(size_t index, void*& expected, void* desired)
+    {
+        auto leaf = AcquireLeaf(index >> LeafShift);
+        auto& slot = leaf->Slots[index & LeafMask];
+
+        if (!slot.compare_exchange_strong(expected, desired, std::memory_order_acq_rel))
+            return false;
+
+        if (expected == nullptr && desired != nullptr)
+            leaf->Used.fetch_add(1, std::memory_order_relaxed);
+        else if (expected != nullptr && desired == nullptr)
+            leaf->Used.fetch_sub(1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+} // Native
+} // nDiscUtils
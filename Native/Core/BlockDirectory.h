@@ -0,0 +1,190 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Two-level block index: a root table of leaf pointers where every leaf
+    // holds the slots of LeafEntries consecutive blocks. Leaves are only
+    // allocated once a slot inside of them is materialized, so the index
+    // grows with the written data instead of the capacity.
+    //
+    // Leaves may be shared between directories of the same geometry, which
+    // makes copying a directory cost a pass over the root table only. A
+    // shared leaf is read-only and has to be unshared before any slot of
+    // it is modified.
+    //
+    // Get() and CompareExchange() may be called concurrently; Set(),
+    // Unshare(), Release() and ForEach() require that nobody else accesses
+    // the affected leaf.
+    class BlockDirectory
+    {
+
+    public:
+        static constexpr size_t LeafShift = 9;
+        static constexpr size_t LeafEntries = (size_t)1 << LeafShift;
+        static constexpr size_t LeafMask = LeafEntries - 1;
+
+        explicit BlockDirectory(size_t blockCount);
+
+        ~BlockDirectory();
+
+        BlockDirectory(const BlockDirectory&) = delete;
+        BlockDirectory& operator=(const BlockDirectory&) = delete;
+
+        size_t BlockCount() const
+        {
+            return mBlockCount;
+        }
+
+        size_t RootCount() const
+        {
+            return mRootCount;
+        }
+
+        size_t LeafCount() const
+        {
+            return mLeafCount.load(std::memory_order_relaxed);
+        }
+
+        // Memory held by the root table and all allocated leaves
+        size_t IndexBytes() const
+        {
+            return mRootCount * sizeof(Leaf*) + LeafCount() * sizeof(Leaf);
+        }
+
+        // Returns nullptr for slots whose leaf was never allocated
+        void* Get(size_t index) const
+        {
+            auto leaf = mRoot[index >> LeafShift].load(std::memory_order_acquire);
+            return leaf != nullptr ? leaf->Slots[index & LeafMask].load(std::memory_order_acquire) : nullptr;
+        }
+
+        // Allocates the leaf of the slot when storing a value and releases
+        // it again once its last slot is cleared; the leaf must not be shared
+        void Set(size_t index, void* value);
+
+        // Stores desired if the slot still holds expected, otherwise returns
+        // false with expected updated to the current value. Leaves are
+        // allocated as needed but never released.
+        bool CompareExchange(size_t index, void*& expected, void* desired);
+
+        bool IsShared(size_t index) const
+        {
+            auto leaf = mRoot[index >> LeafShift].load(std::memory_order_acquire);
+            return leaf != nullptr && leaf->Owners.load(std::memory_order_acquire) > 1;
+        }
+
+        // Shares all leaves of source, which needs the same block count;
+        // the directory has to be empty
+        void ShareFrom(const BlockDirectory& source);
+
+        // Gives the slot's leaf a private copy if it is shared, invoking
+        // fn(value) for every slot the copy adds another reference to
+        template <typename TCallback>
+        void Unshare(size_t index, TCallback fn)
+        {
+            auto root = index >> LeafShift;
+            auto leaf = mRoot[root].load(std::memory_order_acquire);
+            if (leaf == nullptr || leaf->Owners.load(std::memory_order_acquire) == 1)
+                return;
+
+            auto copy = CopyLeaf(leaf);
+            for (size_t entry = 0; entry < LeafEntries; entry++)
+            {
+                auto value = copy->Slots[entry].load(std::memory_order_relaxed);
+                if (value != nullptr)
+                    fn(value);
+            }
+
+            mRoot[root].store(copy, std::memory_order_release);
+            leaf->Owners.fetch_sub(1, std::memory_order_acq_rel);
+        }
+
+        // Detaches the leaf at the given root index; if this was its last
+        // owner fn(index, value) is invoked for every non-empty slot before
+        // the leaf is freed
+        template <typename TCallback>
+        void Release(size_t root, TCallback fn)
+        {
+            auto leaf = mRoot[root].load(std::memory_order_acquire);
+            if (leaf == nullptr)
+                return;
+
+            mRoot[root].store(nullptr, std::memory_order_release);
+            mLeafCount.fetch_sub(1, std::memory_order_relaxed);
+
+            if (leaf->Owners.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+
+            for (size_t entry = 0; entry < LeafEntries; entry++)
+            {
+                auto value = leaf->Slots[entry].load(std::memory_order_relaxed);
+                if (value != nullptr)
+                    fn((root << LeafShift) | entry, value);
+            }
+
+            std::free(leaf);
+        }
+
+        // Invokes fn(index, value) for every non-empty slot
+        template <typename TCallback>
+        void ForEach(TCallback fn) const
+        {
+            for (size_t root = 0; root < mRootCount; root++)
+            {
+                auto leaf = mRoot[root].load(std::memory_order_acquire);
+                if (leaf == nullptr)
+                    continue;
+
+                for (size_t entry = 0; entry < LeafEntries; entry++)
+                {
+                    auto value = leaf->Slots[entry].load(std::memory_order_relaxed);
+                    if (value != nullptr)
+                        fn((root << LeafShift) | entry, value);
+                }
+            }
+        }
+
+    private:
+        struct Leaf
+        {
+            std::atomic<size_t> Owners;
+            std::atomic<size_t> Used;
+            std::atomic<void*> Slots[LeafEntries];
+        };
+
+        Leaf* AcquireLeaf(size_t root);
+
+        Leaf* CopyLeaf(const Leaf* leaf);
+
+        size_t mBlockCount;
+        size_t mRootCount;
+        std::atomic<size_t> mLeafCount;
+        std::atomic<Leaf*>* mRoot;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,406 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "CompareEngine.h"
+#include "AlignedBuffer.h"
+#include "MemoryKernels.h"
+#include "NativeException.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        // Differences of one chunk. Only the first MaxRanges ranges are kept,
+        // the first and last one are needed to join ranges across chunks.
+        struct ChunkDifferences
+        {
+            uint64_t DifferingBytes = 0;
+            uint64_t Count = 0;
+            std::vector<ByteRange> Ranges;
+            ByteRange First { 0, 0 };
+            ByteRange Last { 0, 0 };
+        };
+
+        void FindDifferences(const unsigned char* left, const unsigned char* right, size_t count, uint64_t offset,
+            const CompareEngineOptions& options, ChunkDifferences& differences)
+        {
+            auto i = (size_t)0;
+
+            while (i < count)
+            {
+                i += MemoryKernels::FindMismatch(left + i, right + i, count - i);
+                if (i >= count)
+                    break;
+
+                // Differing data is walked bytewise until MergeGap equal bytes
+                // follow the last difference, then the kernel takes over again
+                auto start = i;
+                auto last = i;
+                differences.DifferingBytes++;
+
+                for (i++; i < count && i - last <= options.MergeGap + 1; i++)
+                {
+                    if (left[i] != right[i])
+                    {
+                        last = i;
+                        differences.DifferingBytes++;
+                    }
+                }
+
+                ByteRange range { offset + start, (uint64_t)(last - start + 1) };
+                if (differences.Count == 0)
+                    differences.First = range;
+
+                differences.Last = range;
+                differences.Count++;
+
+                if (differences.Ranges.size() < options.MaxRanges)
+                    differences.Ranges.push_back(range);
+            }
+        }
+
+        // Appends the differences of consecutive chunks to a result
+        class RangeMerger
+        {
+
+        public:
+            RangeMerger(const CompareEngineOptions& options, CompareResult& result) :
+                mOptions(options),
+                mResult(result),
+                mHasLast(false),
+                mLastListed(false),
+                mLast { 0, 0 } { }
+
+            void Add(const ChunkDifferences& differences)
+            {
+                mResult.DifferingBytes += differences.DifferingBytes;
+                if (differences.Count == 0)
+                    return;
+
+                auto joined = mHasLast &&
+                    differences.First.Offset - (mLast.Offset + mLast.Length) <= mOptions.MergeGap;
+                mResult.DifferingRanges += differences.Count - (joined ? 1 : 0);
+
+                auto index = (size_t)0;
+                if (joined)
+                {
+                    mLast.Length = differences.First.Offset + differences.First.Length - mLast.Offset;
+                    if (mLastListed)
+                        mResult.Ranges.back() = mLast;
+
+                    if (differences.Count == 1)
+                        return;
+
+                    index = 1;
+                }
+
+                for (; index < differences.Ranges.size() && mResult.Ranges.size() < mOptions.MaxRanges; index++)
+                    mResult.Ranges.push_back(differences.Ranges[index]);
+
+                mLast = differences.Last;
+                mHasLast = true;
+                mLastListed = (index == differences.Count);
+            }
+
+        private:
+            const CompareEngineOptions& mOptions;
+            CompareResult& mResult;
+
+            bool mHasLast;
+            bool mLastListed;
+            ByteRange mLast;
+
+        };
+
+        // Buffers of both sides for the chunk currently assigned to them
+        struct Slot
+        {
+            explicit Slot(size_t bytes) :
+                Left(bytes),
+                Right(bytes) { }
+
+            AlignedBuffer Left;
+            AlignedBuffer Right;
+
+            // Where the data of each side is, its buffer or memory of the source
+            SourceView LeftView;
+            SourceView RightView;
+
+            uint64_t Chunk = 0;
+
+            // Sides which did not finish reading the chunk yet
+            int Pending = 2;
+        };
+
+        // Reads a whole request into buffer unless the source can expose it
+        // in place; view points to the data afterwards. Returns false and
+        // records the failure if the source fails or ends early.
+        bool ReadChunk(ReadSource& source, CompareSide side, uint64_t offset, unsigned char* buffer, size_t count,
+            SourceView& view, CompareResult& failure)
+        {
+            size_t read;
+
+            try
+            {
+                if (source.View(offset, count, view))
+                    return true;
+
+                view.Data = buffer;
+                read = source.Read(offset, buffer, count);
+            }
+            catch (const NativeException& ex)
+            {
+                failure.FailedSide = side;
+                failure.FailedOffset = offset;
+                failure.Failure = ex.what();
+                return false;
+            }
+
+            if (read < count)
+            {
+                failure.FailedSide = side;
+                failure.FailedOffset = offset + read;
+                failure.Failure = "Data ends after " + std::to_string(offset + read) + " bytes";
+                return false;
+            }
+
+            return true;
+        }
+
+    } // namespace
+
+    CompareEngine::CompareEngine(const CompareEngineOptions& options) :
+        mOptions(options)
+    {
+        if (options.ChunkBytes == 0 || options.Depth == 0)
+            throw NativeException(NativeError::InvalidArgument, "Chunk size and depth of a comparison may not be zero");
+    }
+
+    CompareResult CompareEngine::Compare(ReadSource& left, ReadSource& right, uint64_t length) const
+    {
+        CompareResult result;
+        RangeMerger merger(mOptions, result);
+
+        if (length == 0)
+            return result;
+
+        auto chunkBytes = (uint64_t)mOptions.ChunkBytes;
+        auto chunks = (length + chunkBytes - 1) / chunkBytes;
+        auto chunkLength = [&](uint64_t chunk)
+        {
+            return (size_t)std::min(chunkBytes, length - chunk * chunkBytes);
+        };
+
+        // A single chunk is not worth any threads
+        if (chunks == 1)
+        {
+            Slot slot((size_t)length);
+            if (!ReadChunk(left, CompareSide::Left, 0, slot.Left.Data(), (size_t)length, slot.LeftView, result) ||
+                !ReadChunk(right, CompareSide::Right, 0, slot.Right.Data(), (size_t)length, slot.RightView, result))
+                return result;
+
+            ChunkDifferences differences;
+            FindDifferences(slot.LeftView.Data, slot.RightView.Data, (size_t)length, 0, mOptions, differences);
+            merger.Add(differences);
+
+            result.ComparedBytes = length;
+            return result;
+        }
+
+        auto depth = (size_t)std::min<uint64_t>(mOptions.Depth, chunks);
+        auto threads = (size_t)(mOptions.Threads != 0 ? mOptions.Threads : std::thread::hardware_concurrency());
+        threads = std::max<size_t>(std::min(threads, depth), 1);
+
+        std::vector<std::unique_ptr<Slot>> slots;
+        for (size_t i = 0; i < depth; i++)
+        {
+            slots.emplace_back(new Slot(mOptions.ChunkBytes));
+            slots.back()->Chunk = i;
+        }
+
+        std::mutex lock;
+        std::condition_variable readable;
+        std::condition_variable comparable;
+        std::deque<Slot*> filled;
+
+        // Compared chunks wait here until all chunks before them are merged
+        std::map<uint64_t, ChunkDifferences> compared;
+        uint64_t merged = 0;
+
+        bool stopped = false;
+        std::exception_ptr error;
+
+        // Called with the lock held
+        auto stop = [&](std::exception_ptr exception)
+        {
+            if (exception && !error)
+                error = exception;
+
+            stopped = true;
+            readable.notify_all();
+            comparable.notify_all();
+        };
+
+        auto reader = [&](ReadSource& source, CompareSide side)
+        {
+            try
+            {
+                for (uint64_t chunk = 0; chunk < chunks; chunk++)
+                {
+                    auto& slot = *slots[(size_t)(chunk % depth)];
+
+                    {
+                        std::unique_lock<std::mutex> guard(lock);
+                        readable.wait(guard, [&]() { return stopped || slot.Chunk == chunk; });
+                        if (stopped)
+                            return;
+                    }
+
+                    auto buffer = (side == CompareSide::Left ? slot.Left : slot.Right).Data();
+                    auto& view = (side == CompareSide::Left ? slot.LeftView : slot.RightView);
+                    CompareResult failure;
+                    auto read = ReadChunk(source, side, chunk * chunkBytes, buffer, chunkLength(chunk), view, failure);
+
+                    std::lock_guard<std::mutex> guard(lock);
+                    if (!read)
+                    {
+                        // Keep the failure closest to the start
+                        if (result.FailedSide == CompareSide::None || failure.FailedOffset < result.FailedOffset)
+                        {
+                            result.FailedSide = failure.FailedSide;
+                            result.FailedOffset = failure.FailedOffset;
+                            result.Failure = failure.Failure;
+                        }
+
+                        stop(nullptr);
+                        return;
+                    }
+
+                    if (--slot.Pending == 0)
+                    {
+                        filled.push_back(&slot);
+                        comparable.notify_one();
+                    }
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stop(std::current_exception());
+            }
+        };
+
+        auto worker = [&]()
+        {
+            try
+            {
+                for (;;)
+                {
+                    Slot* slot;
+
+                    {
+                        std::unique_lock<std::mutex> guard(lock);
+                        comparable.wait(guard, [&]() { return stopped || !filled.empty() || merged == chunks; });
+                        if (stopped || filled.empty())
+                            return;
+
+                        slot = filled.front();
+                        filled.pop_front();
+                    }
+
+                    auto count = chunkLength(slot->Chunk);
+                    ChunkDifferences differences;
+                    FindDifferences(slot->LeftView.Data, slot->RightView.Data, count, slot->Chunk * chunkBytes,
+                        mOptions, differences);
+                    slot->LeftView = SourceView();
+                    slot->RightView = SourceView();
+
+                    std::lock_guard<std::mutex> guard(lock);
+                    compared.emplace(slot->Chunk, std::move(differences));
+
+                    while (!compared.empty() && compared.begin()->first == merged)
+                    {
+                        merger.Add(compared.begin()->second);
+                        result.ComparedBytes += chunkLength(merged);
+
+                        compared.erase(compared.begin());
+                        merged++;
+                    }
+
+                    // Hand the buffers to the chunk depth positions ahead
+                    slot->Chunk += depth;
+                    slot->Pending = 2;
+                    readable.notify_all();
+
+                    if (merged == chunks)
+                        comparable.notify_all();
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stop(std::current_exception());
+            }
+        };
+
+        std::vector<std::thread> pool;
+        try
+        {
+            pool.emplace_back(reader, std::ref(left), CompareSide::Left);
+            pool.emplace_back(reader, std::ref(right), CompareSide::Right);
+
+            for (size_t i = 1; i < threads; i++)
+                pool.emplace_back(worker);
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stop(nullptr);
+            }
+
+            for (auto& thread : pool)
+                thread.join();
+
+            throw;
+        }
+
+        // The calling thread compares as well
+        worker();
+
+        for (auto& thread : pool)
+            thread.join();
+
+        if (error)
+            std::rethrow_exception(error);
+
+        return result;
+    }
+
+} // Native
+} // nDiscUtils
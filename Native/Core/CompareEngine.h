@@ -0,0 +1,107 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "ReadSource.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nDiscUtils {
+namespace Native {
+
+    enum class CompareSide
+    {
+        None,
+        Left,
+        Right
+    };
+
+    // Differing bytes at [Offset, Offset + Length), which may include up to
+    // MergeGap equal bytes between two differences
+    struct ByteRange
+    {
+        uint64_t Offset;
+        uint64_t Length;
+    };
+
+    struct CompareEngineOptions
+    {
+        // Bytes read from each side per request
+        size_t ChunkBytes = 1u << 20;
+
+        // Chunks which are read or compared at the same time
+        size_t Depth = 4;
+
+        // Threads comparing chunks, zero for one per core
+        size_t Threads = 0;
+
+        // Differences separated by at most this many equal bytes are
+        // reported as one range
+        size_t MergeGap = 16;
+
+        // Ranges listed in the result; any further ones are only counted
+        size_t MaxRanges = 4096;
+    };
+
+    struct CompareResult
+    {
+        // Leading bytes which were compared before the end or a failure
+        uint64_t ComparedBytes = 0;
+
+        uint64_t DifferingBytes = 0;
+        uint64_t DifferingRanges = 0;
+
+        // First MaxRanges differing ranges in ascending order
+        std::vector<ByteRange> Ranges;
+
+        // Side which failed to read or ended early, the offset of the
+        // failed request and the reason
+        CompareSide FailedSide = CompareSide::None;
+        uint64_t FailedOffset = 0;
+        std::string Failure;
+    };
+
+    // Compares two sources chunk by chunk. Each side is read on its own
+    // thread into Depth buffers, so both devices are busy at the same time,
+    // while filled chunks are compared in parallel with the vectorized
+    // mismatch kernel.
+    class CompareEngine
+    {
+
+    public:
+        explicit CompareEngine(const CompareEngineOptions& options = CompareEngineOptions());
+
+        const CompareEngineOptions& Options() const
+        {
+            return mOptions;
+        }
+
+        // Compares the first length bytes of both sources
+        CompareResult Compare(ReadSource& left, ReadSource& right, uint64_t length) const;
+
+    private:
+        CompareEngineOptions mOptions;
+
+    };
+
+} // Native
+} // nDiscUtils
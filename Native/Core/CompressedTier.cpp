@@ -0,0 +1,636 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "CompressedTier.h"
+#include "LzCodec.h"
+#include "NativeException.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <string>
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        // Bytes the worker spills at once
+        const size_t SpillBatchBytes = (size_t)4 << 20;
+
+        // Pause after a batch could not be written
+        const auto SpillRetryDelay = std::chrono::seconds(1);
+
+    } // namespace
+
+    CompressedTier::CompressedTier(size_t blockSize, size_t hotLimit, uint32_t coldAfter, BlockArena* arena,
+        size_t budget, const std::string& spillPath) :
+        mBlockSize(blockSize),
+        mHotLimit(hotLimit),
+        mColdAfter(coldAfter),
+        mArena(arena),
+        mHand(0),
+        mBuffer(blockSize),
+        mColdHand(0),
+        mColdRawBlocks(0),
+        mPackedBlocks(0),
+        mPackedBytes(0),
+        mHits(0),
+        mMisses(0),
+        mBudget(budget),
+        mProvider(PageProvider::Default()),
+        mStaging(nullptr),
+        mStagingBlocks(std::max<size_t>(SpillBatchBytes / blockSize, 1)),
+        mReadBuffer(nullptr),
+        mSpilledBlocks(0),
+        mEvictions(0),
+        mSpillReads(0),
+        mSpillFailures(0),
+        mEpoch(std::chrono::steady_clock::now()),
+        mStopping(false)
+    {
+        if (mBudget != 0)
+        {
+            if (spillPath.empty())
+                throw NativeException(NativeError::InvalidArgument, "Memory budget requires a spill file");
+
+            mSpill.reset(new SpillFile(spillPath, mBlockSize));
+
+            // Both buffers take part in unbuffered I/O and have to be aligned
+            mStaging = (unsigned char*)mProvider->Allocate(mStagingBlocks * mBlockSize);
+            mReadBuffer = (unsigned char*)mProvider->Allocate(mBlockSize);
+            if (mStaging == nullptr || mReadBuffer == nullptr)
+            {
+                if (mStaging != nullptr)
+                    mProvider->Release(mStaging, mStagingBlocks * mBlockSize);
+
+                if (mReadBuffer != nullptr)
+                    mProvider->Release(mReadBuffer, mBlockSize);
+
+                throw NativeException(NativeError::OutOfMemory, "Failed to allocate the spill buffers");
+            }
+
+            mSpilling.reserve(mStagingBlocks);
+            mTrimBatch.reserve(mStagingBlocks);
+        }
+
+        if (mColdAfter != 0 || mSpill != nullptr)
+            mWorker = std::thread(&CompressedTier::Run, this);
+    }
+
+    CompressedTier::~CompressedTier()
+    {
+        Stop();
+
+        if (mStaging != nullptr)
+            mProvider->Release(mStaging, mStagingBlocks * mBlockSize);
+
+        if (mReadBuffer != nullptr)
+            mProvider->Release(mReadBuffer, mBlockSize);
+    }
+
+    void CompressedTier::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+
+        mWakeup.notify_all();
+
+        if (mWorker.joinable())
+            mWorker.join();
+    }
+
+    uint32_t CompressedTier::Tick() const
+    {
+        auto elapsed = std::chrono::steady_clock::now() - mEpoch;
+        return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+    }
+
+    void CompressedTier::Attach(Block* block)
+    {
+        Insert(block);
+    }
+
+    void CompressedTier::Detach(Block* block)
+    {
+        if ((block->Flags & Block::Spilling) != 0)
+        {
+            // The batch in flight releases the slot once it completes
+            for (auto& entry : mSpilling)
+            {
+                if (entry.Target == block)
+                    entry.Target = nullptr;
+            }
+
+            block->Flags &= ~Block::Spilling;
+        }
+
+        if ((block->Flags & Block::Hot) != 0)
+            Remove(block);
+        else if ((block->Flags & Block::Cold) != 0)
+            RemoveCold(block);
+
+        if (block->Packed != nullptr)
+        {
+            mPackedBlocks--;
+            mPackedBytes -= block->PackedSize;
+
+            delete[] block->Packed;
+            block->Packed = nullptr;
+            block->PackedSize = 0;
+        }
+
+        if ((block->Flags & Block::Spilled) != 0)
+        {
+            mSpill->Release(block->SpillSlot);
+            mSpilledBlocks--;
+
+            block->Flags &= ~Block::Spilled;
+            block->PackedSize = 0;
+        }
+    }
+
+    void CompressedTier::Load(Block* block, bool modify)
+    {
+        // Mapped blocks are not tracked, they are copied before any change
+        if ((block->Flags & Block::Mapped) != 0)
+            return;
+
+        if (block->Data != nullptr)
+        {
+            mHits++;
+
+            // A copy being spilled is outdated by the modification
+            if (modify)
+                block->Flags &= ~Block::Spilling;
+
+            if ((block->Flags & Block::Hot) != 0)
+            {
+                block->Flags |= Block::Accessed;
+                block->Touched = Tick();
+            }
+            else if (modify)
+            {
+                // New contents may compress better than the old ones did
+                RemoveCold(block);
+                block->Flags &= ~Block::Incompressible;
+                Insert(block);
+            }
+
+            return;
+        }
+
+        mMisses++;
+
+        auto data = (unsigned char*)mArena->Allocate(block->Node);
+        if (data == nullptr)
+            throw NativeException(NativeError::OutOfMemory,
+                "Failed to allocate " + std::to_string(mBlockSize) + " bytes of memory");
+
+        if ((block->Flags & Block::Spilled) != 0)
+        {
+            try
+            {
+                if (block->PackedSize == 0)
+                {
+                    mSpill->Read(block->SpillSlot, data, mBlockSize);
+                }
+                else
+                {
+                    ReadSpilled(block);
+                    if (!LzCodec::Decompress(mReadBuffer, block->PackedSize, data, mBlockSize))
+                        throw NativeException(NativeError::IO, "Spilled block is corrupted");
+                }
+            }
+            catch (...)
+            {
+                mArena->Release(data, block->Node);
+                throw;
+            }
+
+            mSpillReads++;
+            mSpill->Release(block->SpillSlot);
+            mSpilledBlocks--;
+
+            block->Flags &= ~Block::Spilled;
+            block->PackedSize = 0;
+            block->Data = data;
+
+            Insert(block);
+            return;
+        }
+
+        if (!LzCodec::Decompress(block->Packed, block->PackedSize, data, mBlockSize))
+        {
+            mArena->Release(data, block->Node);
+            throw NativeException(NativeError::IO, "Compressed block is corrupted");
+        }
+
+        RemoveCold(block);
+        block->Flags &= ~Block::Spilling;
+
+        mPackedBlocks--;
+        mPackedBytes -= block->PackedSize;
+
+        delete[] block->Packed;
+        block->Packed = nullptr;
+        block->PackedSize = 0;
+        block->Data = data;
+
+        Insert(block);
+    }
+
+    bool CompressedTier::Equals(const Block* block, const unsigned char* data)
+    {
+        if (block->Data != nullptr)
+            return std::memcmp(block->Data, data, mBlockSize) == 0;
+
+        const unsigned char* packed = block->Packed;
+        if ((block->Flags & Block::Spilled) != 0)
+        {
+            ReadSpilled(block);
+            if (block->PackedSize == 0)
+                return std::memcmp(mReadBuffer, data, mBlockSize) == 0;
+
+            packed = mReadBuffer;
+        }
+
+        if (!LzCodec::Decompress(packed, block->PackedSize, mBuffer.data(), mBlockSize))
+            return false;
+
+        return std::memcmp(mBuffer.data(), data, mBlockSize) == 0;
+    }
+
+    void CompressedTier::Trim()
+    {
+        if (mHotLimit != 0)
+        {
+            // Two rounds are enough to clear every reference bit; stop there
+            // if nothing could be packed at all
+            auto steps = 2 * mHot.size() + 1;
+
+            while (mHot.size() > mHotLimit && steps-- > 0)
+            {
+                if (mHand >= mHot.size())
+                    mHand = 0;
+
+                auto block = mHot[mHand];
+                if ((block->Flags & Block::Accessed) != 0)
+                {
+                    block->Flags &= ~Block::Accessed;
+                    mHand++;
+                }
+                else if (!Pack(block))
+                {
+                    mHand++;
+                }
+            }
+        }
+
+        if (!OverBudget())
+            return;
+
+        // Left to the worker unless it cannot keep up with the requests
+        if (ResidentBytes() <= mBudget + mBudget / 8)
+        {
+            mWakeup.notify_one();
+            return;
+        }
+
+        while (ResidentBytes() > mBudget && SpillNow())
+        {
+        }
+    }
+
+    void CompressedTier::Insert(Block* block)
+    {
+        block->HotSlot = (uint32_t)mHot.size();
+        mHot.push_back(block);
+
+        block->Flags |= Block::Hot | Block::Accessed;
+        block->Touched = Tick();
+    }
+
+    void CompressedTier::Remove(Block* block)
+    {
+        auto last = mHot.back();
+
+        mHot[block->HotSlot] = last;
+        last->HotSlot = block->HotSlot;
+        mHot.pop_back();
+
+        block->Flags &= ~(Block::Hot | Block::Accessed);
+    }
+
+    void CompressedTier::InsertCold(Block* block)
+    {
+        block->HotSlot = (uint32_t)mCold.size();
+        mCold.push_back(block);
+
+        block->Flags |= Block::Cold;
+        if (block->Data != nullptr)
+            mColdRawBlocks++;
+    }
+
+    void CompressedTier::RemoveCold(Block* block)
+    {
+        auto last = mCold.back();
+
+        mCold[block->HotSlot] = last;
+        last->HotSlot = block->HotSlot;
+        mCold.pop_back();
+
+        block->Flags &= ~Block::Cold;
+        if (block->Data != nullptr)
+            mColdRawBlocks--;
+    }
+
+    bool CompressedTier::Pack(Block* block)
+    {
+        // Blocks being spilled stay as they are until the batch completes
+        if ((block->Flags & Block::Spilling) != 0)
+            return false;
+
+        // Packing has to save at least an eighth of the block to be worth
+        // the decompression on the next access
+        auto size = LzCodec::Compress(block->Data, mBlockSize, mBuffer.data(), mBlockSize - mBlockSize / 8);
+        if (size == 0)
+        {
+            Remove(block);
+            block->Flags |= Block::Incompressible;
+            InsertCold(block);
+            return true;
+        }
+
+        auto packed = new (std::nothrow) unsigned char[size];
+        if (packed == nullptr)
+            return false;
+
+        std::memcpy(packed, mBuffer.data(), size);
+        mArena->Release(block->Data, block->Node);
+
+        block->Data = nullptr;
+        block->Packed = packed;
+        block->PackedSize = (uint32_t)size;
+
+        mPackedBlocks++;
+        mPackedBytes += size;
+
+        Remove(block);
+        InsertCold(block);
+        return true;
+    }
+
+    void CompressedTier::ReadSpilled(const Block* block)
+    {
+        auto granularity = mProvider->Granularity();
+        auto size = block->PackedSize == 0 ? mBlockSize :
+            (block->PackedSize + granularity - 1) / granularity * granularity;
+
+        mSpill->Read(block->SpillSlot, mReadBuffer, size);
+    }
+
+    bool CompressedTier::OverBudget() const
+    {
+        return mSpill != nullptr && ResidentBytes() > mBudget && std::chrono::steady_clock::now() >= mRetryAt;
+    }
+
+    void CompressedTier::SelectVictims(size_t count, std::vector<SpillEntry>& entries)
+    {
+        entries.clear();
+
+        // Selection ends early once the spill file runs out of slots
+        auto add = [&](Block* block, bool packed)
+        {
+            try
+            {
+                entries.push_back({ block, mSpill->Allocate(), packed });
+            }
+            catch (const NativeException&)
+            {
+                return false;
+            }
+
+            block->Flags |= Block::Spilling;
+            return true;
+        };
+
+        // Blocks which already left the hot set go first
+        for (auto steps = mCold.size(); entries.size() < count && steps > 0; steps--)
+        {
+            if (mColdHand >= mCold.size())
+                mColdHand = 0;
+
+            auto block = mCold[mColdHand++];
+            if ((block->Flags & Block::Spilling) == 0 && !add(block, block->Packed != nullptr))
+                return;
+        }
+
+        for (auto steps = 2 * mHot.size() + 1; entries.size() < count && steps > 0 && !mHot.empty(); steps--)
+        {
+            if (mHand >= mHot.size())
+                mHand = 0;
+
+            auto block = mHot[mHand++];
+            if ((block->Flags & Block::Spilling) != 0)
+                continue;
+
+            if ((block->Flags & Block::Accessed) != 0)
+                block->Flags &= ~Block::Accessed;
+            else if (!add(block, false))
+                return;
+        }
+    }
+
+    bool CompressedTier::SpillBatch(std::unique_lock<std::mutex>& lock)
+    {
+        SelectVictims(mStagingBlocks, mSpilling);
+        if (mSpilling.empty())
+            return false;
+
+        for (size_t index = 0; index < mSpilling.size(); index++)
+        {
+            auto& entry = mSpilling[index];
+            if (entry.Packed)
+                std::memcpy(mStaging + index * mBlockSize, entry.Target->Packed, entry.Target->PackedSize);
+            else
+                std::memcpy(mStaging + index * mBlockSize, entry.Target->Data, mBlockSize);
+        }
+
+        lock.unlock();
+
+        // Entries with adjacent slots are written at once
+        auto written = true;
+        try
+        {
+            size_t first = 0;
+            while (first < mSpilling.size())
+            {
+                auto last = first + 1;
+                while (last < mSpilling.size() && mSpilling[last].Slot == mSpilling[last - 1].Slot + 1)
+                    last++;
+
+                mSpill->Write(mSpilling[first].Slot, mStaging + first * mBlockSize, (last - first) * mBlockSize);
+                first = last;
+            }
+        }
+        catch (const NativeException&)
+        {
+            written = false;
+        }
+
+        lock.lock();
+
+        FinishBatch(mSpilling, written);
+        return written;
+    }
+
+    bool CompressedTier::SpillNow()
+    {
+        SelectVictims(mStagingBlocks, mTrimBatch);
+        if (mTrimBatch.empty())
+            return false;
+
+        auto written = true;
+        try
+        {
+            auto granularity = mProvider->Granularity();
+            for (auto& entry : mTrimBatch)
+            {
+                if (!entry.Packed)
+                {
+                    mSpill->Write(entry.Slot, entry.Target->Data, mBlockSize);
+                    continue;
+                }
+
+                auto size = (entry.Target->PackedSize + granularity - 1) / granularity * granularity;
+                std::memcpy(mReadBuffer, entry.Target->Packed, entry.Target->PackedSize);
+                mSpill->Write(entry.Slot, mReadBuffer, size);
+            }
+        }
+        catch (const NativeException&)
+        {
+            written = false;
+        }
+
+        FinishBatch(mTrimBatch, written);
+        return written;
+    }
+
+    void CompressedTier::FinishBatch(std::vector<SpillEntry>& entries, bool written)
+    {
+        if (!written)
+        {
+            mSpillFailures++;
+            mRetryAt = std::chrono::steady_clock::now() + SpillRetryDelay;
+        }
+
+        for (auto& entry : entries)
+        {
+            auto block = entry.Target;
+            auto evict = block != nullptr && written && (block->Flags & Block::Spilling) != 0;
+
+            // Blocks read while their batch was written stay in memory
+            if (evict && (block->Flags & Block::Hot) != 0 && (block->Flags & Block::Accessed) != 0)
+                evict = false;
+
+            if (block != nullptr)
+                block->Flags &= ~Block::Spilling;
+
+            if (!evict)
+            {
+                mSpill->Release(entry.Slot);
+                continue;
+            }
+
+            if ((block->Flags & Block::Hot) != 0)
+                Remove(block);
+            else
+                RemoveCold(block);
+
+            if (entry.Packed)
+            {
+                mPackedBlocks--;
+                mPackedBytes -= block->PackedSize;
+
+                delete[] block->Packed;
+                block->Packed = nullptr;
+            }
+            else
+            {
+                mArena->Release(block->Data, block->Node);
+                block->Data = nullptr;
+                block->PackedSize = 0;
+            }
+
+            block->Flags |= Block::Spilled;
+            block->SpillSlot = entry.Slot;
+
+            mSpilledBlocks++;
+            mEvictions++;
+        }
+
+        entries.clear();
+    }
+
+    void CompressedTier::Run()
+    {
+        auto period = std::chrono::milliseconds(mColdAfter != 0 ? std::max<uint32_t>(mColdAfter / 4, 10) : 1000);
+        std::unique_lock<std::mutex> lock(mMutex);
+
+        while (!mStopping)
+        {
+            mWakeup.wait_for(lock, period, [this]() { return mStopping || OverBudget(); });
+
+            // Spill down to seven eighths of the budget, so the worker is not
+            // woken for every block written afterwards
+            if (OverBudget())
+            {
+                while (!mStopping && ResidentBytes() > mBudget - mBudget / 8 && SpillBatch(lock))
+                {
+                }
+            }
+
+            if (mColdAfter == 0)
+                continue;
+
+            auto now = Tick();
+            auto index = (size_t)0;
+            auto visited = (size_t)0;
+
+            while (!mStopping && index < mHot.size())
+            {
+                auto block = mHot[index];
+                if ((uint32_t)(now - block->Touched) < mColdAfter || !Pack(block))
+                    index++;
+
+                // Let pending I/O in between batches
+                if (++visited % 64 == 0)
+                {
+                    lock.unlock();
+                    std::this_thread::yield();
+                    lock.lock();
+                }
+            }
+        }
+    }
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,233 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Block.h"
+#include "BlockArena.h"
+#include "SpillFile.h"
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Keeps a bounded set of recently used blocks uncompressed and packs
+    // the remaining ones with LzCodec. Hot blocks are chosen by a CLOCK
+    // sweep over the hot set; a background worker additionally packs all
+    // blocks which were not accessed for the configured interval.
+    //
+    // With a memory budget, blocks are spilled to a scratch file once the
+    // resident blocks, packed or not, exceed it. The worker evicts blocks
+    // which left the hot set first and then the coldest hot ones, copying
+    // a batch of them aside and writing it without holding the mutex.
+    // Requests which find the budget exceeded by more than an eighth spill
+    // a batch right away. Spilled blocks are read back on their next access.
+    //
+    // All members except the constructor and destructor have to be called
+    // with Mutex() held.
+    class CompressedTier
+    {
+
+    public:
+        // hotLimit is given in blocks, coldAfter in milliseconds; zero
+        // disables the respective policy. A non-zero budget requires a
+        // spill file path.
+        CompressedTier(size_t blockSize, size_t hotLimit, uint32_t coldAfter, BlockArena* arena,
+            size_t budget = 0, const std::string& spillPath = std::string());
+
+        ~CompressedTier();
+
+        CompressedTier(const CompressedTier&) = delete;
+        CompressedTier& operator=(const CompressedTier&) = delete;
+
+        std::mutex& Mutex()
+        {
+            return mMutex;
+        }
+
+        size_t HotBlocks() const
+        {
+            return mHot.size();
+        }
+
+        size_t PackedBlocks() const
+        {
+            return mPackedBlocks;
+        }
+
+        size_t PackedBytes() const
+        {
+            return mPackedBytes;
+        }
+
+        // Memory held by tracked blocks, uncompressed or packed
+        size_t ResidentBytes() const
+        {
+            return (mHot.size() + mColdRawBlocks) * mBlockSize + mPackedBytes;
+        }
+
+        size_t SpilledBlocks() const
+        {
+            return mSpilledBlocks;
+        }
+
+        // Blocks written to the spill file so far
+        uint64_t Evictions() const
+        {
+            return mEvictions;
+        }
+
+        // Blocks read back from the spill file so far
+        uint64_t SpillReads() const
+        {
+            return mSpillReads;
+        }
+
+        // Batches which could not be written to the spill file
+        uint64_t SpillFailures() const
+        {
+            return mSpillFailures;
+        }
+
+        uint64_t Hits() const
+        {
+            return mHits;
+        }
+
+        uint64_t Misses() const
+        {
+            return mMisses;
+        }
+
+        // Starts to track a freshly allocated, uncompressed block
+        void Attach(Block* block);
+
+        // Stops tracking a block before it is freed; releases its packed
+        // data and spill slot
+        void Detach(Block* block);
+
+        // Makes the data of the block available, unpacking or reading it
+        // back if needed. Blocks which are about to be modified rejoin the
+        // hot set.
+        void Load(Block* block, bool modify);
+
+        // Compares the block's contents without moving it into the hot set
+        bool Equals(const Block* block, const unsigned char* data);
+
+        // Packs blocks until the hot set is within its limit again and
+        // spills blocks if the worker falls behind the memory budget
+        void Trim();
+
+        // Stops the background worker; has to be called without Mutex() held
+        void Stop();
+
+    private:
+        struct SpillEntry
+        {
+            Block* Target;
+            uint32_t Slot;
+            bool Packed;
+        };
+
+        uint32_t Tick() const;
+
+        void Insert(Block* block);
+
+        void Remove(Block* block);
+
+        void InsertCold(Block* block);
+
+        void RemoveCold(Block* block);
+
+        // Returns true if the block left the hot set
+        bool Pack(Block* block);
+
+        // Reads the spilled form of the block into mReadBuffer
+        void ReadSpilled(const Block* block);
+
+        bool OverBudget() const;
+
+        // Picks up to count blocks to spill, marks them Spilling and
+        // reserves their slots
+        void SelectVictims(size_t count, std::vector<SpillEntry>& entries);
+
+        // Copies the entries aside, writes them with the mutex released and
+        // completes the batch; returns false if nothing was written
+        bool SpillBatch(std::unique_lock<std::mutex>& lock);
+
+        // Writes a batch straight from the blocks while holding the mutex
+        bool SpillNow();
+
+        // Releases the memory of all entries which were neither modified
+        // nor accessed meanwhile; failed batches keep all blocks in memory
+        void FinishBatch(std::vector<SpillEntry>& entries, bool written);
+
+        void Run();
+
+        size_t mBlockSize;
+        size_t mHotLimit;
+        uint32_t mColdAfter;
+        BlockArena* mArena;
+
+        std::vector<Block*> mHot;
+        size_t mHand;
+        std::vector<unsigned char> mBuffer;
+
+        // Blocks which left the hot set: packed or incompressible ones
+        std::vector<Block*> mCold;
+        size_t mColdHand;
+        size_t mColdRawBlocks;
+
+        size_t mPackedBlocks;
+        size_t mPackedBytes;
+        uint64_t mHits;
+        uint64_t mMisses;
+
+        size_t mBudget;
+        std::unique_ptr<SpillFile> mSpill;
+        PageProvider* mProvider;
+        unsigned char* mStaging;
+        size_t mStagingBlocks;
+        unsigned char* mReadBuffer;
+        std::vector<SpillEntry> mSpilling;
+        std::vector<SpillEntry> mTrimBatch;
+        size_t mSpilledBlocks;
+        uint64_t mEvictions;
+        uint64_t mSpillReads;
+        uint64_t mSpillFailures;
+        std::chrono::steady_clock::time_point mRetryAt;
+
+        std::chrono::steady_clock::time_point mEpoch;
+        std::mutex mMutex;
+        std::condition_variable mWakeup;
+        std::thread mWorker;
+        bool mStopping;
+
+    };
+
+} // Native
+} // nDiscUtils
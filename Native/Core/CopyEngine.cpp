@@ -0,0 +1,523 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "CopyEngine.h"
+#include "AlignedBuffer.h"
+#include "MemoryKernels.h"
+#include "NativeException.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        using Clock = std::chrono::steady_clock;
+
+        double SecondsSince(Clock::time_point start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        // Buffer of the chunk currently assigned to it
+        struct Slot
+        {
+            explicit Slot(size_t bytes) :
+                Buffer(bytes) { }
+
+            AlignedBuffer Buffer;
+
+            uint64_t Chunk = 0;
+
+            // Bytes of the chunk which fell into holes of the source
+            size_t Unread = 0;
+        };
+
+        // Reads a whole request and measures it. Sparse reads only fetch the
+        // data extents of the source and zero-fill the holes in between.
+        // Returns false and records the failure if the source fails or ends
+        // early.
+        bool ReadChunk(ReadSource& source, uint64_t offset, unsigned char* buffer, size_t count, bool sparse,
+            double& seconds, size_t& unread, CopyResult& failure)
+        {
+            auto start = Clock::now();
+            auto end = offset + count;
+            auto position = offset;
+            unread = 0;
+
+            try
+            {
+                while (position < end)
+                {
+                    auto extent = (sparse ? source.NextData(position) : DataExtent { position, end - position });
+
+                    auto dataStart = end;
+                    auto dataEnd = end;
+                    if (extent.Length != 0 && extent.Offset < end)
+                    {
+                        dataStart = std::max(extent.Offset, position);
+                        dataEnd = std::min(extent.Offset + std::min(extent.Length, UINT64_MAX - extent.Offset), end);
+
+                        // Extents which do not end after the position are read anyway
+                        if (dataEnd <= dataStart)
+                            dataEnd = end;
+                    }
+
+                    if (dataStart > position)
+                    {
+                        MemoryKernels::Fill(buffer + (position - offset), 0, (size_t)(dataStart - position));
+                        unread += (size_t)(dataStart - position);
+                        position = dataStart;
+                    }
+
+                    if (dataEnd > dataStart)
+                    {
+                        auto request = (size_t)(dataEnd - dataStart);
+                        auto read = source.Read(dataStart, buffer + (dataStart - offset), request);
+                        if (read < request)
+                        {
+                            failure.FailedSide = CopySide::Source;
+                            failure.FailedOffset = dataStart + read;
+                            failure.Failure = "Data ends after " + std::to_string(dataStart + read) + " bytes";
+                            return false;
+                        }
+
+                        position = dataEnd;
+                    }
+                }
+            }
+            catch (const NativeException& ex)
+            {
+                failure.FailedSide = CopySide::Source;
+                failure.FailedOffset = position;
+                failure.Failure = ex.what();
+                return false;
+            }
+
+            seconds = SecondsSince(start);
+            return true;
+        }
+
+        // Writes a whole request and measures it. With a granularity, runs of
+        // zeroed granules are discarded on the target instead, until it turns
+        // out not to support that; zeroed requests are not even scanned.
+        bool WriteChunk(WriteTarget& target, uint64_t offset, const unsigned char* buffer, size_t count,
+            size_t granularity, bool zeroed, std::atomic<bool>& discardable, double& seconds, uint64_t& skipped,
+            CopyResult& failure)
+        {
+            auto start = Clock::now();
+            auto sparse = (granularity != 0 && discardable.load(std::memory_order_relaxed));
+            auto position = (size_t)0;
+            skipped = 0;
+
+            auto isZero = [&](size_t at)
+            {
+                return sparse && (zeroed || MemoryKernels::IsZero(buffer + at, std::min(granularity, count - at)));
+            };
+
+            try
+            {
+                while (position < count)
+                {
+                    auto zero = isZero(position);
+                    auto end = position;
+                    while (end < count && isZero(end) == zero)
+                        end += std::min(sparse ? granularity : count, count - end);
+
+                    if (zero)
+                    {
+                        if (target.Discard(offset + position, end - position))
+                        {
+                            skipped += end - position;
+                            position = end;
+                            continue;
+                        }
+
+                        discardable.store(false, std::memory_order_relaxed);
+                        sparse = false;
+                    }
+
+                    target.Write(offset + position, buffer + position, end - position);
+                    position = end;
+                }
+            }
+            catch (const NativeException& ex)
+            {
+                failure.FailedSide = CopySide::Destination;
+                failure.FailedOffset = offset + position;
+                failure.Failure = ex.what();
+                return false;
+            }
+
+            seconds = SecondsSince(start);
+            return true;
+        }
+
+    } // namespace
+
+    CopyEngine::CopyEngine(const CopyEngineOptions& options) :
+        mOptions(options)
+    {
+        if (options.ChunkBytes == 0 || options.Depth == 0)
+            throw NativeException(NativeError::InvalidArgument, "Chunk size and depth of a copy may not be zero");
+        if (!(options.ProgressInterval > 0.0))
+            throw NativeException(NativeError::InvalidArgument, "Progress interval of a copy has to be positive");
+        if (options.SparseBytes != 0 && (options.ChunkBytes % options.SparseBytes) != 0)
+            throw NativeException(NativeError::InvalidArgument, "Chunk size of a copy has to be a multiple of its sparse granularity");
+    }
+
+    CopyResult CopyEngine::Copy(ReadSource& source, WriteTarget& target, uint64_t length,
+        CopyProgressSink* progress) const
+    {
+        CopyResult result;
+        if (length == 0)
+            return result;
+
+        auto started = Clock::now();
+        auto chunkBytes = (uint64_t)mOptions.ChunkBytes;
+        auto chunks = (length + chunkBytes - 1) / chunkBytes;
+        auto chunkLength = [&](uint64_t chunk)
+        {
+            return (size_t)std::min(chunkBytes, length - chunk * chunkBytes);
+        };
+
+        auto sparse = (mOptions.SparseBytes != 0);
+        std::atomic<bool> discardable(sparse);
+
+        // Bytes written so far and the state of the current interval, which
+        // are guarded by the lock once threads are running
+        uint64_t written = 0;
+        uint64_t reportedBytes = 0;
+        auto reported = started;
+        RequestLatency intervalRead;
+        RequestLatency intervalWrite;
+
+        auto takeProgress = [&]()
+        {
+            auto now = Clock::now();
+
+            CopyProgress snapshot;
+            snapshot.CopiedBytes = written;
+            snapshot.SkippedBytes = result.SkippedBytes;
+            snapshot.TotalBytes = length;
+            snapshot.IntervalSeconds = std::chrono::duration<double>(now - reported).count();
+            snapshot.IntervalBytes = written - reportedBytes;
+            snapshot.IntervalRead = intervalRead;
+            snapshot.IntervalWrite = intervalWrite;
+
+            reported = now;
+            reportedBytes = written;
+            intervalRead = RequestLatency();
+            intervalWrite = RequestLatency();
+            return snapshot;
+        };
+
+        // A single chunk is not worth any threads
+        if (chunks == 1)
+        {
+            AlignedBuffer buffer((size_t)length);
+            double seconds;
+            size_t unread;
+            uint64_t skipped;
+
+            if (ReadChunk(source, 0, buffer.Data(), (size_t)length, sparse, seconds, unread, result))
+            {
+                result.Read.Add(seconds);
+                result.UnreadBytes = unread;
+                intervalRead.Add(seconds);
+
+                if (WriteChunk(target, 0, buffer.Data(), (size_t)length, mOptions.SparseBytes, unread == length,
+                    discardable, seconds, skipped, result))
+                {
+                    result.Write.Add(seconds);
+                    result.SkippedBytes = skipped;
+                    intervalWrite.Add(seconds);
+
+                    written = length;
+                    result.CopiedBytes = length;
+                }
+            }
+        }
+        else
+        {
+            auto depth = (size_t)std::min<uint64_t>(mOptions.Depth, chunks);
+            auto readers = (source.Concurrent() ? depth : 1);
+            auto writers = (target.Concurrent() ? depth : 1);
+
+            std::vector<std::unique_ptr<Slot>> slots;
+            for (size_t i = 0; i < depth; i++)
+            {
+                slots.emplace_back(new Slot(mOptions.ChunkBytes));
+                slots.back()->Chunk = i;
+            }
+
+            std::mutex lock;
+            std::condition_variable readable;
+            std::condition_variable writable;
+            std::condition_variable progressed;
+            std::deque<Slot*> filled;
+
+            uint64_t claimedReads = 0;
+
+            // Written chunks wait here until all chunks before them are written
+            std::set<uint64_t> completed;
+            uint64_t contiguous = 0;
+
+            bool stopped = false;
+            std::exception_ptr error;
+
+            // Called with the lock held
+            auto stop = [&](std::exception_ptr exception)
+            {
+                if (exception && !error)
+                    error = exception;
+
+                stopped = true;
+                readable.notify_all();
+                writable.notify_all();
+                progressed.notify_all();
+            };
+
+            // Keeps the failure closest to the start; called with the lock held
+            auto fail = [&](const CopyResult& failure)
+            {
+                if (result.FailedSide == CopySide::None || failure.FailedOffset < result.FailedOffset)
+                {
+                    result.FailedSide = failure.FailedSide;
+                    result.FailedOffset = failure.FailedOffset;
+                    result.Failure = failure.Failure;
+                }
+
+                stop(nullptr);
+            };
+
+            auto reader = [&]()
+            {
+                try
+                {
+                    for (;;)
+                    {
+                        uint64_t chunk;
+                        Slot* slot;
+
+                        {
+                            std::unique_lock<std::mutex> guard(lock);
+                            if (stopped || claimedReads == chunks)
+                                return;
+
+                            // Chunks are claimed in order, so the one holding
+                            // the slot before is always written eventually
+                            chunk = claimedReads++;
+                            slot = slots[(size_t)(chunk % depth)].get();
+
+                            readable.wait(guard, [&]() { return stopped || slot->Chunk == chunk; });
+                            if (stopped)
+                                return;
+                        }
+
+                        CopyResult failure;
+                        double seconds;
+                        auto read = ReadChunk(source, chunk * chunkBytes, slot->Buffer.Data(), chunkLength(chunk),
+                            sparse, seconds, slot->Unread, failure);
+
+                        std::lock_guard<std::mutex> guard(lock);
+                        if (!read)
+                        {
+                            fail(failure);
+                            return;
+                        }
+
+                        result.Read.Add(seconds);
+                        result.UnreadBytes += slot->Unread;
+                        intervalRead.Add(seconds);
+
+                        filled.push_back(slot);
+                        writable.notify_one();
+                    }
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    stop(std::current_exception());
+                }
+            };
+
+            auto writer = [&]()
+            {
+                try
+                {
+                    for (;;)
+                    {
+                        Slot* slot;
+
+                        {
+                            std::unique_lock<std::mutex> guard(lock);
+                            writable.wait(guard, [&]() { return stopped || !filled.empty() || contiguous == chunks; });
+                            if (stopped || filled.empty())
+                                return;
+
+                            slot = filled.front();
+                            filled.pop_front();
+                        }
+
+                        auto chunk = slot->Chunk;
+                        auto count = chunkLength(chunk);
+
+                        CopyResult failure;
+                        double seconds;
+                        uint64_t skipped;
+                        auto wrote = WriteChunk(target, chunk * chunkBytes, slot->Buffer.Data(), count,
+                            mOptions.SparseBytes, slot->Unread == count, discardable, seconds, skipped, failure);
+
+                        std::lock_guard<std::mutex> guard(lock);
+                        if (!wrote)
+                        {
+                            fail(failure);
+                            return;
+                        }
+
+                        result.Write.Add(seconds);
+                        result.SkippedBytes += skipped;
+                        intervalWrite.Add(seconds);
+                        written += count;
+
+                        completed.insert(chunk);
+                        while (!completed.empty() && *completed.begin() == contiguous)
+                        {
+                            result.CopiedBytes += chunkLength(contiguous);
+                            completed.erase(completed.begin());
+                            contiguous++;
+                        }
+
+                        // Hand the buffer to the chunk depth positions ahead
+                        slot->Chunk += depth;
+                        readable.notify_all();
+
+                        if (contiguous == chunks)
+                        {
+                            writable.notify_all();
+                            progressed.notify_all();
+                        }
+                    }
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    stop(std::current_exception());
+                }
+            };
+
+            std::vector<std::thread> pool;
+            try
+            {
+                for (size_t i = 0; i < readers; i++)
+                    pool.emplace_back(reader);
+
+                for (size_t i = 0; i < writers; i++)
+                    pool.emplace_back(writer);
+            }
+            catch (...)
+            {
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    stop(nullptr);
+                }
+
+                for (auto& thread : pool)
+                    thread.join();
+
+                throw;
+            }
+
+            // The calling thread reports the progress, outside of the lock
+            auto interval = std::chrono::duration<double>(mOptions.ProgressInterval);
+            for (;;)
+            {
+                CopyProgress snapshot;
+
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    auto done = [&]() { return stopped || contiguous == chunks; };
+
+                    if (progress == nullptr)
+                    {
+                        progressed.wait(guard, done);
+                        break;
+                    }
+
+                    if (progressed.wait_for(guard, interval, done))
+                        break;
+
+                    snapshot = takeProgress();
+                }
+
+                try
+                {
+                    progress->Report(snapshot);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    stop(std::current_exception());
+                    break;
+                }
+            }
+
+            for (auto& thread : pool)
+                thread.join();
+
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        if (result.FailedSide == CopySide::None)
+        {
+            try
+            {
+                target.Flush();
+            }
+            catch (const NativeException& ex)
+            {
+                result.FailedSide = CopySide::Destination;
+                result.FailedOffset = length;
+                result.Failure = ex.what();
+            }
+        }
+
+        result.Seconds = SecondsSince(started);
+
+        // The last report covers the remainder and is made after any failure
+        if (progress != nullptr)
+            progress->Report(takeProgress());
+
+        return result;
+    }
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,160 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "ReadSource.h"
+#include "WriteTarget.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace nDiscUtils {
+namespace Native {
+
+    enum class CopySide
+    {
+        None,
+        Source,
+        Destination
+    };
+
+    // Service times of completed requests; a chunk which is split around
+    // holes or zeros counts as one request
+    struct RequestLatency
+    {
+        uint64_t Requests = 0;
+        double TotalSeconds = 0.0;
+        double MaxSeconds = 0.0;
+
+        double MeanSeconds() const
+        {
+            return (Requests == 0 ? 0.0 : TotalSeconds / Requests);
+        }
+
+        void Add(double seconds)
+        {
+            Requests++;
+            TotalSeconds += seconds;
+            if (seconds > MaxSeconds)
+                MaxSeconds = seconds;
+        }
+    };
+
+    // Snapshot passed to the progress sink; the interval is the time since
+    // the previous report
+    struct CopyProgress
+    {
+        // Bytes written or skipped so far, which are not necessarily contiguous
+        uint64_t CopiedBytes = 0;
+        uint64_t SkippedBytes = 0;
+        uint64_t TotalBytes = 0;
+
+        double IntervalSeconds = 0.0;
+        uint64_t IntervalBytes = 0;
+
+        RequestLatency IntervalRead;
+        RequestLatency IntervalWrite;
+
+        double BytesPerSecond() const
+        {
+            return (IntervalSeconds <= 0.0 ? 0.0 : IntervalBytes / IntervalSeconds);
+        }
+    };
+
+    // Receives the progress on the thread calling CopyEngine::Copy(); a
+    // NativeException thrown from it aborts the copy and is passed on
+    class CopyProgressSink
+    {
+
+    public:
+        virtual ~CopyProgressSink() { }
+
+        virtual void Report(const CopyProgress& progress) = 0;
+
+    };
+
+    struct CopyEngineOptions
+    {
+        // Bytes read and written per request
+        size_t ChunkBytes = 1u << 20;
+
+        // Chunks which are in flight at the same time; concurrent sources
+        // and targets get one request per chunk, others one at a time
+        size_t Depth = 4;
+
+        // Seconds between two progress reports
+        double ProgressInterval = 1.0;
+
+        // Granularity of sparse copies, zero to copy every byte. Holes of the
+        // source are not read, and runs of zeroed granules are discarded on
+        // the target instead of written if it supports that. ChunkBytes has
+        // to be a multiple of it.
+        size_t SparseBytes = 0;
+    };
+
+    struct CopyResult
+    {
+        // Leading bytes which were written or skipped before the end or a failure
+        uint64_t CopiedBytes = 0;
+
+        // Zeros which were discarded on the target instead of written, and
+        // holes of the source which were not read
+        uint64_t SkippedBytes = 0;
+        uint64_t UnreadBytes = 0;
+
+        double Seconds = 0.0;
+
+        RequestLatency Read;
+        RequestLatency Write;
+
+        // Side which failed or ended early, the offset of the failed request
+        // and the reason
+        CopySide FailedSide = CopySide::None;
+        uint64_t FailedOffset = 0;
+        std::string Failure;
+    };
+
+    // Copies a source to a target chunk by chunk through a ring of Depth
+    // page-aligned buffers. Reads and writes run on their own threads, so
+    // the next chunks are read while earlier ones are written, and both
+    // sides keep up to Depth requests in flight if they are concurrent.
+    class CopyEngine
+    {
+
+    public:
+        explicit CopyEngine(const CopyEngineOptions& options = CopyEngineOptions());
+
+        const CopyEngineOptions& Options() const
+        {
+            return mOptions;
+        }
+
+        // Copies the first length bytes of the source to the same offsets of
+        // the target and flushes it
+        CopyResult Copy(ReadSource& source, WriteTarget& target, uint64_t length,
+            CopyProgressSink* progress = nullptr) const;
+
+    private:
+        CopyEngineOptions mOptions;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,164 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "CpuFeatures.h"
+
+#ifdef NDISCUTILS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#include <cstdint>
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+#ifdef NDISCUTILS_X86
+
+        void Cpuid(unsigned leaf, unsigned subleaf, unsigned registers[4])
+        {
+#ifdef _MSC_VER
+            __cpuidex((int*)registers, (int)leaf, (int)subleaf);
+#else
+            __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+        }
+
+        // Register state the operating system saves on context switches
+        uint64_t EnabledStates()
+        {
+#ifdef _MSC_VER
+            return _xgetbv(0);
+#else
+            unsigned low, high;
+            __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+            return ((uint64_t)high << 32) | low;
+#endif
+        }
+
+        // Largest cache reported by the deterministic cache parameter leaf
+        // (Intel) or its extended counterpart (AMD)
+        size_t LargestCache(unsigned leaf)
+        {
+            auto largest = (size_t)0;
+            unsigned registers[4];
+
+            for (unsigned index = 0; index < 16; index++)
+            {
+                Cpuid(leaf, index, registers);
+                if ((registers[0] & 0x1F) == 0)
+                    break;
+
+                auto ways = (size_t)((registers[1] >> 22) & 0x3FF) + 1;
+                auto partitions = (size_t)((registers[1] >> 12) & 0x3FF) + 1;
+                auto lineSize = (size_t)(registers[1] & 0xFFF) + 1;
+                auto sets = (size_t)registers[2] + 1;
+
+                auto size = ways * partitions * lineSize * sets;
+                if (size > largest)
+                    largest = size;
+            }
+
+            return largest;
+        }
+
+        size_t DetectCacheBytes()
+        {
+            unsigned registers[4];
+
+            Cpuid(0, 0, registers);
+            if (registers[0] >= 4)
+            {
+                auto size = LargestCache(4);
+                if (size != 0)
+                    return size;
+            }
+
+            Cpuid(0x80000000u, 0, registers);
+            if (registers[0] >= 0x8000001Du)
+                return LargestCache(0x8000001Du);
+
+            return 0;
+        }
+
+#endif // NDISCUTILS_X86
+
+        CpuFeatures Detect()
+        {
+            CpuFeatures features;
+
+#ifdef NDISCUTILS_X86
+            unsigned registers[4];
+
+            Cpuid(0, 0, registers);
+            auto maxLeaf = registers[0];
+            if (maxLeaf < 1)
+                return features;
+
+            features.CacheBytes = DetectCacheBytes();
+
+            Cpuid(1, 0, registers);
+            features.Sse2 = (registers[3] & (1u << 26)) != 0;
+            features.Pclmul = (registers[2] & (1u << 1)) != 0;
+            features.Aes = (registers[2] & (1u << 25)) != 0;
+            features.Sse42 = (registers[2] & (1u << 20)) != 0;
+            features.PopCnt = (registers[2] & (1u << 23)) != 0;
+
+            auto osxsave = (registers[2] & (1u << 27)) != 0;
+            auto avx = (registers[2] & (1u << 28)) != 0;
+
+            // SHA only needs the XMM state every x86 operating system saves
+            if (maxLeaf >= 7)
+            {
+                Cpuid(7, 0, registers);
+                features.Sha = features.Sse42 && (registers[1] & (1u << 29)) != 0;
+            }
+
+            if (!osxsave || !avx || maxLeaf < 7)
+                return features;
+
+            // XMM and YMM, then opmask and both halves of ZMM
+            auto states = EnabledStates();
+            auto ymm = (states & 0x06) == 0x06;
+            auto zmm = ymm && (states & 0xE0) == 0xE0;
+
+            features.Avx2 = ymm && (registers[1] & (1u << 5)) != 0;
+            features.Avx512 = zmm && features.Avx2 &&
+                (registers[1] & (1u << 16)) != 0 && (registers[1] & (1u << 30)) != 0;
+            features.Avx512PopCnt = features.Avx512 && (registers[2] & (1u << 14)) != 0;
+            features.Vaes = features.Avx512 && features.Aes && (registers[2] & (1u << 9)) != 0;
+#endif
+
+            return features;
+        }
+
+    } // namespace
+
+    const CpuFeatures& CpuFeatures::Current()
+    {
+        static CpuFeatures features = Detect();
+        return features;
+    }
+
+} // Native
+} // nDiscUtils
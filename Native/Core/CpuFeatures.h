@@ -0,0 +1,67 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NDISCUTILS_X86
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define NDISCUTILS_X64
+#endif
+
+// GCC and Clang only emit instructions beyond the compiler flags inside
+// functions which opt into them; MSVC accepts any intrinsic anywhere
+#if defined(NDISCUTILS_X86) && !defined(_MSC_VER)
+#define NDISCUTILS_TARGET(features) __attribute__((target(features)))
+#else
+#define NDISCUTILS_TARGET(features)
+#endif
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Instruction set extensions of this CPU which the operating system
+    // enabled as well; all of them are false on other architectures
+    struct CpuFeatures
+    {
+        bool Sse2 = false;
+        bool Sse42 = false;
+        bool PopCnt = false;
+        bool Pclmul = false;
+        bool Aes = false;
+        bool Avx2 = false;
+        bool Avx512 = false;
+        bool Avx512PopCnt = false;
+        bool Sha = false;
+
+        // AES instructions on the 512-bit registers
+        bool Vaes = false;
+
+        // Size of the largest cache, zero if it could not be determined
+        size_t CacheBytes = 0;
+
+        // Detected once on first use
+        static const CpuFeatures& Current();
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,281 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "Crc32c.h"
+#include "CpuFeatures.h"
+#include "MemoryKernels.h"
+
+#include <cstring>
+
+#ifdef NDISCUTILS_X86
+#include <immintrin.h>
+#endif
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        // Reflected Castagnoli polynomial
+        constexpr uint32_t Polynomial = 0x82F63B78u;
+
+        // Bytes per lane of the interleaved hardware loop; the lanes of one
+        // round stay within the L1 cache
+        constexpr size_t LaneBytes = 4096;
+
+        // Product of two polynomials modulo the CRC polynomial, both in the
+        // reflected representation of the CRC register
+        uint32_t MultiplyModulo(uint32_t a, uint32_t b)
+        {
+            auto mask = 1u << 31;
+            auto product = 0u;
+
+            for (;;)
+            {
+                if (a & mask)
+                {
+                    product ^= b;
+                    if ((a & (mask - 1)) == 0)
+                        break;
+                }
+
+                mask >>= 1;
+                b = (b & 1) ? (b >> 1) ^ Polynomial : b >> 1;
+            }
+
+            return product;
+        }
+
+        // x^(8 * count) modulo the CRC polynomial, which shifts a register
+        // over count zero bytes when multiplied with it
+        uint32_t ZeroBytesOperator(uint64_t count)
+        {
+            // x^(2^k) for k = 3.., starting at x^8 for a single byte
+            auto power = 1u << 23;
+            auto result = 1u << 31;
+
+            while (count != 0)
+            {
+                if (count & 1)
+                    result = MultiplyModulo(power, result);
+
+                power = MultiplyModulo(power, power);
+                count >>= 1;
+            }
+
+            return result;
+        }
+
+        struct Tables
+        {
+            Tables()
+            {
+                for (uint32_t i = 0; i < 256; i++)
+                {
+                    auto crc = i;
+                    for (int bit = 0; bit < 8; bit++)
+                        crc = (crc & 1) ? (crc >> 1) ^ Polynomial : crc >> 1;
+
+                    Slices[0][i] = crc;
+                }
+
+                for (uint32_t i = 0; i < 256; i++)
+                {
+                    for (int slice = 1; slice < 8; slice++)
+                        Slices[slice][i] = (Slices[slice - 1][i] >> 8) ^ Slices[0][Slices[slice - 1][i] & 0xFF];
+                }
+
+                // Shifting over one lane is linear in the register, so it is
+                // tabulated per byte of the register
+                auto lane = ZeroBytesOperator(LaneBytes);
+                for (uint32_t i = 0; i < 256; i++)
+                {
+                    for (int byte = 0; byte < 4; byte++)
+                        LaneShift[byte][i] = MultiplyModulo(lane, i << (8 * byte));
+                }
+            }
+
+            uint32_t Slices[8][256];
+            uint32_t LaneShift[4][256];
+        };
+
+        const Tables& CrcTables()
+        {
+            static Tables tables;
+            return tables;
+        }
+
+        inline uint32_t ShiftLane(const Tables& tables, uint32_t crc)
+        {
+            return tables.LaneShift[0][crc & 0xFF] ^ tables.LaneShift[1][(crc >> 8) & 0xFF] ^
+                tables.LaneShift[2][(crc >> 16) & 0xFF] ^ tables.LaneShift[3][crc >> 24];
+        }
+
+        // Both kernels work on the inverted register
+
+        uint32_t SoftwareUpdate(uint32_t crc, const unsigned char* data, size_t count)
+        {
+            auto& tables = CrcTables();
+            auto i = (size_t)0;
+
+            for (; i + 8 <= count; i += 8)
+            {
+                uint32_t low, high;
+                std::memcpy(&low, data + i, sizeof(low));
+                std::memcpy(&high, data + i + 4, sizeof(high));
+                low ^= crc;
+
+                crc = tables.Slices[7][low & 0xFF] ^ tables.Slices[6][(low >> 8) & 0xFF] ^
+                    tables.Slices[5][(low >> 16) & 0xFF] ^ tables.Slices[4][low >> 24] ^
+                    tables.Slices[3][high & 0xFF] ^ tables.Slices[2][(high >> 8) & 0xFF] ^
+                    tables.Slices[1][(high >> 16) & 0xFF] ^ tables.Slices[0][high >> 24];
+            }
+
+            for (; i < count; i++)
+                crc = (crc >> 8) ^ tables.Slices[0][(crc ^ data[i]) & 0xFF];
+
+            return crc;
+        }
+
+#ifdef NDISCUTILS_X86
+
+        NDISCUTILS_TARGET("sse4.2")
+        inline uint32_t HardwareSerial(uint32_t crc, const unsigned char* data, size_t count)
+        {
+            auto i = (size_t)0;
+
+#ifdef NDISCUTILS_X64
+            uint64_t wide = crc;
+            for (; i + 8 <= count; i += 8)
+            {
+                uint64_t value;
+                std::memcpy(&value, data + i, sizeof(value));
+                wide = _mm_crc32_u64(wide, value);
+            }
+            crc = (uint32_t)wide;
+#endif
+
+            for (; i + 4 <= count; i += 4)
+            {
+                uint32_t value;
+                std::memcpy(&value, data + i, sizeof(value));
+                crc = _mm_crc32_u32(crc, value);
+            }
+
+            for (; i < count; i++)
+                crc = _mm_crc32_u8(crc, data[i]);
+
+            return crc;
+        }
+
+        // The CRC instruction has a latency of three cycles but issues every
+        // cycle, so three lanes are computed at once. The register of data
+        // A followed by B is the register of A shifted over B's length XOR
+        // the register of B started at zero.
+        NDISCUTILS_TARGET("sse4.2")
+        uint32_t HardwareUpdate(uint32_t crc, const unsigned char* data, size_t count)
+        {
+            if (count >= 3 * LaneBytes)
+            {
+                auto& tables = CrcTables();
+
+                do
+                {
+#ifdef NDISCUTILS_X64
+                    uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+
+                    for (size_t i = 0; i < LaneBytes; i += 8)
+                    {
+                        uint64_t value0, value1, value2;
+                        std::memcpy(&value0, data + i, sizeof(value0));
+                        std::memcpy(&value1, data + LaneBytes + i, sizeof(value1));
+                        std::memcpy(&value2, data + 2 * LaneBytes + i, sizeof(value2));
+
+                        crc0 = _mm_crc32_u64(crc0, value0);
+                        crc1 = _mm_crc32_u64(crc1, value1);
+                        crc2 = _mm_crc32_u64(crc2, value2);
+                    }
+#else
+                    uint32_t crc0 = crc, crc1 = 0, crc2 = 0;
+
+                    for (size_t i = 0; i < LaneBytes; i += 4)
+                    {
+                        uint32_t value0, value1, value2;
+                        std::memcpy(&value0, data + i, sizeof(value0));
+                        std::memcpy(&value1, data + LaneBytes + i, sizeof(value1));
+                        std::memcpy(&value2, data + 2 * LaneBytes + i, sizeof(value2));
+
+                        crc0 = _mm_crc32_u32(crc0, value0);
+                        crc1 = _mm_crc32_u32(crc1, value1);
+                        crc2 = _mm_crc32_u32(crc2, value2);
+                    }
+#endif
+
+                    crc = ShiftLane(tables, (uint32_t)crc0) ^ (uint32_t)crc1;
+                    crc = ShiftLane(tables, crc) ^ (uint32_t)crc2;
+
+                    data += 3 * LaneBytes;
+                    count -= 3 * LaneBytes;
+                } while (count >= 3 * LaneBytes);
+            }
+
+            return HardwareSerial(crc, data, count);
+        }
+
+#endif // NDISCUTILS_X86
+
+        using UpdateFunction = uint32_t (*)(uint32_t crc, const unsigned char* data, size_t count);
+
+        UpdateFunction SelectUpdate()
+        {
+#ifdef NDISCUTILS_X86
+            if (CpuFeatures::Current().Sse42)
+                return HardwareUpdate;
+#endif
+
+            return SoftwareUpdate;
+        }
+
+        UpdateFunction CurrentUpdate()
+        {
+            // Follows the kernel level so benchmarks can compare both paths
+            static UpdateFunction selected = SelectUpdate();
+            return MemoryKernels::Level() == SimdLevel::Scalar ? SoftwareUpdate : selected;
+        }
+
+    } // namespace
+
+    uint32_t Crc32c::Update(uint32_t crc, const void* data, size_t count)
+    {
+        return ~CurrentUpdate()(~crc, (const unsigned char*)data, count);
+    }
+
+    uint32_t Crc32c::Combine(uint32_t first, uint32_t second, uint64_t secondCount)
+    {
+        // The inversions of both CRCs cancel out, leaving the first one
+        // shifted over the second piece
+        return MultiplyModulo(ZeroBytesOperator(secondCount), first) ^ second;
+    }
+
+    bool Crc32c::Accelerated()
+    {
+        return CurrentUpdate() != SoftwareUpdate;
+    }
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,46 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // CRC-32C (Castagnoli) as used by iSCSI, ext4 and Btrfs. Machines with
+    // SSE4.2 run three independent CRC instruction chains over adjacent
+    // lanes and fold them together, everything else uses slicing-by-8.
+    class Crc32c
+    {
+
+    public:
+        // CRC of the data appended to data whose CRC is crc, zero to start
+        static uint32_t Update(uint32_t crc, const void* data, size_t count);
+
+        // CRC of two pieces of data back to back given their separate CRCs
+        // and the length of the second one
+        static uint32_t Combine(uint32_t first, uint32_t second, uint64_t secondCount);
+
+        static bool Accelerated();
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,63 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "DedupIndex.h"
+
+#include <cstring>
+
+namespace nDiscUtils {
+namespace Native {
+
+    Block* DedupIndex::Find(uint64_t hash, const unsigned char* data) const
+    {
+        auto range = mBlocks.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (std::memcmp(it->second->Data, data, mBlockSize) == 0)
+                return it->second;
+        }
+
+        return nullptr;
+    }
+
+    void DedupIndex::Insert(Block* block)
+    {
+        mBlocks.emplace(block->Hash, block);
+        block->Flags |= Block::Indexed;
+    }
+
+    void DedupIndex::Remove(Block* block)
+    {
+        if ((block->Flags & Block::Indexed) == 0)
+            return;
+
+        auto range = mBlocks.equal_range(block->Hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second == block)
+            {
+                mBlocks.erase(it);
+                break;
+            }
+        }
+
+        block->Flags &= ~Block::Indexed;
+    }
+
+} // Native
+} // nDiscUtils
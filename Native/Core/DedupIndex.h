@@ -0,0 +1,72 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+#include "Block.h"
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Content-addressed lookup of physical blocks. Hashes only select the
+    // candidates, a match is always confirmed by comparing the contents.
+    class DedupIndex
+    {
+
+    public:
+        explicit DedupIndex(size_t blockSize) :
+            mBlockSize(blockSize) { }
+
+        size_t Count() const
+        {
+            return mBlocks.size();
+        }
+
+        // Returns a block with exactly the given contents or nullptr
+        Block* Find(uint64_t hash, const unsigned char* data) const;
+
+        // Returns the first block of the hash accepted by matches(block)
+        template <typename TPredicate>
+        Block* FindIf(uint64_t hash, TPredicate matches) const
+        {
+            auto range = mBlocks.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                if (matches(it->second))
+                    return it->second;
+            }
+
+            return nullptr;
+        }
+
+        void Insert(Block* block);
+
+        void Remove(Block* block);
+
+    private:
+        size_t mBlockSize;
+        std::unordered_multimap<uint64_t, Block*> mBlocks;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,978 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "DynamicMemoryStore.h"
+#include "Block.h"
+#include "BlockBitmap.h"
+#include "CompressedTier.h"
+#include "DedupIndex.h"
+#include "Hashes.h"
+#include "ImageFile.h"
+#include "MemoryKernels.h"
+#include "NativeException.h"
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        const size_t StripeCount = 64;
+
+    } // namespace
+
+    // Block pool shared by a store, its snapshots and forks, kept out of the
+    // header as managed code including it cannot use <mutex>. Every
+    // directory leaf maps to one stripe, so a stripe held exclusively also
+    // protects the leaf and its blocks in all directories of the pool.
+    struct DynamicMemoryStore::Shared
+    {
+        struct alignas(64) Stripe
+        {
+            std::shared_mutex Lock;
+        };
+
+        Shared(size_t blockSize, size_t blockCount, const DynamicMemoryStoreOptions& options, PageProvider* provider);
+
+        ~Shared();
+
+        std::shared_mutex& StripeOf(size_t blockIndex)
+        {
+            return Stripes[(blockIndex >> BlockDirectory::LeafShift) % StripeCount].Lock;
+        }
+
+        // BasicLockable excluding all requests on every store of the pool
+        void lock();
+
+        void unlock();
+
+        // Drops one user of the pool and frees it with the last one
+        void Release();
+
+        // Empties a directory of the pool, leaves still shared elsewhere
+        // are kept; locked tells whether the pool is locked already
+        void ReleaseDirectory(BlockDirectory& directory, bool locked);
+
+        // Node the memory of a new block for the slot is taken from
+        size_t NodeOf(size_t blockIndex) const;
+
+        Block* AllocateBlock(size_t blockIndex);
+
+        // Returns whether the block was freed and its memory given back,
+        // which mapped image blocks never are
+        bool ReleaseReference(Block* block);
+
+        // Copies referenced, still mapped image blocks marked in changed into
+        // the pool; requires the pool to be locked
+        void DetachImage(const BlockBitmap& changed);
+
+        std::atomic<size_t> Users;
+        DynamicMemoryStoreOptions Options;
+        size_t BlockSize;
+        PageProvider* Provider;
+        BlockArena Arena;
+        DedupIndex* Index;
+        CompressedTier* Tier;
+        unsigned char* Scratch;
+
+        Stripe Stripes[StripeCount];
+        std::mutex Global;
+
+        // Lock serializing all requests, nullptr if they may run concurrently
+        std::mutex* Serial;
+
+        std::atomic<size_t> Length;
+
+        // Mapping a store was restored from and the descriptors of its
+        // blocks, ordered by block index
+        FileMapping* Image;
+        std::vector<Block> ImageBlocks;
+        std::vector<size_t> ImageIndices;
+    };
+
+    DynamicMemoryStore::Shared::Shared(size_t blockSize, size_t blockCount, const DynamicMemoryStoreOptions& options,
+        PageProvider* provider) :
+        Users(1),
+        Options(options),
+        BlockSize(blockSize),
+        Provider(provider),
+        Arena(blockSize, options.MaxChunkBytes, blockCount * blockSize, provider, NumaTopology::IsPlaced(options.Numa)),
+        Index(nullptr),
+        Tier(nullptr),
+        Scratch(nullptr),
+        Serial(nullptr),
+        Length(0),
+        Image(nullptr)
+    {
+        NumaTopology::AssertPolicy(options.Numa);
+
+        if (options.Deduplicate)
+        {
+            Scratch = (unsigned char*)Provider->Allocate(BlockSize);
+            if (Scratch == nullptr)
+                throw NativeException(NativeError::OutOfMemory,
+                    "Failed to allocate " + std::to_string(BlockSize) + " bytes of memory");
+
+            Index = new DedupIndex(BlockSize);
+        }
+
+        if (options.Compress || options.MemoryBudget != 0)
+        {
+            // Without compression the tier only keeps the budget
+            auto hotLimit = options.Compress ? options.HotBytes / BlockSize : 0;
+            if (options.Compress && options.HotBytes != 0 && hotLimit == 0)
+                hotLimit = 1;
+
+            try
+            {
+                Tier = new CompressedTier(BlockSize, hotLimit, options.Compress ? options.ColdAfter : 0, &Arena,
+                    options.MemoryBudget, options.SpillPath);
+            }
+            catch (...)
+            {
+                delete Index;
+                if (Scratch != nullptr)
+                    Provider->Release(Scratch, BlockSize);
+
+                throw;
+            }
+        }
+
+        if (Tier != nullptr)
+            Serial = &Tier->Mutex();
+        else if (Index != nullptr)
+            Serial = &Global;
+    }
+
+    DynamicMemoryStore::Shared::~Shared()
+    {
+        delete Index;
+        Index = nullptr;
+
+        delete Tier;
+        Tier = nullptr;
+
+        if (Scratch != nullptr)
+            Provider->Release(Scratch, BlockSize);
+
+        delete Image;
+        Image = nullptr;
+    }
+
+    void DynamicMemoryStore::Shared::lock()
+    {
+        if (Serial != nullptr)
+        {
+            Serial->lock();
+            return;
+        }
+
+        for (auto& stripe : Stripes)
+            stripe.Lock.lock();
+    }
+
+    void DynamicMemoryStore::Shared::unlock()
+    {
+        if (Serial != nullptr)
+        {
+            Serial->unlock();
+            return;
+        }
+
+        for (auto& stripe : Stripes)
+            stripe.Lock.unlock();
+    }
+
+    void DynamicMemoryStore::Shared::Release()
+    {
+        if (Users.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+    void DynamicMemoryStore::Shared::ReleaseDirectory(BlockDirectory& directory, bool locked)
+    {
+        for (size_t root = 0; root < directory.RootCount(); root++)
+        {
+            std::unique_lock<std::mutex> serial;
+            std::unique_lock<std::shared_mutex> exclusive;
+            if (!locked && Serial != nullptr)
+                serial = std::unique_lock<std::mutex>(*Serial);
+            else if (!locked)
+                exclusive = std::unique_lock<std::shared_mutex>(StripeOf(root << BlockDirectory::LeafShift));
+
+            directory.Release(root, [this](size_t, void* slot) { ReleaseReference((Block*)slot); });
+        }
+    }
+
+    size_t DynamicMemoryStore::Shared::NodeOf(size_t blockIndex) const
+    {
+        if (Arena.NodeCount() == 1)
+            return 0;
+
+        switch (Options.Numa.Placement)
+        {
+            case NumaPlacement::Interleave: return blockIndex % Arena.NodeCount();
+            case NumaPlacement::Local: return NumaTopology::CurrentNode();
+            case NumaPlacement::Node: return Options.Numa.Node;
+            default: return 0;
+        }
+    }
+
+    Block* DynamicMemoryStore::Shared::AllocateBlock(size_t blockIndex)
+    {
+        auto node = NodeOf(blockIndex);
+        auto blockMemory = (unsigned char*)Arena.Allocate(node);
+        if (blockMemory == nullptr)
+            throw NativeException(NativeError::OutOfMemory,
+                "Failed to allocate " + std::to_string(BlockSize) + " bytes of memory");
+
+        auto block = new (std::nothrow) Block { blockMemory, 1, 0, 0, nullptr, 0, 0, 0, (uint32_t)node, 0 };
+        if (block == nullptr)
+        {
+            Arena.Release(blockMemory, node);
+            throw NativeException(NativeError::OutOfMemory, "Failed to allocate block descriptor");
+        }
+
+        if (Tier != nullptr)
+        {
+            try
+            {
+                Tier->Attach(block);
+            }
+            catch (...)
+            {
+                Arena.Release(blockMemory, node);
+                delete block;
+                throw;
+            }
+        }
+
+        Length += BlockSize;
+        return block;
+    }
+
+    bool DynamicMemoryStore::Shared::ReleaseReference(Block* block)
+    {
+        if (--block->References != 0)
+            return false;
+
+        if (Index != nullptr)
+            Index->Remove(block);
+
+        if (Tier != nullptr)
+            Tier->Detach(block);
+
+        auto owned = ((block->Flags & Block::Mapped) == 0);
+        if (owned)
+        {
+            if (block->Data != nullptr)
+                Arena.Release(block->Data, block->Node);
+
+            Length -= BlockSize;
+        }
+
+        // Embedded descriptors are freed with the image table
+        if ((block->Flags & Block::Embedded) == 0)
+            delete block;
+
+        return owned;
+    }
+
+    void DynamicMemoryStore::Shared::DetachImage(const BlockBitmap& changed)
+    {
+        if (Image == nullptr)
+            return;
+
+        for (size_t entry = 0; entry < ImageBlocks.size(); entry++)
+        {
+            auto block = &ImageBlocks[entry];
+            if (block->References == 0 || (block->Flags & Block::Mapped) == 0 || !changed.Test(ImageIndices[entry]))
+                continue;
+
+            auto node = NodeOf(ImageIndices[entry]);
+            auto data = (unsigned char*)Arena.Allocate(node);
+            if (data == nullptr)
+                throw NativeException(NativeError::OutOfMemory,
+                    "Failed to allocate " + std::to_string(BlockSize) + " bytes of memory");
+
+            std::memcpy(data, block->Data, BlockSize);
+            block->Data = data;
+            block->Node = (uint32_t)node;
+            block->Flags &= ~Block::Mapped;
+
+            if (Tier != nullptr)
+                Tier->Attach(block);
+
+            Length += BlockSize;
+        }
+    }
+
+    DynamicMemoryStore::DynamicMemoryStore(size_t capacity, size_t blockSize, PageProvider* provider) :
+        DynamicMemoryStore(capacity, blockSize, DynamicMemoryStoreOptions(), provider) { }
+
+    DynamicMemoryStore::DynamicMemoryStore(size_t capacity, size_t blockSize, const DynamicMemoryStoreOptions& options,
+        PageProvider* provider) :
+        MemoryStore(capacity, provider),
+        mOptions(options),
+        mBlockSize(AssertBlockSize(blockSize)),
+        mBlockCount((capacity + mBlockSize - 1) / mBlockSize),
+        mDirectory(mBlockCount),
+        mShared(new Shared(mBlockSize, mBlockCount, mOptions, mProvider)),
+        mChanged(nullptr),
+        mArena(&mShared->Arena),
+        mDedupIndex(mShared->Index),
+        mTier(mShared->Tier),
+        mScratch(mShared->Scratch),
+        mLogicalLength(0) { }
+
+    DynamicMemoryStore::DynamicMemoryStore(size_t capacity, Shared* shared) :
+        MemoryStore(capacity, shared->Provider),
+        mOptions(shared->Options),
+        mBlockSize(shared->BlockSize),
+        mBlockCount((capacity + mBlockSize - 1) / mBlockSize),
+        mDirectory(mBlockCount),
+        mShared(shared),
+        mChanged(nullptr),
+        mArena(&shared->Arena),
+        mDedupIndex(shared->Index),
+        mTier(shared->Tier),
+        mScratch(shared->Scratch),
+        mLogicalLength(0)
+    {
+        mShared->Users++;
+    }
+
+    DynamicMemoryStore::~DynamicMemoryStore()
+    {
+        delete mChanged;
+        mChanged = nullptr;
+
+        if (mShared->Users.load(std::memory_order_acquire) != 1)
+        {
+            // Snapshots or forks still use the pool, so the blocks are
+            // handed back one by one
+            mShared->ReleaseDirectory(mDirectory, false);
+            mShared->Release();
+            return;
+        }
+
+        if (mTier != nullptr)
+            mTier->Stop();
+
+        // The arena releases its chunks as a whole, so blocks only need
+        // their descriptors and compressed data freed
+        mDirectory.ForEach([this](size_t, void* slot)
+        {
+            auto block = (Block*)slot;
+            if (--block->References != 0)
+                return;
+
+            if (mTier != nullptr)
+                mTier->Detach(block);
+
+            if (block->Data != nullptr && (block->Flags & Block::Mapped) == 0)
+                mArena->Abandon(block->Data);
+
+            if ((block->Flags & Block::Embedded) == 0)
+                delete block;
+        });
+
+        mShared->Release();
+    }
+
+    size_t DynamicMemoryStore::AssertBlockSize(size_t blockSize) const
+    {
+        if (blockSize == 0)
+            throw NativeException(NativeError::InvalidArgument, "Block size was expected to be greater than zero");
+
+        AssertAligned(blockSize, "Block size");
+        return blockSize;
+    }
+
+    size_t DynamicMemoryStore::CommittedBytes() const
+    {
+        if (mTier == nullptr)
+            return mShared->Length;
+
+        std::lock_guard<std::mutex> lock(mTier->Mutex());
+        return mShared->Length - (mTier->PackedBlocks() + mTier->SpilledBlocks()) * mBlockSize + mTier->PackedBytes();
+    }
+
+    size_t DynamicMemoryStore::ReservedBytes() const
+    {
+        return mArena->ReservedBytes();
+    }
+
+    DynamicMemoryStoreStatistics DynamicMemoryStore::Statistics() const
+    {
+        DynamicMemoryStoreStatistics statistics;
+        if (mTier == nullptr)
+        {
+            statistics.ResidentBytes = mShared->Length;
+            return statistics;
+        }
+
+        std::lock_guard<std::mutex> lock(mTier->Mutex());
+        statistics.HotBlocks = mTier->HotBlocks();
+        statistics.CompressedBlocks = mTier->PackedBlocks();
+        statistics.CompressedBytes = mTier->PackedBytes();
+        statistics.HotHits = mTier->Hits();
+        statistics.HotMisses = mTier->Misses();
+        statistics.ResidentBytes = mTier->ResidentBytes();
+        statistics.SpilledBlocks = mTier->SpilledBlocks();
+        statistics.SpilledBytes = mTier->SpilledBlocks() * mBlockSize;
+        statistics.Evictions = mTier->Evictions();
+        statistics.SpillReads = mTier->SpillReads();
+        statistics.SpillFailures = mTier->SpillFailures();
+        return statistics;
+    }
+
+    void DynamicMemoryStore::Read(size_t offset, void* buffer, size_t count)
+    {
+        AssertRange(offset, count);
+
+        auto start = StoreCounters::Now();
+        std::unique_lock<std::mutex> serial;
+        if (mShared->Serial != nullptr)
+            serial = std::unique_lock<std::mutex>(*mShared->Serial);
+
+        auto bufferPointer = (unsigned char*)buffer;
+        auto readCount = (size_t)0;
+
+        while (readCount < count)
+        {
+            auto position = offset + readCount;
+            auto blockIndex = position / mBlockSize;
+            auto innerBlockOffset = position - (blockIndex * mBlockSize);
+
+            auto readBlockSize = mBlockSize - innerBlockOffset;
+            if (readBlockSize > count - readCount)
+                readBlockSize = count - readCount;
+
+            std::shared_lock<std::shared_mutex> shared;
+            if (!serial.owns_lock())
+                shared = std::shared_lock<std::shared_mutex>(mShared->StripeOf(blockIndex));
+
+            auto block = (Block*)mDirectory.Get(blockIndex);
+            if (block == nullptr)
+            {
+                std::memset(bufferPointer + readCount, 0, readBlockSize);
+                mCounters.RecordZeroRead();
+            }
+            else
+            {
+                if (mTier != nullptr)
+                    mTier->Load(block, false);
+
+                std::memcpy(bufferPointer + readCount, block->Data + innerBlockOffset, readBlockSize);
+            }
+
+            if (mTier != nullptr)
+                mTier->Trim();
+
+            readCount += readBlockSize;
+        }
+
+        mCounters.RecordRead(count, start);
+    }
+
+    void DynamicMemoryStore::Write(size_t offset, const void* buffer, size_t count)
+    {
+        AssertRange(offset, count);
+
+        auto start = StoreCounters::Now();
+        WriteRange(offset, (const unsigned char*)buffer, count);
+        mCounters.RecordWrite(count, start);
+    }
+
+    void DynamicMemoryStore::Discard(size_t offset, size_t count)
+    {
+        // Discarding is writing zeros without a source buffer: covered
+        // blocks are released and partially covered ones cleared
+        AssertRange(offset, count);
+
+        auto start = StoreCounters::Now();
+        WriteRange(offset, nullptr, count);
+        mCounters.RecordDiscard(count, start);
+    }
+
+    void DynamicMemoryStore::WriteRange(size_t offset, const unsigned char* source, size_t count)
+    {
+        std::unique_lock<std::mutex> serial;
+        if (mShared->Serial != nullptr)
+            serial = std::unique_lock<std::mutex>(*mShared->Serial);
+
+        auto writeCount = (size_t)0;
+
+        while (writeCount < count)
+        {
+            auto position = offset + writeCount;
+            auto blockIndex = position / mBlockSize;
+            auto innerBlockOffset = position - (blockIndex * mBlockSize);
+
+            auto writeBlockSize = mBlockSize - innerBlockOffset;
+            if (writeBlockSize > count - writeCount)
+                writeBlockSize = count - writeCount;
+
+            auto blockSource = (source != nullptr ? source + writeCount : nullptr);
+            if (mDedupIndex != nullptr)
+                WriteBlockDeduplicated(blockIndex, innerBlockOffset, blockSource, writeBlockSize);
+            else
+                WriteBlock(blockIndex, innerBlockOffset, blockSource, writeBlockSize);
+
+            if (mTier != nullptr)
+                mTier->Trim();
+
+            writeCount += writeBlockSize;
+        }
+    }
+
+    void DynamicMemoryStore::WriteBlock(size_t blockIndex, size_t innerBlockOffset, const unsigned char* source, size_t count)
+    {
+        std::shared_lock<std::shared_mutex> shared;
+        std::unique_lock<std::shared_mutex> exclusive;
+        if (mShared->Serial == nullptr)
+            shared = std::shared_lock<std::shared_mutex>(mShared->StripeOf(blockIndex));
+
+        auto block = (Block*)mDirectory.Get(blockIndex);
+        auto wholeBlock = (count == mBlockSize);
+        auto zeros = (source == nullptr || MemoryKernels::IsZero(source, count));
+
+        // Zeros need no backing: unbacked blocks already read as zero
+        if (zeros && block == nullptr)
+            return;
+
+        if (mChanged != nullptr)
+            mChanged->Set(blockIndex);
+
+        if (mDirectory.IsShared(blockIndex) ||
+            (block != nullptr && (block->References > 1 || (block->Flags & Block::Mapped) != 0)))
+        {
+            // Copying a shared leaf, shared or mapped block must not overlap
+            // with any other request on the leaf, so the leaf is locked
+            // exclusively and the block looked up again
+            if (shared.owns_lock())
+            {
+                shared.unlock();
+                exclusive = std::unique_lock<std::shared_mutex>(mShared->StripeOf(blockIndex));
+            }
+
+            UnshareLeaf(blockIndex);
+            block = (Block*)mDirectory.Get(blockIndex);
+        }
+
+        if (zeros)
+        {
+            // Backed blocks are released once nothing else is left
+            if (block == nullptr)
+                return;
+
+            if (shared.owns_lock())
+            {
+                // Checking and releasing the block must not overlap with any
+                // other request on the leaf, so the leaf is locked exclusively
+                // and the block looked up again; a snapshot may have shared
+                // the leaf in the meantime
+                shared.unlock();
+                exclusive = std::unique_lock<std::shared_mutex>(mShared->StripeOf(blockIndex));
+
+                UnshareLeaf(blockIndex);
+                block = (Block*)mDirectory.Get(blockIndex);
+                if (block == nullptr)
+                    return;
+            }
+
+            if (!wholeBlock)
+            {
+                block = MakeWritable(blockIndex, block, true);
+                std::memset(block->Data + innerBlockOffset, 0, count);
+
+                if (!MemoryKernels::IsZero(block->Data, mBlockSize))
+                    return;
+            }
+
+            SetSlot(blockIndex, nullptr);
+            ReleaseBlock(block);
+            return;
+        }
+
+        if (block == nullptr)
+            block = MaterializeBlock(blockIndex);
+        else
+            block = MakeWritable(blockIndex, block, !wholeBlock);
+
+        std::memcpy(block->Data + innerBlockOffset, source, count);
+    }
+
+    void DynamicMemoryStore::WriteBlockDeduplicated(size_t blockIndex, size_t innerBlockOffset, const unsigned char* source, size_t count)
+    {
+        if (mChanged != nullptr)
+            mChanged->Set(blockIndex);
+
+        UnshareLeaf(blockIndex);
+
+        auto block = (Block*)mDirectory.Get(blockIndex);
+        auto contents = source;
+
+        // Fingerprints cover whole blocks, so partial writes are merged
+        // with the current contents first
+        if (count != mBlockSize)
+        {
+            if (block != nullptr && mTier != nullptr)
+                mTier->Load(block, false);
+
+            if (block != nullptr)
+                std::memcpy(mScratch, block->Data, mBlockSize);
+            else
+                std::memset(mScratch, 0, mBlockSize);
+
+            if (source != nullptr)
+                std::memcpy(mScratch + innerBlockOffset, source, count);
+            else
+                std::memset(mScratch + innerBlockOffset, 0, count);
+
+            contents = mScratch;
+        }
+
+        if (contents == nullptr || MemoryKernels::IsZero(contents, mBlockSize))
+        {
+            if (block != nullptr)
+            {
+                SetSlot(blockIndex, nullptr);
+                ReleaseBlock(block);
+            }
+
+            return;
+        }
+
+        auto hash = Hashes::XxHash64(contents, mBlockSize);
+        Block* match;
+        if (mTier != nullptr)
+            match = mDedupIndex->FindIf(hash, [&](Block* candidate) { return mTier->Equals(candidate, contents); });
+        else
+            match = mDedupIndex->Find(hash, contents);
+
+        if (match != nullptr)
+        {
+            if (match != block)
+            {
+                match->References++;
+                SetSlot(blockIndex, match);
+
+                if (block != nullptr)
+                    ReleaseBlock(block);
+            }
+
+            return;
+        }
+
+        if (block != nullptr && block->References == 1 && (block->Flags & Block::Mapped) == 0)
+        {
+            if (mTier != nullptr)
+                mTier->Load(block, true);
+
+            mDedupIndex->Remove(block);
+        }
+        else
+        {
+            auto shared = block;
+
+            block = InstallBlock(blockIndex);
+            if (shared != nullptr)
+                ReleaseBlock(shared);
+        }
+
+        std::memcpy(block->Data, contents, mBlockSize);
+
+        block->Hash = hash;
+        mDedupIndex->Insert(block);
+    }
+
+    void DynamicMemoryStore::UnshareLeaf(size_t blockIndex)
+    {
+        // The private copy of the leaf adds a reference to all its blocks
+        mDirectory.Unshare(blockIndex, [](void* slot) { ((Block*)slot)->References++; });
+    }
+
+    void DynamicMemoryStore::SetSlot(size_t blockIndex, Block* block)
+    {
+        auto previous = mDirectory.Get(blockIndex);
+
+        mDirectory.Set(blockIndex, block);
+
+        if (previous == nullptr && block != nullptr)
+            mLogicalLength += mBlockSize;
+        else if (previous != nullptr && block == nullptr)
+            mLogicalLength -= mBlockSize;
+    }
+
+    Block* DynamicMemoryStore::InstallBlock(size_t blockIndex)
+    {
+        auto block = mShared->AllocateBlock(blockIndex);
+        mCounters.RecordAllocation();
+
+        try
+        {
+            SetSlot(blockIndex, block);
+        }
+        catch (...)
+        {
+            ReleaseBlock(block);
+            throw;
+        }
+
+        return block;
+    }
+
+    Block* DynamicMemoryStore::MaterializeBlock(size_t blockIndex)
+    {
+        auto block = mShared->AllocateBlock(blockIndex);
+        mCounters.RecordAllocation();
+        void* current = nullptr;
+
+        try
+        {
+            if (!mDirectory.CompareExchange(blockIndex, current, block))
+            {
+                // Another writer materialized the slot first, its block wins
+                ReleaseBlock(block);
+                return (Block*)current;
+            }
+        }
+        catch (...)
+        {
+            ReleaseBlock(block);
+            throw;
+        }
+
+        mLogicalLength += mBlockSize;
+        return block;
+    }
+
+    Block* DynamicMemoryStore::MakeWritable(size_t blockIndex, Block* block, bool preserve)
+    {
+        if (mTier != nullptr)
+            mTier->Load(block, true);
+
+        if (block->References == 1 && (block->Flags & Block::Mapped) == 0)
+            return block;
+
+        // Copy-on-write: the slot gets a private copy, the shared or mapped
+        // block stays with its other references
+        auto copy = mShared->AllocateBlock(blockIndex);
+        mCounters.RecordAllocation();
+
+        if (preserve)
+            std::memcpy(copy->Data, block->Data, mBlockSize);
+
+        SetSlot(blockIndex, copy);
+        ReleaseBlock(block);
+        return copy;
+    }
+
+    void DynamicMemoryStore::ReleaseBlock(Block* block)
+    {
+        if (mShared->ReleaseReference(block))
+            mCounters.RecordFree();
+    }
+
+    DynamicMemorySnapshot* DynamicMemoryStore::Snapshot()
+    {
+        auto snapshot = new DynamicMemorySnapshot(mCapacity, mBlockCount, mShared);
+
+        std::lock_guard<Shared> lock(*mShared);
+        snapshot->mDirectory.ShareFrom(mDirectory);
+        snapshot->mLogicalLength = mLogicalLength;
+        return snapshot;
+    }
+
+    DynamicMemorySnapshot* DynamicMemoryStore::Snapshot(BlockBitmap& changed)
+    {
+        if (changed.Count() != mBlockCount)
+            throw NativeException(NativeError::InvalidArgument, "Bitmap does not match the block count of the store");
+
+        std::unique_ptr<BlockBitmap> tracker(mChanged == nullptr ? new BlockBitmap(mBlockCount) : nullptr);
+        std::unique_ptr<DynamicMemorySnapshot> snapshot(new DynamicMemorySnapshot(mCapacity, mBlockCount, mShared));
+
+        // Taking the changes and the snapshot at once guarantees that every
+        // later write is part of the next set
+        std::lock_guard<Shared> lock(*mShared);
+        if (tracker != nullptr)
+        {
+            mChanged = tracker.release();
+            changed.SetAll();
+        }
+        else
+        {
+            mChanged->MoveTo(changed);
+        }
+
+        mShared->DetachImage(changed);
+
+        snapshot->mDirectory.ShareFrom(mDirectory);
+        snapshot->mLogicalLength = mLogicalLength;
+        return snapshot.release();
+    }
+
+    void DynamicMemoryStore::TrackChanges()
+    {
+        std::unique_ptr<BlockBitmap> tracker(new BlockBitmap(mBlockCount));
+
+        std::lock_guard<Shared> lock(*mShared);
+        if (mChanged == nullptr)
+            mChanged = tracker.release();
+        else
+            mChanged->ClearAll();
+    }
+
+    void DynamicMemoryStore::Map(FileMapping* mapping, const BlockBitmap& backed)
+    {
+        if (backed.Count() != mBlockCount || mapping->Size() / mBlockSize < mBlockCount)
+            throw NativeException(NativeError::InvalidArgument, "Mapping does not cover all blocks of the store");
+
+        std::lock_guard<Shared> lock(*mShared);
+        if (mShared->Image != nullptr || mLogicalLength != 0)
+            throw NativeException(NativeError::InvalidArgument, "Only empty stores can be mapped");
+
+        auto& blocks = mShared->ImageBlocks;
+        auto& indices = mShared->ImageIndices;
+        auto count = backed.Population();
+
+        try
+        {
+            // Descriptors are stored in one table, so slots may point into
+            // it only once it is fully sized
+            blocks.resize(count);
+            indices.resize(count);
+
+            auto entry = (size_t)0;
+            for (size_t blockIndex = 0; blockIndex < mBlockCount; blockIndex++)
+            {
+                if (!backed.Test(blockIndex))
+                    continue;
+
+                auto data = const_cast<unsigned char*>(mapping->Data()) + blockIndex * mBlockSize;
+                blocks[entry] = Block { data, 1, Block::Mapped | Block::Embedded, 0, nullptr, 0, 0, 0, 0, 0 };
+                indices[entry] = blockIndex;
+
+                mDirectory.Set(blockIndex, &blocks[entry]);
+                entry++;
+            }
+        }
+        catch (...)
+        {
+            for (size_t root = 0; root < mDirectory.RootCount(); root++)
+                mDirectory.Release(root, [](size_t, void*) { });
+
+            blocks.clear();
+            indices.clear();
+            throw;
+        }
+
+        mLogicalLength = count * mBlockSize;
+        mShared->Image = mapping;
+    }
+
+    void DynamicMemoryStore::Restore(const DynamicMemorySnapshot& snapshot)
+    {
+        if (snapshot.mShared != mShared || snapshot.mCapacity != mCapacity)
+            throw NativeException(NativeError::InvalidArgument, "Snapshot was not taken from this store or its forks");
+
+        std::lock_guard<Shared> lock(*mShared);
+        mShared->ReleaseDirectory(mDirectory, true);
+        mDirectory.ShareFrom(snapshot.mDirectory);
+        mLogicalLength = snapshot.mLogicalLength;
+
+        if (mChanged != nullptr)
+            mChanged->SetAll();
+    }
+
+    DynamicMemoryStore* DynamicMemoryStore::Fork()
+    {
+        auto fork = new DynamicMemoryStore(mCapacity, mShared);
+
+        std::lock_guard<Shared> lock(*mShared);
+        fork->mDirectory.ShareFrom(mDirectory);
+        fork->mLogicalLength = mLogicalLength.load();
+        return fork;
+    }
+
+    DynamicMemoryStore* DynamicMemoryStore::Fork(const DynamicMemorySnapshot& snapshot)
+    {
+        auto fork = new DynamicMemoryStore(snapshot.mCapacity, snapshot.mShared);
+
+        std::lock_guard<Shared> lock(*snapshot.mShared);
+        fork->mDirectory.ShareFrom(snapshot.mDirectory);
+        fork->mLogicalLength = snapshot.mLogicalLength;
+        return fork;
+    }
+
+    DynamicMemorySnapshot::DynamicMemorySnapshot(size_t capacity, size_t blockCount, DynamicMemoryStore::Shared* shared) :
+        mCapacity(capacity),
+        mBlockSize(shared->BlockSize),
+        mDirectory(blockCount),
+        mShared(shared),
+        mLogicalLength(0)
+    {
+        mShared->Users++;
+    }
+
+    DynamicMemorySnapshot::~DynamicMemorySnapshot()
+    {
+        mShared->ReleaseDirectory(mDirectory, false);
+        mShared->Release();
+    }
+
+    bool DynamicMemorySnapshot::ReadBlock(size_t blockIndex, void* buffer) const
+    {
+        if (blockIndex >= mDirectory.BlockCount())
+            throw NativeException(NativeError::InvalidArgument, "Block index is out of range");
+
+        // The stripe keeps images from being detached during the copy
+        std::unique_lock<std::mutex> serial;
+        std::shared_lock<std::shared_mutex> shared;
+        if (mShared->Serial != nullptr)
+            serial = std::unique_lock<std::mutex>(*mShared->Serial);
+        else
+            shared = std::shared_lock<std::shared_mutex>(mShared->StripeOf(blockIndex));
+
+        auto block = (Block*)mDirectory.Get(blockIndex);
+        if (block == nullptr)
+            return false;
+
+        auto tier = mShared->Tier;
+        if (tier != nullptr)
+            tier->Load(block, false);
+
+        std::memcpy(buffer, block->Data, mBlockSize);
+
+        if (tier != nullptr)
+            tier->Trim();
+
+        return true;
+    }
+
+} // Native
+} // nDiscUtils
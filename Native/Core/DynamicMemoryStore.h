@@ -0,0 +1,302 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "BlockDirectory.h"
+#include "MemoryStore.h"
+#include "NumaTopology.h"
+
+namespace nDiscUtils {
+namespace Native {
+
+    struct Block;
+    class BlockArena;
+    class BlockBitmap;
+    class CompressedTier;
+    class DedupIndex;
+    class DynamicMemorySnapshot;
+    class FileMapping;
+
+    struct DynamicMemoryStoreOptions
+    {
+        // Largest chunk the block arena reserves at once; zero requests
+        // every block from the page provider on its own
+        size_t MaxChunkBytes = (size_t)64 << 20;
+
+        // Let slots with identical contents share one physical block
+        bool Deduplicate = false;
+
+        // Keep cold blocks compressed, only the hot set stays uncompressed
+        bool Compress = false;
+
+        // Upper bound of the hot set when compressing, zero for no bound
+        size_t HotBytes = 0;
+
+        // Compress blocks in the background once they were not accessed for
+        // this many milliseconds, zero to only compress beyond HotBytes
+        uint32_t ColdAfter = 30000;
+
+        // Nodes the memory of new blocks is taken from
+        NumaPolicy Numa;
+
+        // Memory resident blocks may occupy, packed or not, before the
+        // coldest ones are spilled to SpillPath; zero for no budget
+        size_t MemoryBudget = 0;
+
+        // Scratch file spilled blocks are kept in; it is replaced when the
+        // store is created and deleted once the pool is freed
+        std::string SpillPath;
+    };
+
+    struct DynamicMemoryStoreStatistics
+    {
+        size_t HotBlocks = 0;
+        size_t CompressedBlocks = 0;
+        size_t CompressedBytes = 0;
+
+        // Block accesses served from uncompressed blocks vs. those which
+        // had to be decompressed or read back first
+        uint64_t HotHits = 0;
+        uint64_t HotMisses = 0;
+
+        // Memory held by blocks, packed or not, apart from mapped ones
+        size_t ResidentBytes = 0;
+
+        size_t SpilledBlocks = 0;
+        size_t SpilledBytes = 0;
+
+        // Blocks written to and read back from the spill file so far
+        uint64_t Evictions = 0;
+        uint64_t SpillReads = 0;
+
+        // Batches which could not be written to the spill file
+        uint64_t SpillFailures = 0;
+    };
+
+    // Splits the capacity into fixed-size blocks which are only backed by
+    // memory once non-zero data is written to them; unbacked blocks read as
+    // zero and blocks which are overwritten with zeros are released again.
+    //
+    // Read() and Write() may be called from multiple threads. Blocks are
+    // materialized lock-free and only releasing a block excludes the other
+    // requests on the same directory leaf; stores which deduplicate or
+    // compress blocks or keep a memory budget serialize all requests
+    // instead. Blocks beyond the budget are spilled to a scratch file and
+    // read back on their next access, see CompressedTier.
+    //
+    // Snapshots and forks share the directory leaves and blocks of the
+    // store, so taking them only costs a pass over the root table. Leaves
+    // and blocks are copied once either side writes to them. All of them
+    // allocate from one block pool; the pool is freed with its last user.
+    //
+    // Stores restored from an image read blocks straight from a mapping of
+    // it until they are written, see Map().
+    class DynamicMemoryStore : public MemoryStore
+    {
+
+    public:
+        DynamicMemoryStore(size_t capacity, size_t blockSize, PageProvider* provider = nullptr);
+        DynamicMemoryStore(size_t capacity, size_t blockSize, const DynamicMemoryStoreOptions& options,
+            PageProvider* provider = nullptr);
+
+        ~DynamicMemoryStore();
+
+        size_t BlockSize() const
+        {
+            return mBlockSize;
+        }
+
+        size_t BlockCount() const
+        {
+            return mBlockCount;
+        }
+
+        const DynamicMemoryStoreOptions& Options() const
+        {
+            return mOptions;
+        }
+
+        // Physical bytes of all blocks, shared blocks are only counted once
+        // and compressed blocks with their compressed size. Covers the whole
+        // pool shared with snapshots and forks of the store.
+        size_t CommittedBytes() const override;
+
+        // Bytes addressed by backed slots; exceeds CommittedBytes() once
+        // blocks are shared between slots
+        size_t LogicalBytes() const
+        {
+            return mLogicalLength;
+        }
+
+        // Memory reserved for blocks, including blocks kept for reuse
+        size_t ReservedBytes() const;
+
+        // Memory used to index the committed blocks
+        size_t IndexBytes() const
+        {
+            return mDirectory.IndexBytes();
+        }
+
+        DynamicMemoryStoreStatistics Statistics() const;
+
+        void Read(size_t offset, void* buffer, size_t count) override;
+
+        void Write(size_t offset, const void* buffer, size_t count) override;
+
+        void Discard(size_t offset, size_t count) override;
+
+        // Freezes the current contents; the snapshot stays valid after the
+        // store is destroyed and has to be deleted by the caller
+        DynamicMemorySnapshot* Snapshot();
+
+        // Takes a snapshot and moves the blocks written since the previous
+        // call into changed. Before the first call every block counts as
+        // changed and recording starts with it. Changed blocks still mapped
+        // from an image are copied into memory first, so their range of the
+        // image may be overwritten afterwards.
+        DynamicMemorySnapshot* Snapshot(BlockBitmap& changed);
+
+        // Starts recording changes for Snapshot(changed) with none so far
+        void TrackChanges();
+
+        // Backs the blocks marked in backed by a read-only mapping which
+        // holds all blocks back to back; they are read from the mapping
+        // until they are written. The store has to be empty and owns the
+        // mapping once this returns.
+        void Map(FileMapping* mapping, const BlockBitmap& backed);
+
+        // Resets the contents to a snapshot taken from this store or any
+        // of its forks
+        void Restore(const DynamicMemorySnapshot& snapshot);
+
+        // Returns an independent store starting with the current contents
+        DynamicMemoryStore* Fork();
+
+        // Returns an independent store starting with the snapshot's contents
+        static DynamicMemoryStore* Fork(const DynamicMemorySnapshot& snapshot);
+
+    private:
+        struct Shared;
+
+        friend class DynamicMemorySnapshot;
+
+        DynamicMemoryStore(size_t capacity, Shared* shared);
+
+        size_t AssertBlockSize(size_t blockSize) const;
+
+        void UnshareLeaf(size_t blockIndex);
+
+        void SetSlot(size_t blockIndex, Block* block);
+
+        Block* InstallBlock(size_t blockIndex);
+
+        Block* MaterializeBlock(size_t blockIndex);
+
+        Block* MakeWritable(size_t blockIndex, Block* block, bool preserve);
+
+        // Drops the reference of a slot, counting the block if it is freed
+        void ReleaseBlock(Block* block);
+
+        // Writes count bytes from source, nullptr writes zeros
+        void WriteRange(size_t offset, const unsigned char* source, size_t count);
+
+        void WriteBlock(size_t blockIndex, size_t innerBlockOffset, const unsigned char* source, size_t count);
+
+        void WriteBlockDeduplicated(size_t blockIndex, size_t innerBlockOffset, const unsigned char* source, size_t count);
+
+        DynamicMemoryStoreOptions mOptions;
+        size_t mBlockSize;
+        size_t mBlockCount;
+        BlockDirectory mDirectory;
+        Shared* mShared;
+
+        // Blocks written since the last Snapshot(changed), nullptr until
+        // changes are tracked
+        BlockBitmap* mChanged;
+
+        // Parts of the shared pool used on every request
+        BlockArena* mArena;
+        DedupIndex* mDedupIndex;
+        CompressedTier* mTier;
+        unsigned char* mScratch;
+
+        std::atomic<size_t> mLogicalLength;
+
+    };
+
+    // Frozen contents of a DynamicMemoryStore, see Snapshot()
+    class DynamicMemorySnapshot
+    {
+
+    public:
+        ~DynamicMemorySnapshot();
+
+        DynamicMemorySnapshot(const DynamicMemorySnapshot&) = delete;
+        DynamicMemorySnapshot& operator=(const DynamicMemorySnapshot&) = delete;
+
+        size_t Capacity() const
+        {
+            return mCapacity;
+        }
+
+        size_t BlockSize() const
+        {
+            return mBlockSize;
+        }
+
+        size_t BlockCount() const
+        {
+            return mDirectory.BlockCount();
+        }
+
+        bool IsBacked(size_t blockIndex) const
+        {
+            return mDirectory.Get(blockIndex) != nullptr;
+        }
+
+        // Copies a whole block into buffer; returns false without touching
+        // the buffer if the block is not backed. May be called concurrently
+        // with any request on the stores of the pool.
+        bool ReadBlock(size_t blockIndex, void* buffer) const;
+
+        // Bytes addressed by backed slots at the time of the snapshot
+        size_t LogicalBytes() const
+        {
+            return mLogicalLength;
+        }
+
+    private:
+        friend class DynamicMemoryStore;
+
+        DynamicMemorySnapshot(size_t capacity, size_t blockCount, DynamicMemoryStore::Shared* shared);
+
+        size_t mCapacity;
+        size_t mBlockSize;
+        BlockDirectory mDirectory;
+        DynamicMemoryStore::Shared* mShared;
+        size_t mLogicalLength;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,69 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "ExtentMap.h"
+
+#include <algorithm>
+
+namespace nDiscUtils {
+namespace Native {
+
+    ExtentMap::ExtentMap(std::vector<DataExtent> extents) :
+        mDataBytes(0)
+    {
+        std::sort(extents.begin(), extents.end(), [](const DataExtent& left, const DataExtent& right)
+        {
+            return left.Offset < right.Offset;
+        });
+
+        for (auto& extent : extents)
+        {
+            if (extent.Length == 0)
+                continue;
+
+            auto end = extent.Offset + extent.Length;
+            if (!mExtents.empty() && extent.Offset <= mExtents.back().Offset + mExtents.back().Length)
+            {
+                auto& last = mExtents.back();
+                last.Length = std::max(last.Offset + last.Length, end) - last.Offset;
+                continue;
+            }
+
+            mExtents.push_back(extent);
+        }
+
+        for (auto& extent : mExtents)
+            mDataBytes += extent.Length;
+    }
+
+    DataExtent ExtentMap::NextData(uint64_t offset) const
+    {
+        auto extent = std::upper_bound(mExtents.begin(), mExtents.end(), offset,
+            [](uint64_t value, const DataExtent& candidate)
+            {
+                return value < candidate.Offset + candidate.Length;
+            });
+
+        if (extent == mExtents.end())
+            return DataExtent { offset, 0 };
+
+        return *extent;
+    }
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,65 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Range of a source which holds data, as opposed to a hole
+    struct DataExtent
+    {
+        uint64_t Offset;
+        uint64_t Length;
+    };
+
+    // Sorted, non-overlapping data extents of a source, such as the
+    // allocated ranges of a sparse file or the clusters a file system uses
+    class ExtentMap
+    {
+
+    public:
+        // Extents may be given in any order and may overlap or touch
+        explicit ExtentMap(std::vector<DataExtent> extents);
+
+        // First extent which ends after offset; a zero Length means that no
+        // data follows
+        DataExtent NextData(uint64_t offset) const;
+
+        uint64_t DataBytes() const
+        {
+            return mDataBytes;
+        }
+
+        const std::vector<DataExtent>& Extents() const
+        {
+            return mExtents;
+        }
+
+    private:
+        std::vector<DataExtent> mExtents;
+        uint64_t mDataBytes;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,508 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "HashEngine.h"
+#include "AlignedBuffer.h"
+#include "Crc32c.h"
+#include "NativeException.h"
+#include "Sha256.h"
+#include "XxHash3.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        void WriteBigEndian(unsigned char* digest, uint64_t value, size_t bytes)
+        {
+            for (size_t i = 0; i < bytes; i++)
+                digest[i] = (unsigned char)(value >> (8 * (bytes - 1 - i)));
+        }
+
+        uint32_t ReadBigEndian32(const unsigned char* digest)
+        {
+            return ((uint32_t)digest[0] << 24) | ((uint32_t)digest[1] << 16) | ((uint32_t)digest[2] << 8) | digest[3];
+        }
+
+        // Digest of the whole data for the algorithms which cannot be
+        // combined from the block digests
+        class StreamDigest
+        {
+
+        public:
+            explicit StreamDigest(HashAlgorithm algorithm) :
+                mAlgorithm(algorithm) { }
+
+            void Update(const void* data, size_t count)
+            {
+                if (mAlgorithm == HashAlgorithm::XxHash3)
+                    mXxHash3.Update(data, count);
+                else
+                    mSha256.Update(data, count);
+            }
+
+            void Final(unsigned char* digest)
+            {
+                if (mAlgorithm == HashAlgorithm::XxHash3)
+                    WriteBigEndian(digest, mXxHash3.Digest(), sizeof(uint64_t));
+                else
+                    mSha256.Final(digest);
+            }
+
+        private:
+            HashAlgorithm mAlgorithm;
+            XxHash3 mXxHash3;
+            Sha256 mSha256;
+
+        };
+
+        // Digests of the blocks of one chunk, which starts at a block boundary
+        void HashBlocks(HashAlgorithm algorithm, const unsigned char* data, size_t count, size_t blockBytes,
+            unsigned char* digests)
+        {
+            auto digestBytes = HashEngine::DigestBytes(algorithm);
+            auto blocks = count / blockBytes;
+
+            if (algorithm == HashAlgorithm::Sha256 && blocks > 1)
+            {
+                std::vector<const unsigned char*> pointers(blocks);
+                for (size_t i = 0; i < blocks; i++)
+                    pointers[i] = data + i * blockBytes;
+
+                Sha256::HashMany(pointers.data(), blocks, blockBytes, digests);
+            }
+            else
+            {
+                for (size_t i = 0; i < blocks; i++)
+                    HashEngine::Digest(algorithm, data + i * blockBytes, blockBytes, digests + i * digestBytes);
+            }
+
+            if (count % blockBytes != 0)
+                HashEngine::Digest(algorithm, data + blocks * blockBytes, count % blockBytes, digests + blocks * digestBytes);
+        }
+
+        // Buffer of the chunk currently assigned to it
+        struct Slot
+        {
+            explicit Slot(size_t bytes) :
+                Buffer(bytes) { }
+
+            AlignedBuffer Buffer;
+
+            // Where the data of the chunk is, the buffer or memory of the source
+            SourceView View;
+
+            uint64_t Chunk = 0;
+            bool Filled = false;
+
+            // Block and stream digests which did not finish the chunk yet
+            int Pending = 0;
+        };
+
+        struct Task
+        {
+            Slot* Target;
+
+            // Feeds the whole digest instead of hashing the blocks
+            bool Stream;
+        };
+
+        // Reads a whole request into buffer unless the source can expose it
+        // in place; view points to the data afterwards. Returns false and
+        // records the failure if the source fails or ends early.
+        bool ReadChunk(ReadSource& source, uint64_t offset, unsigned char* buffer, size_t count, SourceView& view,
+            HashResult& failure)
+        {
+            size_t read;
+
+            try
+            {
+                if (source.View(offset, count, view))
+                    return true;
+
+                view.Data = buffer;
+                read = source.Read(offset, buffer, count);
+            }
+            catch (const NativeException& ex)
+            {
+                failure.FailedOffset = offset;
+                failure.Failure = ex.what();
+                if (failure.Failure.empty())
+                    failure.Failure = "Read failed";
+
+                return false;
+            }
+
+            if (read < count)
+            {
+                failure.FailedOffset = offset + read;
+                failure.Failure = "Data ends after " + std::to_string(offset + read) + " bytes";
+                return false;
+            }
+
+            return true;
+        }
+
+    } // namespace
+
+    HashEngine::HashEngine(const HashEngineOptions& options) :
+        mOptions(options)
+    {
+        if (options.BlockBytes == 0 || options.ChunkBytes == 0 || options.Depth == 0)
+            throw NativeException(NativeError::InvalidArgument, "Block size, chunk size and depth of a hash may not be zero");
+
+        if (options.Algorithm != HashAlgorithm::Crc32c && options.Algorithm != HashAlgorithm::XxHash3 &&
+            options.Algorithm != HashAlgorithm::Sha256)
+            throw NativeException(NativeError::InvalidArgument, "Unknown hash algorithm");
+
+        // Blocks may not straddle two chunks
+        mOptions.ChunkBytes = (options.ChunkBytes + options.BlockBytes - 1) / options.BlockBytes * options.BlockBytes;
+        if (mOptions.ChunkBytes < options.ChunkBytes)
+            throw NativeException(NativeError::Overflow, "Chunk size of a hash exceeds the address space");
+    }
+
+    HashResult HashEngine::Hash(ReadSource& source, uint64_t length) const
+    {
+        HashResult result;
+
+        auto algorithm = mOptions.Algorithm;
+        auto digestBytes = DigestBytes(algorithm);
+        auto blockBytes = (uint64_t)mOptions.BlockBytes;
+        auto chunkBytes = (uint64_t)mOptions.ChunkBytes;
+        auto streamed = algorithm != HashAlgorithm::Crc32c;
+
+        auto blocks = (length + blockBytes - 1) / blockBytes;
+        if (blocks > (uint64_t)(SIZE_MAX / digestBytes))
+            throw NativeException(NativeError::Overflow, "Block list of a hash exceeds the address space");
+
+        result.BlockDigests.resize((size_t)blocks * digestBytes);
+        StreamDigest stream(algorithm);
+
+        auto chunks = (length + chunkBytes - 1) / chunkBytes;
+        auto chunkLength = [&](uint64_t chunk)
+        {
+            return (size_t)std::min(chunkBytes, length - chunk * chunkBytes);
+        };
+
+        auto blockDigests = [&](uint64_t chunk)
+        {
+            return result.BlockDigests.data() + (size_t)(chunk * (chunkBytes / blockBytes)) * digestBytes;
+        };
+
+        auto finish = [&]()
+        {
+            result.HashedBytes = length;
+            result.Digest.resize(digestBytes);
+
+            if (streamed)
+            {
+                stream.Final(result.Digest.data());
+                return;
+            }
+
+            // Full blocks all combine with the same length, only the last
+            // one may be shorter
+            auto crc = (uint32_t)0;
+            for (uint64_t block = 0; block < blocks; block++)
+            {
+                auto blockCrc = ReadBigEndian32(result.BlockDigests.data() + (size_t)block * digestBytes);
+                auto count = std::min(blockBytes, length - block * blockBytes);
+                crc = block == 0 ? blockCrc : Crc32c::Combine(crc, blockCrc, count);
+            }
+
+            WriteBigEndian(result.Digest.data(), crc, sizeof(uint32_t));
+        };
+
+        auto fail = [&](uint64_t hashedChunks)
+        {
+            result.HashedBytes = hashedChunks * chunkBytes;
+            result.BlockDigests.resize((size_t)(result.HashedBytes / blockBytes) * digestBytes);
+        };
+
+        if (chunks == 0)
+        {
+            finish();
+            return result;
+        }
+
+        // A single chunk is not worth any threads
+        if (chunks == 1)
+        {
+            AlignedBuffer buffer((size_t)length);
+            SourceView view;
+            if (!ReadChunk(source, 0, buffer.Data(), (size_t)length, view, result))
+            {
+                fail(0);
+                return result;
+            }
+
+            HashBlocks(algorithm, view.Data, (size_t)length, (size_t)blockBytes, blockDigests(0));
+            if (streamed)
+                stream.Update(view.Data, (size_t)length);
+
+            finish();
+            return result;
+        }
+
+        auto tasksPerChunk = streamed ? 2 : 1;
+        auto depth = (size_t)std::min<uint64_t>(mOptions.Depth, chunks);
+        auto threads = (size_t)(mOptions.Threads != 0 ? mOptions.Threads : std::thread::hardware_concurrency());
+        threads = std::max<size_t>(std::min(threads, depth * tasksPerChunk), 1);
+
+        std::vector<std::unique_ptr<Slot>> slots;
+        for (size_t i = 0; i < depth; i++)
+        {
+            slots.emplace_back(new Slot((size_t)chunkBytes));
+            slots.back()->Chunk = i;
+            slots.back()->Pending = tasksPerChunk;
+        }
+
+        std::mutex lock;
+        std::condition_variable readable;
+        std::condition_variable runnable;
+        std::deque<Task> tasks;
+
+        // Chunks done with both digests, which are only counted in order
+        std::vector<bool> finished((size_t)chunks);
+        uint64_t completed = 0;
+
+        // Next chunk for the whole digest and whether a thread feeds it
+        uint64_t nextStreamed = 0;
+        bool streaming = false;
+
+        bool failed = false;
+        bool stopped = false;
+        std::exception_ptr error;
+
+        // Called with the lock held
+        auto stop = [&](std::exception_ptr exception)
+        {
+            if (exception && !error)
+                error = exception;
+
+            stopped = true;
+            readable.notify_all();
+            runnable.notify_all();
+        };
+
+        // Queues the next chunk for the whole digest once it is read and no
+        // other thread is feeding it; called with the lock held
+        auto queueStream = [&]()
+        {
+            if (!streamed || streaming || nextStreamed == chunks)
+                return;
+
+            auto& slot = *slots[(size_t)(nextStreamed % depth)];
+            if (slot.Chunk != nextStreamed || !slot.Filled)
+                return;
+
+            streaming = true;
+            tasks.push_back({ &slot, true });
+            runnable.notify_one();
+        };
+
+        auto reader = [&]()
+        {
+            try
+            {
+                for (uint64_t chunk = 0; chunk < chunks; chunk++)
+                {
+                    auto& slot = *slots[(size_t)(chunk % depth)];
+
+                    {
+                        std::unique_lock<std::mutex> guard(lock);
+                        readable.wait(guard, [&]() { return stopped || slot.Chunk == chunk; });
+                        if (stopped)
+                            return;
+                    }
+
+                    HashResult failure;
+                    auto read = ReadChunk(source, chunk * chunkBytes, slot.Buffer.Data(), chunkLength(chunk), slot.View,
+                        failure);
+
+                    std::lock_guard<std::mutex> guard(lock);
+                    if (!read)
+                    {
+                        failed = true;
+                        result.FailedOffset = failure.FailedOffset;
+                        result.Failure = failure.Failure;
+
+                        stop(nullptr);
+                        return;
+                    }
+
+                    slot.Filled = true;
+                    tasks.push_back({ &slot, false });
+                    runnable.notify_one();
+                    queueStream();
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stop(std::current_exception());
+            }
+        };
+
+        auto worker = [&]()
+        {
+            try
+            {
+                for (;;)
+                {
+                    Task task;
+
+                    {
+                        std::unique_lock<std::mutex> guard(lock);
+                        runnable.wait(guard, [&]() { return stopped || !tasks.empty() || completed == chunks; });
+                        if (stopped || tasks.empty())
+                            return;
+
+                        task = tasks.front();
+                        tasks.pop_front();
+                    }
+
+                    auto& slot = *task.Target;
+                    auto count = chunkLength(slot.Chunk);
+
+                    if (task.Stream)
+                        stream.Update(slot.View.Data, count);
+                    else
+                        HashBlocks(algorithm, slot.View.Data, count, (size_t)blockBytes, blockDigests(slot.Chunk));
+
+                    std::lock_guard<std::mutex> guard(lock);
+                    if (task.Stream)
+                    {
+                        streaming = false;
+                        nextStreamed++;
+                    }
+
+                    if (--slot.Pending == 0)
+                    {
+                        finished[(size_t)slot.Chunk] = true;
+                        while (completed < chunks && finished[(size_t)completed])
+                            completed++;
+
+                        // Hand the buffer to the chunk depth positions ahead
+                        slot.Chunk += depth;
+                        slot.Filled = false;
+                        slot.View = SourceView();
+                        slot.Pending = tasksPerChunk;
+                        readable.notify_all();
+
+                        if (completed == chunks)
+                            runnable.notify_all();
+                    }
+
+                    if (task.Stream)
+                        queueStream();
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stop(std::current_exception());
+            }
+        };
+
+        std::vector<std::thread> pool;
+        try
+        {
+            pool.emplace_back(reader);
+
+            for (size_t i = 1; i < threads; i++)
+                pool.emplace_back(worker);
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stop(nullptr);
+            }
+
+            for (auto& thread : pool)
+                thread.join();
+
+            throw;
+        }
+
+        // The calling thread hashes as well
+        worker();
+
+        for (auto& thread : pool)
+            thread.join();
+
+        if (error)
+            std::rethrow_exception(error);
+
+        if (failed)
+            fail(completed);
+        else
+            finish();
+
+        return result;
+    }
+
+    size_t HashEngine::DigestBytes(HashAlgorithm algorithm)
+    {
+        switch (algorithm)
+        {
+            case HashAlgorithm::Crc32c: return sizeof(uint32_t);
+            case HashAlgorithm::XxHash3: return sizeof(uint64_t);
+            default: return Sha256::DigestBytes;
+        }
+    }
+
+    const char* HashEngine::AlgorithmName(HashAlgorithm algorithm)
+    {
+        switch (algorithm)
+        {
+            case HashAlgorithm::Crc32c: return "crc32c";
+            case HashAlgorithm::XxHash3: return "xxh3";
+            default: return "sha256";
+        }
+    }
+
+    void HashEngine::Digest(HashAlgorithm algorithm, const void* data, size_t count, unsigned char* digest)
+    {
+        switch (algorithm)
+        {
+            case HashAlgorithm::Crc32c:
+                WriteBigEndian(digest, Crc32c::Update(0, data, count), sizeof(uint32_t));
+                break;
+
+            case HashAlgorithm::XxHash3:
+                WriteBigEndian(digest, XxHash3::Hash(data, count), sizeof(uint64_t));
+                break;
+
+            default:
+                Sha256::Hash(data, count, digest);
+                break;
+        }
+    }
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,106 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "ReadSource.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nDiscUtils {
+namespace Native {
+
+    enum class HashAlgorithm
+    {
+        Crc32c,
+        XxHash3,
+        Sha256
+    };
+
+    struct HashEngineOptions
+    {
+        HashAlgorithm Algorithm = HashAlgorithm::XxHash3;
+
+        // Bytes covered by each digest of the block list
+        size_t BlockBytes = 1u << 20;
+
+        // Bytes read per request, rounded up to whole blocks
+        size_t ChunkBytes = 4u << 20;
+
+        // Chunks which are read or hashed at the same time
+        size_t Depth = 4;
+
+        // Threads hashing chunks, zero for one per core
+        size_t Threads = 0;
+    };
+
+    struct HashResult
+    {
+        // Leading bytes which were hashed before the end or a failure
+        uint64_t HashedBytes = 0;
+
+        // Digest of the whole data as the algorithm's own tools print it,
+        // empty after a failure
+        std::vector<unsigned char> Digest;
+
+        // Digests of the blocks within HashedBytes back to back; the last
+        // block may be shorter than BlockBytes
+        std::vector<unsigned char> BlockDigests;
+
+        // Offset of the failed request and the reason, empty on success
+        uint64_t FailedOffset = 0;
+        std::string Failure;
+    };
+
+    // Hashes a source into a digest of the whole data and one per block.
+    // A reader thread keeps Depth chunks in flight while filled chunks are
+    // split into blocks hashed on all threads, equally long SHA-256 blocks
+    // side by side. The whole digest is folded from the block CRCs for
+    // CRC32C; XXH3 and SHA-256 feed the chunks in order into one state on
+    // whichever thread is free, overlapping with the block digests.
+    class HashEngine
+    {
+
+    public:
+        explicit HashEngine(const HashEngineOptions& options = HashEngineOptions());
+
+        const HashEngineOptions& Options() const
+        {
+            return mOptions;
+        }
+
+        // Hashes the first length bytes of the source
+        HashResult Hash(ReadSource& source, uint64_t length) const;
+
+        static size_t DigestBytes(HashAlgorithm algorithm);
+
+        static const char* AlgorithmName(HashAlgorithm algorithm);
+
+        // Digest of a single buffer in the same form as HashResult::Digest
+        static void Digest(HashAlgorithm algorithm, const void* data, size_t count, unsigned char* digest);
+
+    private:
+        HashEngineOptions mOptions;
+
+    };
+
+} // Native
+} // nDiscUtils
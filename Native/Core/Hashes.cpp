@@ -0,0 +1,133 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "Hashes.h"
+
+#include <cstring>
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        const uint64_t Prime64_1 = 0x9E3779B185EBCA87ull;
+        const uint64_t Prime64_2 = 0xC2B2AE3D27D4EB4Full;
+        const uint64_t Prime64_3 = 0x165667B19E3779F9ull;
+        const uint64_t Prime64_4 = 0x85EBCA77C2B2AE63ull;
+        const uint64_t Prime64_5 = 0x27D4EB2F165667C5ull;
+
+        inline uint64_t RotateLeft(uint64_t value, int bits)
+        {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        inline uint64_t Read64(const unsigned char* ptr)
+        {
+            uint64_t value;
+            std::memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+
+        inline uint32_t Read32(const unsigned char* ptr)
+        {
+            uint32_t value;
+            std::memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+
+        inline uint64_t Round(uint64_t accumulator, uint64_t input)
+        {
+            accumulator += input * Prime64_2;
+            accumulator = RotateLeft(accumulator, 31);
+            return accumulator * Prime64_1;
+        }
+
+        inline uint64_t MergeRound(uint64_t accumulator, uint64_t value)
+        {
+            accumulator ^= Round(0, value);
+            return accumulator * Prime64_1 + Prime64_4;
+        }
+
+    } // namespace
+
+    uint64_t Hashes::XxHash64(const void* data, size_t count, uint64_t seed)
+    {
+        auto ptr = (const unsigned char*)data;
+        auto end = ptr + count;
+        uint64_t hash;
+
+        if (count >= 32)
+        {
+            auto limit = end - 32;
+            auto v1 = seed + Prime64_1 + Prime64_2;
+            auto v2 = seed + Prime64_2;
+            auto v3 = seed;
+            auto v4 = seed - Prime64_1;
+
+            do
+            {
+                v1 = Round(v1, Read64(ptr));
+                v2 = Round(v2, Read64(ptr + 8));
+                v3 = Round(v3, Read64(ptr + 16));
+                v4 = Round(v4, Read64(ptr + 24));
+                ptr += 32;
+            } while (ptr <= limit);
+
+            hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+            hash = MergeRound(hash, v1);
+            hash = MergeRound(hash, v2);
+            hash = MergeRound(hash, v3);
+            hash = MergeRound(hash, v4);
+        }
+        else
+        {
+            hash = seed + Prime64_5;
+        }
+
+        hash += (uint64_t)count;
+
+        for (; ptr + 8 <= end; ptr += 8)
+        {
+            hash ^= Round(0, Read64(ptr));
+            hash = RotateLeft(hash, 27) * Prime64_1 + Prime64_4;
+        }
+
+        if (ptr + 4 <= end)
+        {
+            hash ^= (uint64_t)Read32(ptr) * Prime64_1;
+            hash = RotateLeft(hash, 23) * Prime64_2 + Prime64_3;
+            ptr += 4;
+        }
+
+        for (; ptr < end; ptr++)
+        {
+            hash ^= (*ptr) * Prime64_5;
+            hash = RotateLeft(hash, 11) * Prime64_1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= Prime64_2;
+        hash ^= hash >> 29;
+        hash *= Prime64_3;
+        hash ^= hash >> 32;
+
+        return hash;
+    }
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,157 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "ExtentMap.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Expected use of a mapped range, see FileMapping::Advise()
+    enum class MapAdvice
+    {
+        // Read front to back, pages behind may be dropped early
+        Sequential,
+
+        // Read in no particular order, no read-ahead
+        Random,
+
+        // Read soon, starts reading the range in the background
+        WillNeed,
+    };
+
+    // Read-only view of a file range, unmapped on destruction. It stays
+    // valid after the ImageFile it was created from is closed.
+    class FileMapping
+    {
+
+    public:
+        virtual ~FileMapping() { }
+
+        // Hints how a range of the view is going to be read; platforms
+        // without a matching hint ignore it
+        virtual void Advise(size_t /* offset */, size_t /* size */, MapAdvice /* advice */) { }
+
+        FileMapping(const FileMapping&) = delete;
+        FileMapping& operator=(const FileMapping&) = delete;
+
+        const unsigned char* Data() const
+        {
+            return mData;
+        }
+
+        size_t Size() const
+        {
+            return mSize;
+        }
+
+    protected:
+        FileMapping(const unsigned char* data, size_t size) :
+            mData(data),
+            mSize(size) { }
+
+        const unsigned char* mData;
+        size_t mSize;
+
+    };
+
+    enum class ImageFileMode
+    {
+        // Existing file, read-only
+        Read,
+
+        // Existing file, read-write
+        Write,
+
+        // New sparse file, replacing any existing one
+        Create,
+    };
+
+    // Positional I/O on the files stores are persisted to. ReadAt() and
+    // WriteAt() may be called concurrently; failures throw a NativeException
+    // of NativeError::IO carrying the system error code. Paths are UTF-8.
+    //
+    // Unbuffered files bypass the system cache, so offsets, sizes and buffer
+    // addresses have to be aligned to the page provider's granularity.
+    // Write-through files return from writes once the data reached the
+    // device rather than the cache.
+    class ImageFile
+    {
+
+    public:
+        virtual ~ImageFile() { }
+
+        // Opens a file of the current platform
+        static ImageFile* Open(const std::string& path, ImageFileMode mode, bool unbuffered = false,
+            bool writeThrough = false);
+
+        static bool Exists(const std::string& path);
+
+        // Removes the file if it exists, failures are ignored
+        static void Delete(const std::string& path);
+
+        // Renames source to target, replacing target
+        static void Replace(const std::string& source, const std::string& target);
+
+        const std::string& Path() const
+        {
+            return mPath;
+        }
+
+        virtual bool Unbuffered() const = 0;
+
+        virtual uint64_t Length() const = 0;
+
+        // Growing leaves a hole which reads back as zero
+        virtual void SetLength(uint64_t length) = 0;
+
+        virtual void ReadAt(uint64_t offset, void* buffer, size_t count) = 0;
+
+        virtual void WriteAt(uint64_t offset, const void* buffer, size_t count) = 0;
+
+        // Frees the storage of the range where the file system supports it;
+        // the range reads back as zero either way
+        virtual void Deallocate(uint64_t offset, uint64_t count) = 0;
+
+        // First allocated range which ends after offset, Length zero if only
+        // holes follow; file systems without sparse files report all of the
+        // file as allocated
+        virtual DataExtent NextData(uint64_t offset) = 0;
+
+        virtual void Flush() = 0;
+
+        // Offsets passed to Map() have to be aligned to this
+        virtual size_t MapGranularity() const = 0;
+
+        virtual FileMapping* Map(uint64_t offset, size_t size) = 0;
+
+    protected:
+        explicit ImageFile(const std::string& path) :
+            mPath(path) { }
+
+        std::string mPath;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,136 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        // Buckets per power of two are half of the values recorded exactly
+        constexpr unsigned SubBucketBits = 7;
+        constexpr uint64_t ExactValues = 2ull << SubBucketBits;
+        constexpr unsigned MaxBit = 40;
+        constexpr size_t BucketCount = (size_t)ExactValues + ((size_t)(MaxBit - SubBucketBits) << SubBucketBits);
+
+        unsigned HighestBit(uint64_t value)
+        {
+            unsigned bit = 0;
+            while (value >>= 1)
+                bit++;
+
+            return bit;
+        }
+
+    } // namespace
+
+    LatencyHistogram::LatencyHistogram() :
+        mCounts(BucketCount, 0),
+        mCount(0),
+        mTotal(0),
+        mMin(UINT64_MAX),
+        mMax(0) { }
+
+    size_t LatencyHistogram::Bucket(uint64_t value)
+    {
+        if (value < ExactValues)
+            return (size_t)value;
+
+        // The top SubBucketBits + 1 bits select the bucket within the octave
+        auto shift = HighestBit(value) - SubBucketBits;
+        return ((size_t)shift << SubBucketBits) + (size_t)(value >> shift);
+    }
+
+    uint64_t LatencyHistogram::BucketEnd(size_t bucket)
+    {
+        if (bucket < ExactValues)
+            return bucket;
+
+        auto shift = (unsigned)(bucket >> SubBucketBits) - 1;
+        auto mantissa = (uint64_t)bucket - ((uint64_t)shift << SubBucketBits);
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    void LatencyHistogram::Record(uint64_t nanoseconds)
+    {
+        auto value = std::min(nanoseconds, MaxValue);
+
+        mCounts[Bucket(value)]++;
+        mCount++;
+        mTotal += value;
+        mMin = std::min(mMin, value);
+        mMax = std::max(mMax, value);
+    }
+
+    void LatencyHistogram::RecordSeconds(double seconds)
+    {
+        auto nanoseconds = seconds * 1e9;
+        Record(nanoseconds <= 0.0 ? 0 : nanoseconds >= (double)MaxValue ? MaxValue : (uint64_t)std::llround(nanoseconds));
+    }
+
+    void LatencyHistogram::Merge(const LatencyHistogram& other)
+    {
+        if (other.mCount == 0)
+            return;
+
+        for (size_t i = 0; i < BucketCount; i++)
+            mCounts[i] += other.mCounts[i];
+
+        mCount += other.mCount;
+        mTotal += other.mTotal;
+        mMin = std::min(mMin, other.mMin);
+        mMax = std::max(mMax, other.mMax);
+    }
+
+    void LatencyHistogram::Reset()
+    {
+        if (mCount == 0)
+            return;
+
+        std::fill(mCounts.begin(), mCounts.end(), 0);
+        mCount = 0;
+        mTotal = 0;
+        mMin = UINT64_MAX;
+        mMax = 0;
+    }
+
+    uint64_t LatencyHistogram::Percentile(double percentile) const
+    {
+        if (mCount == 0)
+            return 0;
+
+        auto rank = (uint64_t)std::ceil(std::min(std::max(percentile, 0.0), 100.0) / 100.0 * mCount);
+        rank = std::max<uint64_t>(rank, 1);
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BucketCount; i++)
+        {
+            seen += mCounts[i];
+            if (seen >= rank)
+                return std::min(std::max(BucketEnd(i), mMin), mMax);
+        }
+
+        return mMax;
+    }
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,89 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Latency distribution in the manner of an HDR histogram: values are
+    // nanoseconds, recorded exactly below 256 and with 128 buckets per power
+    // of two above, so every percentile is within 1% of the recorded value.
+    // Values beyond MaxValue count as MaxValue. Recording is O(1) and not
+    // synchronized.
+    class LatencyHistogram
+    {
+
+    public:
+        // About 36 minutes
+        static constexpr uint64_t MaxValue = (1ull << 41) - 1;
+
+        LatencyHistogram();
+
+        void Record(uint64_t nanoseconds);
+
+        void RecordSeconds(double seconds);
+
+        // Adds all values recorded by another histogram
+        void Merge(const LatencyHistogram& other);
+
+        void Reset();
+
+        uint64_t Count() const
+        {
+            return mCount;
+        }
+
+        uint64_t Min() const
+        {
+            return (mCount == 0 ? 0 : mMin);
+        }
+
+        uint64_t Max() const
+        {
+            return mMax;
+        }
+
+        double Mean() const
+        {
+            return (mCount == 0 ? 0.0 : (double)mTotal / mCount);
+        }
+
+        // Smallest value which at least percentile percent of all values do
+        // not exceed, as the upper end of its bucket; zero when empty
+        uint64_t Percentile(double percentile) const;
+
+    private:
+        static size_t Bucket(uint64_t value);
+
+        static uint64_t BucketEnd(size_t bucket);
+
+        std::vector<uint64_t> mCounts;
+        uint64_t mCount;
+        uint64_t mTotal;
+        uint64_t mMin;
+        uint64_t mMax;
+
+    };
+
+} // Native
+} // nDiscUtils
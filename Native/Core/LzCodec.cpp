@@ -0,0 +1,276 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "LzCodec.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        const size_t MinMatch = 4;
+        const size_t LastLiterals = 5;
+        const size_t MatchFindLimit = 12;
+        const size_t MaxDistance = 65535;
+        const int HashLog = 12;
+
+        inline uint32_t Read32(const unsigned char* ptr)
+        {
+            uint32_t value;
+            std::memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+
+        inline uint64_t Read64(const unsigned char* ptr)
+        {
+            uint64_t value;
+            std::memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+
+        inline uint32_t Hash(uint32_t sequence)
+        {
+            return (sequence * 2654435761u) >> (32 - HashLog);
+        }
+
+        // Length of the common prefix of both pointers, not reaching past limit
+        inline size_t MatchLength(const unsigned char* ptr, const unsigned char* match, const unsigned char* limit)
+        {
+            auto start = ptr;
+
+            while (ptr + 8 <= limit && Read64(ptr) == Read64(match))
+            {
+                ptr += 8;
+                match += 8;
+            }
+
+            while (ptr < limit && *ptr == *match)
+            {
+                ptr++;
+                match++;
+            }
+
+            return (size_t)(ptr - start);
+        }
+
+        inline unsigned char* WriteLength(unsigned char* out, size_t length)
+        {
+            while (length >= 255)
+            {
+                *out++ = 255;
+                length -= 255;
+            }
+
+            *out++ = (unsigned char)length;
+            return out;
+        }
+
+        inline bool ReadLength(const unsigned char*& in, const unsigned char* end, size_t& length)
+        {
+            unsigned char value;
+
+            do
+            {
+                if (in >= end)
+                    return false;
+
+                value = *in++;
+                length += value;
+            } while (value == 255);
+
+            return true;
+        }
+
+        // Space a sequence with the given literal count needs at most, not
+        // counting the length bytes of its match
+        inline size_t SequenceBound(size_t literals)
+        {
+            return 1 + literals + (literals / 255) + 1 + 2;
+        }
+
+    } // namespace
+
+    size_t LzCodec::Compress(const void* source, size_t count, void* destination, size_t capacity)
+    {
+        auto in = (const unsigned char*)source;
+        auto end = in + count;
+        auto out = (unsigned char*)destination;
+        auto outEnd = out + capacity;
+        auto anchor = in;
+
+        if (count > MatchFindLimit)
+        {
+            auto matchFindLimit = end - MatchFindLimit;
+            auto matchLimit = end - LastLiterals;
+            uint32_t table[1 << HashLog] = { };
+
+            auto ptr = in + 1;
+            while (ptr < matchFindLimit)
+            {
+                auto sequence = Read32(ptr);
+                auto hash = Hash(sequence);
+                auto match = in + table[hash];
+                table[hash] = (uint32_t)(ptr - in);
+
+                if (match >= ptr || (size_t)(ptr - match) > MaxDistance || Read32(match) != sequence)
+                {
+                    // Step faster through data which does not match at all
+                    ptr += 1 + ((size_t)(ptr - anchor) >> 6);
+                    continue;
+                }
+
+                while (ptr > anchor && match > in && ptr[-1] == match[-1])
+                {
+                    ptr--;
+                    match--;
+                }
+
+                auto literals = (size_t)(ptr - anchor);
+                auto length = MinMatch + MatchLength(ptr + MinMatch, match + MinMatch, matchLimit);
+                auto extra = length - MinMatch;
+
+                if (SequenceBound(literals) + (extra / 255) + 1 > (size_t)(outEnd - out))
+                    return 0;
+
+                auto token = out++;
+                if (literals >= 15)
+                {
+                    *token = 15 << 4;
+                    out = WriteLength(out, literals - 15);
+                }
+                else
+                {
+                    *token = (unsigned char)(literals << 4);
+                }
+
+                std::memcpy(out, anchor, literals);
+                out += literals;
+
+                auto distance = (uint16_t)(ptr - match);
+                *out++ = (unsigned char)(distance & 0xFF);
+                *out++ = (unsigned char)(distance >> 8);
+
+                if (extra >= 15)
+                {
+                    *token |= 15;
+                    out = WriteLength(out, extra - 15);
+                }
+                else
+                {
+                    *token |= (unsigned char)extra;
+                }
+
+                ptr += length;
+                anchor = ptr;
+
+                if (ptr < matchFindLimit)
+                    table[Hash(Read32(ptr - 2))] = (uint32_t)(ptr - 2 - in);
+            }
+        }
+
+        auto literals = (size_t)(end - anchor);
+        if (1 + literals + (literals / 255) + 1 > (size_t)(outEnd - out))
+            return 0;
+
+        if (literals >= 15)
+        {
+            *out++ = 15 << 4;
+            out = WriteLength(out, literals - 15);
+        }
+        else
+        {
+            *out++ = (unsigned char)(literals << 4);
+        }
+
+        std::memcpy(out, anchor, literals);
+        out += literals;
+
+        return (size_t)(out - (unsigned char*)destination);
+    }
+
+    bool LzCodec::Decompress(const void* source, size_t sourceCount, void* destination, size_t count)
+    {
+        auto in = (const unsigned char*)source;
+        auto inEnd = in + sourceCount;
+        auto out = (unsigned char*)destination;
+        auto outStart = out;
+        auto outEnd = out + count;
+
+        while (in < inEnd)
+        {
+            auto token = *in++;
+
+            auto literals = (size_t)(token >> 4);
+            if (literals == 15 && !ReadLength(in, inEnd, literals))
+                return false;
+
+            if (literals > (size_t)(inEnd - in) || literals > (size_t)(outEnd - out))
+                return false;
+
+            std::memcpy(out, in, literals);
+            in += literals;
+            out += literals;
+
+            // The last sequence consists of literals only
+            if (in == inEnd)
+                break;
+
+            if (inEnd - in < 2)
+                return false;
+
+            auto distance = (size_t)in[0] | ((size_t)in[1] << 8);
+            in += 2;
+
+            if (distance == 0 || distance > (size_t)(out - outStart))
+                return false;
+
+            auto length = (size_t)(token & 15);
+            if (length == 15 && !ReadLength(in, inEnd, length))
+                return false;
+
+            length += MinMatch;
+            if (length > (size_t)(outEnd - out))
+                return false;
+
+            auto match = out - distance;
+            if (distance == 1)
+            {
+                std::memset(out, *match, length);
+            }
+            else if (distance >= length)
+            {
+                std::memcpy(out, match, length);
+            }
+            else
+            {
+                // Overlapping matches repeat the last distance bytes
+                for (size_t i = 0; i < length; i++)
+                    out[i] = match[i];
+            }
+
+            out += length;
+        }
+
+        return out == outEnd;
+    }
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,42 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Byte-oriented LZ77 codec using the LZ4 block format; trades ratio for
+    // speed so that cold blocks can be packed and unpacked on the I/O path
+    class LzCodec
+    {
+
+    public:
+        // Returns the size of the compressed data or zero if it would not
+        // fit into the given capacity
+        static size_t Compress(const void* source, size_t count, void* destination, size_t capacity);
+
+        // Returns false unless the input decodes to exactly count bytes
+        static bool Decompress(const void* source, size_t sourceCount, void* destination, size_t count);
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,236 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "MappedImage.h"
+#include "NativeException.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+namespace nDiscUtils {
+namespace Native {
+
+    struct MappedImage::State
+    {
+        std::unique_ptr<ImageFile> File;
+        size_t Granularity = 0;
+
+        // Guards the windows, the prefetch request and the file
+        std::mutex Lock;
+
+        // Window of the latest request which left the others, the one before
+        // it for readers still behind and the one mapped ahead of them
+        Window Current;
+        Window Previous;
+        Window Prefetched;
+
+        size_t LargestRequest = 0;
+
+        // Offset of the window the prefetcher maps next, UINT64_MAX for none
+        uint64_t PrefetchOffset = UINT64_MAX;
+        bool Stopping = false;
+        std::condition_variable Wake;
+        std::thread Prefetcher;
+
+        static bool Covers(const Window& window, uint64_t offset, size_t count)
+        {
+            return window.Mapping != nullptr && offset >= window.Offset &&
+                offset + count <= window.Offset + window.Mapping->Size();
+        }
+    };
+
+    namespace {
+
+        uint64_t AlignDown(uint64_t value, size_t alignment)
+        {
+            return value - value % alignment;
+        }
+
+    } // namespace
+
+    MappedImage::MappedImage(const std::string& path, const MappedImageOptions& options) :
+        mPath(path),
+        mOptions(options),
+        mState(new State())
+    {
+        mState->File.reset(ImageFile::Open(path, ImageFileMode::Read));
+        mState->Granularity = mState->File->MapGranularity();
+        mLength = mState->File->Length();
+
+        if (mLength > SIZE_MAX)
+            throw NativeException(NativeError::Overflow, "Image is too large to be mapped");
+
+        if (mOptions.WindowBytes == 0 || mOptions.WindowBytes >= mLength)
+        {
+            // Everything fits into one window, nothing is left to prefetch
+            mOptions.WindowBytes = (size_t)mLength;
+            mOptions.Prefetch = false;
+        }
+        else
+        {
+            mOptions.WindowBytes = std::max(mOptions.WindowBytes, mState->Granularity);
+        }
+
+        if (!mOptions.Prefetch)
+            return;
+
+        auto state = mState.get();
+        mState->Prefetcher = std::thread([this, state]()
+        {
+            std::unique_lock<std::mutex> lock(state->Lock);
+
+            while (true)
+            {
+                state->Wake.wait(lock, [state]() { return state->Stopping || state->PrefetchOffset != UINT64_MAX; });
+                if (state->Stopping)
+                    return;
+
+                auto offset = state->PrefetchOffset;
+                auto size = (size_t)std::min<uint64_t>(std::max(mOptions.WindowBytes, state->LargestRequest),
+                    mLength - offset);
+                state->PrefetchOffset = UINT64_MAX;
+
+                if (state->Prefetched.Mapping != nullptr && state->Prefetched.Offset == offset)
+                    continue;
+
+                lock.unlock();
+
+                // Readers map the window themselves if this fails
+                Window window;
+                try
+                {
+                    window.Mapping.reset(state->File->Map(offset, size));
+                    window.Offset = offset;
+                    window.Mapping->Advise(0, size, mOptions.Advice);
+                    window.Mapping->Advise(0, size, MapAdvice::WillNeed);
+                }
+                catch (const NativeException&)
+                {
+                    window = Window();
+                }
+
+                lock.lock();
+
+                // Readers may have passed it already while it was mapped
+                if (window.Mapping != nullptr && window.Offset > state->Current.Offset)
+                    state->Prefetched = window;
+            }
+        });
+    }
+
+    MappedImage::~MappedImage()
+    {
+        if (mState->Prefetcher.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mState->Lock);
+                mState->Stopping = true;
+            }
+
+            mState->Wake.notify_one();
+            mState->Prefetcher.join();
+        }
+    }
+
+    MappedImage::Window MappedImage::Acquire(uint64_t offset, size_t count)
+    {
+        std::lock_guard<std::mutex> lock(mState->Lock);
+        auto& state = *mState;
+
+        state.LargestRequest = std::max(state.LargestRequest, count);
+
+        if (State::Covers(state.Current, offset, count))
+            return state.Current;
+
+        if (State::Covers(state.Previous, offset, count))
+            return state.Previous;
+
+        Window window;
+        if (State::Covers(state.Prefetched, offset, count))
+        {
+            window = state.Prefetched;
+            state.Prefetched = Window();
+        }
+        else
+        {
+            window.Offset = AlignDown(offset, state.Granularity);
+
+            auto size = (size_t)std::min<uint64_t>(
+                std::max<uint64_t>(mOptions.WindowBytes, offset + count - window.Offset), mLength - window.Offset);
+            window.Mapping.reset(state.File->Map(window.Offset, size));
+            window.Mapping->Advise(0, size, mOptions.Advice);
+        }
+
+        state.Previous = state.Current;
+        state.Current = window;
+
+        // The next window overlaps this one by the largest request, so the
+        // request which leaves this window lies within the next one
+        auto end = window.Offset + window.Mapping->Size();
+        if (state.Prefetcher.joinable() && end < mLength)
+        {
+            auto next = AlignDown(end - std::min<uint64_t>(state.LargestRequest, end), state.Granularity);
+            if (next <= window.Offset)
+                next = AlignDown(end, state.Granularity);
+
+            state.PrefetchOffset = next;
+            state.Wake.notify_one();
+        }
+
+        return window;
+    }
+
+    size_t MappedImage::Read(uint64_t offset, void* buffer, size_t count)
+    {
+        if (offset >= mLength)
+            return 0;
+
+        count = (size_t)std::min<uint64_t>(count, mLength - offset);
+        if (count == 0)
+            return 0;
+
+        auto window = Acquire(offset, count);
+        std::memcpy(buffer, window.Mapping->Data() + (offset - window.Offset), count);
+
+        return count;
+    }
+
+    DataExtent MappedImage::NextData(uint64_t offset)
+    {
+        std::lock_guard<std::mutex> lock(mState->Lock);
+        return mState->File->NextData(offset);
+    }
+
+    bool MappedImage::View(uint64_t offset, size_t count, SourceView& view)
+    {
+        // Ranges reaching past the end are left to Read(), which reports them short
+        if (count == 0 || offset >= mLength || count > mLength - offset)
+            return false;
+
+        auto window = Acquire(offset, count);
+        view.Data = window.Mapping->Data() + (offset - window.Offset);
+        view.Owner = window.Mapping;
+
+        return true;
+    }
+
+} // Native
+} // nDiscUtils
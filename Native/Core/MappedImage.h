@@ -0,0 +1,114 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "ImageFile.h"
+#include "ReadSource.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace nDiscUtils {
+namespace Native {
+
+    struct MappedImageOptions
+    {
+        // Bytes mapped at a time, zero to map the whole file at once
+        size_t WindowBytes = (size_t)256 << 20;
+
+        // Hint applied to every window as it is mapped
+        MapAdvice Advice = MapAdvice::Sequential;
+
+        // Map the window following the current one on a background thread
+        // and have the system start reading it ahead of the readers
+        bool Prefetch = true;
+    };
+
+    // Read-only image file accessed through sliding mappings of large
+    // windows, so the compare, hash and scan engines read the page cache in
+    // place through View() instead of copying each chunk into a buffer.
+    //
+    // Windows start at the request which left the previous one and overlap
+    // it by the largest request seen, so requests of one size never straddle
+    // two windows. Views keep their window mapped for as long as they are
+    // held. The file must not be shrunk while it is mapped; failing reads of
+    // mapped pages are raised by the system rather than as a NativeException.
+    class MappedImage : public ReadSource
+    {
+
+    public:
+        explicit MappedImage(const std::string& path, const MappedImageOptions& options = MappedImageOptions());
+
+        ~MappedImage();
+
+        MappedImage(const MappedImage&) = delete;
+        MappedImage& operator=(const MappedImage&) = delete;
+
+        const std::string& Path() const
+        {
+            return mPath;
+        }
+
+        const MappedImageOptions& Options() const
+        {
+            return mOptions;
+        }
+
+        // Length of the file when it was opened
+        uint64_t Length() const
+        {
+            return mLength;
+        }
+
+        size_t Read(uint64_t offset, void* buffer, size_t count) override;
+
+        DataExtent NextData(uint64_t offset) override;
+
+        // Succeeds for every range within the file
+        bool View(uint64_t offset, size_t count, SourceView& view) override;
+
+        bool Concurrent() const override
+        {
+            return true;
+        }
+
+    private:
+        struct State;
+
+        struct Window
+        {
+            std::shared_ptr<FileMapping> Mapping;
+            uint64_t Offset = 0;
+        };
+
+        // Window holding [offset, offset + count), which has to lie within the file
+        Window Acquire(uint64_t offset, size_t count);
+
+        std::string mPath;
+        MappedImageOptions mOptions;
+        uint64_t mLength;
+
+        std::unique_ptr<State> mState;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,689 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "MemoryKernels.h"
+#include "CpuFeatures.h"
+
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef NDISCUTILS_X86
+#include <immintrin.h>
+#endif
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        struct KernelTable
+        {
+            // Streaming copy and fill, null if the level has none
+            void (*StreamCopy)(void* destination, const void* source, size_t count);
+            void (*StreamFill)(void* destination, unsigned char value, size_t count);
+            size_t (*FindMismatch)(const void* left, const void* right, size_t count);
+            bool (*IsZero)(const void* ptr, size_t count);
+            uint64_t (*PopCount)(const void* ptr, size_t count);
+        };
+
+        // Used when the cache size cannot be determined
+        constexpr size_t DefaultCacheBytes = 8u << 20;
+
+        inline unsigned TrailingZeros(uint64_t value)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+#ifdef _M_X64
+            _BitScanForward64(&index, value);
+#else
+            if (!_BitScanForward(&index, (unsigned long)value))
+            {
+                _BitScanForward(&index, (unsigned long)(value >> 32));
+                index += 32;
+            }
+#endif
+            return (unsigned)index;
+#else
+            return (unsigned)__builtin_ctzll(value);
+#endif
+        }
+
+        // Scalar kernels, which also finish the tails of the vector ones
+
+        size_t ScalarFindMismatch(const void* left, const void* right, size_t count)
+        {
+            auto a = (const unsigned char*)left;
+            auto b = (const unsigned char*)right;
+            auto i = (size_t)0;
+
+            for (; i + sizeof(uint64_t) <= count; i += sizeof(uint64_t))
+            {
+                uint64_t x, y;
+                std::memcpy(&x, a + i, sizeof(x));
+                std::memcpy(&y, b + i, sizeof(y));
+
+                if (x != y)
+                    break;
+            }
+
+            for (; i < count; i++)
+            {
+                if (a[i] != b[i])
+                    return i;
+            }
+
+            return count;
+        }
+
+        bool ScalarIsZero(const void* ptr, size_t count)
+        {
+            auto bytes = (const unsigned char*)ptr;
+            auto i = (size_t)0;
+
+            for (; i + sizeof(uint64_t) <= count; i += sizeof(uint64_t))
+            {
+                uint64_t value;
+                std::memcpy(&value, bytes + i, sizeof(value));
+
+                if (value != 0)
+                    return false;
+            }
+
+            for (; i < count; i++)
+            {
+                if (bytes[i] != 0)
+                    return false;
+            }
+
+            return true;
+        }
+
+        inline uint64_t PopCountWord(uint64_t value)
+        {
+            value = value - ((value >> 1) & 0x5555555555555555ull);
+            value = (value & 0x3333333333333333ull) + ((value >> 2) & 0x3333333333333333ull);
+            value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+            return (value * 0x0101010101010101ull) >> 56;
+        }
+
+        uint64_t ScalarPopCount(const void* ptr, size_t count)
+        {
+            auto bytes = (const unsigned char*)ptr;
+            auto i = (size_t)0;
+            auto total = (uint64_t)0;
+
+            for (; i + sizeof(uint64_t) <= count; i += sizeof(uint64_t))
+            {
+                uint64_t value;
+                std::memcpy(&value, bytes + i, sizeof(value));
+                total += PopCountWord(value);
+            }
+
+            for (; i < count; i++)
+                total += PopCountWord(bytes[i]);
+
+            return total;
+        }
+
+#ifdef NDISCUTILS_X86
+
+        // SSE2
+
+        NDISCUTILS_TARGET("sse2")
+        void Sse2StreamCopy(void* destination, const void* source, size_t count)
+        {
+            auto dst = (unsigned char*)destination;
+            auto src = (const unsigned char*)source;
+
+            auto head = (size_t)((16 - ((uintptr_t)dst & 15)) & 15);
+            if (head > count)
+                head = count;
+
+            std::memcpy(dst, src, head);
+
+            auto i = head;
+            for (; i + 64 <= count; i += 64)
+            {
+                auto v0 = _mm_loadu_si128((const __m128i*)(src + i));
+                auto v1 = _mm_loadu_si128((const __m128i*)(src + i + 16));
+                auto v2 = _mm_loadu_si128((const __m128i*)(src + i + 32));
+                auto v3 = _mm_loadu_si128((const __m128i*)(src + i + 48));
+                _mm_stream_si128((__m128i*)(dst + i), v0);
+                _mm_stream_si128((__m128i*)(dst + i + 16), v1);
+                _mm_stream_si128((__m128i*)(dst + i + 32), v2);
+                _mm_stream_si128((__m128i*)(dst + i + 48), v3);
+            }
+
+            // Streaming stores are weakly ordered
+            _mm_sfence();
+            std::memcpy(dst + i, src + i, count - i);
+        }
+
+        NDISCUTILS_TARGET("sse2")
+        void Sse2StreamFill(void* destination, unsigned char value, size_t count)
+        {
+            auto dst = (unsigned char*)destination;
+
+            auto head = (size_t)((16 - ((uintptr_t)dst & 15)) & 15);
+            if (head > count)
+                head = count;
+
+            std::memset(dst, value, head);
+
+            auto pattern = _mm_set1_epi8((char)value);
+            auto i = head;
+            for (; i + 64 <= count; i += 64)
+            {
+                _mm_stream_si128((__m128i*)(dst + i), pattern);
+                _mm_stream_si128((__m128i*)(dst + i + 16), pattern);
+                _mm_stream_si128((__m128i*)(dst + i + 32), pattern);
+                _mm_stream_si128((__m128i*)(dst + i + 48), pattern);
+            }
+
+            _mm_sfence();
+            std::memset(dst + i, value, count - i);
+        }
+
+        NDISCUTILS_TARGET("sse2")
+        size_t Sse2FindMismatch(const void* left, const void* right, size_t count)
+        {
+            auto a = (const unsigned char*)left;
+            auto b = (const unsigned char*)right;
+            auto i = (size_t)0;
+
+            // Test four vectors at once and only locate the byte on a mismatch
+            for (; i + 64 <= count; i += 64)
+            {
+                auto e0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+                auto e1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i + 16)), _mm_loadu_si128((const __m128i*)(b + i + 16)));
+                auto e2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i + 32)), _mm_loadu_si128((const __m128i*)(b + i + 32)));
+                auto e3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i + 48)), _mm_loadu_si128((const __m128i*)(b + i + 48)));
+
+                auto all = _mm_and_si128(_mm_and_si128(e0, e1), _mm_and_si128(e2, e3));
+                if (_mm_movemask_epi8(all) != 0xFFFF)
+                {
+                    auto differing =
+                        (uint64_t)(unsigned)(_mm_movemask_epi8(e0) ^ 0xFFFF) |
+                        ((uint64_t)(unsigned)(_mm_movemask_epi8(e1) ^ 0xFFFF) << 16) |
+                        ((uint64_t)(unsigned)(_mm_movemask_epi8(e2) ^ 0xFFFF) << 32) |
+                        ((uint64_t)(unsigned)(_mm_movemask_epi8(e3) ^ 0xFFFF) << 48);
+                    return i + TrailingZeros(differing);
+                }
+            }
+
+            return i + ScalarFindMismatch(a + i, b + i, count - i);
+        }
+
+        NDISCUTILS_TARGET("sse2")
+        bool Sse2IsZero(const void* ptr, size_t count)
+        {
+            auto bytes = (const unsigned char*)ptr;
+            auto i = (size_t)0;
+
+            // OR four vectors together per iteration and test once, which keeps
+            // the loop bound by load bandwidth; bail out on the first non-zero chunk
+            for (; i + 64 <= count; i += 64)
+            {
+                auto v0 = _mm_loadu_si128((const __m128i*)(bytes + i));
+                auto v1 = _mm_loadu_si128((const __m128i*)(bytes + i + 16));
+                auto v2 = _mm_loadu_si128((const __m128i*)(bytes + i + 32));
+                auto v3 = _mm_loadu_si128((const __m128i*)(bytes + i + 48));
+                auto any = _mm_or_si128(_mm_or_si128(v0, v1), _mm_or_si128(v2, v3));
+
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) != 0xFFFF)
+                    return false;
+            }
+
+            return ScalarIsZero(bytes + i, count - i);
+        }
+
+        // SSE2 has no byte shuffle, so this level counts words with POPCNT
+        NDISCUTILS_TARGET("popcnt")
+        uint64_t PopCntPopCount(const void* ptr, size_t count)
+        {
+            auto bytes = (const unsigned char*)ptr;
+            auto i = (size_t)0;
+            auto total = (uint64_t)0;
+
+            for (; i + sizeof(uint64_t) <= count; i += sizeof(uint64_t))
+            {
+                uint64_t value;
+                std::memcpy(&value, bytes + i, sizeof(value));
+#ifdef NDISCUTILS_X64
+                total += (uint64_t)_mm_popcnt_u64(value);
+#else
+                total += (uint64_t)_mm_popcnt_u32((unsigned)value) + (uint64_t)_mm_popcnt_u32((unsigned)(value >> 32));
+#endif
+            }
+
+            return total + ScalarPopCount(bytes + i, count - i);
+        }
+
+        // AVX2
+
+        NDISCUTILS_TARGET("avx2")
+        void Avx2StreamCopy(void* destination, const void* source, size_t count)
+        {
+            auto dst = (unsigned char*)destination;
+            auto src = (const unsigned char*)source;
+
+            auto head = (size_t)((32 - ((uintptr_t)dst & 31)) & 31);
+            if (head > count)
+                head = count;
+
+            std::memcpy(dst, src, head);
+
+            auto i = head;
+            for (; i + 128 <= count; i += 128)
+            {
+                auto v0 = _mm256_loadu_si256((const __m256i*)(src + i));
+                auto v1 = _mm256_loadu_si256((const __m256i*)(src + i + 32));
+                auto v2 = _mm256_loadu_si256((const __m256i*)(src + i + 64));
+                auto v3 = _mm256_loadu_si256((const __m256i*)(src + i + 96));
+                _mm256_stream_si256((__m256i*)(dst + i), v0);
+                _mm256_stream_si256((__m256i*)(dst + i + 32), v1);
+                _mm256_stream_si256((__m256i*)(dst + i + 64), v2);
+                _mm256_stream_si256((__m256i*)(dst + i + 96), v3);
+            }
+
+            _mm_sfence();
+            std::memcpy(dst + i, src + i, count - i);
+        }
+
+        NDISCUTILS_TARGET("avx2")
+        void Avx2StreamFill(void* destination, unsigned char value, size_t count)
+        {
+            auto dst = (unsigned char*)destination;
+
+            auto head = (size_t)((32 - ((uintptr_t)dst & 31)) & 31);
+            if (head > count)
+                head = count;
+
+            std::memset(dst, value, head);
+
+            auto pattern = _mm256_set1_epi8((char)value);
+            auto i = head;
+            for (; i + 128 <= count; i += 128)
+            {
+                _mm256_stream_si256((__m256i*)(dst + i), pattern);
+                _mm256_stream_si256((__m256i*)(dst + i + 32), pattern);
+                _mm256_stream_si256((__m256i*)(dst + i + 64), pattern);
+                _mm256_stream_si256((__m256i*)(dst + i + 96), pattern);
+            }
+
+            _mm_sfence();
+            std::memset(dst + i, value, count - i);
+        }
+
+        NDISCUTILS_TARGET("avx2")
+        size_t Avx2FindMismatch(const void* left, const void* right, size_t count)
+        {
+            auto a = (const unsigned char*)left;
+            auto b = (const unsigned char*)right;
+            auto i = (size_t)0;
+
+            for (; i + 64 <= count; i += 64)
+            {
+                auto e0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+                auto e1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i + 32)), _mm256_loadu_si256((const __m256i*)(b + i + 32)));
+
+                auto equal = (uint64_t)(uint32_t)_mm256_movemask_epi8(e0) |
+                    ((uint64_t)(uint32_t)_mm256_movemask_epi8(e1) << 32);
+                if (equal != ~0ull)
+                    return i + TrailingZeros(~equal);
+            }
+
+            return i + Sse2FindMismatch(a + i, b + i, count - i);
+        }
+
+        NDISCUTILS_TARGET("avx2")
+        bool Avx2IsZero(const void* ptr, size_t count)
+        {
+            auto bytes = (const unsigned char*)ptr;
+            auto i = (size_t)0;
+
+            for (; i + 128 <= count; i += 128)
+            {
+                auto v0 = _mm256_loadu_si256((const __m256i*)(bytes + i));
+                auto v1 = _mm256_loadu_si256((const __m256i*)(bytes + i + 32));
+                auto v2 = _mm256_loadu_si256((const __m256i*)(bytes + i + 64));
+                auto v3 = _mm256_loadu_si256((const __m256i*)(bytes + i + 96));
+                auto any = _mm256_or_si256(_mm256_or_si256(v0, v1), _mm256_or_si256(v2, v3));
+
+                if (!_mm256_testz_si256(any, any))
+                    return false;
+            }
+
+            return Sse2IsZero(bytes + i, count - i);
+        }
+
+        // Looks up the bit count of each nibble with a byte shuffle and sums
+        // the bytes of each 64-bit lane with SAD against zero
+        NDISCUTILS_TARGET("avx2")
+        uint64_t Avx2PopCount(const void* ptr, size_t count)
+        {
+            auto bytes = (const unsigned char*)ptr;
+            auto i = (size_t)0;
+
+            auto lookup = _mm256_setr_epi8(
+                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+            auto nibbles = _mm256_set1_epi8(0x0F);
+            auto totals = _mm256_setzero_si256();
+
+            for (; i + 32 <= count; i += 32)
+            {
+                auto value = _mm256_loadu_si256((const __m256i*)(bytes + i));
+                auto low = _mm256_shuffle_epi8(lookup, _mm256_and_si256(value, nibbles));
+                auto high = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(value, 4), nibbles));
+                totals = _mm256_add_epi64(totals, _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256()));
+            }
+
+            auto total =
+                (uint64_t)_mm256_extract_epi64(totals, 0) + (uint64_t)_mm256_extract_epi64(totals, 1) +
+                (uint64_t)_mm256_extract_epi64(totals, 2) + (uint64_t)_mm256_extract_epi64(totals, 3);
+            return total + ScalarPopCount(bytes + i, count - i);
+        }
+
+        // AVX-512 (F and BW)
+
+        NDISCUTILS_TARGET("avx512f,avx512bw")
+        void Avx512StreamCopy(void* destination, const void* source, size_t count)
+        {
+            auto dst = (unsigned char*)destination;
+            auto src = (const unsigned char*)source;
+
+            auto head = (size_t)((64 - ((uintptr_t)dst & 63)) & 63);
+            if (head > count)
+                head = count;
+
+            std::memcpy(dst, src, head);
+
+            auto i = head;
+            for (; i + 256 <= count; i += 256)
+            {
+                auto v0 = _mm512_loadu_si512((const void*)(src + i));
+                auto v1 = _mm512_loadu_si512((const void*)(src + i + 64));
+                auto v2 = _mm512_loadu_si512((const void*)(src + i + 128));
+                auto v3 = _mm512_loadu_si512((const void*)(src + i + 192));
+                _mm512_stream_si512((__m512i*)(dst + i), v0);
+                _mm512_stream_si512((__m512i*)(dst + i + 64), v1);
+                _mm512_stream_si512((__m512i*)(dst + i + 128), v2);
+                _mm512_stream_si512((__m512i*)(dst + i + 192), v3);
+            }
+
+            _mm_sfence();
+            std::memcpy(dst + i, src + i, count - i);
+        }
+
+        NDISCUTILS_TARGET("avx512f,avx512bw")
+        void Avx512StreamFill(void* destination, unsigned char value, size_t count)
+        {
+            auto dst = (unsigned char*)destination;
+
+            auto head = (size_t)((64 - ((uintptr_t)dst & 63)) & 63);
+            if (head > count)
+                head = count;
+
+            std::memset(dst, value, head);
+
+            auto pattern = _mm512_set1_epi8((char)value);
+            auto i = head;
+            for (; i + 256 <= count; i += 256)
+            {
+                _mm512_stream_si512((__m512i*)(dst + i), pattern);
+                _mm512_stream_si512((__m512i*)(dst + i + 64), pattern);
+                _mm512_stream_si512((__m512i*)(dst + i + 128), pattern);
+                _mm512_stream_si512((__m512i*)(dst + i + 192), pattern);
+            }
+
+            _mm_sfence();
+            std::memset(dst + i, value, count - i);
+        }
+
+        NDISCUTILS_TARGET("avx512f,avx512bw")
+        size_t Avx512FindMismatch(const void* left, const void* right, size_t count)
+        {
+            auto a = (const unsigned char*)left;
+            auto b = (const unsigned char*)right;
+            auto i = (size_t)0;
+
+            for (; i + 128 <= count; i += 128)
+            {
+                auto d0 = (uint64_t)_mm512_cmpneq_epi8_mask(
+                    _mm512_loadu_si512((const void*)(a + i)), _mm512_loadu_si512((const void*)(b + i)));
+                auto d1 = (uint64_t)_mm512_cmpneq_epi8_mask(
+                    _mm512_loadu_si512((const void*)(a + i + 64)), _mm512_loadu_si512((const void*)(b + i + 64)));
+
+                if ((d0 | d1) != 0)
+                    return d0 != 0 ? i + TrailingZeros(d0) : i + 64 + TrailingZeros(d1);
+            }
+
+            // The tail is compared under a mask instead of falling back
+            for (; i < count; i += 64)
+            {
+                auto remaining = count - i;
+                auto mask = remaining >= 64 ? ~0ull : (1ull << remaining) - 1;
+                auto differing = (uint64_t)_mm512_mask_cmpneq_epi8_mask((__mmask64)mask,
+                    _mm512_maskz_loadu_epi8((__mmask64)mask, (const void*)(a + i)),
+                    _mm512_maskz_loadu_epi8((__mmask64)mask, (const void*)(b + i)));
+
+                if (differing != 0)
+                    return i + TrailingZeros(differing);
+            }
+
+            return count;
+        }
+
+        NDISCUTILS_TARGET("avx512f,avx512bw")
+        bool Avx512IsZero(const void* ptr, size_t count)
+        {
+            auto bytes = (const unsigned char*)ptr;
+            auto i = (size_t)0;
+
+            for (; i + 256 <= count; i += 256)
+            {
+                auto v0 = _mm512_loadu_si512((const void*)(bytes + i));
+                auto v1 = _mm512_loadu_si512((const void*)(bytes + i + 64));
+                auto v2 = _mm512_loadu_si512((const void*)(bytes + i + 128));
+                auto v3 = _mm512_loadu_si512((const void*)(bytes + i + 192));
+                auto any = _mm512_or_si512(_mm512_or_si512(v0, v1), _mm512_or_si512(v2, v3));
+
+                if (_mm512_test_epi64_mask(any, any) != 0)
+                    return false;
+            }
+
+            return Avx2IsZero(bytes + i, count - i);
+        }
+
+        NDISCUTILS_TARGET("avx512f,avx512bw,avx512vpopcntdq")
+        uint64_t Avx512PopCount(const void* ptr, size_t count)
+        {
+            auto bytes = (const unsigned char*)ptr;
+            auto i = (size_t)0;
+            auto totals = _mm512_setzero_si512();
+
+            for (; i + 64 <= count; i += 64)
+                totals = _mm512_add_epi64(totals, _mm512_popcnt_epi64(_mm512_loadu_si512((const void*)(bytes + i))));
+
+            uint64_t lanes[8];
+            _mm512_storeu_si512((void*)lanes, totals);
+
+            auto total = (uint64_t)0;
+            for (auto lane : lanes)
+                total += lane;
+
+            return total + ScalarPopCount(bytes + i, count - i);
+        }
+
+#endif // NDISCUTILS_X86
+
+        struct Dispatch
+        {
+            CpuFeatures Features;
+            SimdLevel Supported;
+            SimdLevel Level;
+            size_t CacheBytes;
+            size_t Threshold;
+            KernelTable Kernels;
+        };
+
+        KernelTable TableFor(SimdLevel level, const CpuFeatures& features)
+        {
+            KernelTable table { nullptr, nullptr, ScalarFindMismatch, ScalarIsZero, ScalarPopCount };
+            (void)features;
+
+#ifdef NDISCUTILS_X86
+            if (level >= SimdLevel::Sse2)
+            {
+                table = { Sse2StreamCopy, Sse2StreamFill, Sse2FindMismatch, Sse2IsZero, ScalarPopCount };
+                if (features.PopCnt)
+                    table.PopCount = PopCntPopCount;
+            }
+
+            if (level >= SimdLevel::Avx2)
+                table = { Avx2StreamCopy, Avx2StreamFill, Avx2FindMismatch, Avx2IsZero, Avx2PopCount };
+
+            if (level >= SimdLevel::Avx512)
+            {
+                table = { Avx512StreamCopy, Avx512StreamFill, Avx512FindMismatch, Avx512IsZero, Avx2PopCount };
+                if (features.Avx512PopCnt)
+                    table.PopCount = Avx512PopCount;
+            }
+#endif
+
+            return table;
+        }
+
+        Dispatch Detect()
+        {
+            Dispatch dispatch;
+            dispatch.Supported = SimdLevel::Scalar;
+            dispatch.CacheBytes = DefaultCacheBytes;
+
+#ifdef NDISCUTILS_X86
+            dispatch.Features = CpuFeatures::Current();
+            if (dispatch.Features.CacheBytes != 0)
+                dispatch.CacheBytes = dispatch.Features.CacheBytes;
+
+            if (dispatch.Features.Sse2)
+                dispatch.Supported = SimdLevel::Sse2;
+            if (dispatch.Features.Avx2)
+                dispatch.Supported = SimdLevel::Avx2;
+            if (dispatch.Features.Avx512)
+                dispatch.Supported = SimdLevel::Avx512;
+#endif
+
+            dispatch.Level = dispatch.Supported;
+            dispatch.Threshold = dispatch.CacheBytes;
+            dispatch.Kernels = TableFor(dispatch.Level, dispatch.Features);
+            return dispatch;
+        }
+
+        Dispatch& Current()
+        {
+            static Dispatch dispatch = Detect();
+            return dispatch;
+        }
+
+    } // namespace
+
+    void MemoryKernels::Copy(void* destination, const void* source, size_t count)
+    {
+        auto& dispatch = Current();
+
+        if (count >= dispatch.Threshold && dispatch.Kernels.StreamCopy != nullptr)
+            dispatch.Kernels.StreamCopy(destination, source, count);
+        else
+            std::memcpy(destination, source, count);
+    }
+
+    void MemoryKernels::Fill(void* destination, unsigned char value, size_t count)
+    {
+        auto& dispatch = Current();
+
+        if (count >= dispatch.Threshold && dispatch.Kernels.StreamFill != nullptr)
+            dispatch.Kernels.StreamFill(destination, value, count);
+        else
+            std::memset(destination, value, count);
+    }
+
+    size_t MemoryKernels::FindMismatch(const void* left, const void* right, size_t count)
+    {
+        return Current().Kernels.FindMismatch(left, right, count);
+    }
+
+    bool MemoryKernels::IsZero(const void* ptr, size_t count)
+    {
+        return Current().Kernels.IsZero(ptr, count);
+    }
+
+    uint64_t MemoryKernels::PopCount(const void* ptr, size_t count)
+    {
+        return Current().Kernels.PopCount(ptr, count);
+    }
+
+    SimdLevel MemoryKernels::SupportedLevel()
+    {
+        return Current().Supported;
+    }
+
+    SimdLevel MemoryKernels::Level()
+    {
+        return Current().Level;
+    }
+
+    void MemoryKernels::SetLevel(SimdLevel level)
+    {
+        auto& dispatch = Current();
+
+        dispatch.Level = level < dispatch.Supported ? level : dispatch.Supported;
+        dispatch.Kernels = TableFor(dispatch.Level, dispatch.Features);
+    }
+
+    size_t MemoryKernels::CacheBytes()
+    {
+        return Current().CacheBytes;
+    }
+
+    size_t MemoryKernels::NonTemporalThreshold()
+    {
+        return Current().Threshold;
+    }
+
+    void MemoryKernels::SetNonTemporalThreshold(size_t bytes)
+    {
+        Current().Threshold = bytes;
+    }
+
+    const char* MemoryKernels::LevelName(SimdLevel level)
+    {
+        switch (level)
+        {
+            case SimdLevel::Sse2: return "sse2";
+            case SimdLevel::Avx2: return "avx2";
+            case SimdLevel::Avx512: return "avx512";
+            default: return "scalar";
+        }
+    }
+
+} // Native
+} // nDiscUtils
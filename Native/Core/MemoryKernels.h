@@ -0,0 +1,79 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Instruction sets the kernels are dispatched to, each including the previous
+    enum class SimdLevel
+    {
+        Scalar,
+        Sse2,
+        Avx2,
+        Avx512
+    };
+
+    // Bulk memory primitives which pick the widest instruction set the CPU
+    // and the operating system support on first use. Copies and fills of at
+    // least NonTemporalThreshold() bytes bypass the caches with streaming
+    // stores, so large transfers do not evict the working set of the caller;
+    // smaller ones are left to the C runtime.
+    class MemoryKernels
+    {
+
+    public:
+        static void Copy(void* destination, const void* source, size_t count);
+
+        static void Fill(void* destination, unsigned char value, size_t count);
+
+        // Offset of the first byte which differs, count if both ranges are equal
+        static size_t FindMismatch(const void* left, const void* right, size_t count);
+
+        // True if all count bytes at ptr are zero
+        static bool IsZero(const void* ptr, size_t count);
+
+        // Number of set bits in count bytes at ptr
+        static uint64_t PopCount(const void* ptr, size_t count);
+
+        // Widest level supported by this machine
+        static SimdLevel SupportedLevel();
+
+        static SimdLevel Level();
+
+        // Restricts the kernels to a level, clamped to SupportedLevel(); meant
+        // for benchmarks and tests and not safe while kernels are running
+        static void SetLevel(SimdLevel level);
+
+        // Size of the last level cache, which defaults the threshold
+        static size_t CacheBytes();
+
+        static size_t NonTemporalThreshold();
+
+        static void SetNonTemporalThreshold(size_t bytes);
+
+        static const char* LevelName(SimdLevel level);
+
+    };
+
+} // Native
+} // nDiscUtils
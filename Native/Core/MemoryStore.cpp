@@ -0,0 +1,52 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "MemoryStore.h"
+#include "NativeException.h"
+
+#include <string>
+
+namespace nDiscUtils {
+namespace Native {
+
+    MemoryStore::MemoryStore(size_t capacity, PageProvider* provider) :
+        mCapacity(capacity),
+        mProvider(provider != nullptr ? provider : PageProvider::Default())
+    {
+        if (mCapacity == 0)
+            throw NativeException(NativeError::InvalidArgument, "Capacity was expected to be greater than zero");
+
+        AssertAligned(mCapacity, "Capacity");
+    }
+
+    void MemoryStore::AssertRange(size_t offset, size_t count) const
+    {
+        if (offset > mCapacity || count > mCapacity - offset)
+            throw NativeException(NativeError::IO, "Operation would exceed memory limits");
+    }
+
+    void MemoryStore::AssertAligned(size_t value, const char* description) const
+    {
+        if (!mProvider->IsAligned(value))
+            throw NativeException(NativeError::InvalidArgument,
+                std::string(description) + " is not aligned to allocation granularity (" +
+                std::to_string(mProvider->Granularity()) + ")");
+    }
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,87 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+
+#include "PageProvider.h"
+#include "StoreCounters.h"
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Fixed-capacity, positional byte store backing the ramdisk streams.
+    // Kept free of CLR and Win32 types so it builds on any platform.
+    class MemoryStore
+    {
+
+    public:
+        virtual ~MemoryStore() { }
+
+        size_t Capacity() const
+        {
+            return mCapacity;
+        }
+
+        PageProvider* Provider() const
+        {
+            return mProvider;
+        }
+
+        // Bytes of memory currently backing stored data
+        virtual size_t CommittedBytes() const = 0;
+
+        // Requests, allocations and latencies recorded since creation or
+        // the last reset, along with the committed bytes
+        StoreCountersSnapshot Counters() const
+        {
+            auto snapshot = mCounters.Snapshot();
+            snapshot.CommittedBytes = CommittedBytes();
+            return snapshot;
+        }
+
+        void ResetCounters()
+        {
+            mCounters.Reset();
+        }
+
+        // Implementations document whether requests may run concurrently
+        virtual void Read(size_t offset, void* buffer, size_t count) = 0;
+
+        virtual void Write(size_t offset, const void* buffer, size_t count) = 0;
+
+        // Zeroes the range and gives memory of fully covered blocks or pages
+        // back to the system
+        virtual void Discard(size_t offset, size_t count) = 0;
+
+    protected:
+        MemoryStore(size_t capacity, PageProvider* provider);
+
+        void AssertRange(size_t offset, size_t count) const;
+
+        void AssertAligned(size_t value, const char* description) const;
+
+        size_t mCapacity;
+        PageProvider* mProvider;
+        StoreCounters mCounters;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,63 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+namespace nDiscUtils {
+namespace Native {
+
+    enum class NativeError
+    {
+        InvalidArgument,
+        Overflow,
+        OutOfMemory,
+        IO,
+    };
+
+    // Thrown by the portable core; the CLR wrappers translate it into the
+    // matching managed exception (see StreamUtils::ThrowManaged)
+    class NativeException : public std::runtime_error
+    {
+
+    public:
+        NativeException(NativeError error, const std::string& message, int code = 0) :
+            std::runtime_error(message),
+            mError(error),
+            mCode(code) { }
+
+        NativeError Error() const
+        {
+            return mError;
+        }
+
+        int Code() const
+        {
+            return mCode;
+        }
+
+    private:
+        NativeError mError;
+        int mCode;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,94 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "NativeException.h"
+
+namespace nDiscUtils {
+namespace Native {
+
+    enum class NumaPlacement
+    {
+        // Left to the operating system, usually the node touching it first
+        Default,
+
+        // Spread round-robin over all nodes by block index
+        Interleave,
+
+        // Node of the thread allocating the block
+        Local,
+
+        // Always the node given by NumaPolicy::Node
+        Node
+    };
+
+    struct NumaPolicy
+    {
+        NumaPlacement Placement = NumaPlacement::Default;
+
+        // Node used by NumaPlacement::Node
+        size_t Node = 0;
+
+        // Bytes placed on one node before moving on to the next one when
+        // a single region is interleaved
+        size_t InterleaveBytes = (size_t)2 << 20;
+    };
+
+    // NUMA nodes of the machine, numbered from zero without gaps. Machines
+    // or platforms without NUMA support report a single node.
+    class NumaTopology
+    {
+
+    public:
+        static size_t NodeCount();
+
+        // Node of the processor the calling thread currently runs on
+        static size_t CurrentNode();
+
+        // Restricts the calling thread to the processors of a node; returns
+        // false if the platform does not support it
+        static bool BindThread(size_t node);
+
+        // Identifier of a node as used by the operating system
+        static int SystemNode(size_t node);
+
+        // Whether blocks need to be placed explicitly to follow the policy
+        static bool IsPlaced(const NumaPolicy& policy)
+        {
+            return policy.Placement != NumaPlacement::Default && NodeCount() > 1;
+        }
+
+        static void AssertPolicy(const NumaPolicy& policy)
+        {
+            if (policy.Placement == NumaPlacement::Node && policy.Node >= NodeCount())
+                throw NativeException(NativeError::InvalidArgument,
+                    "NUMA node " + std::to_string(policy.Node) + " does not exist, the machine has " +
+                    std::to_string(NodeCount()) + " node(s)");
+
+            if (policy.Placement == NumaPlacement::Interleave && policy.InterleaveBytes == 0)
+                throw NativeException(NativeError::InvalidArgument, "Interleave size was expected to be greater than zero");
+        }
+
+    };
+
+} // Native
+} // nDiscUtils
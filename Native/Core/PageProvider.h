@@ -0,0 +1,109 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Source of zero-filled, granularity-aligned memory for the block stores
+    class PageProvider
+    {
+
+    public:
+        virtual ~PageProvider() { }
+
+        // Returns zero-filled memory or nullptr if the request cannot be satisfied
+        virtual void* Allocate(size_t size) = 0;
+
+        // Like Allocate(), but prefers physical memory of a NUMA node, see
+        // NumaTopology. Providers which cannot place memory ignore the node.
+        virtual void* AllocateOnNode(size_t size, size_t /* node */)
+        {
+            return Allocate(size);
+        }
+
+        // Like Allocate(), but places consecutive stride-sized pieces of
+        // the region on all NUMA nodes in turn
+        virtual void* AllocateInterleaved(size_t size, size_t /* stride */)
+        {
+            return Allocate(size);
+        }
+
+        // Size of the pages used by AllocateLarge(), zero if there are none
+        virtual size_t LargePageSize() const
+        {
+            return 0;
+        }
+
+        // Like Allocate(), but backed by large pages, which need far fewer
+        // TLB entries; size must be a multiple of LargePageSize(). Returns
+        // nullptr if large pages are unavailable, callers fall back to
+        // Allocate(). Regions are freed with Release().
+        virtual void* AllocateLarge(size_t /* size */)
+        {
+            return nullptr;
+        }
+
+        virtual void Release(void* ptr, size_t size) = 0;
+
+        // Drops the physical backing of the range, it reads back as zero
+        // afterwards; throws NativeError::OutOfMemory if the range could not
+        // be made usable again
+        virtual void Discard(void* ptr, size_t size) = 0;
+
+        // Discard() for regions of AllocateLarge(), covering whole large pages
+        virtual void DiscardLarge(void* ptr, size_t size)
+        {
+            std::memset(ptr, 0, size);
+        }
+
+        // Backs a range of fresh, still zero-filled memory with physical
+        // pages now instead of on first touch; may be called for disjoint
+        // ranges from multiple threads
+        virtual void Populate(void* ptr, size_t size)
+        {
+            // Writing one byte per page faults it in
+            auto bytes = (volatile unsigned char*)ptr;
+            for (size_t offset = 0; offset < size; offset += PopulateStride)
+                bytes[offset] = 0;
+        }
+
+        virtual size_t Granularity() const = 0;
+
+        virtual const char* Name() const = 0;
+
+        bool IsAligned(size_t value) const
+        {
+            return (value % Granularity()) == 0;
+        }
+
+        // Process-wide provider of the current platform
+        static PageProvider* Default();
+
+    protected:
+        // Smallest page size of all supported platforms
+        static constexpr size_t PopulateStride = 4096;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,298 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "PosixImageFile.h"
+#include "NativeException.h"
+#include "PageProvider.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        class PosixFileMapping : public FileMapping
+        {
+
+        public:
+            PosixFileMapping(void* base, size_t size) :
+                FileMapping((const unsigned char*)base, size) { }
+
+            ~PosixFileMapping()
+            {
+                munmap((void*)mData, mSize);
+            }
+
+            void Advise(size_t offset, size_t size, MapAdvice advice) override
+            {
+                // madvise() needs a page-aligned start; failing hints are harmless
+                auto pageSize = (size_t)sysconf(_SC_PAGESIZE);
+                auto start = offset / pageSize * pageSize;
+                if (start >= mSize)
+                    return;
+
+                int hint = MADV_NORMAL;
+                switch (advice)
+                {
+                    case MapAdvice::Sequential: hint = MADV_SEQUENTIAL; break;
+                    case MapAdvice::Random: hint = MADV_RANDOM; break;
+                    case MapAdvice::WillNeed: hint = MADV_WILLNEED; break;
+                }
+
+                madvise((void*)(mData + start), std::min(size + (offset - start), mSize - start), hint);
+            }
+
+        };
+
+    } // namespace
+
+    PosixImageFile::PosixImageFile(const std::string& path, ImageFileMode mode, bool unbuffered, bool writeThrough) :
+        ImageFile(path),
+        mDescriptor(-1),
+        mUnbuffered(false)
+    {
+        int flags = O_CLOEXEC;
+        switch (mode)
+        {
+            case ImageFileMode::Read: flags |= O_RDONLY; break;
+            case ImageFileMode::Write: flags |= O_RDWR; break;
+            case ImageFileMode::Create: flags |= O_RDWR | O_CREAT | O_TRUNC; break;
+        }
+
+        if (writeThrough)
+            flags |= O_DSYNC;
+
+#ifdef O_DIRECT
+        if (unbuffered)
+        {
+            // Not every file system supports direct I/O, those fall back to
+            // the page cache
+            mDescriptor = open(path.c_str(), flags | O_DIRECT, 0644);
+            mUnbuffered = (mDescriptor >= 0);
+        }
+#endif
+
+        if (mDescriptor < 0)
+            mDescriptor = open(path.c_str(), flags, 0644);
+
+        if (mDescriptor < 0)
+            Fail("open");
+    }
+
+    PosixImageFile::~PosixImageFile()
+    {
+        if (mDescriptor >= 0)
+            close(mDescriptor);
+    }
+
+    void PosixImageFile::Fail(const char* operation) const
+    {
+        auto error = errno;
+        throw NativeException(NativeError::IO,
+            std::string("Failed to ") + operation + " \"" + mPath + "\": " + std::strerror(error), error);
+    }
+
+    uint64_t PosixImageFile::Length() const
+    {
+        struct stat status;
+        if (fstat(mDescriptor, &status) != 0)
+            Fail("query the length of");
+
+        return (uint64_t)status.st_size;
+    }
+
+    void PosixImageFile::SetLength(uint64_t length)
+    {
+        if (ftruncate(mDescriptor, (off_t)length) != 0)
+            Fail("resize");
+    }
+
+    void PosixImageFile::ReadAt(uint64_t offset, void* buffer, size_t count)
+    {
+        auto pointer = (unsigned char*)buffer;
+        while (count > 0)
+        {
+            auto result = pread(mDescriptor, pointer, count, (off_t)offset);
+            if (result < 0 && errno == EINTR)
+                continue;
+
+            if (result < 0)
+                Fail("read from");
+
+            if (result == 0)
+            {
+                errno = EIO;
+                Fail("read past the end of");
+            }
+
+            pointer += result;
+            offset += (uint64_t)result;
+            count -= (size_t)result;
+        }
+    }
+
+    void PosixImageFile::WriteAt(uint64_t offset, const void* buffer, size_t count)
+    {
+        auto pointer = (const unsigned char*)buffer;
+        while (count > 0)
+        {
+            auto result = pwrite(mDescriptor, pointer, count, (off_t)offset);
+            if (result < 0 && errno == EINTR)
+                continue;
+
+            if (result < 0)
+                Fail("write to");
+
+            pointer += result;
+            offset += (uint64_t)result;
+            count -= (size_t)result;
+        }
+    }
+
+    void PosixImageFile::Deallocate(uint64_t offset, uint64_t count)
+    {
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+        if (fallocate(mDescriptor, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)count) == 0)
+            return;
+
+        if (errno != EOPNOTSUPP && errno != ENOSYS)
+            Fail("deallocate a range of");
+#endif
+
+        // Without hole punching the range is overwritten with zeros from an
+        // aligned buffer, which also satisfies unbuffered files
+        auto provider = PageProvider::Default();
+        auto chunk = (size_t)std::min<uint64_t>(count, (uint64_t)1 << 20);
+        chunk += provider->Granularity() - 1;
+        chunk -= chunk % provider->Granularity();
+
+        auto zeros = provider->Allocate(chunk);
+        if (zeros == nullptr)
+            throw NativeException(NativeError::OutOfMemory, "Failed to allocate " + std::to_string(chunk) + " bytes of memory");
+
+        try
+        {
+            while (count > 0)
+            {
+                auto size = (size_t)std::min<uint64_t>(count, chunk);
+                WriteAt(offset, zeros, size);
+
+                offset += size;
+                count -= size;
+            }
+        }
+        catch (...)
+        {
+            provider->Release(zeros, chunk);
+            throw;
+        }
+
+        provider->Release(zeros, chunk);
+    }
+
+    DataExtent PosixImageFile::NextData(uint64_t offset)
+    {
+        auto length = Length();
+        if (offset >= length)
+            return DataExtent { length, 0 };
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+        // Both only return offsets and do not disturb pread()/pwrite()
+        auto data = lseek(mDescriptor, (off_t)offset, SEEK_DATA);
+        if (data < 0)
+        {
+            if (errno == ENXIO)
+                return DataExtent { length, 0 };
+
+            if (errno != EINVAL && errno != EOPNOTSUPP)
+                Fail("find data in");
+
+            return DataExtent { offset, length - offset };
+        }
+
+        auto hole = lseek(mDescriptor, data, SEEK_HOLE);
+        if (hole < 0)
+            Fail("find holes in");
+
+        return DataExtent { (uint64_t)data, (uint64_t)(hole - data) };
+#else
+        return DataExtent { offset, length - offset };
+#endif
+    }
+
+    void PosixImageFile::Flush()
+    {
+        if (fsync(mDescriptor) != 0)
+            Fail("flush");
+    }
+
+    size_t PosixImageFile::MapGranularity() const
+    {
+        return (size_t)sysconf(_SC_PAGESIZE);
+    }
+
+    FileMapping* PosixImageFile::Map(uint64_t offset, size_t size)
+    {
+        if (offset % MapGranularity() != 0)
+            throw NativeException(NativeError::InvalidArgument, "Mapping offset is not aligned to the page size");
+
+        // A read-only view only ever reads, so sharing it with the page
+        // cache avoids any private copies
+        auto base = mmap(nullptr, size, PROT_READ, MAP_SHARED, mDescriptor, (off_t)offset);
+        if (base == MAP_FAILED)
+            Fail("map");
+
+        return new PosixFileMapping(base, size);
+    }
+
+    ImageFile* ImageFile::Open(const std::string& path, ImageFileMode mode, bool unbuffered, bool writeThrough)
+    {
+        return new PosixImageFile(path, mode, unbuffered, writeThrough);
+    }
+
+    bool ImageFile::Exists(const std::string& path)
+    {
+        struct stat status;
+        return stat(path.c_str(), &status) == 0;
+    }
+
+    void ImageFile::Delete(const std::string& path)
+    {
+        unlink(path.c_str());
+    }
+
+    void ImageFile::Replace(const std::string& source, const std::string& target)
+    {
+        if (rename(source.c_str(), target.c_str()) != 0)
+        {
+            auto error = errno;
+            throw NativeException(NativeError::IO,
+                "Failed to replace \"" + target + "\": " + std::strerror(error), error);
+        }
+    }
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,68 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "ImageFile.h"
+
+namespace nDiscUtils {
+namespace Native {
+
+    // File descriptor based image file using pread/pwrite, O_DIRECT for
+    // unbuffered access and fallocate() to punch holes where available
+    class PosixImageFile : public ImageFile
+    {
+
+    public:
+        PosixImageFile(const std::string& path, ImageFileMode mode, bool unbuffered, bool writeThrough);
+
+        ~PosixImageFile();
+
+        bool Unbuffered() const override
+        {
+            return mUnbuffered;
+        }
+
+        uint64_t Length() const override;
+
+        void SetLength(uint64_t length) override;
+
+        void ReadAt(uint64_t offset, void* buffer, size_t count) override;
+
+        void WriteAt(uint64_t offset, const void* buffer, size_t count) override;
+
+        void Deallocate(uint64_t offset, uint64_t count) override;
+
+        DataExtent NextData(uint64_t offset) override;
+
+        void Flush() override;
+
+        size_t MapGranularity() const override;
+
+        FileMapping* Map(uint64_t offset, size_t size) override;
+
+    private:
+        [[noreturn]] void Fail(const char* operation) const;
+
+        int mDescriptor;
+        bool mUnbuffered;
+
+    };
+
+} // Native
+} // nDiscUtils
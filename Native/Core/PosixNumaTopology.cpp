@@ -0,0 +1,163 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "NumaTopology.h"
+
+#include <fstream>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        // Nodes and processors as listed by sysfs, read once per process
+        struct Topology
+        {
+            Topology()
+            {
+#ifdef __linux__
+                for (auto id : ReadList("/sys/devices/system/node/online"))
+                {
+                    auto processors = ReadList("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+                    Nodes.push_back(id);
+                    Processors.push_back(processors);
+
+                    for (auto processor : processors)
+                    {
+                        if ((size_t)processor >= ProcessorNodes.size())
+                            ProcessorNodes.resize(processor + 1, 0);
+
+                        ProcessorNodes[processor] = Nodes.size() - 1;
+                    }
+                }
+#endif
+
+                if (Nodes.empty())
+                {
+                    Nodes.push_back(0);
+                    Processors.emplace_back();
+                }
+            }
+
+            // Parses lists like "0-3,8,10-11"
+            static std::vector<int> ReadList(const std::string& path)
+            {
+                std::vector<int> values;
+                std::ifstream file(path);
+                std::string list;
+                if (!std::getline(file, list))
+                    return values;
+
+                size_t position = 0;
+                while (position < list.size())
+                {
+                    auto end = list.find(',', position);
+                    if (end == std::string::npos)
+                        end = list.size();
+
+                    auto range = list.substr(position, end - position);
+                    auto dash = range.find('-');
+
+                    try
+                    {
+                        auto first = std::stoi(range.substr(0, dash));
+                        auto last = dash != std::string::npos ? std::stoi(range.substr(dash + 1)) : first;
+                        for (auto value = first; value <= last; value++)
+                            values.push_back(value);
+                    }
+                    catch (const std::exception&)
+                    {
+                        return std::vector<int>();
+                    }
+
+                    position = end + 1;
+                }
+
+                return values;
+            }
+
+            std::vector<int> Nodes;
+            std::vector<std::vector<int>> Processors;
+            std::vector<size_t> ProcessorNodes;
+        };
+
+        const Topology& Current()
+        {
+            static Topology topology;
+            return topology;
+        }
+
+    } // namespace
+
+    size_t NumaTopology::NodeCount()
+    {
+        return Current().Nodes.size();
+    }
+
+    size_t NumaTopology::CurrentNode()
+    {
+        auto& topology = Current();
+        if (topology.Nodes.size() == 1)
+            return 0;
+
+#ifdef __linux__
+        auto processor = sched_getcpu();
+        if (processor >= 0 && (size_t)processor < topology.ProcessorNodes.size())
+            return topology.ProcessorNodes[processor];
+#endif
+
+        return 0;
+    }
+
+    bool NumaTopology::BindThread(size_t node)
+    {
+#ifdef __linux__
+        // Nodes without processors only provide memory and cannot be bound to
+        auto& topology = Current();
+        if (node >= topology.Nodes.size() || topology.Processors[node].empty())
+            return false;
+
+        cpu_set_t processors;
+        CPU_ZERO(&processors);
+        for (auto processor : topology.Processors[node])
+        {
+            if (processor < CPU_SETSIZE)
+                CPU_SET(processor, &processors);
+        }
+
+        return pthread_setaffinity_np(pthread_self(), sizeof(processors), &processors) == 0;
+#else
+        (void)node;
+        return false;
+#endif
+    }
+
+    int NumaTopology::SystemNode(size_t node)
+    {
+        auto& topology = Current();
+        return node < topology.Nodes.size() ? topology.Nodes[node] : 0;
+    }
+
+} // Native
+} // nDiscUtils
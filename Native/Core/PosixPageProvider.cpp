@@ -0,0 +1,188 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "PosixPageProvider.h"
+#include "NumaTopology.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+namespace nDiscUtils {
+namespace Native {
+
+    PosixPageProvider::PosixPageProvider()
+    {
+        mGranularity = (size_t)sysconf(_SC_PAGESIZE);
+        mLargePageSize = 0;
+
+#ifdef __linux__
+        // Default size of the huge page pool, "Hugepagesize:    2048 kB"
+        std::ifstream meminfo("/proc/meminfo");
+        std::string line;
+        while (std::getline(meminfo, line))
+        {
+            if (line.compare(0, 13, "Hugepagesize:") == 0)
+            {
+                mLargePageSize = (size_t)std::strtoull(line.c_str() + 13, nullptr, 10) << 10;
+                break;
+            }
+        }
+#endif
+    }
+
+    void* PosixPageProvider::Allocate(size_t size)
+    {
+        auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED)
+            return nullptr;
+
+        return ptr;
+    }
+
+    void* PosixPageProvider::AllocateOnNode(size_t size, size_t node)
+    {
+        auto ptr = Allocate(size);
+        if (ptr != nullptr && NumaTopology::NodeCount() > 1)
+            Place(ptr, size, node);
+
+        return ptr;
+    }
+
+    void* PosixPageProvider::AllocateInterleaved(size_t size, size_t stride)
+    {
+        auto ptr = (unsigned char*)Allocate(size);
+        auto nodes = NumaTopology::NodeCount();
+        if (ptr == nullptr || nodes == 1)
+            return ptr;
+
+        stride = (stride + mGranularity - 1) / mGranularity * mGranularity;
+        for (size_t offset = 0, piece = 0; offset < size; offset += stride, piece++)
+            Place(ptr + offset, std::min(stride, size - offset), piece % nodes);
+
+        return ptr;
+    }
+
+    void PosixPageProvider::Place(void* ptr, size_t size, size_t node)
+    {
+#ifdef __linux__
+        // Untouched pages get allocated on the preferred node, falling back
+        // to others once it runs out of memory. Failing to place the pages
+        // is not fatal, so the result is ignored.
+        const int PreferredPolicy = 1;
+        const size_t MaskBits = sizeof(unsigned long) * 8;
+
+        unsigned long mask[16] = { };
+        auto systemNode = (size_t)NumaTopology::SystemNode(node);
+        if (systemNode >= sizeof(mask) * 8)
+            return;
+
+        mask[systemNode / MaskBits] |= 1ul << (systemNode % MaskBits);
+        syscall(SYS_mbind, ptr, size, PreferredPolicy, mask, sizeof(mask) * 8, 0);
+#else
+        (void)ptr;
+        (void)size;
+        (void)node;
+#endif
+    }
+
+    void* PosixPageProvider::AllocateLarge(size_t size)
+    {
+#ifdef __linux__
+        if (mLargePageSize == 0 || (size % mLargePageSize) != 0)
+            return nullptr;
+
+        auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED)
+            return ptr;
+
+        // Without reserved huge pages, the kernel may still back a region
+        // aligned to the huge page size with transparent huge pages; the
+        // region is over-reserved and trimmed to get the alignment
+        auto reserved = size + mLargePageSize;
+        auto region = (unsigned char*)mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED)
+            return nullptr;
+
+        auto aligned = (unsigned char*)(((uintptr_t)region + mLargePageSize - 1) / mLargePageSize * mLargePageSize);
+        if (aligned != region)
+            munmap(region, (size_t)(aligned - region));
+
+        auto tail = (size_t)(region + reserved - (aligned + size));
+        if (tail != 0)
+            munmap(aligned + size, tail);
+
+        if (madvise(aligned, size, MADV_HUGEPAGE) != 0)
+        {
+            munmap(aligned, size);
+            return nullptr;
+        }
+
+        return aligned;
+#else
+        (void)size;
+        return nullptr;
+#endif
+    }
+
+    void PosixPageProvider::Release(void* ptr, size_t size)
+    {
+        munmap(ptr, size);
+    }
+
+    void PosixPageProvider::Discard(void* ptr, size_t size)
+    {
+        // Private anonymous mappings are zero-filled on the next touch
+        madvise(ptr, size, MADV_DONTNEED);
+    }
+
+    void PosixPageProvider::DiscardLarge(void* ptr, size_t size)
+    {
+        // Kernels before 5.18 cannot drop pages of the hugetlbfs pool
+        if (madvise(ptr, size, MADV_DONTNEED) != 0)
+            std::memset(ptr, 0, size);
+    }
+
+    void PosixPageProvider::Populate(void* ptr, size_t size)
+    {
+#ifdef MADV_POPULATE_WRITE
+        // Faults the whole range in with a single call, Linux 5.14 and later
+        if (madvise(ptr, size, MADV_POPULATE_WRITE) == 0)
+            return;
+#endif
+
+        PageProvider::Populate(ptr, size);
+    }
+
+    PageProvider* PageProvider::Default()
+    {
+        static PosixPageProvider provider;
+        return &provider;
+    }
+
+} // Native
+} // nDiscUtils
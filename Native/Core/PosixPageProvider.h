@@ -0,0 +1,76 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "PageProvider.h"
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Anonymous private mmap backed pages, discarded through madvise(MADV_DONTNEED).
+    // Pages are placed on NUMA nodes with mbind(), which keeps the placement
+    // of discarded ranges. Large pages come from the hugetlbfs pool, or are
+    // transparent huge pages when none are reserved.
+    class PosixPageProvider : public PageProvider
+    {
+
+    public:
+        PosixPageProvider();
+
+        void* Allocate(size_t size) override;
+
+        void* AllocateOnNode(size_t size, size_t node) override;
+
+        void* AllocateInterleaved(size_t size, size_t stride) override;
+
+        size_t LargePageSize() const override
+        {
+            return mLargePageSize;
+        }
+
+        void* AllocateLarge(size_t size) override;
+
+        void Release(void* ptr, size_t size) override;
+
+        void Discard(void* ptr, size_t size) override;
+
+        void DiscardLarge(void* ptr, size_t size) override;
+
+        void Populate(void* ptr, size_t size) override;
+
+        size_t Granularity() const override
+        {
+            return mGranularity;
+        }
+
+        const char* Name() const override
+        {
+            return "posix";
+        }
+
+    private:
+        void Place(void* ptr, size_t size, size_t node);
+
+        size_t mGranularity;
+        size_t mLargePageSize;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,351 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "RandomFill.h"
+#include "CpuFeatures.h"
+#include "MemoryKernels.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef NDISCUTILS_X86
+#include <immintrin.h>
+#endif
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        constexpr size_t Rounds = 10;
+
+        // Smallest share of a fill worth a thread of its own
+        constexpr size_t MinThreadBytes = 4u << 20;
+
+        const unsigned char SBox[256] =
+        {
+            0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+            0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+            0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+            0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+            0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+            0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+            0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+            0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+            0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+            0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+            0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+            0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+            0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+            0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+            0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+            0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16,
+        };
+
+        const unsigned char RoundConstants[Rounds] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36 };
+
+        inline unsigned char Double(unsigned char value)
+        {
+            return (unsigned char)((value << 1) ^ ((value & 0x80) != 0 ? 0x1B : 0x00));
+        }
+
+        void ExpandKey(const unsigned char key[16], unsigned char roundKeys[176])
+        {
+            std::memcpy(roundKeys, key, 16);
+
+            for (size_t i = 16; i < 176; i += 4)
+            {
+                unsigned char word[4];
+                std::memcpy(word, roundKeys + i - 4, 4);
+
+                if (i % 16 == 0)
+                {
+                    auto first = word[0];
+                    word[0] = (unsigned char)(SBox[word[1]] ^ RoundConstants[i / 16 - 1]);
+                    word[1] = SBox[word[2]];
+                    word[2] = SBox[word[3]];
+                    word[3] = SBox[first];
+                }
+
+                for (size_t j = 0; j < 4; j++)
+                    roundKeys[i + j] = (unsigned char)(roundKeys[i - 16 + j] ^ word[j]);
+            }
+        }
+
+        // The block is the counter on input and the cipher text on output
+        void SoftwareEncryptBlock(const unsigned char* roundKeys, unsigned char block[16])
+        {
+            for (size_t i = 0; i < 16; i++)
+                block[i] ^= roundKeys[i];
+
+            for (size_t round = 1; round <= Rounds; round++)
+            {
+                // SubBytes and ShiftRows; byte r of column c moves to column c - r
+                unsigned char state[16];
+                for (size_t column = 0; column < 4; column++)
+                {
+                    for (size_t row = 0; row < 4; row++)
+                        state[column * 4 + row] = SBox[block[((column + row) % 4) * 4 + row]];
+                }
+
+                if (round != Rounds)
+                {
+                    for (size_t column = 0; column < 4; column++)
+                    {
+                        auto s = state + column * 4;
+                        auto all = (unsigned char)(s[0] ^ s[1] ^ s[2] ^ s[3]);
+                        auto first = s[0];
+
+                        s[0] ^= (unsigned char)(all ^ Double((unsigned char)(s[0] ^ s[1])));
+                        s[1] ^= (unsigned char)(all ^ Double((unsigned char)(s[1] ^ s[2])));
+                        s[2] ^= (unsigned char)(all ^ Double((unsigned char)(s[2] ^ s[3])));
+                        s[3] ^= (unsigned char)(all ^ Double((unsigned char)(s[3] ^ first)));
+                    }
+                }
+
+                for (size_t i = 0; i < 16; i++)
+                    block[i] = (unsigned char)(state[i] ^ roundKeys[round * 16 + i]);
+            }
+        }
+
+        inline void StoreCounter(uint64_t block, unsigned char counter[16])
+        {
+            for (size_t i = 0; i < 8; i++)
+                counter[i] = (unsigned char)(block >> (i * 8));
+
+            std::memset(counter + 8, 0, 8);
+        }
+
+        // The kernels write the cipher text of the counters [block, block + blocks)
+
+        void SoftwareEncrypt(const unsigned char* roundKeys, uint64_t block, size_t blocks, unsigned char* output)
+        {
+            for (size_t i = 0; i < blocks; i++)
+            {
+                StoreCounter(block + i, output + i * RandomFill::BlockBytes);
+                SoftwareEncryptBlock(roundKeys, output + i * RandomFill::BlockBytes);
+            }
+        }
+
+#ifdef NDISCUTILS_X86
+
+        NDISCUTILS_TARGET("sse2,aes")
+        void AesNiEncrypt(const unsigned char* roundKeys, uint64_t block, size_t blocks, unsigned char* output)
+        {
+            __m128i keys[Rounds + 1];
+            for (size_t round = 0; round <= Rounds; round++)
+                keys[round] = _mm_loadu_si128((const __m128i*)(roundKeys + round * 16));
+
+            // Eight independent blocks hide the latency of each round
+            auto i = (size_t)0;
+            for (; i + 8 <= blocks; i += 8)
+            {
+                __m128i state[8];
+                for (size_t j = 0; j < 8; j++)
+                    state[j] = _mm_xor_si128(_mm_set_epi64x(0, (long long)(block + i + j)), keys[0]);
+
+                for (size_t round = 1; round < Rounds; round++)
+                {
+                    for (size_t j = 0; j < 8; j++)
+                        state[j] = _mm_aesenc_si128(state[j], keys[round]);
+                }
+
+                for (size_t j = 0; j < 8; j++)
+                    _mm_storeu_si128((__m128i*)(output + (i + j) * 16), _mm_aesenclast_si128(state[j], keys[Rounds]));
+            }
+
+            for (; i < blocks; i++)
+            {
+                auto state = _mm_xor_si128(_mm_set_epi64x(0, (long long)(block + i)), keys[0]);
+                for (size_t round = 1; round < Rounds; round++)
+                    state = _mm_aesenc_si128(state, keys[round]);
+
+                _mm_storeu_si128((__m128i*)(output + i * 16), _mm_aesenclast_si128(state, keys[Rounds]));
+            }
+        }
+
+        NDISCUTILS_TARGET("avx512f,aes,vaes")
+        void VaesEncrypt(const unsigned char* roundKeys, uint64_t block, size_t blocks, unsigned char* output)
+        {
+            // The masked broadcast avoids an undefined source operand, which
+            // GCC reports as uninitialized
+            __m512i keys[Rounds + 1];
+            for (size_t round = 0; round <= Rounds; round++)
+                keys[round] = _mm512_maskz_broadcast_i32x4(0xFFFF, _mm_loadu_si128((const __m128i*)(roundKeys + round * 16)));
+
+            // Eight registers of four blocks each; only the low halves of the
+            // counters change
+            const auto laneOffsets = _mm512_set_epi64(0, 3, 0, 2, 0, 1, 0, 0);
+            const auto registerStep = _mm512_set_epi64(0, 4, 0, 4, 0, 4, 0, 4);
+
+            auto i = (size_t)0;
+            for (; i + 32 <= blocks; i += 32)
+            {
+                auto first = (long long)(block + i);
+                __m512i state[8];
+                state[0] = _mm512_add_epi64(_mm512_set_epi64(0, first, 0, first, 0, first, 0, first), laneOffsets);
+                for (size_t j = 1; j < 8; j++)
+                    state[j] = _mm512_add_epi64(state[j - 1], registerStep);
+
+                for (size_t j = 0; j < 8; j++)
+                    state[j] = _mm512_xor_si512(state[j], keys[0]);
+
+                for (size_t round = 1; round < Rounds; round++)
+                {
+                    for (size_t j = 0; j < 8; j++)
+                        state[j] = _mm512_aesenc_epi128(state[j], keys[round]);
+                }
+
+                for (size_t j = 0; j < 8; j++)
+                    _mm512_storeu_si512((void*)(output + (i + j * 4) * 16), _mm512_aesenclast_epi128(state[j], keys[Rounds]));
+            }
+
+            AesNiEncrypt(roundKeys, block + i, blocks - i, output + i * 16);
+        }
+
+#endif // NDISCUTILS_X86
+
+        using EncryptFunction = void (*)(const unsigned char* roundKeys, uint64_t block, size_t blocks, unsigned char* output);
+
+        EncryptFunction CurrentEncrypt()
+        {
+#ifdef NDISCUTILS_X86
+            auto& features = CpuFeatures::Current();
+            auto level = MemoryKernels::Level();
+
+            if (features.Vaes && level >= SimdLevel::Avx512)
+                return VaesEncrypt;
+            if (features.Aes && level >= SimdLevel::Sse2)
+                return AesNiEncrypt;
+#endif
+
+            return SoftwareEncrypt;
+        }
+
+    } // namespace
+
+    RandomFill::RandomFill(uint64_t seed) :
+        mSeed(seed)
+    {
+        unsigned char key[16];
+        auto high = seed ^ 0x9E3779B97F4A7C15ull;
+
+        for (size_t i = 0; i < 8; i++)
+        {
+            key[i] = (unsigned char)(seed >> (i * 8));
+            key[i + 8] = (unsigned char)(high >> (i * 8));
+        }
+
+        ExpandKey(key, mRoundKeys);
+    }
+
+    void RandomFill::Fill(void* destination, size_t count, uint64_t position) const
+    {
+        auto output = (unsigned char*)destination;
+        auto encrypt = CurrentEncrypt();
+        auto block = position / BlockBytes;
+
+        // A partial block in front is encrypted aside and its tail copied
+        auto skip = (size_t)(position % BlockBytes);
+        if (skip != 0 && count != 0)
+        {
+            unsigned char partial[BlockBytes];
+            encrypt(mRoundKeys, block++, 1, partial);
+
+            auto head = std::min(count, BlockBytes - skip);
+            std::memcpy(output, partial + skip, head);
+            output += head;
+            count -= head;
+        }
+
+        auto blocks = count / BlockBytes;
+        encrypt(mRoundKeys, block, blocks, output);
+
+        auto tail = count % BlockBytes;
+        if (tail != 0)
+        {
+            unsigned char partial[BlockBytes];
+            encrypt(mRoundKeys, block + blocks, 1, partial);
+            std::memcpy(output + blocks * BlockBytes, partial, tail);
+        }
+    }
+
+    void RandomFill::Fill(void* destination, size_t count, uint64_t position, size_t threads) const
+    {
+        if (threads == 0)
+            threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+        threads = std::max<size_t>(std::min(threads, count / MinThreadBytes), 1);
+        if (threads == 1)
+        {
+            Fill(destination, count, position);
+            return;
+        }
+
+        // Shares are whole pages, the last one takes the rest
+        auto share = (count / threads) & ~(size_t)4095;
+        auto output = (unsigned char*)destination;
+
+        std::vector<std::thread> pool;
+        auto started = (size_t)1;
+
+        try
+        {
+            for (; started < threads; started++)
+            {
+                auto offset = started * share;
+                auto length = (started + 1 == threads) ? count - offset : share;
+                pool.emplace_back([=]() { Fill(output + offset, length, position + offset); });
+            }
+        }
+        catch (...)
+        {
+            // Shares without a thread are filled by the caller below
+        }
+
+        Fill(output, share, position);
+        if (started < threads)
+            Fill(output + started * share, count - started * share, position + started * share);
+
+        for (auto& thread : pool)
+            thread.join();
+    }
+
+    const char* RandomFill::Implementation()
+    {
+        auto encrypt = CurrentEncrypt();
+
+#ifdef NDISCUTILS_X86
+        if (encrypt == VaesEncrypt)
+            return "vaes";
+        if (encrypt == AesNiEncrypt)
+            return "aes-ni";
+#endif
+
+        (void)encrypt;
+        return "software";
+    }
+
+} // Native
+} // nDiscUtils
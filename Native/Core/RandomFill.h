@@ -0,0 +1,66 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Counter-based random data for wiping and benchmarking: byte p of the
+    // stream for a seed is byte p % 16 of AES-128(key, p / 16), the block
+    // index encoded little-endian into the low half of the counter and the
+    // key made from the seed and the seed xor 0x9E3779B97F4A7C15, both
+    // little-endian. Any range can be produced on its own, so large fills
+    // are split across threads and a wipe can be checked again later.
+    // Blocks are encrypted with VAES or AES-NI where the CPU has them.
+    class RandomFill
+    {
+
+    public:
+        static constexpr size_t BlockBytes = 16;
+
+        explicit RandomFill(uint64_t seed);
+
+        uint64_t Seed() const
+        {
+            return mSeed;
+        }
+
+        // Writes bytes [position, position + count) of the stream
+        void Fill(void* destination, size_t count, uint64_t position) const;
+
+        // Splits fills of several megabytes across up to threads threads,
+        // zero for one per core
+        void Fill(void* destination, size_t count, uint64_t position, size_t threads) const;
+
+        // Cipher implementation Fill() uses, for diagnostics
+        static const char* Implementation();
+
+    private:
+        uint64_t mSeed;
+
+        // Expanded AES-128 key, eleven round keys
+        unsigned char mRoundKeys[176];
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,78 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "ExtentMap.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Range of a source readable in place, see ReadSource::View()
+    struct SourceView
+    {
+        const unsigned char* Data = nullptr;
+
+        // Keeps the memory behind Data valid for as long as it is held
+        std::shared_ptr<const void> Owner;
+    };
+
+    // Data consumed by the compare, hash and copy engines. Sources which do
+    // not report Concurrent() are only read by one thread at a time, but not
+    // always by the same one.
+    class ReadSource
+    {
+
+    public:
+        virtual ~ReadSource() { }
+
+        // Reads up to count bytes at offset and returns fewer only at the
+        // end of the data; failures throw a NativeException
+        virtual size_t Read(uint64_t offset, void* buffer, size_t count) = 0;
+
+        // First range holding data which ends after offset, everything before
+        // it reads back as zero; a zero Length means that only zeros follow.
+        // Sources without allocation information report all of it as data.
+        virtual DataExtent NextData(uint64_t offset)
+        {
+            return DataExtent { offset, UINT64_MAX - offset };
+        }
+
+        // Exposes count bytes at offset without copying them, for sources
+        // which hold their data in memory; returns false if the source
+        // cannot, the range is then taken with Read(). Called under the same
+        // rules as Read(), failures throw a NativeException.
+        virtual bool View(uint64_t /* offset */, size_t /* count */, SourceView& /* view */)
+        {
+            return false;
+        }
+
+        // Whether Read() may be called by several threads at the same time
+        virtual bool Concurrent() const
+        {
+            return false;
+        }
+
+    };
+
+} // Native
+} // nDiscUtils
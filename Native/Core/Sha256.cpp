@@ -0,0 +1,451 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "Sha256.h"
+#include "CpuFeatures.h"
+#include "MemoryKernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef NDISCUTILS_X86
+#include <immintrin.h>
+#endif
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        const uint32_t InitialState[8] = {
+            0x6a09e667u, 0xbb67ae85u, 0x3c6ef372u, 0xa54ff53au, 0x510e527fu, 0x9b05688cu, 0x1f83d9abu, 0x5be0cd19u
+        };
+
+        const uint32_t RoundConstants[64] = {
+            0x428a2f98u, 0x71374491u, 0xb5c0fbcfu, 0xe9b5dba5u, 0x3956c25bu, 0x59f111f1u, 0x923f82a4u, 0xab1c5ed5u,
+            0xd807aa98u, 0x12835b01u, 0x243185beu, 0x550c7dc3u, 0x72be5d74u, 0x80deb1feu, 0x9bdc06a7u, 0xc19bf174u,
+            0xe49b69c1u, 0xefbe4786u, 0x0fc19dc6u, 0x240ca1ccu, 0x2de92c6fu, 0x4a7484aau, 0x5cb0a9dcu, 0x76f988dau,
+            0x983e5152u, 0xa831c66du, 0xb00327c8u, 0xbf597fc7u, 0xc6e00bf3u, 0xd5a79147u, 0x06ca6351u, 0x14292967u,
+            0x27b70a85u, 0x2e1b2138u, 0x4d2c6dfcu, 0x53380d13u, 0x650a7354u, 0x766a0abbu, 0x81c2c92eu, 0x92722c85u,
+            0xa2bfe8a1u, 0xa81a664bu, 0xc24b8b70u, 0xc76c51a3u, 0xd192e819u, 0xd6990624u, 0xf40e3585u, 0x106aa070u,
+            0x19a4c116u, 0x1e376c08u, 0x2748774cu, 0x34b0bcb5u, 0x391c0cb3u, 0x4ed8aa4au, 0x5b9cca4fu, 0x682e6ff3u,
+            0x748f82eeu, 0x78a5636fu, 0x84c87814u, 0x8cc70208u, 0x90befffau, 0xa4506cebu, 0xbef9a3f7u, 0xc67178f2u
+        };
+
+        inline uint32_t ReadBigEndian32(const unsigned char* ptr)
+        {
+            return ((uint32_t)ptr[0] << 24) | ((uint32_t)ptr[1] << 16) | ((uint32_t)ptr[2] << 8) | ptr[3];
+        }
+
+        inline void WriteBigEndian32(unsigned char* ptr, uint32_t value)
+        {
+            ptr[0] = (unsigned char)(value >> 24);
+            ptr[1] = (unsigned char)(value >> 16);
+            ptr[2] = (unsigned char)(value >> 8);
+            ptr[3] = (unsigned char)value;
+        }
+
+        inline void WriteBigEndian64(unsigned char* ptr, uint64_t value)
+        {
+            WriteBigEndian32(ptr, (uint32_t)(value >> 32));
+            WriteBigEndian32(ptr + 4, (uint32_t)value);
+        }
+
+        inline uint32_t RotateRight(uint32_t value, int bits)
+        {
+            return (value >> bits) | (value << (32 - bits));
+        }
+
+        // Final one or two blocks of a message of total bytes whose last
+        // total % 64 bytes are at tail; returns the number of blocks
+        size_t PadMessage(const unsigned char* tail, uint64_t total, unsigned char* blocks)
+        {
+            auto remaining = (size_t)(total % Sha256::BlockBytes);
+            auto count = remaining < Sha256::BlockBytes - 8 ? 1 : 2;
+
+            std::memcpy(blocks, tail, remaining);
+            blocks[remaining] = 0x80;
+            std::memset(blocks + remaining + 1, 0, count * Sha256::BlockBytes - remaining - 1 - 8);
+            WriteBigEndian64(blocks + count * Sha256::BlockBytes - 8, total * 8);
+            return count;
+        }
+
+        void ScalarCompress(uint32_t* state, const unsigned char* data, size_t blocks)
+        {
+            for (; blocks > 0; blocks--, data += Sha256::BlockBytes)
+            {
+                uint32_t w[64];
+                for (int t = 0; t < 16; t++)
+                    w[t] = ReadBigEndian32(data + 4 * t);
+
+                for (int t = 16; t < 64; t++)
+                {
+                    auto s0 = RotateRight(w[t - 15], 7) ^ RotateRight(w[t - 15], 18) ^ (w[t - 15] >> 3);
+                    auto s1 = RotateRight(w[t - 2], 17) ^ RotateRight(w[t - 2], 19) ^ (w[t - 2] >> 10);
+                    w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+                }
+
+                auto a = state[0], b = state[1], c = state[2], d = state[3];
+                auto e = state[4], f = state[5], g = state[6], h = state[7];
+
+                for (int t = 0; t < 64; t++)
+                {
+                    auto s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+                    auto choice = (e & f) ^ (~e & g);
+                    auto t1 = h + s1 + choice + RoundConstants[t] + w[t];
+                    auto s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+                    auto majority = (a & b) ^ (a & c) ^ (b & c);
+                    auto t2 = s0 + majority;
+
+                    h = g;
+                    g = f;
+                    f = e;
+                    e = d + t1;
+                    d = c;
+                    c = b;
+                    b = a;
+                    a = t1 + t2;
+                }
+
+                state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+                state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+            }
+        }
+
+#ifdef NDISCUTILS_X86
+
+        // Four rounds per group; the message schedule of later groups is
+        // computed while earlier ones are processed
+        NDISCUTILS_TARGET("sha,sse4.1,ssse3")
+        void ShaCompress(uint32_t* state, const unsigned char* data, size_t blocks)
+        {
+            auto byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bll, 0x0405060700010203ll);
+
+            // The instructions keep the state as ABEF and CDGH
+            auto temp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0xB1);
+            auto state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(state + 4)), 0x1B);
+            auto state0 = _mm_alignr_epi8(temp, state1, 8);
+            state1 = _mm_blend_epi16(state1, temp, 0xF0);
+
+            for (; blocks > 0; blocks--, data += Sha256::BlockBytes)
+            {
+                auto savedState0 = state0;
+                auto savedState1 = state1;
+                __m128i messages[4];
+
+                for (int group = 0; group < 16; group++)
+                {
+                    auto& current = messages[group % 4];
+                    if (group < 4)
+                        current = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * group)), byteSwap);
+
+                    auto message = _mm_add_epi32(current, _mm_loadu_si128((const __m128i*)(RoundConstants + 4 * group)));
+                    state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+
+                    if (group >= 3 && group <= 14)
+                    {
+                        auto& next = messages[(group + 1) % 4];
+                        next = _mm_add_epi32(next, _mm_alignr_epi8(current, messages[(group + 3) % 4], 4));
+                        next = _mm_sha256msg2_epu32(next, current);
+                    }
+
+                    message = _mm_shuffle_epi32(message, 0x0E);
+                    state0 = _mm_sha256rnds2_epu32(state0, state1, message);
+
+                    if (group >= 1 && group <= 12)
+                    {
+                        auto& previous = messages[(group + 3) % 4];
+                        previous = _mm_sha256msg1_epu32(previous, current);
+                    }
+                }
+
+                state0 = _mm_add_epi32(state0, savedState0);
+                state1 = _mm_add_epi32(state1, savedState1);
+            }
+
+            temp = _mm_shuffle_epi32(state0, 0x1B);
+            state1 = _mm_shuffle_epi32(state1, 0xB1);
+            state0 = _mm_blend_epi16(temp, state1, 0xF0);
+            state1 = _mm_alignr_epi8(state1, temp, 8);
+
+            _mm_storeu_si128((__m128i*)state, state0);
+            _mm_storeu_si128((__m128i*)(state + 4), state1);
+        }
+
+        // Eight messages at once, one per 32-bit lane
+
+        constexpr size_t Lanes = 8;
+
+        NDISCUTILS_TARGET("avx2")
+        inline __m256i RotateRight8(__m256i value, int bits)
+        {
+            return _mm256_or_si256(_mm256_srli_epi32(value, bits), _mm256_slli_epi32(value, 32 - bits));
+        }
+
+        // Turns eight rows of eight words into eight columns
+        NDISCUTILS_TARGET("avx2")
+        inline void Transpose8(__m256i* rows)
+        {
+            auto t0 = _mm256_unpacklo_epi32(rows[0], rows[1]);
+            auto t1 = _mm256_unpackhi_epi32(rows[0], rows[1]);
+            auto t2 = _mm256_unpacklo_epi32(rows[2], rows[3]);
+            auto t3 = _mm256_unpackhi_epi32(rows[2], rows[3]);
+            auto t4 = _mm256_unpacklo_epi32(rows[4], rows[5]);
+            auto t5 = _mm256_unpackhi_epi32(rows[4], rows[5]);
+            auto t6 = _mm256_unpacklo_epi32(rows[6], rows[7]);
+            auto t7 = _mm256_unpackhi_epi32(rows[6], rows[7]);
+
+            auto u0 = _mm256_unpacklo_epi64(t0, t2);
+            auto u1 = _mm256_unpackhi_epi64(t0, t2);
+            auto u2 = _mm256_unpacklo_epi64(t1, t3);
+            auto u3 = _mm256_unpackhi_epi64(t1, t3);
+            auto u4 = _mm256_unpacklo_epi64(t4, t6);
+            auto u5 = _mm256_unpackhi_epi64(t4, t6);
+            auto u6 = _mm256_unpacklo_epi64(t5, t7);
+            auto u7 = _mm256_unpackhi_epi64(t5, t7);
+
+            rows[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+            rows[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+            rows[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+            rows[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+            rows[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+            rows[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+            rows[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+            rows[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+        }
+
+        // Compresses one block of each lane, the block of lane i being at
+        // blocks[i] + offset
+        NDISCUTILS_TARGET("avx2")
+        void Avx2CompressLanes(__m256i* state, const unsigned char* const* blocks, size_t offset)
+        {
+            auto byteSwap = _mm256_set_epi8(
+                12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+            __m256i w[16];
+            for (size_t half = 0; half < 2; half++)
+            {
+                for (size_t lane = 0; lane < Lanes; lane++)
+                    w[8 * half + lane] = _mm256_loadu_si256((const __m256i*)(blocks[lane] + offset + 32 * half));
+
+                Transpose8(w + 8 * half);
+            }
+
+            for (auto& word : w)
+                word = _mm256_shuffle_epi8(word, byteSwap);
+
+            auto a = state[0], b = state[1], c = state[2], d = state[3];
+            auto e = state[4], f = state[5], g = state[6], h = state[7];
+
+            for (int t = 0; t < 64; t++)
+            {
+                auto& word = w[t % 16];
+                if (t >= 16)
+                {
+                    auto w15 = w[(t - 15) % 16];
+                    auto w2 = w[(t - 2) % 16];
+                    auto s0 = _mm256_xor_si256(_mm256_xor_si256(RotateRight8(w15, 7), RotateRight8(w15, 18)),
+                        _mm256_srli_epi32(w15, 3));
+                    auto s1 = _mm256_xor_si256(_mm256_xor_si256(RotateRight8(w2, 17), RotateRight8(w2, 19)),
+                        _mm256_srli_epi32(w2, 10));
+                    word = _mm256_add_epi32(_mm256_add_epi32(word, s0), _mm256_add_epi32(w[(t - 7) % 16], s1));
+                }
+
+                auto s1 = _mm256_xor_si256(_mm256_xor_si256(RotateRight8(e, 6), RotateRight8(e, 11)), RotateRight8(e, 25));
+                auto choice = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+                auto t1 = _mm256_add_epi32(_mm256_add_epi32(h, s1),
+                    _mm256_add_epi32(choice, _mm256_add_epi32(word, _mm256_set1_epi32((int)RoundConstants[t]))));
+                auto s0 = _mm256_xor_si256(_mm256_xor_si256(RotateRight8(a, 2), RotateRight8(a, 13)), RotateRight8(a, 22));
+                auto majority = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+                auto t2 = _mm256_add_epi32(s0, majority);
+
+                h = g;
+                g = f;
+                f = e;
+                e = _mm256_add_epi32(d, t1);
+                d = c;
+                c = b;
+                b = a;
+                a = _mm256_add_epi32(t1, t2);
+            }
+
+            state[0] = _mm256_add_epi32(state[0], a); state[1] = _mm256_add_epi32(state[1], b);
+            state[2] = _mm256_add_epi32(state[2], c); state[3] = _mm256_add_epi32(state[3], d);
+            state[4] = _mm256_add_epi32(state[4], e); state[5] = _mm256_add_epi32(state[5], f);
+            state[6] = _mm256_add_epi32(state[6], g); state[7] = _mm256_add_epi32(state[7], h);
+        }
+
+        // Hashes up to eight buffers of equal length; unused lanes repeat
+        // the first buffer and their digests are dropped
+        NDISCUTILS_TARGET("avx2")
+        void Avx2HashLanes(const unsigned char* const* data, size_t count, size_t length, unsigned char* digests)
+        {
+            const unsigned char* lanes[Lanes];
+            for (size_t lane = 0; lane < Lanes; lane++)
+                lanes[lane] = data[lane < count ? lane : 0];
+
+            __m256i state[8];
+            for (size_t i = 0; i < 8; i++)
+                state[i] = _mm256_set1_epi32((int)InitialState[i]);
+
+            auto blocks = length / Sha256::BlockBytes;
+            for (size_t block = 0; block < blocks; block++)
+                Avx2CompressLanes(state, lanes, block * Sha256::BlockBytes);
+
+            // All lanes share the padding layout as their lengths are equal
+            unsigned char padding[Lanes][2 * Sha256::BlockBytes];
+            const unsigned char* paddedLanes[Lanes];
+            size_t paddingBlocks = 0;
+
+            for (size_t lane = 0; lane < Lanes; lane++)
+            {
+                paddingBlocks = PadMessage(lanes[lane] + blocks * Sha256::BlockBytes, length, padding[lane]);
+                paddedLanes[lane] = padding[lane];
+            }
+
+            for (size_t block = 0; block < paddingBlocks; block++)
+                Avx2CompressLanes(state, paddedLanes, block * Sha256::BlockBytes);
+
+            auto byteSwap = _mm256_set_epi8(
+                12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+            Transpose8(state);
+            for (size_t lane = 0; lane < count; lane++)
+            {
+                _mm256_storeu_si256((__m256i*)(digests + lane * Sha256::DigestBytes),
+                    _mm256_shuffle_epi8(state[lane], byteSwap));
+            }
+        }
+
+#endif // NDISCUTILS_X86
+
+        using CompressFunction = void (*)(uint32_t* state, const unsigned char* data, size_t blocks);
+
+        CompressFunction CurrentCompress()
+        {
+#ifdef NDISCUTILS_X86
+            if (CpuFeatures::Current().Sha && MemoryKernels::Level() >= SimdLevel::Sse2)
+                return ShaCompress;
+#endif
+
+            return ScalarCompress;
+        }
+
+        bool UseLanes()
+        {
+#ifdef NDISCUTILS_X86
+            return CurrentCompress() == ScalarCompress && MemoryKernels::Level() >= SimdLevel::Avx2;
+#else
+            return false;
+#endif
+        }
+
+    } // namespace
+
+    Sha256::Sha256()
+    {
+        Reset();
+    }
+
+    void Sha256::Reset()
+    {
+        std::memcpy(mState, InitialState, sizeof(mState));
+        mBuffered = 0;
+        mTotal = 0;
+    }
+
+    void Sha256::Update(const void* data, size_t count)
+    {
+        auto input = (const unsigned char*)data;
+        auto compress = CurrentCompress();
+        mTotal += count;
+
+        if (mBuffered > 0)
+        {
+            auto fill = std::min(count, BlockBytes - mBuffered);
+            std::memcpy(mBuffer + mBuffered, input, fill);
+            mBuffered += fill;
+            input += fill;
+            count -= fill;
+
+            if (mBuffered < BlockBytes)
+                return;
+
+            compress(mState, mBuffer, 1);
+            mBuffered = 0;
+        }
+
+        auto blocks = count / BlockBytes;
+        if (blocks > 0)
+        {
+            compress(mState, input, blocks);
+            input += blocks * BlockBytes;
+            count -= blocks * BlockBytes;
+        }
+
+        std::memcpy(mBuffer, input, count);
+        mBuffered = count;
+    }
+
+    void Sha256::Final(unsigned char* digest)
+    {
+        unsigned char padding[2 * BlockBytes];
+        auto blocks = PadMessage(mBuffer, mTotal, padding);
+        CurrentCompress()(mState, padding, blocks);
+
+        for (size_t i = 0; i < 8; i++)
+            WriteBigEndian32(digest + 4 * i, mState[i]);
+
+        Reset();
+    }
+
+    void Sha256::Hash(const void* data, size_t count, unsigned char* digest)
+    {
+        Sha256 state;
+        state.Update(data, count);
+        state.Final(digest);
+    }
+
+    void Sha256::HashMany(const unsigned char* const* data, size_t count, size_t length, unsigned char* digests)
+    {
+#ifdef NDISCUTILS_X86
+        if (UseLanes())
+        {
+            for (size_t i = 0; i < count; i += Lanes)
+                Avx2HashLanes(data + i, std::min(count - i, Lanes), length, digests + i * DigestBytes);
+
+            return;
+        }
+#endif
+
+        for (size_t i = 0; i < count; i++)
+            Hash(data[i], length, digests + i * DigestBytes);
+    }
+
+    const char* Sha256::Implementation()
+    {
+        if (UseLanes())
+            return "avx2x8";
+
+        return CurrentCompress() == ScalarCompress ? "scalar" : "sha";
+    }
+
+} // Native
+} // nDiscUtils
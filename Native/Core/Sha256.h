@@ -0,0 +1,63 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // SHA-256 (FIPS 180-4) on the SHA extensions where the CPU has them.
+    // HashMany() hashes equally long buffers side by side, eight lanes per
+    // AVX2 register on machines without the extensions.
+    class Sha256
+    {
+
+    public:
+        static constexpr size_t DigestBytes = 32;
+        static constexpr size_t BlockBytes = 64;
+
+        Sha256();
+
+        void Reset();
+
+        void Update(const void* data, size_t count);
+
+        // Writes DigestBytes bytes and resets the state
+        void Final(unsigned char* digest);
+
+        static void Hash(const void* data, size_t count, unsigned char* digest);
+
+        // Hashes count buffers of length bytes each into consecutive digests
+        static void HashMany(const unsigned char* const* data, size_t count, size_t length, unsigned char* digests);
+
+        // Compression function HashMany() uses, for diagnostics
+        static const char* Implementation();
+
+    private:
+        uint32_t mState[8];
+        unsigned char mBuffer[BlockBytes];
+        size_t mBuffered;
+        uint64_t mTotal;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,619 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "SignatureScanner.h"
+#include "AlignedBuffer.h"
+#include "CpuFeatures.h"
+#include "MemoryKernels.h"
+#include "NativeException.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef NDISCUTILS_X86
+#include <immintrin.h>
+#endif
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        // Two bytes every signature of a kind has at a fixed distance from
+        // its start; the vectorized pass only looks for these
+        struct Anchor
+        {
+            uint32_t Kind;
+            size_t Offset;
+            unsigned char First;
+            unsigned char Second;
+        };
+
+        const Anchor Anchors[] =
+        {
+            { SignatureNtfs, 3, 'N', 'T' },
+            { SignatureFat, 510, 0x55, 0xAA },
+            { SignatureExt, 1080, 0x53, 0xEF },
+        };
+
+        constexpr size_t MaxAnchors = sizeof(Anchors) / sizeof(Anchors[0]);
+
+        // Byte pairs of the enabled anchors; unused entries repeat the first
+        // one, so the kernels always test all of them without branching
+        struct AnchorSet
+        {
+            unsigned char First[MaxAnchors];
+            unsigned char Second[MaxAnchors];
+        };
+
+        inline unsigned TrailingZeros(uint64_t value)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+#ifdef _M_X64
+            _BitScanForward64(&index, value);
+#else
+            if (!_BitScanForward(&index, (unsigned long)value))
+            {
+                _BitScanForward(&index, (unsigned long)(value >> 32));
+                index += 32;
+            }
+#endif
+            return (unsigned)index;
+#else
+            return (unsigned)__builtin_ctzll(value);
+#endif
+        }
+
+        inline uint16_t ReadUInt16(const unsigned char* data)
+        {
+            return (uint16_t)(data[0] | (data[1] << 8));
+        }
+
+        inline uint32_t ReadUInt32(const unsigned char* data)
+        {
+            return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+        }
+
+        // The kernels return the first position below count at which any
+        // anchor matches; data has to hold count + 1 bytes
+
+        size_t ScalarFindAnchor(const unsigned char* data, size_t count, const AnchorSet& anchors)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                for (size_t k = 0; k < MaxAnchors; k++)
+                {
+                    if (data[i] == anchors.First[k] && data[i + 1] == anchors.Second[k])
+                        return i;
+                }
+            }
+
+            return count;
+        }
+
+#ifdef NDISCUTILS_X86
+
+        NDISCUTILS_TARGET("sse2")
+        size_t Sse2FindAnchor(const unsigned char* data, size_t count, const AnchorSet& anchors)
+        {
+            __m128i first[MaxAnchors], second[MaxAnchors];
+            for (size_t k = 0; k < MaxAnchors; k++)
+            {
+                first[k] = _mm_set1_epi8((char)anchors.First[k]);
+                second[k] = _mm_set1_epi8((char)anchors.Second[k]);
+            }
+
+            auto i = (size_t)0;
+            for (; i + 16 <= count; i += 16)
+            {
+                auto v0 = _mm_loadu_si128((const __m128i*)(data + i));
+                auto v1 = _mm_loadu_si128((const __m128i*)(data + i + 1));
+
+                auto any = _mm_and_si128(_mm_cmpeq_epi8(v0, first[0]), _mm_cmpeq_epi8(v1, second[0]));
+                for (size_t k = 1; k < MaxAnchors; k++)
+                    any = _mm_or_si128(any, _mm_and_si128(_mm_cmpeq_epi8(v0, first[k]), _mm_cmpeq_epi8(v1, second[k])));
+
+                auto mask = (unsigned)_mm_movemask_epi8(any);
+                if (mask != 0)
+                    return i + TrailingZeros(mask);
+            }
+
+            return i + ScalarFindAnchor(data + i, count - i, anchors);
+        }
+
+        NDISCUTILS_TARGET("avx2")
+        size_t Avx2FindAnchor(const unsigned char* data, size_t count, const AnchorSet& anchors)
+        {
+            __m256i first[MaxAnchors], second[MaxAnchors];
+            for (size_t k = 0; k < MaxAnchors; k++)
+            {
+                first[k] = _mm256_set1_epi8((char)anchors.First[k]);
+                second[k] = _mm256_set1_epi8((char)anchors.Second[k]);
+            }
+
+            auto i = (size_t)0;
+            for (; i + 32 <= count; i += 32)
+            {
+                auto v0 = _mm256_loadu_si256((const __m256i*)(data + i));
+                auto v1 = _mm256_loadu_si256((const __m256i*)(data + i + 1));
+
+                auto any = _mm256_and_si256(_mm256_cmpeq_epi8(v0, first[0]), _mm256_cmpeq_epi8(v1, second[0]));
+                for (size_t k = 1; k < MaxAnchors; k++)
+                    any = _mm256_or_si256(any, _mm256_and_si256(_mm256_cmpeq_epi8(v0, first[k]), _mm256_cmpeq_epi8(v1, second[k])));
+
+                auto mask = (uint32_t)_mm256_movemask_epi8(any);
+                if (mask != 0)
+                    return i + TrailingZeros(mask);
+            }
+
+            return i + ScalarFindAnchor(data + i, count - i, anchors);
+        }
+
+        NDISCUTILS_TARGET("avx512f,avx512bw")
+        size_t Avx512FindAnchor(const unsigned char* data, size_t count, const AnchorSet& anchors)
+        {
+            __m512i first[MaxAnchors], second[MaxAnchors];
+            for (size_t k = 0; k < MaxAnchors; k++)
+            {
+                first[k] = _mm512_set1_epi8((char)anchors.First[k]);
+                second[k] = _mm512_set1_epi8((char)anchors.Second[k]);
+            }
+
+            auto i = (size_t)0;
+            for (; i + 64 <= count; i += 64)
+            {
+                auto v0 = _mm512_loadu_si512((const void*)(data + i));
+                auto v1 = _mm512_loadu_si512((const void*)(data + i + 1));
+
+                // The second comparison only runs on lanes where the first byte matched
+                __mmask64 any = 0;
+                for (size_t k = 0; k < MaxAnchors; k++)
+                    any |= _mm512_mask_cmpeq_epi8_mask(_mm512_cmpeq_epi8_mask(v0, first[k]), v1, second[k]);
+
+                if (any != 0)
+                    return i + TrailingZeros(any);
+            }
+
+            return i + ScalarFindAnchor(data + i, count - i, anchors);
+        }
+
+#endif
+
+        typedef size_t (*FindAnchorKernel)(const unsigned char* data, size_t count, const AnchorSet& anchors);
+
+        FindAnchorKernel CurrentKernel()
+        {
+#ifdef NDISCUTILS_X86
+            switch (MemoryKernels::Level())
+            {
+                case SimdLevel::Avx512: return Avx512FindAnchor;
+                case SimdLevel::Avx2: return Avx2FindAnchor;
+                case SimdLevel::Sse2: return Sse2FindAnchor;
+                default: break;
+            }
+#endif
+
+            return ScalarFindAnchor;
+        }
+
+        // Checks the fields behind an anchor match; available is the number
+        // of bytes at data which belong to the source
+
+        bool IsNtfs(const unsigned char* data, size_t available)
+        {
+            return available >= 11 && std::memcmp(data + 3, "NTFS    ", 8) == 0;
+        }
+
+        bool IsFat(const unsigned char* data, size_t available)
+        {
+            if (available < 512 || data[510] != 0x55 || data[511] != 0xAA)
+                return false;
+
+            auto bytesPerSector = ReadUInt16(data + 11);
+            auto sectorsPerCluster = data[13];
+            auto reservedSectors = ReadUInt16(data + 14);
+            auto fats = data[16];
+            auto media = data[21];
+
+            return (bytesPerSector == 512 || bytesPerSector == 1024 || bytesPerSector == 2048 || bytesPerSector == 4096) &&
+                sectorsPerCluster != 0 && (sectorsPerCluster & (sectorsPerCluster - 1)) == 0 &&
+                reservedSectors != 0 &&
+                (fats == 1 || fats == 2) &&
+                (media == 0xF0 || media >= 0xF8);
+        }
+
+        bool IsExt(const unsigned char* data, size_t available)
+        {
+            if (available < SignatureScanner::Overlap || data[1080] != 0x53 || data[1081] != 0xEF)
+                return false;
+
+            // Block sizes range from 1K to 64K
+            auto superblock = data + 1024;
+            return ReadUInt32(superblock + 24) <= 6 &&
+                ReadUInt32(superblock + 32) != 0 &&
+                ReadUInt32(superblock + 40) != 0;
+        }
+
+        bool Matches(uint32_t kind, const unsigned char* data, size_t available)
+        {
+            switch (kind)
+            {
+                case SignatureNtfs: return IsNtfs(data, available);
+                case SignatureFat: return IsFat(data, available);
+                case SignatureExt: return IsExt(data, available);
+                default: return false;
+            }
+        }
+
+        // Buffer of the chunk currently assigned to it and where its data
+        // is, the buffer or memory of the source
+        struct Slot
+        {
+            explicit Slot(size_t bytes) :
+                Buffer(bytes) { }
+
+            AlignedBuffer Buffer;
+            SourceView View;
+
+            uint64_t Chunk = 0;
+        };
+
+        // Reads a whole request into buffer unless the source can expose it
+        // in place; view points to the data afterwards. Returns false and
+        // records the failure if the source fails or ends early.
+        bool ReadChunk(ReadSource& source, uint64_t offset, unsigned char* buffer, size_t count,
+            SourceView& view, SignatureScanResult& failure)
+        {
+            size_t read;
+
+            try
+            {
+                if (source.View(offset, count, view))
+                    return true;
+
+                view.Data = buffer;
+                read = source.Read(offset, buffer, count);
+            }
+            catch (const NativeException& ex)
+            {
+                failure.FailedOffset = offset;
+                failure.Failure = ex.what();
+                return false;
+            }
+
+            if (read < count)
+            {
+                failure.FailedOffset = offset + read;
+                failure.Failure = "Data ends after " + std::to_string(offset + read) + " bytes";
+                return false;
+            }
+
+            return true;
+        }
+
+    } // namespace
+
+    SignatureScanner::SignatureScanner(const SignatureScannerOptions& options) :
+        mOptions(options)
+    {
+        if (options.ChunkBytes == 0 || options.Depth == 0)
+            throw NativeException(NativeError::InvalidArgument, "Chunk size and depth of a scan may not be zero");
+        if (options.Granularity == 0)
+            throw NativeException(NativeError::InvalidArgument, "Granularity of a scan may not be zero");
+        if ((options.Kinds & SignatureAll) == 0 || (options.Kinds & ~(uint32_t)SignatureAll) != 0)
+            throw NativeException(NativeError::InvalidArgument, "A scan needs at least one known signature");
+        if (options.ChunkBytes > SIZE_MAX - Overlap)
+            throw NativeException(NativeError::Overflow, "Chunk size of a scan is too large");
+    }
+
+    void SignatureScanner::ScanBuffer(const unsigned char* data, size_t count, size_t candidates, uint64_t base,
+        uint32_t kinds, size_t granularity, std::vector<SignatureHit>& hits)
+    {
+        const Anchor* enabled[MaxAnchors];
+        size_t anchorCount = 0;
+        size_t maxOffset = 0;
+
+        for (auto& anchor : Anchors)
+        {
+            if ((kinds & anchor.Kind) == 0)
+                continue;
+
+            enabled[anchorCount++] = &anchor;
+            maxOffset = std::max(maxOffset, anchor.Offset);
+        }
+
+        if (anchorCount == 0 || count < 2 || candidates == 0)
+            return;
+
+        AnchorSet set;
+        for (size_t k = 0; k < MaxAnchors; k++)
+        {
+            auto anchor = enabled[k < anchorCount ? k : 0];
+            set.First[k] = anchor->First;
+            set.Second[k] = anchor->Second;
+        }
+
+        // Positions of anchors which can belong to one of the candidates
+        auto limit = std::min(count - 1, candidates + maxOffset);
+        auto findAnchor = CurrentKernel();
+        auto first = hits.size();
+
+        for (auto i = (size_t)0; i < limit; i++)
+        {
+            i += findAnchor(data + i, limit - i, set);
+            if (i >= limit)
+                break;
+
+            for (size_t k = 0; k < anchorCount; k++)
+            {
+                auto anchor = enabled[k];
+                if (data[i] != anchor->First || data[i + 1] != anchor->Second || i < anchor->Offset)
+                    continue;
+
+                auto start = i - anchor->Offset;
+                if (start >= candidates || ((base + start) % granularity) != 0)
+                    continue;
+
+                if (Matches(anchor->Kind, data + start, count - start))
+                    hits.push_back({ base + start, anchor->Kind });
+            }
+        }
+
+        // Anchors are found in data order, which differs from the order of
+        // the signatures' starts; join kinds found at the same offset
+        std::sort(hits.begin() + first, hits.end(),
+            [](const SignatureHit& left, const SignatureHit& right) { return left.Offset < right.Offset; });
+
+        auto last = first;
+        for (auto i = first; i < hits.size(); i++)
+        {
+            if (last > first && hits[last - 1].Offset == hits[i].Offset)
+                hits[last - 1].Kinds |= hits[i].Kinds;
+            else
+                hits[last++] = hits[i];
+        }
+
+        hits.resize(last);
+    }
+
+    SignatureScanResult SignatureScanner::Scan(ReadSource& source, uint64_t sourceLength, uint64_t offset, uint64_t length) const
+    {
+        SignatureScanResult result;
+
+        if (offset > sourceLength || length > sourceLength - offset)
+            throw NativeException(NativeError::InvalidArgument, "Scanned range exceeds the source");
+
+        if (length == 0)
+            return result;
+
+        auto chunkBytes = (uint64_t)mOptions.ChunkBytes;
+        auto chunks = (length + chunkBytes - 1) / chunkBytes;
+        auto chunkStart = [&](uint64_t chunk)
+        {
+            return offset + chunk * chunkBytes;
+        };
+        auto chunkLength = [&](uint64_t chunk)
+        {
+            return (size_t)std::min(chunkBytes, length - chunk * chunkBytes);
+        };
+
+        // Chunks are read with the overlap into the next one unless the source ends first
+        auto readLength = [&](uint64_t chunk)
+        {
+            return (size_t)std::min<uint64_t>(chunkLength(chunk) + Overlap, sourceLength - chunkStart(chunk));
+        };
+
+        auto scan = [&](const unsigned char* data, uint64_t chunk, std::vector<SignatureHit>& hits)
+        {
+            ScanBuffer(data, readLength(chunk), chunkLength(chunk), chunkStart(chunk),
+                mOptions.Kinds, mOptions.Granularity, hits);
+        };
+
+        auto merge = [&](std::vector<SignatureHit>& hits)
+        {
+            result.HitCount += hits.size();
+
+            auto listed = std::min(hits.size(), mOptions.MaxHits - std::min(mOptions.MaxHits, result.Hits.size()));
+            result.Hits.insert(result.Hits.end(), hits.begin(), hits.begin() + listed);
+        };
+
+        // A single chunk is not worth any threads
+        if (chunks == 1)
+        {
+            Slot slot(readLength(0));
+            if (!ReadChunk(source, offset, slot.Buffer.Data(), readLength(0), slot.View, result))
+                return result;
+
+            std::vector<SignatureHit> hits;
+            scan(slot.View.Data, 0, hits);
+            merge(hits);
+
+            result.ScannedBytes = length;
+            return result;
+        }
+
+        auto depth = (size_t)std::min<uint64_t>(mOptions.Depth, chunks);
+        auto threads = (size_t)(mOptions.Threads != 0 ? mOptions.Threads : std::thread::hardware_concurrency());
+        threads = std::max<size_t>(std::min(threads, depth), 1);
+
+        std::vector<std::unique_ptr<Slot>> slots;
+        for (size_t i = 0; i < depth; i++)
+        {
+            slots.emplace_back(new Slot(mOptions.ChunkBytes + Overlap));
+            slots.back()->Chunk = i;
+        }
+
+        std::mutex lock;
+        std::condition_variable readable;
+        std::condition_variable scannable;
+        std::deque<Slot*> filled;
+
+        // Scanned chunks wait here until all chunks before them are merged
+        std::map<uint64_t, std::vector<SignatureHit>> scanned;
+        uint64_t merged = 0;
+
+        bool stopped = false;
+        std::exception_ptr error;
+
+        // Called with the lock held
+        auto stop = [&](std::exception_ptr exception)
+        {
+            if (exception && !error)
+                error = exception;
+
+            stopped = true;
+            readable.notify_all();
+            scannable.notify_all();
+        };
+
+        auto reader = [&]()
+        {
+            try
+            {
+                for (uint64_t chunk = 0; chunk < chunks; chunk++)
+                {
+                    auto& slot = *slots[(size_t)(chunk % depth)];
+
+                    {
+                        std::unique_lock<std::mutex> guard(lock);
+                        readable.wait(guard, [&]() { return stopped || slot.Chunk == chunk; });
+                        if (stopped)
+                            return;
+                    }
+
+                    SignatureScanResult failure;
+                    auto read = ReadChunk(source, chunkStart(chunk), slot.Buffer.Data(), readLength(chunk), slot.View,
+                        failure);
+
+                    std::lock_guard<std::mutex> guard(lock);
+                    if (!read)
+                    {
+                        result.FailedOffset = failure.FailedOffset;
+                        result.Failure = failure.Failure;
+
+                        stop(nullptr);
+                        return;
+                    }
+
+                    filled.push_back(&slot);
+                    scannable.notify_one();
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stop(std::current_exception());
+            }
+        };
+
+        auto worker = [&]()
+        {
+            try
+            {
+                for (;;)
+                {
+                    Slot* slot;
+
+                    {
+                        std::unique_lock<std::mutex> guard(lock);
+                        scannable.wait(guard, [&]() { return stopped || !filled.empty() || merged == chunks; });
+                        if (stopped || filled.empty())
+                            return;
+
+                        slot = filled.front();
+                        filled.pop_front();
+                    }
+
+                    std::vector<SignatureHit> hits;
+                    scan(slot->View.Data, slot->Chunk, hits);
+                    slot->View = SourceView();
+
+                    std::lock_guard<std::mutex> guard(lock);
+                    scanned.emplace(slot->Chunk, std::move(hits));
+
+                    while (!scanned.empty() && scanned.begin()->first == merged)
+                    {
+                        merge(scanned.begin()->second);
+                        result.ScannedBytes += chunkLength(merged);
+
+                        scanned.erase(scanned.begin());
+                        merged++;
+                    }
+
+                    // Hand the buffer to the chunk depth positions ahead
+                    slot->Chunk += depth;
+                    readable.notify_all();
+
+                    if (merged == chunks)
+                        scannable.notify_all();
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stop(std::current_exception());
+            }
+        };
+
+        std::vector<std::thread> pool;
+        try
+        {
+            pool.emplace_back(reader);
+
+            for (size_t i = 1; i < threads; i++)
+                pool.emplace_back(worker);
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stop(nullptr);
+            }
+
+            for (auto& thread : pool)
+                thread.join();
+
+            throw;
+        }
+
+        // The calling thread scans as well
+        worker();
+
+        for (auto& thread : pool)
+            thread.join();
+
+        if (error)
+            std::rethrow_exception(error);
+
+        return result;
+    }
+
+} // Native
+} // nDiscUtils
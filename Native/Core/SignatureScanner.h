@@ -0,0 +1,124 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "ReadSource.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // File systems a scan looks for, combined as flags
+    enum SignatureKind : uint32_t
+    {
+        SignatureNone = 0,
+
+        // "NTFS    " OEM ID at +3
+        SignatureNtfs = 1 << 0,
+
+        // 0x55AA at +510 with a plausible BIOS parameter block
+        SignatureFat = 1 << 1,
+
+        // 0xEF53 superblock magic at +1080 with plausible group sizes
+        SignatureExt = 1 << 2,
+
+        SignatureAll = SignatureNtfs | SignatureFat | SignatureExt
+    };
+
+    // Offset at which one or more file systems may start
+    struct SignatureHit
+    {
+        uint64_t Offset;
+        uint32_t Kinds;
+    };
+
+    struct SignatureScannerOptions
+    {
+        // SignatureKind flags to look for
+        uint32_t Kinds = SignatureAll;
+
+        // Only offsets which are a multiple of this are reported
+        size_t Granularity = 1;
+
+        // Bytes read per request, plus the overlap into the next chunk
+        size_t ChunkBytes = 16u << 20;
+
+        // Chunks which are read or scanned at the same time
+        size_t Depth = 4;
+
+        // Threads scanning chunks, zero for one per core
+        size_t Threads = 0;
+
+        // Hits listed in the result; any further ones are only counted
+        size_t MaxHits = 1u << 16;
+    };
+
+    struct SignatureScanResult
+    {
+        // Leading bytes of the range which were scanned before the end or a failure
+        uint64_t ScannedBytes = 0;
+
+        uint64_t HitCount = 0;
+
+        // First MaxHits hits in ascending order
+        std::vector<SignatureHit> Hits;
+
+        // Offset of the failed request and the reason
+        uint64_t FailedOffset = 0;
+        std::string Failure;
+    };
+
+    // Finds offsets at which file systems may start. A vectorized pass looks
+    // for the two-byte anchors of all enabled signatures at once, and only
+    // where one of them matches are the remaining fields of that signature
+    // checked. Hits are candidates for the full detectors, not proof.
+    class SignatureScanner
+    {
+
+    public:
+        // Bytes behind an offset which all signatures together look at
+        static const size_t Overlap = 1082;
+
+        explicit SignatureScanner(const SignatureScannerOptions& options = SignatureScannerOptions());
+
+        const SignatureScannerOptions& Options() const
+        {
+            return mOptions;
+        }
+
+        // Scans all offsets in [offset, offset + length) of a source holding
+        // sourceLength bytes; signatures reaching beyond the source never match
+        SignatureScanResult Scan(ReadSource& source, uint64_t sourceLength, uint64_t offset, uint64_t length) const;
+
+        // Appends the hits at offsets [0, candidates) of data, which holds
+        // count bytes and starts at base within its source
+        static void ScanBuffer(const unsigned char* data, size_t count, size_t candidates, uint64_t base,
+            uint32_t kinds, size_t granularity, std::vector<SignatureHit>& hits);
+
+    private:
+        SignatureScannerOptions mOptions;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,94 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "SpillFile.h"
+#include "NativeException.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <new>
+
+namespace nDiscUtils {
+namespace Native {
+
+    SpillFile::SpillFile(const std::string& path, size_t slotSize) :
+        mSlotSize(slotSize),
+        mFile(ImageFile::Open(path, ImageFileMode::Create, true)),
+        mSlotCount(0),
+        mUsedSlots(0) { }
+
+    SpillFile::~SpillFile()
+    {
+        auto path = mFile->Path();
+        mFile.reset();
+        ImageFile::Delete(path);
+    }
+
+    uint32_t SpillFile::Allocate()
+    {
+        mUsedSlots++;
+
+        if (!mFree.empty())
+        {
+            std::pop_heap(mFree.begin(), mFree.end(), std::greater<uint32_t>());
+            auto slot = mFree.back();
+            mFree.pop_back();
+            return slot;
+        }
+
+        if (mSlotCount == std::numeric_limits<uint32_t>::max())
+        {
+            mUsedSlots--;
+            throw NativeException(NativeError::OutOfMemory, "Spill file has no slots left");
+        }
+
+        // Keeping room for every slot now spares Release() from allocating
+        try
+        {
+            mFree.reserve((size_t)mSlotCount + 1);
+        }
+        catch (const std::bad_alloc&)
+        {
+            mUsedSlots--;
+            throw NativeException(NativeError::OutOfMemory, "Failed to allocate the spill slot table");
+        }
+
+        return mSlotCount++;
+    }
+
+    void SpillFile::Release(uint32_t slot)
+    {
+        mUsedSlots--;
+
+        mFree.push_back(slot);
+        std::push_heap(mFree.begin(), mFree.end(), std::greater<uint32_t>());
+    }
+
+    void SpillFile::Read(uint32_t slot, void* buffer, size_t count)
+    {
+        mFile->ReadAt((uint64_t)slot * mSlotSize, buffer, count);
+    }
+
+    void SpillFile::Write(uint32_t slot, const void* buffer, size_t count)
+    {
+        mFile->WriteAt((uint64_t)slot * mSlotSize, buffer, count);
+    }
+
+} // Native
+} // nDiscUtils
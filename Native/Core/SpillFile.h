@@ -0,0 +1,84 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ImageFile.h"
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Scratch file split into fixed-size slots which hold blocks evicted
+    // from memory. The file is created sparse, unbuffered, and deleted
+    // again on destruction. Free slots are handed out lowest first, so
+    // slots taken in a row tend to be adjacent and can be written at once.
+    //
+    // Allocate() and Release() have to be serialized by the caller; Read()
+    // and Write() may be called concurrently with anything.
+    class SpillFile
+    {
+
+    public:
+        SpillFile(const std::string& path, size_t slotSize);
+
+        ~SpillFile();
+
+        SpillFile(const SpillFile&) = delete;
+        SpillFile& operator=(const SpillFile&) = delete;
+
+        size_t SlotSize() const
+        {
+            return mSlotSize;
+        }
+
+        // Slots currently holding a block
+        size_t UsedSlots() const
+        {
+            return mUsedSlots;
+        }
+
+        uint32_t Allocate();
+
+        void Release(uint32_t slot);
+
+        // Transfers count bytes starting at the slot, which may span the
+        // following slots; count and buffer have to be aligned for
+        // unbuffered I/O, see ImageFile
+        void Read(uint32_t slot, void* buffer, size_t count);
+
+        void Write(uint32_t slot, const void* buffer, size_t count);
+
+    private:
+        size_t mSlotSize;
+        std::unique_ptr<ImageFile> mFile;
+
+        // Min-heap of released slots below mSlotCount
+        std::vector<uint32_t> mFree;
+        uint32_t mSlotCount;
+        size_t mUsedSlots;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,54 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <atomic>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Minimal lock for short critical sections in headers which are also
+    // compiled as managed code, where <mutex> is not available. Provides
+    // lock()/unlock() so it can be used with std::lock_guard.
+    class SpinLock
+    {
+
+    public:
+        void lock()
+        {
+            while (mLocked.exchange(true, std::memory_order_acquire))
+                Wait();
+        }
+
+        void unlock()
+        {
+            mLocked.store(false, std::memory_order_release);
+        }
+
+    private:
+        // Spins until the lock looks free, yielding to other threads once
+        // the holder takes longer
+        void Wait();
+
+        std::atomic<bool> mLocked { false };
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,185 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "StaticMemoryStore.h"
+#include "NativeException.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        // Unit of work while prefaulting, rounded up to the page size
+        constexpr size_t PrefaultChunkBytes = (size_t)64 << 20;
+
+    } // namespace
+
+    StaticMemoryStore::StaticMemoryStore(size_t capacity, PageProvider* provider) :
+        StaticMemoryStore(capacity, StaticMemoryStoreOptions(), provider) { }
+
+    StaticMemoryStore::StaticMemoryStore(size_t capacity, const NumaPolicy& policy, PageProvider* provider) :
+        StaticMemoryStore(capacity, StaticMemoryStoreOptions { policy }, provider) { }
+
+    StaticMemoryStore::StaticMemoryStore(size_t capacity, const StaticMemoryStoreOptions& options, PageProvider* provider) :
+        MemoryStore(capacity, provider),
+        mMemory(nullptr),
+        mPageBytes(0),
+        mRegionBytes(capacity)
+    {
+        auto& policy = options.Numa;
+        NumaTopology::AssertPolicy(policy);
+
+        if (options.LargePages && NumaTopology::IsPlaced(policy))
+            throw NativeException(NativeError::InvalidArgument, "Large pages can only be used with the default NUMA placement");
+
+        auto largePageSize = mProvider->LargePageSize();
+        if (options.LargePages && largePageSize != 0 && mCapacity <= SIZE_MAX - largePageSize)
+        {
+            auto regionBytes = (mCapacity + largePageSize - 1) / largePageSize * largePageSize;
+
+            mMemory = (unsigned char*)mProvider->AllocateLarge(regionBytes);
+            if (mMemory != nullptr)
+            {
+                mPageBytes = largePageSize;
+                mRegionBytes = regionBytes;
+            }
+        }
+
+        if (mMemory == nullptr)
+        {
+            if (!NumaTopology::IsPlaced(policy))
+                mMemory = (unsigned char*)mProvider->Allocate(mCapacity);
+            else if (policy.Placement == NumaPlacement::Interleave)
+                mMemory = (unsigned char*)mProvider->AllocateInterleaved(mCapacity, policy.InterleaveBytes);
+            else if (policy.Placement == NumaPlacement::Local)
+                mMemory = (unsigned char*)mProvider->AllocateOnNode(mCapacity, NumaTopology::CurrentNode());
+            else
+                mMemory = (unsigned char*)mProvider->AllocateOnNode(mCapacity, policy.Node);
+        }
+
+        if (mMemory == nullptr)
+            throw NativeException(NativeError::OutOfMemory,
+                "Failed to allocate " + std::to_string(mCapacity) + " bytes of memory");
+
+        // Faulting a large page in stalls the request touching it for as long
+        // as zeroing the whole page takes, so those regions always are
+        if (options.Prefault || mPageBytes != 0)
+            Prefault(options.PrefaultThreads);
+    }
+
+    StaticMemoryStore::~StaticMemoryStore()
+    {
+        mProvider->Release(mMemory, mRegionBytes);
+        mMemory = nullptr;
+    }
+
+    void StaticMemoryStore::Prefault(size_t threads)
+    {
+        // Faulting in zeroes every page, which is what makes large regions
+        // slow to set up on a single thread; chunks are handed out to all
+        // threads until none are left
+        auto pageBytes = (mPageBytes != 0 ? mPageBytes : mProvider->Granularity());
+        auto chunkBytes = (PrefaultChunkBytes + pageBytes - 1) / pageBytes * pageBytes;
+        auto chunks = (mRegionBytes + chunkBytes - 1) / chunkBytes;
+
+        if (threads == 0)
+            threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+        threads = std::min(threads, chunks);
+
+        std::atomic<size_t> next { 0 };
+        auto populate = [&]()
+        {
+            for (auto chunk = next++; chunk < chunks; chunk = next++)
+            {
+                auto offset = chunk * chunkBytes;
+                mProvider->Populate(mMemory + offset, std::min(chunkBytes, mRegionBytes - offset));
+            }
+        };
+
+        std::vector<std::thread> workers;
+        try
+        {
+            for (size_t i = 1; i < threads; i++)
+                workers.emplace_back(populate);
+        }
+        catch (...)
+        {
+            // Fewer threads only take longer, the calling one finishes the rest
+        }
+
+        populate();
+
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    void StaticMemoryStore::Read(size_t offset, void* buffer, size_t count)
+    {
+        AssertRange(offset, count);
+
+        auto start = StoreCounters::Now();
+        std::memcpy(buffer, mMemory + offset, count);
+        mCounters.RecordRead(count, start);
+    }
+
+    void StaticMemoryStore::Write(size_t offset, const void* buffer, size_t count)
+    {
+        AssertRange(offset, count);
+
+        auto start = StoreCounters::Now();
+        std::memcpy(mMemory + offset, buffer, count);
+        mCounters.RecordWrite(count, start);
+    }
+
+    void StaticMemoryStore::Discard(size_t offset, size_t count)
+    {
+        AssertRange(offset, count);
+
+        // Only whole pages can be dropped, the edges are zeroed in place
+        auto granularity = (mPageBytes != 0 ? mPageBytes : mProvider->Granularity());
+        auto first = (offset + granularity - 1) / granularity * granularity;
+        auto last = (offset + count) / granularity * granularity;
+        auto start = StoreCounters::Now();
+
+        if (first >= last)
+        {
+            std::memset(mMemory + offset, 0, count);
+            mCounters.RecordDiscard(count, start);
+            return;
+        }
+
+        std::memset(mMemory + offset, 0, first - offset);
+        if (mPageBytes != 0)
+            mProvider->DiscardLarge(mMemory + first, last - first);
+        else
+            mProvider->Discard(mMemory + first, last - first);
+        std::memset(mMemory + last, 0, offset + count - last);
+        mCounters.RecordDiscard(count, start);
+    }
+
+} // Native
+} // nDiscUtils
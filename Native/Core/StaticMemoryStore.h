@@ -0,0 +1,89 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "MemoryStore.h"
+#include "NumaTopology.h"
+
+namespace nDiscUtils {
+namespace Native {
+
+    struct StaticMemoryStoreOptions
+    {
+        // Nodes the region is placed on
+        NumaPolicy Numa;
+
+        // Back the region with large pages if the provider has them,
+        // falling back to regular pages otherwise; requires the default
+        // NUMA placement. Large page regions are always prefaulted.
+        bool LargePages = false;
+
+        // Fault the whole region in while constructing instead of on first
+        // touch, spread over PrefaultThreads threads or all processors if zero
+        bool Prefault = false;
+        size_t PrefaultThreads = 0;
+    };
+
+    // Backs the whole capacity with a single region allocated up front;
+    // requests only copy memory and may be issued from multiple threads.
+    // The region is placed on NUMA nodes as a whole, so the local placement
+    // follows the thread constructing the store. The region never moves
+    // during the lifetime of the store.
+    class StaticMemoryStore : public MemoryStore
+    {
+
+    public:
+        StaticMemoryStore(size_t capacity, PageProvider* provider = nullptr);
+        StaticMemoryStore(size_t capacity, const NumaPolicy& policy, PageProvider* provider = nullptr);
+        StaticMemoryStore(size_t capacity, const StaticMemoryStoreOptions& options, PageProvider* provider = nullptr);
+
+        ~StaticMemoryStore();
+
+        // Whether the region is backed by large pages of the provider
+        bool LargePages() const
+        {
+            return mPageBytes != 0;
+        }
+
+        size_t CommittedBytes() const override
+        {
+            return mRegionBytes;
+        }
+
+        void Read(size_t offset, void* buffer, size_t count) override;
+
+        void Write(size_t offset, const void* buffer, size_t count) override;
+
+        // The region stays reserved, CommittedBytes() does not change
+        void Discard(size_t offset, size_t count) override;
+
+    private:
+        void Prefault(size_t threads);
+
+        unsigned char* mMemory;
+
+        // Size of the large pages and the region rounded up to them, or
+        // zero and the capacity for regular pages
+        size_t mPageBytes;
+        size_t mRegionBytes;
+
+    };
+
+} // Native
+} // nDiscUtils
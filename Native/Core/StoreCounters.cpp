@@ -0,0 +1,261 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "StoreCounters.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        // Processors beyond share shards, which only costs contention
+        constexpr size_t MaxShards = 32;
+
+        constexpr unsigned MaxBit = (unsigned)(StoreLatency::BucketCount / StoreLatency::SubBuckets);
+
+        inline unsigned HighestBit(uint64_t value)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+#ifdef _M_X64
+            _BitScanReverse64(&index, value);
+#else
+            if (_BitScanReverse(&index, (unsigned long)(value >> 32)))
+                index += 32;
+            else
+                _BitScanReverse(&index, (unsigned long)value);
+#endif
+            return (unsigned)index;
+#else
+            return 63u - (unsigned)__builtin_clzll(value);
+#endif
+        }
+
+        size_t ShardCount()
+        {
+            auto processors = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+            size_t shards = 1;
+            while (shards < processors && shards < MaxShards)
+                shards <<= 1;
+
+            return shards;
+        }
+
+        // Used where the processor number is unavailable: threads are
+        // spread over the shards in the order they first record
+        size_t ThreadSlot()
+        {
+            static std::atomic<size_t> next { 0 };
+            static thread_local size_t slot = next.fetch_add(1, std::memory_order_relaxed);
+            return slot;
+        }
+
+        void AppendLatency(std::string& json, const char* name, const StoreLatency& latency)
+        {
+            char buffer[320];
+            std::snprintf(buffer, sizeof(buffer), "\"%s\": { \"count\": %" PRIu64 ", \"mean_ns\": %.1f, "
+                "\"p50_ns\": %" PRIu64 ", \"p99_ns\": %" PRIu64 ", \"p999_ns\": %" PRIu64 ", \"max_ns\": %" PRIu64 " }",
+                name, latency.Count, latency.Mean(), latency.Percentile(50.0), latency.Percentile(99.0),
+                latency.Percentile(99.9), latency.Max());
+            json += buffer;
+        }
+
+    } // namespace
+
+    size_t StoreLatency::Bucket(uint64_t nanoseconds)
+    {
+        if (nanoseconds < SubBuckets)
+            return (size_t)nanoseconds;
+
+        // The two bits below the highest one select the bucket in the octave
+        auto bit = HighestBit(nanoseconds);
+        if (bit >= MaxBit)
+            return BucketCount - 1;
+
+        return (size_t)(bit - 1) * SubBuckets + (size_t)((nanoseconds >> (bit - 2)) & (SubBuckets - 1));
+    }
+
+    uint64_t StoreLatency::BucketEnd(size_t bucket)
+    {
+        if (bucket < SubBuckets)
+            return bucket;
+
+        auto shift = (unsigned)(bucket / SubBuckets - 1);
+        auto start = (uint64_t)(SubBuckets + bucket % SubBuckets) << shift;
+        return start + (1ull << shift) - 1;
+    }
+
+    uint64_t StoreLatency::Percentile(double percentile) const
+    {
+        if (Count == 0)
+            return 0;
+
+        auto rank = (uint64_t)(percentile / 100.0 * Count + 0.5);
+        rank = std::min(std::max<uint64_t>(rank, 1), Count);
+
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < BucketCount; bucket++)
+        {
+            seen += Buckets[bucket];
+            if (seen >= rank)
+                return BucketEnd(bucket);
+        }
+
+        return Max();
+    }
+
+    uint64_t StoreLatency::Max() const
+    {
+        for (size_t bucket = BucketCount; bucket-- > 0;)
+        {
+            if (Buckets[bucket] != 0)
+                return BucketEnd(bucket);
+        }
+
+        return 0;
+    }
+
+    std::string StoreCountersSnapshot::ToJson() const
+    {
+        char buffer[640];
+        std::snprintf(buffer, sizeof(buffer), "{ \"reads\": %" PRIu64 ", \"writes\": %" PRIu64 ", "
+            "\"read_bytes\": %" PRIu64 ", \"written_bytes\": %" PRIu64 ", \"discards\": %" PRIu64 ", "
+            "\"discarded_bytes\": %" PRIu64 ", \"blocks_allocated\": %" PRIu64 ", "
+            "\"blocks_freed\": %" PRIu64 ", \"zero_reads\": %" PRIu64 ", \"committed_bytes\": %" PRIu64 ", ",
+            Reads, Writes, ReadBytes, WrittenBytes, Discards, DiscardedBytes, BlocksAllocated, BlocksFreed, ZeroReads,
+            CommittedBytes);
+
+        std::string json(buffer);
+        AppendLatency(json, "read_latency", ReadLatency);
+        json += ", ";
+        AppendLatency(json, "write_latency", WriteLatency);
+        json += ", ";
+        AppendLatency(json, "discard_latency", DiscardLatency);
+        json += " }";
+        return json;
+    }
+
+    StoreCounters::StoreCounters() :
+        mShards(nullptr),
+        mShardMask(0)
+    {
+        if (!Enabled)
+            return;
+
+        auto shards = ShardCount();
+        mShards = new Shard[shards];
+        mShardMask = shards - 1;
+        Reset();
+    }
+
+    StoreCounters::~StoreCounters()
+    {
+        delete[] mShards;
+        mShards = nullptr;
+    }
+
+    StoreCounters::Shard& StoreCounters::Local()
+    {
+        size_t slot;
+#ifdef _WIN32
+        slot = (size_t)GetCurrentProcessorNumber();
+#elif defined(__linux__)
+        auto processor = sched_getcpu();
+        slot = (processor >= 0 ? (size_t)processor : ThreadSlot());
+#else
+        slot = ThreadSlot();
+#endif
+
+        return mShards[slot & mShardMask];
+    }
+
+    void StoreCounters::Collect(const Histogram& histogram, StoreLatency& latency)
+    {
+        latency.TotalNanoseconds += histogram.Total.load(std::memory_order_relaxed);
+
+        for (size_t bucket = 0; bucket < StoreLatency::BucketCount; bucket++)
+        {
+            auto count = histogram.Buckets[bucket].load(std::memory_order_relaxed);
+            latency.Buckets[bucket] += count;
+            latency.Count += count;
+        }
+    }
+
+    StoreCountersSnapshot StoreCounters::Snapshot() const
+    {
+        StoreCountersSnapshot snapshot;
+        if (mShards == nullptr)
+            return snapshot;
+
+        for (size_t i = 0; i <= mShardMask; i++)
+        {
+            auto& shard = mShards[i];
+            snapshot.Reads += shard.Reads.load(std::memory_order_relaxed);
+            snapshot.Writes += shard.Writes.load(std::memory_order_relaxed);
+            snapshot.ReadBytes += shard.ReadBytes.load(std::memory_order_relaxed);
+            snapshot.WrittenBytes += shard.WrittenBytes.load(std::memory_order_relaxed);
+            snapshot.Discards += shard.Discards.load(std::memory_order_relaxed);
+            snapshot.DiscardedBytes += shard.DiscardedBytes.load(std::memory_order_relaxed);
+            snapshot.BlocksAllocated += shard.BlocksAllocated.load(std::memory_order_relaxed);
+            snapshot.BlocksFreed += shard.BlocksFreed.load(std::memory_order_relaxed);
+            snapshot.ZeroReads += shard.ZeroReads.load(std::memory_order_relaxed);
+            Collect(shard.ReadLatency, snapshot.ReadLatency);
+            Collect(shard.WriteLatency, snapshot.WriteLatency);
+            Collect(shard.DiscardLatency, snapshot.DiscardLatency);
+        }
+
+        return snapshot;
+    }
+
+    void StoreCounters::Reset()
+    {
+        if (mShards == nullptr)
+            return;
+
+        for (size_t i = 0; i <= mShardMask; i++)
+        {
+            auto& shard = mShards[i];
+            for (auto counter : { &shard.Reads, &shard.Writes, &shard.ReadBytes, &shard.WrittenBytes,
+                &shard.Discards, &shard.DiscardedBytes, &shard.BlocksAllocated, &shard.BlocksFreed, &shard.ZeroReads,
+                &shard.ReadLatency.Total, &shard.WriteLatency.Total, &shard.DiscardLatency.Total })
+                counter->store(0, std::memory_order_relaxed);
+
+            for (size_t bucket = 0; bucket < StoreLatency::BucketCount; bucket++)
+            {
+                shard.ReadLatency.Buckets[bucket].store(0, std::memory_order_relaxed);
+                shard.WriteLatency.Buckets[bucket].store(0, std::memory_order_relaxed);
+                shard.DiscardLatency.Buckets[bucket].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+} // Native
+} // nDiscUtils
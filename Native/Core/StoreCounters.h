@@ -0,0 +1,239 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Instrumentation of the memory stores; building with
+// NDISCUTILS_STORE_COUNTERS=0 compiles all recording away and leaves every
+// snapshot empty apart from the committed bytes
+#ifndef NDISCUTILS_STORE_COUNTERS
+#define NDISCUTILS_STORE_COUNTERS 1
+#endif
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Distribution of request latencies in nanoseconds with four buckets
+    // per power of two, so every percentile is within 25% of the recorded
+    // value. Small enough to be kept per processor.
+    struct StoreLatency
+    {
+        static constexpr size_t SubBuckets = 4;
+        static constexpr size_t BucketCount = 48 * SubBuckets;
+
+        uint64_t Count = 0;
+        uint64_t TotalNanoseconds = 0;
+        uint64_t Buckets[BucketCount] = { };
+
+        static size_t Bucket(uint64_t nanoseconds);
+
+        // Largest value counted by a bucket
+        static uint64_t BucketEnd(size_t bucket);
+
+        double Mean() const
+        {
+            return (Count == 0 ? 0.0 : (double)TotalNanoseconds / Count);
+        }
+
+        // Smallest value which at least percentile percent of all requests
+        // did not exceed, as the upper end of its bucket; zero when empty
+        uint64_t Percentile(double percentile) const;
+
+        // Largest value recorded, as the upper end of its bucket
+        uint64_t Max() const;
+
+    };
+
+    struct StoreCountersSnapshot
+    {
+        uint64_t Reads = 0;
+        uint64_t Writes = 0;
+        uint64_t ReadBytes = 0;
+        uint64_t WrittenBytes = 0;
+
+        // Ranges dropped by Discard() and their total length
+        uint64_t Discards = 0;
+        uint64_t DiscardedBytes = 0;
+
+        // Blocks taken from and given back to the allocator by the store
+        uint64_t BlocksAllocated = 0;
+        uint64_t BlocksFreed = 0;
+
+        // Block-sized pieces of reads answered with zeros as nothing backs them
+        uint64_t ZeroReads = 0;
+
+        uint64_t CommittedBytes = 0;
+
+        StoreLatency ReadLatency;
+        StoreLatency WriteLatency;
+        StoreLatency DiscardLatency;
+
+        // Single JSON object holding all counters and the mean, 50th, 99th
+        // and 99.9th percentile and maximum latency of reads, writes and
+        // discards
+        std::string ToJson() const;
+
+    };
+
+    // Counters of a memory store, kept in cache-line sized shards selected
+    // by the processor the recording thread runs on. Recording is a few
+    // relaxed atomic additions without any lock; snapshots sum all shards
+    // and are not atomic with respect to requests in flight.
+    class StoreCounters
+    {
+
+    public:
+        // Whether instrumentation is compiled in
+        static constexpr bool Enabled = (NDISCUTILS_STORE_COUNTERS != 0);
+
+        StoreCounters();
+
+        ~StoreCounters();
+
+        StoreCounters(const StoreCounters&) = delete;
+        StoreCounters& operator=(const StoreCounters&) = delete;
+
+        // Start of a request as passed to RecordRead(), RecordWrite() and
+        // RecordDiscard()
+        static uint64_t Now()
+        {
+#if NDISCUTILS_STORE_COUNTERS
+            return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+            return 0;
+#endif
+        }
+
+        void RecordRead(size_t bytes, uint64_t start)
+        {
+#if NDISCUTILS_STORE_COUNTERS
+            auto& shard = Local();
+            Add(shard.Reads, 1);
+            Add(shard.ReadBytes, bytes);
+            Record(shard.ReadLatency, Now() - start);
+#else
+            (void)bytes;
+            (void)start;
+#endif
+        }
+
+        void RecordWrite(size_t bytes, uint64_t start)
+        {
+#if NDISCUTILS_STORE_COUNTERS
+            auto& shard = Local();
+            Add(shard.Writes, 1);
+            Add(shard.WrittenBytes, bytes);
+            Record(shard.WriteLatency, Now() - start);
+#else
+            (void)bytes;
+            (void)start;
+#endif
+        }
+
+        void RecordDiscard(size_t bytes, uint64_t start)
+        {
+#if NDISCUTILS_STORE_COUNTERS
+            auto& shard = Local();
+            Add(shard.Discards, 1);
+            Add(shard.DiscardedBytes, bytes);
+            Record(shard.DiscardLatency, Now() - start);
+#else
+            (void)bytes;
+            (void)start;
+#endif
+        }
+
+        void RecordAllocation()
+        {
+#if NDISCUTILS_STORE_COUNTERS
+            Add(Local().BlocksAllocated, 1);
+#endif
+        }
+
+        void RecordFree()
+        {
+#if NDISCUTILS_STORE_COUNTERS
+            Add(Local().BlocksFreed, 1);
+#endif
+        }
+
+        void RecordZeroRead()
+        {
+#if NDISCUTILS_STORE_COUNTERS
+            Add(Local().ZeroReads, 1);
+#endif
+        }
+
+        // Sums all shards; CommittedBytes is left to the store
+        StoreCountersSnapshot Snapshot() const;
+
+        void Reset();
+
+    private:
+        struct Histogram
+        {
+            std::atomic<uint64_t> Total;
+            std::atomic<uint64_t> Buckets[StoreLatency::BucketCount];
+        };
+
+        struct alignas(64) Shard
+        {
+            std::atomic<uint64_t> Reads;
+            std::atomic<uint64_t> Writes;
+            std::atomic<uint64_t> ReadBytes;
+            std::atomic<uint64_t> WrittenBytes;
+            std::atomic<uint64_t> Discards;
+            std::atomic<uint64_t> DiscardedBytes;
+            std::atomic<uint64_t> BlocksAllocated;
+            std::atomic<uint64_t> BlocksFreed;
+            std::atomic<uint64_t> ZeroReads;
+            Histogram ReadLatency;
+            Histogram WriteLatency;
+            Histogram DiscardLatency;
+        };
+
+        static void Add(std::atomic<uint64_t>& counter, uint64_t value)
+        {
+            counter.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        static void Record(Histogram& histogram, uint64_t nanoseconds)
+        {
+            Add(histogram.Total, nanoseconds);
+            Add(histogram.Buckets[StoreLatency::Bucket(nanoseconds)], 1);
+        }
+
+        static void Collect(const Histogram& histogram, StoreLatency& latency);
+
+        // Shard of the processor the calling thread runs on
+        Shard& Local();
+
+        Shard* mShards;
+        size_t mShardMask;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,482 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "StoreImage.h"
+#include "AlignedBuffer.h"
+#include "Hashes.h"
+#include "ImageFile.h"
+#include "NativeException.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        const char Magic[8] = { 'n', 'D', 'U', 'S', 'T', 'O', 'R', 'E' };
+        const uint32_t Version = 1;
+
+        // Set once a checkpoint completed, cleared while one is written
+        const uint32_t CleanFlag = 1;
+
+        const size_t HeaderBytes = 4096;
+
+        // The data area starts at a multiple of the largest mapping
+        // granularity of the supported platforms
+        const uint64_t DataAlignment = (uint64_t)64 << 10;
+
+        // Blocks handed to a writer thread at once
+        const size_t BatchBlocks = 4096;
+
+        struct Header
+        {
+            char Magic[8];
+            uint32_t Version;
+            uint32_t Flags;
+            uint64_t Capacity;
+            uint64_t BlockSize;
+            uint64_t BlockCount;
+            uint64_t MapOffset;
+            uint64_t DataOffset;
+            uint64_t Identity;
+            uint64_t Generation;
+            uint64_t BackedBlocks;
+            uint64_t Checksum;
+        };
+
+        static_assert(sizeof(Header) <= HeaderBytes, "Image header exceeds its reserved space");
+
+        uint64_t AlignUp(uint64_t value, uint64_t alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        uint64_t HeaderChecksum(const Header& header)
+        {
+            return Hashes::XxHash64(&header, offsetof(Header, Checksum));
+        }
+
+        uint64_t NewIdentity()
+        {
+            std::random_device device;
+            auto now = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+            return (((uint64_t)device() << 32) | device()) ^ now;
+        }
+
+        Header ReadHeader(ImageFile& file)
+        {
+            if (file.Length() < HeaderBytes)
+                throw NativeException(NativeError::IO, "\"" + file.Path() + "\" is not a store image");
+
+            AlignedBuffer buffer(HeaderBytes);
+            file.ReadAt(0, buffer.Data(), HeaderBytes);
+
+            Header header;
+            std::memcpy(&header, buffer.Data(), sizeof(header));
+
+            if (std::memcmp(header.Magic, Magic, sizeof(Magic)) != 0)
+                throw NativeException(NativeError::IO, "\"" + file.Path() + "\" is not a store image");
+
+            if (header.Version != Version)
+                throw NativeException(NativeError::IO, "\"" + file.Path() + "\" has unsupported image version " +
+                    std::to_string(header.Version));
+
+            if (header.Checksum != HeaderChecksum(header))
+                throw NativeException(NativeError::IO, "Header of \"" + file.Path() + "\" is corrupted");
+
+            return header;
+        }
+
+    } // namespace
+
+    // Layout of an image, derived from the store's capacity and block size
+    struct StoreImage::Geometry
+    {
+        Geometry(uint64_t capacity, uint64_t blockSize) :
+            Capacity(capacity),
+            BlockSize(blockSize),
+            BlockCount((capacity + blockSize - 1) / blockSize),
+            MapOffset(HeaderBytes),
+            MapBytes(AlignUp((BlockCount + BlockBitmap::WordBits - 1) / BlockBitmap::WordBits * sizeof(uint64_t), HeaderBytes))
+        {
+            // Whole blocks which are aligned in the file as well let hole
+            // punching release them completely
+            DataOffset = AlignUp(MapOffset + MapBytes, DataAlignment);
+            if (BlockSize % DataAlignment == 0)
+                DataOffset = AlignUp(DataOffset, BlockSize);
+        }
+
+        bool Matches(const Header& header) const
+        {
+            return header.Capacity == Capacity && header.BlockSize == BlockSize && header.BlockCount == BlockCount &&
+                header.MapOffset == MapOffset && header.DataOffset == DataOffset;
+        }
+
+        uint64_t Length() const
+        {
+            return DataOffset + BlockCount * BlockSize;
+        }
+
+        uint64_t Capacity;
+        uint64_t BlockSize;
+        uint64_t BlockCount;
+        uint64_t MapOffset;
+        uint64_t MapBytes;
+        uint64_t DataOffset;
+    };
+
+    StoreImage::StoreImage(const std::string& path, const StoreImageOptions& options) :
+        mPath(path),
+        mOptions(options),
+        mStore(nullptr),
+        mIdentity(0),
+        mGeneration(0) { }
+
+    StoreImage::~StoreImage() { }
+
+    DynamicMemoryStore* StoreImage::Load(const DynamicMemoryStoreOptions& options, PageProvider* provider)
+    {
+        std::unique_ptr<ImageFile> file(ImageFile::Open(mPath, ImageFileMode::Read));
+        auto header = ReadHeader(*file);
+
+        if ((header.Flags & CleanFlag) == 0)
+            throw NativeException(NativeError::IO, "\"" + mPath + "\" was left incomplete by an interrupted checkpoint");
+
+        if (header.BlockSize == 0 || (uint64_t)(size_t)header.Capacity != header.Capacity)
+            throw NativeException(NativeError::IO, "Header of \"" + mPath + "\" is corrupted");
+
+        Geometry geometry(header.Capacity, header.BlockSize);
+        if (!geometry.Matches(header))
+            throw NativeException(NativeError::IO, "Header of \"" + mPath + "\" is corrupted");
+
+        if (file->Length() < geometry.Length())
+            throw NativeException(NativeError::IO, "\"" + mPath + "\" is truncated");
+
+        std::unique_ptr<BlockBitmap> backed(new BlockBitmap((size_t)geometry.BlockCount));
+        {
+            AlignedBuffer map((size_t)geometry.MapBytes);
+            file->ReadAt(geometry.MapOffset, map.Data(), (size_t)geometry.MapBytes);
+
+            for (size_t word = 0; word < backed->WordCount(); word++)
+            {
+                uint64_t value;
+                std::memcpy(&value, map.Data() + word * sizeof(value), sizeof(value));
+                backed->SetWord(word, value);
+            }
+        }
+
+        if (backed->Population() != header.BackedBlocks)
+            throw NativeException(NativeError::IO, "Block map of \"" + mPath + "\" is corrupted");
+
+        std::unique_ptr<DynamicMemoryStore> store(new DynamicMemoryStore((size_t)header.Capacity,
+            (size_t)header.BlockSize, options, provider));
+
+        std::unique_ptr<FileMapping> mapping(file->Map(geometry.DataOffset, (size_t)(geometry.BlockCount * geometry.BlockSize)));
+        store->Map(mapping.get(), *backed);
+        mapping.release();
+
+        // The image matches the store from here on
+        store->TrackChanges();
+
+        mStore = store.get();
+        mIdentity = header.Identity;
+        mGeneration = header.Generation;
+        mBacked = std::move(backed);
+        return store.release();
+    }
+
+    StoreImageStatistics StoreImage::Checkpoint(DynamicMemoryStore& store)
+    {
+        BlockBitmap changed(store.BlockCount());
+        std::unique_ptr<DynamicMemorySnapshot> snapshot(store.Snapshot(changed));
+
+        // Stores which were not tracked so far report every block changed,
+        // so even a rewrite in place would cover all of them
+        auto incremental = (mStore == &store);
+
+        // Any failure leaves the image in an unknown state, the next
+        // checkpoint has to replace it
+        mStore = nullptr;
+
+        auto statistics = incremental ? WriteChanges(*snapshot, changed) : WriteFull(*snapshot);
+        mStore = &store;
+        return statistics;
+    }
+
+    StoreImageStatistics StoreImage::WriteFull(const DynamicMemorySnapshot& snapshot)
+    {
+        Geometry geometry(snapshot.Capacity(), snapshot.BlockSize());
+        StoreImageStatistics statistics;
+
+        // Writing a separate file keeps the previous image intact until the
+        // new one is complete
+        auto partialPath = mPath + ".partial";
+        mBacked.reset(new BlockBitmap(snapshot.BlockCount()));
+
+        try
+        {
+            std::unique_ptr<ImageFile> file(ImageFile::Open(partialPath, ImageFileMode::Create, mOptions.Unbuffered));
+            file->SetLength(geometry.Length());
+
+            WriteBlocks(*file, geometry, snapshot, [&](size_t blockIndex) { return snapshot.IsBacked(blockIndex); },
+                statistics);
+
+            mIdentity = NewIdentity();
+            mGeneration = 1;
+
+            WriteMap(*file, geometry);
+            WriteHeader(*file, geometry, true);
+            file->Flush();
+        }
+        catch (...)
+        {
+            ImageFile::Delete(partialPath);
+            throw;
+        }
+
+        ImageFile::Replace(partialPath, mPath);
+
+        statistics.BackedBlocks = mBacked->Population();
+        return statistics;
+    }
+
+    StoreImageStatistics StoreImage::WriteChanges(const DynamicMemorySnapshot& snapshot, const BlockBitmap& changed)
+    {
+        Geometry geometry(snapshot.Capacity(), snapshot.BlockSize());
+
+        // The image must still be the one this object wrote or loaded last
+        std::unique_ptr<ImageFile> file;
+        if (ImageFile::Exists(mPath))
+        {
+            file.reset(ImageFile::Open(mPath, ImageFileMode::Write, mOptions.Unbuffered));
+
+            auto header = ReadHeader(*file);
+            if (!geometry.Matches(header) || (header.Flags & CleanFlag) == 0 ||
+                header.Identity != mIdentity || header.Generation != mGeneration)
+                file.reset();
+        }
+
+        if (file == nullptr)
+            return WriteFull(snapshot);
+
+        StoreImageStatistics statistics;
+        statistics.Incremental = true;
+
+        WriteHeader(*file, geometry, false);
+        file->Flush();
+
+        WriteBlocks(*file, geometry, snapshot, [&](size_t blockIndex) { return changed.Test(blockIndex); }, statistics);
+
+        mGeneration++;
+
+        WriteMap(*file, geometry);
+        file->Flush();
+
+        WriteHeader(*file, geometry, true);
+        file->Flush();
+
+        statistics.BackedBlocks = mBacked->Population();
+        return statistics;
+    }
+
+    template <typename TSelector>
+    void StoreImage::WriteBlocks(ImageFile& file, const Geometry& geometry, const DynamicMemorySnapshot& snapshot,
+        TSelector select, StoreImageStatistics& statistics)
+    {
+        auto blockSize = (size_t)geometry.BlockSize;
+        auto blockCount = (size_t)geometry.BlockCount;
+        auto batches = (blockCount + BatchBlocks - 1) / BatchBlocks;
+
+        auto threads = (size_t)(mOptions.Threads != 0 ? mOptions.Threads : std::thread::hardware_concurrency());
+        threads = std::max<size_t>(std::min(threads, batches), 1);
+
+        std::atomic<size_t> nextBatch(0);
+        std::atomic<size_t> writtenBlocks(0);
+        std::atomic<size_t> clearedBlocks(0);
+        std::atomic<bool> failed(false);
+        std::exception_ptr failure;
+        std::mutex failureLock;
+
+        auto worker = [&]()
+        {
+            try
+            {
+                AlignedBuffer buffer(std::max(mOptions.WriteBytes - mOptions.WriteBytes % blockSize, blockSize));
+                auto bufferBlocks = buffer.Size() / blockSize;
+
+                // Consecutive blocks to write from the buffer and to clear
+                size_t runStart = 0, runLength = 0;
+                size_t holeStart = 0, holeLength = 0;
+
+                auto flushRun = [&]()
+                {
+                    if (runLength == 0)
+                        return;
+
+                    file.WriteAt(geometry.DataOffset + runStart * geometry.BlockSize, buffer.Data(), runLength * blockSize);
+                    writtenBlocks += runLength;
+                    runLength = 0;
+                };
+
+                auto flushHole = [&]()
+                {
+                    if (holeLength == 0)
+                        return;
+
+                    file.Deallocate(geometry.DataOffset + holeStart * geometry.BlockSize, holeLength * geometry.BlockSize);
+                    clearedBlocks += holeLength;
+                    holeLength = 0;
+                };
+
+                while (!failed.load(std::memory_order_relaxed))
+                {
+                    auto batch = nextBatch++;
+                    if (batch >= batches)
+                        break;
+
+                    auto first = batch * BatchBlocks;
+                    auto last = std::min(first + BatchBlocks, blockCount);
+
+                    for (auto blockIndex = first; blockIndex < last; blockIndex++)
+                    {
+                        if (!select(blockIndex))
+                            continue;
+
+                        if (runLength != 0 && (runStart + runLength != blockIndex || runLength == bufferBlocks))
+                            flushRun();
+
+                        if (snapshot.ReadBlock(blockIndex, buffer.Data() + runLength * blockSize))
+                        {
+                            if (runLength == 0)
+                                runStart = blockIndex;
+
+                            runLength++;
+                            mBacked->Set(blockIndex);
+                            continue;
+                        }
+
+                        // Blocks which are holes in the image already stay untouched
+                        if (!mBacked->Test(blockIndex))
+                            continue;
+
+                        if (holeLength != 0 && holeStart + holeLength != blockIndex)
+                            flushHole();
+
+                        if (holeLength == 0)
+                            holeStart = blockIndex;
+
+                        holeLength++;
+                        mBacked->Clear(blockIndex);
+                    }
+
+                    flushRun();
+                    flushHole();
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(failureLock);
+                if (failure == nullptr)
+                    failure = std::current_exception();
+
+                failed = true;
+            }
+        };
+
+        if (threads == 1)
+        {
+            worker();
+        }
+        else
+        {
+            std::vector<std::thread> workers;
+            workers.reserve(threads);
+
+            try
+            {
+                for (size_t index = 0; index < threads; index++)
+                    workers.emplace_back(worker);
+            }
+            catch (...)
+            {
+                // Threads which did start finish all batches on their own
+                if (workers.empty())
+                    throw;
+            }
+
+            for (auto& thread : workers)
+                thread.join();
+        }
+
+        if (failure != nullptr)
+            std::rethrow_exception(failure);
+
+        statistics.WrittenBlocks = writtenBlocks;
+        statistics.ClearedBlocks = clearedBlocks;
+    }
+
+    void StoreImage::WriteHeader(ImageFile& file, const Geometry& geometry, bool clean)
+    {
+        AlignedBuffer buffer(HeaderBytes);
+        std::memset(buffer.Data(), 0, buffer.Size());
+
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.Magic, Magic, sizeof(Magic));
+        header.Version = Version;
+        header.Flags = (clean ? CleanFlag : 0);
+        header.Capacity = geometry.Capacity;
+        header.BlockSize = geometry.BlockSize;
+        header.BlockCount = geometry.BlockCount;
+        header.MapOffset = geometry.MapOffset;
+        header.DataOffset = geometry.DataOffset;
+        header.Identity = mIdentity;
+        header.Generation = mGeneration;
+        header.BackedBlocks = mBacked->Population();
+        header.Checksum = HeaderChecksum(header);
+
+        std::memcpy(buffer.Data(), &header, sizeof(header));
+        file.WriteAt(0, buffer.Data(), HeaderBytes);
+    }
+
+    void StoreImage::WriteMap(ImageFile& file, const Geometry& geometry)
+    {
+        AlignedBuffer buffer((size_t)geometry.MapBytes);
+        std::memset(buffer.Data(), 0, buffer.Size());
+
+        for (size_t word = 0; word < mBacked->WordCount(); word++)
+        {
+            auto value = mBacked->Word(word);
+            std::memcpy(buffer.Data() + word * sizeof(value), &value, sizeof(value));
+        }
+
+        file.WriteAt(geometry.MapOffset, buffer.Data(), (size_t)geometry.MapBytes);
+    }
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,124 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "BlockBitmap.h"
+#include "DynamicMemoryStore.h"
+
+namespace nDiscUtils {
+namespace Native {
+
+    class ImageFile;
+
+    struct StoreImageOptions
+    {
+        // Writer threads, zero for one per hardware thread
+        unsigned Threads = 0;
+
+        // Largest single write; runs of consecutive blocks are merged up to it
+        size_t WriteBytes = (size_t)1 << 20;
+
+        // Bypass the system cache while writing where the file system allows
+        bool Unbuffered = true;
+    };
+
+    struct StoreImageStatistics
+    {
+        // Only blocks changed since the previous checkpoint were written
+        bool Incremental = false;
+
+        size_t WrittenBlocks = 0;
+        size_t ClearedBlocks = 0;
+
+        // Blocks held by the image after the checkpoint
+        size_t BackedBlocks = 0;
+    };
+
+    // Sparse on-disk image of a DynamicMemoryStore: a header, a bitmap of
+    // the backed blocks and the data area, which keeps every block at its
+    // own offset. Unbacked blocks are holes, so the file only occupies as
+    // much space as the store holds data.
+    //
+    // The first checkpoint of a store writes a new image next to the target
+    // and replaces it once complete. Later checkpoints only rewrite blocks
+    // changed since and flag the image as incomplete while doing so, so an
+    // interrupted checkpoint is detected on load. All checkpoints are taken
+    // from a snapshot, the store may be used concurrently.
+    //
+    // A store must only be checkpointed through one StoreImage, which has
+    // to be used from one thread at a time.
+    class StoreImage
+    {
+
+    public:
+        explicit StoreImage(const std::string& path, const StoreImageOptions& options = StoreImageOptions());
+
+        ~StoreImage();
+
+        StoreImage(const StoreImage&) = delete;
+        StoreImage& operator=(const StoreImage&) = delete;
+
+        const std::string& Path() const
+        {
+            return mPath;
+        }
+
+        // Creates a store from the image; its blocks are read from a mapping
+        // of the file on first access and copied into memory once written.
+        // Later checkpoints of the store into the image are incremental.
+        DynamicMemoryStore* Load(const DynamicMemoryStoreOptions& options, PageProvider* provider = nullptr);
+
+        StoreImageStatistics Checkpoint(DynamicMemoryStore& store);
+
+    private:
+        struct Geometry;
+
+        StoreImageStatistics WriteFull(const DynamicMemorySnapshot& snapshot);
+
+        StoreImageStatistics WriteChanges(const DynamicMemorySnapshot& snapshot, const BlockBitmap& changed);
+
+        // Writes or clears the blocks accepted by select(blockIndex) on all
+        // writer threads, recording the result in mBacked
+        template <typename TSelector>
+        void WriteBlocks(ImageFile& file, const Geometry& geometry, const DynamicMemorySnapshot& snapshot,
+            TSelector select, StoreImageStatistics& statistics);
+
+        void WriteHeader(ImageFile& file, const Geometry& geometry, bool clean);
+
+        void WriteMap(ImageFile& file, const Geometry& geometry);
+
+        std::string mPath;
+        StoreImageOptions mOptions;
+
+        // Store whose contents the image held after the last checkpoint
+        // or load, nullptr if it has to be rewritten as a whole
+        const DynamicMemoryStore* mStore;
+        uint64_t mIdentity;
+        uint64_t mGeneration;
+        std::unique_ptr<BlockBitmap> mBacked;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,330 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "Win32ImageFile.h"
+#include "NativeException.h"
+
+#define NOMINMAX
+#include <Windows.h>
+#include <winioctl.h>
+
+#include <algorithm>
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        // Largest single ReadFile/WriteFile request, aligned for unbuffered I/O
+        const size_t MaxTransfer = (size_t)1 << 30;
+
+        std::wstring Widen(const std::string& path)
+        {
+            auto length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), (int)path.size(), nullptr, 0);
+            std::wstring result((size_t)length, L'\0');
+            if (length > 0)
+                MultiByteToWideChar(CP_UTF8, 0, path.c_str(), (int)path.size(), &result[0], length);
+
+            return result;
+        }
+
+        [[noreturn]] void ThrowLastError(const std::string& message)
+        {
+            auto error = GetLastError();
+            throw NativeException(NativeError::IO, message + " (error " + std::to_string(error) + ")", (int)error);
+        }
+
+        class Win32FileMapping : public FileMapping
+        {
+
+        public:
+            Win32FileMapping(void* view, size_t size) :
+                FileMapping((const unsigned char*)view, size) { }
+
+            ~Win32FileMapping()
+            {
+                UnmapViewOfFile(mData);
+            }
+
+            void Advise(size_t offset, size_t size, MapAdvice advice) override
+            {
+                // Only read-ahead has a counterpart, PrefetchVirtualMemory()
+                // of Windows 8 and later, which is looked up at runtime
+                if (advice != MapAdvice::WillNeed)
+                    return;
+
+                struct MemoryRange
+                {
+                    void* Address;
+                    SIZE_T Size;
+                };
+
+                using PrefetchFunction = BOOL (WINAPI*)(HANDLE, ULONG_PTR, MemoryRange*, ULONG);
+                static const auto prefetch = (PrefetchFunction)GetProcAddress(GetModuleHandleW(L"kernel32.dll"),
+                    "PrefetchVirtualMemory");
+
+                if (prefetch == nullptr || offset >= mSize)
+                    return;
+
+                MemoryRange range { (void*)(mData + offset), std::min(size, mSize - offset) };
+                prefetch(GetCurrentProcess(), 1, &range, 0);
+            }
+
+        };
+
+    } // namespace
+
+    Win32ImageFile::Win32ImageFile(const std::string& path, ImageFileMode mode, bool unbuffered, bool writeThrough) :
+        ImageFile(path),
+        mHandle(INVALID_HANDLE_VALUE),
+        mWritable(mode != ImageFileMode::Read),
+        mUnbuffered(unbuffered)
+    {
+        DWORD access = GENERIC_READ | (mWritable ? GENERIC_WRITE : 0);
+        DWORD disposition = (mode == ImageFileMode::Create ? CREATE_ALWAYS : OPEN_EXISTING);
+        DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | (unbuffered ? FILE_FLAG_NO_BUFFERING : 0) |
+            (writeThrough ? FILE_FLAG_WRITE_THROUGH : 0);
+
+        mHandle = CreateFileW(Widen(path).c_str(), access, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+            disposition, flags, nullptr);
+        if (mHandle == INVALID_HANDLE_VALUE)
+            Fail("open");
+
+        if (mode == ImageFileMode::Create)
+        {
+            // Blocks which are never written stay holes of the sparse file
+            DWORD returned;
+            if (!DeviceIoControl(mHandle, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returned, nullptr))
+            {
+                auto error = GetLastError();
+                CloseHandle(mHandle);
+                mHandle = INVALID_HANDLE_VALUE;
+
+                SetLastError(error);
+                Fail("mark sparse");
+            }
+        }
+    }
+
+    Win32ImageFile::~Win32ImageFile()
+    {
+        if (mHandle != INVALID_HANDLE_VALUE)
+            CloseHandle(mHandle);
+    }
+
+    void Win32ImageFile::Fail(const char* operation) const
+    {
+        ThrowLastError(std::string("Failed to ") + operation + " \"" + mPath + "\"");
+    }
+
+    uint64_t Win32ImageFile::Length() const
+    {
+        LARGE_INTEGER length;
+        if (!GetFileSizeEx(mHandle, &length))
+            Fail("query the length of");
+
+        return (uint64_t)length.QuadPart;
+    }
+
+    void Win32ImageFile::SetLength(uint64_t length)
+    {
+        FILE_END_OF_FILE_INFO info;
+        info.EndOfFile.QuadPart = (LONGLONG)length;
+
+        if (!SetFileInformationByHandle(mHandle, FileEndOfFileInfo, &info, sizeof(info)))
+            Fail("resize");
+    }
+
+    size_t Win32ImageFile::Transfer(bool write, uint64_t offset, void* buffer, size_t count)
+    {
+        OVERLAPPED overlapped = { };
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+        overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (overlapped.hEvent == nullptr)
+            ThrowLastError("Failed to create I/O event");
+
+        auto size = (DWORD)std::min(count, MaxTransfer);
+        auto started = write
+            ? WriteFile(mHandle, buffer, size, nullptr, &overlapped)
+            : ReadFile(mHandle, buffer, size, nullptr, &overlapped);
+
+        DWORD transferred = 0;
+        auto completed = (started || GetLastError() == ERROR_IO_PENDING) &&
+            GetOverlappedResult(mHandle, &overlapped, &transferred, TRUE);
+
+        auto error = GetLastError();
+        CloseHandle(overlapped.hEvent);
+
+        if (!completed)
+        {
+            SetLastError(error);
+            Fail(write ? "write to" : "read from");
+        }
+
+        return transferred;
+    }
+
+    void Win32ImageFile::ReadAt(uint64_t offset, void* buffer, size_t count)
+    {
+        auto pointer = (unsigned char*)buffer;
+        while (count > 0)
+        {
+            auto transferred = Transfer(false, offset, pointer, count);
+            if (transferred == 0)
+            {
+                SetLastError(ERROR_HANDLE_EOF);
+                Fail("read past the end of");
+            }
+
+            pointer += transferred;
+            offset += transferred;
+            count -= transferred;
+        }
+    }
+
+    void Win32ImageFile::WriteAt(uint64_t offset, const void* buffer, size_t count)
+    {
+        auto pointer = (unsigned char*)buffer;
+        while (count > 0)
+        {
+            auto transferred = Transfer(true, offset, pointer, count);
+
+            pointer += transferred;
+            offset += transferred;
+            count -= transferred;
+        }
+    }
+
+    size_t Win32ImageFile::Control(uint32_t code, const void* input, size_t inputSize, void* output, size_t outputSize,
+        const char* operation)
+    {
+        OVERLAPPED overlapped = { };
+        overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (overlapped.hEvent == nullptr)
+            ThrowLastError("Failed to create I/O event");
+
+        // ERROR_MORE_DATA only means that the output buffer was filled
+        DWORD returned = 0;
+        auto completed = (DeviceIoControl(mHandle, code, (LPVOID)input, (DWORD)inputSize, output, (DWORD)outputSize,
+            nullptr, &overlapped) || GetLastError() == ERROR_IO_PENDING || GetLastError() == ERROR_MORE_DATA) &&
+            (GetOverlappedResult(mHandle, &overlapped, &returned, TRUE) || GetLastError() == ERROR_MORE_DATA);
+
+        auto error = GetLastError();
+        CloseHandle(overlapped.hEvent);
+
+        if (!completed)
+        {
+            SetLastError(error);
+            Fail(operation);
+        }
+
+        return (size_t)returned;
+    }
+
+    void Win32ImageFile::Deallocate(uint64_t offset, uint64_t count)
+    {
+        // Zeroing a range of a sparse file releases its clusters
+        FILE_ZERO_DATA_INFORMATION info;
+        info.FileOffset.QuadPart = (LONGLONG)offset;
+        info.BeyondFinalZero.QuadPart = (LONGLONG)(offset + count);
+
+        Control(FSCTL_SET_ZERO_DATA, &info, sizeof(info), nullptr, 0, "deallocate a range of");
+    }
+
+    DataExtent Win32ImageFile::NextData(uint64_t offset)
+    {
+        auto length = Length();
+        if (offset >= length)
+            return DataExtent { length, 0 };
+
+        // Files which are not sparse are reported as one allocated range
+        FILE_ALLOCATED_RANGE_BUFFER query;
+        query.FileOffset.QuadPart = (LONGLONG)offset;
+        query.Length.QuadPart = (LONGLONG)(length - offset);
+
+        FILE_ALLOCATED_RANGE_BUFFER range;
+        auto returned = Control(FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query), &range, sizeof(range),
+            "find data in");
+
+        if (returned < sizeof(range))
+            return DataExtent { length, 0 };
+
+        return DataExtent { (uint64_t)range.FileOffset.QuadPart, (uint64_t)range.Length.QuadPart };
+    }
+
+    void Win32ImageFile::Flush()
+    {
+        if (!FlushFileBuffers(mHandle))
+            Fail("flush");
+    }
+
+    size_t Win32ImageFile::MapGranularity() const
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+
+        return info.dwAllocationGranularity;
+    }
+
+    FileMapping* Win32ImageFile::Map(uint64_t offset, size_t size)
+    {
+        if (offset % MapGranularity() != 0)
+            throw NativeException(NativeError::InvalidArgument, "Mapping offset is not aligned to the allocation granularity");
+
+        auto section = CreateFileMappingW(mHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (section == nullptr)
+            Fail("map");
+
+        // The view keeps the section alive on its own
+        auto view = MapViewOfFile(section, FILE_MAP_READ, (DWORD)(offset >> 32), (DWORD)offset, size);
+        auto error = GetLastError();
+        CloseHandle(section);
+
+        if (view == nullptr)
+        {
+            SetLastError(error);
+            Fail("map");
+        }
+
+        return new Win32FileMapping(view, size);
+    }
+
+    ImageFile* ImageFile::Open(const std::string& path, ImageFileMode mode, bool unbuffered, bool writeThrough)
+    {
+        return new Win32ImageFile(path, mode, unbuffered, writeThrough);
+    }
+
+    bool ImageFile::Exists(const std::string& path)
+    {
+        return GetFileAttributesW(Widen(path).c_str()) != INVALID_FILE_ATTRIBUTES;
+    }
+
+    void ImageFile::Delete(const std::string& path)
+    {
+        DeleteFileW(Widen(path).c_str());
+    }
+
+    void ImageFile::Replace(const std::string& source, const std::string& target)
+    {
+        if (!MoveFileExW(Widen(source).c_str(), Widen(target).c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+            ThrowLastError("Failed to replace \"" + target + "\"");
+    }
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,77 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "ImageFile.h"
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Overlapped file handle so positional requests of several threads do
+    // not serialize; unbuffered files use FILE_FLAG_NO_BUFFERING and new
+    // files are marked sparse
+    class Win32ImageFile : public ImageFile
+    {
+
+    public:
+        Win32ImageFile(const std::string& path, ImageFileMode mode, bool unbuffered, bool writeThrough);
+
+        ~Win32ImageFile();
+
+        bool Unbuffered() const override
+        {
+            return mUnbuffered;
+        }
+
+        uint64_t Length() const override;
+
+        void SetLength(uint64_t length) override;
+
+        void ReadAt(uint64_t offset, void* buffer, size_t count) override;
+
+        void WriteAt(uint64_t offset, const void* buffer, size_t count) override;
+
+        void Deallocate(uint64_t offset, uint64_t count) override;
+
+        DataExtent NextData(uint64_t offset) override;
+
+        void Flush() override;
+
+        size_t MapGranularity() const override;
+
+        FileMapping* Map(uint64_t offset, size_t size) override;
+
+    private:
+        [[noreturn]] void Fail(const char* operation) const;
+
+        // Issues an overlapped FSCTL and waits for it, returns the size of the output
+        size_t Control(uint32_t code, const void* input, size_t inputSize, void* output, size_t outputSize,
+            const char* operation);
+
+        // Waits for one overlapped request of at most count bytes
+        size_t Transfer(bool write, uint64_t offset, void* buffer, size_t count);
+
+        void* mHandle;
+        bool mWritable;
+        bool mUnbuffered;
+
+    };
+
+} // Native
+} // nDiscUtils
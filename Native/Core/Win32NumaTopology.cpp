@@ -0,0 +1,75 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "NumaTopology.h"
+
+#define NOMINMAX
+#include <Windows.h>
+
+namespace nDiscUtils {
+namespace Native {
+
+    size_t NumaTopology::NodeCount()
+    {
+        static const size_t nodes = []()
+        {
+            ULONG highest = 0;
+            if (!GetNumaHighestNodeNumber(&highest))
+                return (size_t)1;
+
+            return (size_t)highest + 1;
+        }();
+
+        return nodes;
+    }
+
+    size_t NumaTopology::CurrentNode()
+    {
+        if (NodeCount() == 1)
+            return 0;
+
+        PROCESSOR_NUMBER processor;
+        GetCurrentProcessorNumberEx(&processor);
+
+        USHORT node = 0;
+        if (!GetNumaProcessorNodeEx(&processor, &node) || node >= NodeCount())
+            return 0;
+
+        return node;
+    }
+
+    bool NumaTopology::BindThread(size_t node)
+    {
+        if (node >= NodeCount())
+            return false;
+
+        // Nodes without processors only provide memory and cannot be bound to
+        GROUP_AFFINITY affinity = { };
+        if (!GetNumaNodeProcessorMaskEx((USHORT)node, &affinity) || affinity.Mask == 0)
+            return false;
+
+        return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != FALSE;
+    }
+
+    int NumaTopology::SystemNode(size_t node)
+    {
+        return (int)node;
+    }
+
+} // Native
+} // nDiscUtils
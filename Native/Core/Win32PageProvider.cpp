@@ -0,0 +1,151 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "Win32PageProvider.h"
+#include "NativeException.h"
+#include "NumaTopology.h"
+
+#define NOMINMAX
+#include <Windows.h>
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _MSC_VER
+#pragma comment(lib, "advapi32.lib")
+#endif
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        // Large pages can only be allocated with SeLockMemoryPrivilege
+        // enabled, which is attempted once per process
+        bool EnableLockMemoryPrivilege()
+        {
+            static const bool enabled = []()
+            {
+                HANDLE token;
+                if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+                    return false;
+
+                TOKEN_PRIVILEGES privileges = { };
+                privileges.PrivilegeCount = 1;
+                privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+                // Succeeds without assigning the privilege if the account lacks it
+                auto result = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+                    AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) &&
+                    GetLastError() == ERROR_SUCCESS;
+
+                CloseHandle(token);
+                return result != FALSE;
+            }();
+
+            return enabled;
+        }
+
+    } // namespace
+
+    Win32PageProvider::Win32PageProvider()
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+
+        mGranularity = info.dwAllocationGranularity;
+        mLargePageSize = GetLargePageMinimum();
+    }
+
+    void* Win32PageProvider::Allocate(size_t size)
+    {
+        return VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    }
+
+    void* Win32PageProvider::AllocateOnNode(size_t size, size_t node)
+    {
+        return VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE,
+            (DWORD)NumaTopology::SystemNode(node));
+    }
+
+    void* Win32PageProvider::AllocateInterleaved(size_t size, size_t stride)
+    {
+        auto nodes = NumaTopology::NodeCount();
+        if (nodes == 1)
+            return Allocate(size);
+
+        // The region is reserved at once and committed piece by piece, each
+        // piece preferring its own node
+        auto memory = (unsigned char*)VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_READWRITE);
+        if (memory == nullptr)
+            return nullptr;
+
+        stride = (stride + mGranularity - 1) / mGranularity * mGranularity;
+        for (size_t offset = 0, piece = 0; offset < size; offset += stride, piece++)
+        {
+            auto length = std::min(stride, size - offset);
+            auto node = (DWORD)NumaTopology::SystemNode(piece % nodes);
+            if (VirtualAllocExNuma(GetCurrentProcess(), memory + offset, length, MEM_COMMIT, PAGE_READWRITE, node) == nullptr)
+            {
+                VirtualFree(memory, 0, MEM_RELEASE);
+                return nullptr;
+            }
+        }
+
+        return memory;
+    }
+
+    void* Win32PageProvider::AllocateLarge(size_t size)
+    {
+        if (mLargePageSize == 0 || (size % mLargePageSize) != 0 || !EnableLockMemoryPrivilege())
+            return nullptr;
+
+        // Committed and zeroed right away, fails once physical memory is too
+        // fragmented to provide enough contiguous large pages
+        return VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+    }
+
+    void Win32PageProvider::Release(void* ptr, size_t size)
+    {
+        VirtualFree(ptr, 0, MEM_RELEASE);
+    }
+
+    void Win32PageProvider::Discard(void* ptr, size_t size)
+    {
+        // Decommitting drops the pages, re-committing them right away keeps
+        // the range usable without charging physical memory until next touch.
+        // Pages which cannot be dropped are cleared instead.
+        if (!VirtualFree(ptr, size, MEM_DECOMMIT))
+        {
+            std::memset(ptr, 0, size);
+            return;
+        }
+
+        // Callers hand the range out again, so it must not stay decommitted
+        if (VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) == nullptr)
+            throw NativeException(NativeError::OutOfMemory, "Failed to recommit discarded pages");
+    }
+
+    PageProvider* PageProvider::Default()
+    {
+        static Win32PageProvider provider;
+        return &provider;
+    }
+
+} // Native
+} // nDiscUtils
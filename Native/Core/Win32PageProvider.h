@@ -0,0 +1,69 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "PageProvider.h"
+
+namespace nDiscUtils {
+namespace Native {
+
+    // VirtualAlloc/VirtualFree backed pages, aligned to the allocation granularity.
+    // Pages are placed on NUMA nodes with VirtualAllocExNuma(). Large pages
+    // require the "Lock pages in memory" privilege and cannot be decommitted.
+    class Win32PageProvider : public PageProvider
+    {
+
+    public:
+        Win32PageProvider();
+
+        void* Allocate(size_t size) override;
+
+        void* AllocateOnNode(size_t size, size_t node) override;
+
+        void* AllocateInterleaved(size_t size, size_t stride) override;
+
+        size_t LargePageSize() const override
+        {
+            return mLargePageSize;
+        }
+
+        void* AllocateLarge(size_t size) override;
+
+        void Release(void* ptr, size_t size) override;
+
+        void Discard(void* ptr, size_t size) override;
+
+        size_t Granularity() const override
+        {
+            return mGranularity;
+        }
+
+        const char* Name() const override
+        {
+            return "win32";
+        }
+
+    private:
+        size_t mGranularity;
+        size_t mLargePageSize;
+
+    };
+
+} // Native
+} // nDiscUtils
@@ -0,0 +1,58 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // Data produced by the copy engine. Targets which do not report
+    // Concurrent() are only written by one thread at a time, but not always
+    // by the same one.
+    class WriteTarget
+    {
+
+    public:
+        virtual ~WriteTarget() { }
+
+        // Writes all count bytes at offset; failures throw a NativeException
+        virtual void Write(uint64_t offset, const void* buffer, size_t count) = 0;
+
+        // Makes a range read back as zero without writing it, freeing its
+        // storage where possible; false if the zeros have to be written
+        virtual bool Discard(uint64_t /* offset */, uint64_t /* count */)
+        {
+            return false;
+        }
+
+        // Called once after the last write
+        virtual void Flush() { }
+
+        // Whether Write() may be called by several threads at the same time
+        virtual bool Concurrent() const
+        {
+            return false;
+        }
+
+    };
+
+} // Native
+} // nDiscUtils
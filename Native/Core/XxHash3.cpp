@@ -0,0 +1,572 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "XxHash3.h"
+#include "CpuFeatures.h"
+#include "MemoryKernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef NDISCUTILS_X86
+#include <immintrin.h>
+#endif
+
+namespace nDiscUtils {
+namespace Native {
+
+    namespace {
+
+        const uint32_t Prime32_1 = 0x9E3779B1u;
+        const uint32_t Prime32_2 = 0x85EBCA77u;
+        const uint32_t Prime32_3 = 0xC2B2AE3Du;
+
+        const uint64_t Prime64_1 = 0x9E3779B185EBCA87ull;
+        const uint64_t Prime64_2 = 0xC2B2AE3D27D4EB4Full;
+        const uint64_t Prime64_3 = 0x165667B19E3779F9ull;
+        const uint64_t Prime64_4 = 0x85EBCA77C2B2AE63ull;
+        const uint64_t Prime64_5 = 0x27D4EB2F165667C5ull;
+
+        const uint64_t PrimeMx1 = 0x165667919E3779F9ull;
+        const uint64_t PrimeMx2 = 0x9FB21C651E98DF25ull;
+
+        // Stripes between two scrambles of the accumulators
+        constexpr size_t StripesPerBlock = (XxHash3::SecretBytes - XxHash3::StripeBytes) / 8;
+
+        // Offsets into the secret which the specification fixes
+        constexpr size_t MidSizeMax = 240;
+        constexpr size_t SecretSizeMin = 136;
+        constexpr size_t MidSizeStartOffset = 3;
+        constexpr size_t MidSizeLastOffset = 17;
+        constexpr size_t LastStripeOffset = 7;
+        constexpr size_t MergeOffset = 11;
+
+        const unsigned char DefaultSecret[XxHash3::SecretBytes] = {
+            0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+            0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+            0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+            0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+            0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+            0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+            0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+            0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+            0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+            0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+            0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+            0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+        };
+
+        inline uint64_t Read64(const unsigned char* ptr)
+        {
+            uint64_t value;
+            std::memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+
+        inline uint32_t Read32(const unsigned char* ptr)
+        {
+            uint32_t value;
+            std::memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+
+        inline void Write64(unsigned char* ptr, uint64_t value)
+        {
+            std::memcpy(ptr, &value, sizeof(value));
+        }
+
+        inline uint64_t RotateLeft(uint64_t value, int bits)
+        {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        inline uint32_t Swap32(uint32_t value)
+        {
+            return ((value << 24) & 0xFF000000u) | ((value << 8) & 0x00FF0000u) |
+                ((value >> 8) & 0x0000FF00u) | ((value >> 24) & 0x000000FFu);
+        }
+
+        inline uint64_t Swap64(uint64_t value)
+        {
+            return ((uint64_t)Swap32((uint32_t)value) << 32) | Swap32((uint32_t)(value >> 32));
+        }
+
+        // Folds the 128-bit product of both values into 64 bits
+        inline uint64_t MultiplyFold(uint64_t left, uint64_t right)
+        {
+#if defined(__SIZEOF_INT128__)
+            auto product = (unsigned __int128)left * right;
+            return (uint64_t)product ^ (uint64_t)(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+            uint64_t high;
+            auto low = _umul128(left, right, &high);
+            return low ^ high;
+#else
+            auto lowLow = (left & 0xFFFFFFFFu) * (right & 0xFFFFFFFFu);
+            auto highLow = (left >> 32) * (right & 0xFFFFFFFFu);
+            auto lowHigh = (left & 0xFFFFFFFFu) * (right >> 32);
+            auto highHigh = (left >> 32) * (right >> 32);
+
+            auto cross = (lowLow >> 32) + (highLow & 0xFFFFFFFFu) + lowHigh;
+            auto high = (highLow >> 32) + (cross >> 32) + highHigh;
+            auto low = (cross << 32) | (lowLow & 0xFFFFFFFFu);
+            return low ^ high;
+#endif
+        }
+
+        inline uint64_t Avalanche64(uint64_t hash)
+        {
+            hash ^= hash >> 33;
+            hash *= Prime64_2;
+            hash ^= hash >> 29;
+            hash *= Prime64_3;
+            hash ^= hash >> 32;
+            return hash;
+        }
+
+        inline uint64_t Avalanche(uint64_t hash)
+        {
+            hash ^= hash >> 37;
+            hash *= PrimeMx1;
+            hash ^= hash >> 32;
+            return hash;
+        }
+
+        inline uint64_t RrMxMx(uint64_t hash, uint64_t count)
+        {
+            hash ^= RotateLeft(hash, 49) ^ RotateLeft(hash, 24);
+            hash *= PrimeMx2;
+            hash ^= (hash >> 35) + count;
+            hash *= PrimeMx2;
+            hash ^= hash >> 28;
+            return hash;
+        }
+
+        inline uint64_t Mix16(const unsigned char* input, const unsigned char* secret, uint64_t seed)
+        {
+            return MultiplyFold(Read64(input) ^ (Read64(secret) + seed), Read64(input + 8) ^ (Read64(secret + 8) - seed));
+        }
+
+        uint64_t HashShort(const unsigned char* input, size_t count, const unsigned char* secret, uint64_t seed)
+        {
+            if (count > 8)
+            {
+                auto flip1 = (Read64(secret + 24) ^ Read64(secret + 32)) + seed;
+                auto flip2 = (Read64(secret + 40) ^ Read64(secret + 48)) - seed;
+                auto low = Read64(input) ^ flip1;
+                auto high = Read64(input + count - 8) ^ flip2;
+                return Avalanche(count + Swap64(low) + high + MultiplyFold(low, high));
+            }
+
+            if (count >= 4)
+            {
+                seed ^= (uint64_t)Swap32((uint32_t)seed) << 32;
+                auto flip = (Read64(secret + 8) ^ Read64(secret + 16)) - seed;
+                auto input64 = Read32(input + count - 4) + ((uint64_t)Read32(input) << 32);
+                return RrMxMx(input64 ^ flip, count);
+            }
+
+            if (count > 0)
+            {
+                auto combined = ((uint32_t)input[0] << 16) | ((uint32_t)input[count >> 1] << 24) |
+                    (uint32_t)input[count - 1] | ((uint32_t)count << 8);
+                auto flip = (uint64_t)(Read32(secret) ^ Read32(secret + 4)) + seed;
+                return Avalanche64((uint64_t)combined ^ flip);
+            }
+
+            return Avalanche64(seed ^ (Read64(secret + 56) ^ Read64(secret + 64)));
+        }
+
+        uint64_t HashMedium(const unsigned char* input, size_t count, const unsigned char* secret, uint64_t seed)
+        {
+            auto hash = count * Prime64_1;
+
+            if (count <= 128)
+            {
+                if (count > 32)
+                {
+                    if (count > 64)
+                    {
+                        if (count > 96)
+                        {
+                            hash += Mix16(input + 48, secret + 96, seed);
+                            hash += Mix16(input + count - 64, secret + 112, seed);
+                        }
+
+                        hash += Mix16(input + 32, secret + 64, seed);
+                        hash += Mix16(input + count - 48, secret + 80, seed);
+                    }
+
+                    hash += Mix16(input + 16, secret + 32, seed);
+                    hash += Mix16(input + count - 32, secret + 48, seed);
+                }
+
+                hash += Mix16(input, secret, seed);
+                hash += Mix16(input + count - 16, secret + 16, seed);
+                return Avalanche(hash);
+            }
+
+            auto rounds = count / 16;
+            for (size_t i = 0; i < 8; i++)
+                hash += Mix16(input + 16 * i, secret + 16 * i, seed);
+
+            auto end = Mix16(input + count - 16, secret + SecretSizeMin - MidSizeLastOffset, seed);
+            hash = Avalanche(hash);
+
+            for (size_t i = 8; i < rounds; i++)
+                end += Mix16(input + 16 * i, secret + 16 * (i - 8) + MidSizeStartOffset, seed);
+
+            return Avalanche(hash + end);
+        }
+
+        // Stripe kernels: Accumulate consumes stripes with consecutive
+        // 8-byte steps of the secret, Scramble mixes the accumulators at
+        // the end of each block
+
+        void ScalarAccumulate(uint64_t* accumulators, const unsigned char* input, const unsigned char* secret,
+            size_t stripes)
+        {
+            for (size_t n = 0; n < stripes; n++)
+            {
+                auto stripe = input + n * XxHash3::StripeBytes;
+                auto key = secret + n * 8;
+
+                for (size_t lane = 0; lane < 8; lane++)
+                {
+                    auto value = Read64(stripe + lane * 8);
+                    auto keyed = value ^ Read64(key + lane * 8);
+
+                    accumulators[lane ^ 1] += value;
+                    accumulators[lane] += (keyed & 0xFFFFFFFFu) * (keyed >> 32);
+                }
+            }
+        }
+
+        void ScalarScramble(uint64_t* accumulators, const unsigned char* secret)
+        {
+            for (size_t lane = 0; lane < 8; lane++)
+            {
+                auto value = accumulators[lane];
+                value ^= value >> 47;
+                value ^= Read64(secret + lane * 8);
+                accumulators[lane] = value * Prime32_1;
+            }
+        }
+
+#ifdef NDISCUTILS_X86
+
+        NDISCUTILS_TARGET("avx2")
+        void Avx2Accumulate(uint64_t* accumulators, const unsigned char* input, const unsigned char* secret,
+            size_t stripes)
+        {
+            auto acc0 = _mm256_loadu_si256((const __m256i*)accumulators);
+            auto acc1 = _mm256_loadu_si256((const __m256i*)(accumulators + 4));
+
+            for (size_t n = 0; n < stripes; n++)
+            {
+                auto stripe = input + n * XxHash3::StripeBytes;
+                auto key = secret + n * 8;
+
+                auto data0 = _mm256_loadu_si256((const __m256i*)stripe);
+                auto data1 = _mm256_loadu_si256((const __m256i*)(stripe + 32));
+                auto keyed0 = _mm256_xor_si256(data0, _mm256_loadu_si256((const __m256i*)key));
+                auto keyed1 = _mm256_xor_si256(data1, _mm256_loadu_si256((const __m256i*)(key + 32)));
+
+                // Low times high half of each keyed lane, plus the data of the
+                // neighbouring lane
+                auto product0 = _mm256_mul_epu32(keyed0, _mm256_srli_epi64(keyed0, 32));
+                auto product1 = _mm256_mul_epu32(keyed1, _mm256_srli_epi64(keyed1, 32));
+                auto swapped0 = _mm256_shuffle_epi32(data0, _MM_SHUFFLE(1, 0, 3, 2));
+                auto swapped1 = _mm256_shuffle_epi32(data1, _MM_SHUFFLE(1, 0, 3, 2));
+
+                acc0 = _mm256_add_epi64(acc0, _mm256_add_epi64(product0, swapped0));
+                acc1 = _mm256_add_epi64(acc1, _mm256_add_epi64(product1, swapped1));
+            }
+
+            _mm256_storeu_si256((__m256i*)accumulators, acc0);
+            _mm256_storeu_si256((__m256i*)(accumulators + 4), acc1);
+        }
+
+        NDISCUTILS_TARGET("avx2")
+        void Avx2Scramble(uint64_t* accumulators, const unsigned char* secret)
+        {
+            auto prime = _mm256_set1_epi32((int)Prime32_1);
+
+            for (size_t half = 0; half < 2; half++)
+            {
+                auto value = _mm256_loadu_si256((const __m256i*)(accumulators + 4 * half));
+                value = _mm256_xor_si256(value, _mm256_srli_epi64(value, 47));
+                value = _mm256_xor_si256(value, _mm256_loadu_si256((const __m256i*)(secret + 32 * half)));
+
+                // 64 by 32 bit multiplication from two 32 by 32 bit ones
+                auto low = _mm256_mul_epu32(value, prime);
+                auto high = _mm256_mul_epu32(_mm256_srli_epi64(value, 32), prime);
+                value = _mm256_add_epi64(low, _mm256_slli_epi64(high, 32));
+
+                _mm256_storeu_si256((__m256i*)(accumulators + 4 * half), value);
+            }
+        }
+
+        // The zero-masked forms with all lanes selected compile to the same
+        // instructions, but GCC warns about the unmasked ones in functions
+        // with a target attribute
+        const __mmask8 AllLanes = 0xFF;
+        const __mmask16 AllWords = 0xFFFF;
+
+        NDISCUTILS_TARGET("avx512f")
+        void Avx512Accumulate(uint64_t* accumulators, const unsigned char* input, const unsigned char* secret,
+            size_t stripes)
+        {
+            auto acc = _mm512_loadu_si512((const void*)accumulators);
+
+            for (size_t n = 0; n < stripes; n++)
+            {
+                auto data = _mm512_loadu_si512((const void*)(input + n * XxHash3::StripeBytes));
+                auto keyed = _mm512_xor_si512(data, _mm512_loadu_si512((const void*)(secret + n * 8)));
+
+                auto product = _mm512_maskz_mul_epu32(AllLanes, keyed, _mm512_maskz_srli_epi64(AllLanes, keyed, 32));
+                auto swapped = _mm512_maskz_shuffle_epi32(AllWords, data, (_MM_PERM_ENUM)_MM_SHUFFLE(1, 0, 3, 2));
+
+                acc = _mm512_add_epi64(acc, _mm512_add_epi64(product, swapped));
+            }
+
+            _mm512_storeu_si512((void*)accumulators, acc);
+        }
+
+        NDISCUTILS_TARGET("avx512f")
+        void Avx512Scramble(uint64_t* accumulators, const unsigned char* secret)
+        {
+            auto prime = _mm512_set1_epi32((int)Prime32_1);
+
+            auto value = _mm512_loadu_si512((const void*)accumulators);
+            value = _mm512_xor_si512(value, _mm512_maskz_srli_epi64(AllLanes, value, 47));
+            value = _mm512_xor_si512(value, _mm512_loadu_si512((const void*)secret));
+
+            auto low = _mm512_maskz_mul_epu32(AllLanes, value, prime);
+            auto high = _mm512_maskz_mul_epu32(AllLanes, _mm512_maskz_srli_epi64(AllLanes, value, 32), prime);
+            value = _mm512_add_epi64(low, _mm512_maskz_slli_epi64(AllLanes, high, 32));
+
+            _mm512_storeu_si512((void*)accumulators, value);
+        }
+
+#endif // NDISCUTILS_X86
+
+        struct StripeKernels
+        {
+            void (*Accumulate)(uint64_t* accumulators, const unsigned char* input, const unsigned char* secret,
+                size_t stripes);
+            void (*Scramble)(uint64_t* accumulators, const unsigned char* secret);
+        };
+
+        StripeKernels CurrentKernels()
+        {
+#ifdef NDISCUTILS_X86
+            switch (MemoryKernels::Level())
+            {
+                case SimdLevel::Avx512: return { Avx512Accumulate, Avx512Scramble };
+                case SimdLevel::Avx2: return { Avx2Accumulate, Avx2Scramble };
+                default: break;
+            }
+#endif
+
+            return { ScalarAccumulate, ScalarScramble };
+        }
+
+        void InitializeAccumulators(uint64_t* accumulators)
+        {
+            accumulators[0] = Prime32_3;
+            accumulators[1] = Prime64_1;
+            accumulators[2] = Prime64_2;
+            accumulators[3] = Prime64_3;
+            accumulators[4] = Prime64_4;
+            accumulators[5] = Prime32_2;
+            accumulators[6] = Prime64_5;
+            accumulators[7] = Prime32_1;
+        }
+
+        void InitializeSecret(unsigned char* secret, uint64_t seed)
+        {
+            for (size_t i = 0; i < XxHash3::SecretBytes; i += 16)
+            {
+                Write64(secret + i, Read64(DefaultSecret + i) + seed);
+                Write64(secret + i + 8, Read64(DefaultSecret + i + 8) - seed);
+            }
+        }
+
+        // Consumes whole stripes, scrambling whenever a block is complete
+        void ConsumeStripes(const StripeKernels& kernels, uint64_t* accumulators, size_t& stripesInBlock,
+            const unsigned char* secret, const unsigned char* input, size_t stripes)
+        {
+            while (stripes > 0)
+            {
+                auto count = std::min(stripes, StripesPerBlock - stripesInBlock);
+                kernels.Accumulate(accumulators, input, secret + stripesInBlock * 8, count);
+
+                stripesInBlock += count;
+                input += count * XxHash3::StripeBytes;
+                stripes -= count;
+
+                if (stripesInBlock == StripesPerBlock)
+                {
+                    kernels.Scramble(accumulators, secret + XxHash3::SecretBytes - XxHash3::StripeBytes);
+                    stripesInBlock = 0;
+                }
+            }
+        }
+
+        uint64_t MergeAccumulators(const uint64_t* accumulators, const unsigned char* secret, uint64_t total)
+        {
+            auto hash = total * Prime64_1;
+            secret += MergeOffset;
+
+            for (size_t i = 0; i < 4; i++)
+            {
+                hash += MultiplyFold(accumulators[2 * i] ^ Read64(secret + 16 * i),
+                    accumulators[2 * i + 1] ^ Read64(secret + 16 * i + 8));
+            }
+
+            return Avalanche(hash);
+        }
+
+        // Finishes the accumulators with the final stripe, which always ends
+        // at the end of the input and may overlap consumed ones
+        uint64_t FinishLong(const StripeKernels& kernels, uint64_t* accumulators, const unsigned char* secret,
+            const unsigned char* lastStripe, uint64_t total)
+        {
+            kernels.Accumulate(accumulators, lastStripe,
+                secret + XxHash3::SecretBytes - XxHash3::StripeBytes - LastStripeOffset, 1);
+
+            return MergeAccumulators(accumulators, secret, total);
+        }
+
+    } // namespace
+
+    XxHash3::XxHash3(uint64_t seed)
+    {
+        Reset(seed);
+    }
+
+    void XxHash3::Reset(uint64_t seed)
+    {
+        InitializeAccumulators(mAccumulators);
+        InitializeSecret(mSecret, seed);
+
+        mBuffered = 0;
+        mSeed = seed;
+        mTotal = 0;
+        mStripesInBlock = 0;
+    }
+
+    void XxHash3::Update(const void* data, size_t count)
+    {
+        auto input = (const unsigned char*)data;
+        mTotal += count;
+
+        if (mBuffered + count <= BufferBytes)
+        {
+            std::memcpy(mBuffer + mBuffered, input, count);
+            mBuffered += count;
+            return;
+        }
+
+        // Stripes are only consumed once more input follows them, so the
+        // last one is left for Digest()
+        auto kernels = CurrentKernels();
+
+        if (mBuffered > 0)
+        {
+            auto fill = BufferBytes - mBuffered;
+            std::memcpy(mBuffer + mBuffered, input, fill);
+            input += fill;
+            count -= fill;
+
+            ConsumeStripes(kernels, mAccumulators, mStripesInBlock, mSecret, mBuffer, BufferBytes / StripeBytes);
+            std::memcpy(mLastStripe, mBuffer + BufferBytes - StripeBytes, StripeBytes);
+            mBuffered = 0;
+        }
+
+        if (count > BufferBytes)
+        {
+            auto stripes = (count - 1) / StripeBytes;
+            ConsumeStripes(kernels, mAccumulators, mStripesInBlock, mSecret, input, stripes);
+
+            input += stripes * StripeBytes;
+            count -= stripes * StripeBytes;
+            std::memcpy(mLastStripe, input - StripeBytes, StripeBytes);
+        }
+
+        std::memcpy(mBuffer, input, count);
+        mBuffered = count;
+    }
+
+    uint64_t XxHash3::Digest() const
+    {
+        if (mTotal <= MidSizeMax)
+            return Hash(mBuffer, (size_t)mTotal, mSeed);
+
+        auto kernels = CurrentKernels();
+
+        uint64_t accumulators[8];
+        std::memcpy(accumulators, mAccumulators, sizeof(accumulators));
+        auto stripesInBlock = mStripesInBlock;
+
+        if (mBuffered >= StripeBytes)
+        {
+            ConsumeStripes(kernels, accumulators, stripesInBlock, mSecret, mBuffer, (mBuffered - 1) / StripeBytes);
+            return FinishLong(kernels, accumulators, mSecret, mBuffer + mBuffered - StripeBytes, mTotal);
+        }
+
+        unsigned char lastStripe[StripeBytes];
+        std::memcpy(lastStripe, mLastStripe + mBuffered, StripeBytes - mBuffered);
+        std::memcpy(lastStripe + StripeBytes - mBuffered, mBuffer, mBuffered);
+        return FinishLong(kernels, accumulators, mSecret, lastStripe, mTotal);
+    }
+
+    uint64_t XxHash3::Hash(const void* data, size_t count, uint64_t seed)
+    {
+        auto input = (const unsigned char*)data;
+
+        if (count <= 16)
+            return HashShort(input, count, DefaultSecret, seed);
+        if (count <= MidSizeMax)
+            return HashMedium(input, count, DefaultSecret, seed);
+
+        unsigned char customSecret[SecretBytes];
+        auto secret = DefaultSecret;
+        if (seed != 0)
+        {
+            InitializeSecret(customSecret, seed);
+            secret = customSecret;
+        }
+
+        auto kernels = CurrentKernels();
+
+        uint64_t accumulators[8];
+        InitializeAccumulators(accumulators);
+
+        auto stripesInBlock = (size_t)0;
+        ConsumeStripes(kernels, accumulators, stripesInBlock, secret, input, (count - 1) / StripeBytes);
+        return FinishLong(kernels, accumulators, secret, input + count - StripeBytes, count);
+    }
+
+} // Native
+} // nDiscUtils
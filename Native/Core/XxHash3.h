@@ -0,0 +1,68 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nDiscUtils {
+namespace Native {
+
+    // 64-bit XXH3 as specified by the xxHash project. Input is consumed in
+    // 64-byte stripes by kernels following the memory kernel level, so
+    // bulk data hashes at memory speed on AVX2 and AVX-512 machines.
+    class XxHash3
+    {
+
+    public:
+        explicit XxHash3(uint64_t seed = 0);
+
+        void Reset(uint64_t seed = 0);
+
+        void Update(const void* data, size_t count);
+
+        // Hash of everything passed to Update() so far; more data may follow
+        uint64_t Digest() const;
+
+        static uint64_t Hash(const void* data, size_t count, uint64_t seed = 0);
+
+        static constexpr size_t SecretBytes = 192;
+        static constexpr size_t BufferBytes = 256;
+        static constexpr size_t StripeBytes = 64;
+
+    private:
+        uint64_t mAccumulators[8];
+        unsigned char mSecret[SecretBytes];
+
+        // Input not consumed yet, which always includes the last stripe
+        unsigned char mBuffer[BufferBytes];
+        size_t mBuffered;
+
+        // Last consumed stripe, which completes a final stripe shorter
+        // than a full one from the buffer
+        unsigned char mLastStripe[StripeBytes];
+
+        uint64_t mSeed;
+        uint64_t mTotal;
+        size_t mStripesInBlock;
+
+    };
+
+} // Native
+} // nDiscUtils
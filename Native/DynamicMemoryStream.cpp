@@ -22,9 +22,11 @@
 #include "Memory.h"
 #include "StreamUtils.h"
 
+#include "Core/StoreImage.h"
+
 using namespace System;
 using namespace System::IO;
-using namespace System::Runtime::InteropServices;
+using namespace System::Threading;
 
 using namespace nDiscUtils::IO;
 
@@ -35,28 +37,58 @@ namespace IO {
         DynamicMemoryStream(capacity, 4096) { }
 
     DynamicMemoryStream::DynamicMemoryStream(long long capacity, int blockSize) :
+        DynamicMemoryStream(capacity, blockSize, gcnew DynamicMemoryStreamOptions()) { }
+
+    DynamicMemoryStream::DynamicMemoryStream(long long capacity, int blockSize, DynamicMemoryStreamOptions ^options) :
 
 #pragma warning(push)
 #pragma warning(disable: 4244) // possible loss of data
-        mCapacity(capacity),
+        mCapacity(capacity)
 #pragma warning(pop)
 
-        mBlockSize(blockSize)
     {
         if (capacity != (long long)mCapacity) {
             throw gcnew OverflowException("Detected numeric overflow in capacity");
         }
-        
-        StreamUtils::IsAllocationAlignedStrict(mCapacity, "Capacity");
-        StreamUtils::IsAllocationAlignedStrict(mBlockSize, "Block size");
 
-        mBlockCount = (long)Math::Ceiling((double)mCapacity / mBlockSize);
-        mMemorySize = mBlockCount * sizeof(void*);
-        mMemory = (void**)Memory::Allocate(mMemorySize);
-        Memory::Set(mMemory, 0, mMemorySize);
+        if (blockSize <= 0)
+            throw gcnew ArgumentException("Block size was expected to be greater than zero");
 
-        mLength = __mem_cast(0);
+        mStore = nullptr;
         mPosition = __mem_cast(0);
+
+        mImage = nullptr;
+        mImageLock = gcnew Object();
+
+        try
+        {
+            mStore = new Native::DynamicMemoryStore(mCapacity, (size_t)blockSize, ToNative(options));
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+    }
+
+    DynamicMemoryStream::DynamicMemoryStream(Native::DynamicMemoryStore* store) :
+        mStore(store),
+        mCapacity(store->Capacity()),
+        mImage(nullptr),
+        mImageLock(gcnew Object()),
+        mPosition(0) { }
+
+    Native::DynamicMemoryStoreOptions DynamicMemoryStream::ToNative(DynamicMemoryStreamOptions ^options)
+    {
+        Native::DynamicMemoryStoreOptions storeOptions;
+        storeOptions.Deduplicate = options->Deduplicate;
+        storeOptions.Compress = options->Compress;
+        storeOptions.HotBytes = (size_t)Math::Max(options->HotSize, 0LL);
+        storeOptions.ColdAfter = (uint32_t)Math::Max(options->ColdAfter, 0) * 1000u;
+        storeOptions.Numa = StreamUtils::NativePolicy(options->Placement, options->NumaNode);
+        storeOptions.MemoryBudget = (size_t)Math::Max(options->MemoryBudget, 0LL);
+        if (options->SpillPath != nullptr)
+            storeOptions.SpillPath = StreamUtils::NativePath(options->SpillPath);
+        return storeOptions;
     }
 
     long long DynamicMemoryStream::Seek(long long offset, SeekOrigin origin)
@@ -86,120 +118,286 @@ namespace IO {
 
     DynamicMemoryStream::~DynamicMemoryStream()
     {
-        for (size_t i = 0; i < mBlockCount; i++)
+        delete mImage;
+        mImage = nullptr;
+
+        delete mStore;
+        mStore = nullptr;
+    }
+
+    void DynamicMemoryStream::SetLength(long long value)
+    {
+        if (value < 0)
+            throw gcnew IOException("<value> was expected to be greater than or equal to zero");
+
+        if ((size_t)value >= mCapacity)
+            return;
+
+        Discard(value, (long long)mCapacity - value);
+    }
+
+    int DynamicMemoryStream::Read(array<unsigned char> ^buffer, int offset, int count)
+    {
+        ReadAt((long long)mPosition, buffer, offset, count);
+
+        mPosition += count;
+        return count;
+    }
+
+    void DynamicMemoryStream::Write(array<unsigned char> ^buffer, int offset, int count)
+    {
+        WriteAt((long long)mPosition, buffer, offset, count);
+
+        mPosition += count;
+    }
+
+    int DynamicMemoryStream::ReadAt(long long position, array<unsigned char> ^buffer, int offset, int count)
+    {
+        if (position < 0)
+            throw gcnew IOException("<position> was expected to be greater than or equal to zero");
+
+        StreamUtils::AssertBufferParameters(mCapacity, (size_t)position, buffer, offset, count);
+
+        pin_ptr<unsigned char> bufferPointer = &buffer[offset];
+
+        try
         {
-            if (mMemory[i] != nullptr)
-            {
-                VirtualFree(mMemory[i], 0, MEM_RELEASE);
-                mMemory[i] = nullptr;
+            mStore->Read((size_t)position, bufferPointer, (size_t)count);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
 
-                mLength -= mBlockSize;
-            }
+        return count;
+    }
+
+    void DynamicMemoryStream::WriteAt(long long position, array<unsigned char> ^buffer, int offset, int count)
+    {
+        if (position < 0)
+            throw gcnew IOException("<position> was expected to be greater than or equal to zero");
+
+        StreamUtils::AssertBufferParameters(mCapacity, (size_t)position, buffer, offset, count);
+
+        pin_ptr<unsigned char> bufferPointer = &buffer[offset];
+
+        try
+        {
+            mStore->Write((size_t)position, bufferPointer, (size_t)count);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
         }
     }
 
-    int DynamicMemoryStream::Read(array<unsigned char> ^buffer, int offset, int count)
+    void DynamicMemoryStream::ReadAt(long long position, void *buffer, size_t count)
     {
-        auto readCount = 0;
+        StreamUtils::AssertPointerParameters(mCapacity, position, buffer, count);
 
-        StreamUtils::AssertBufferParameters(mCapacity, mPosition, buffer, offset, count);
+        try
+        {
+            mStore->Read((size_t)position, buffer, count);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+    }
 
-        auto bufferHandle = GCHandle::Alloc(buffer, GCHandleType::Pinned);
-        auto bufferPointer = (void*)bufferHandle.AddrOfPinnedObject();
+    void DynamicMemoryStream::WriteAt(long long position, const void *buffer, size_t count)
+    {
+        StreamUtils::AssertPointerParameters(mCapacity, position, buffer, count);
 
-        while (readCount < count)
+        try
         {
-            auto bufferOffset = offset + readCount;
+            mStore->Write((size_t)position, buffer, count);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+    }
 
-            auto readBlockSize = (size_t)Math::Min(__mem_cast(count - readCount), __mem_cast(mBlockSize));
-            auto blockIndex = (size_t)Math::Floor((double)mPosition / mBlockSize);
-            auto blockBegin = (size_t)(blockIndex * mBlockSize);
-            auto nextBlockBegin = (size_t)(blockBegin + mBlockSize);
-            auto innerBlockOffset = (size_t)0;
+    void DynamicMemoryStream::ReadV(array<IoVector> ^vectors)
+    {
+        StreamUtils::AssertVectorParameters(mCapacity, vectors);
 
-            if (mPosition > blockBegin)
-                innerBlockOffset = mPosition - blockBegin;
+        try
+        {
+            for each (auto vector in vectors)
+                mStore->Read((size_t)vector.Position, (void*)vector.Buffer, (size_t)vector.Length);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+    }
 
-            if (innerBlockOffset + readBlockSize > mBlockSize)
-                readBlockSize = mBlockSize - innerBlockOffset;
+    void DynamicMemoryStream::WriteV(array<IoVector> ^vectors)
+    {
+        StreamUtils::AssertVectorParameters(mCapacity, vectors);
 
-            auto blockMemory = mMemory[blockIndex];
-            if (blockMemory == nullptr)
-            {
-                Memory::Set(bufferPointer, bufferOffset, 0, readBlockSize);
-            }
-            else
-            {
-                Memory::Copy(
-                    blockMemory, innerBlockOffset,
-                    bufferPointer, bufferOffset,
-                    readBlockSize);
-            }
+        try
+        {
+            for each (auto vector in vectors)
+                mStore->Write((size_t)vector.Position, (const void*)vector.Buffer, (size_t)vector.Length);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+    }
 
-            mPosition += readBlockSize;
-            readCount += (int)readBlockSize;
+    void DynamicMemoryStream::Discard(long long position, long long count)
+    {
+        StreamUtils::AssertRangeParameters(mCapacity, position, count);
+
+        try
+        {
+            mStore->Discard((size_t)position, (size_t)count);
         }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+    }
+
+    DynamicMemoryStreamSnapshot^ DynamicMemoryStream::Snapshot()
+    {
+        Native::DynamicMemorySnapshot* snapshot = nullptr;
 
-        bufferHandle.Free();
-        return readCount;
+        try
+        {
+            snapshot = mStore->Snapshot();
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+
+        return gcnew DynamicMemoryStreamSnapshot(snapshot);
     }
 
-    void DynamicMemoryStream::Write(array<unsigned char> ^buffer, int offset, int count)
+    void DynamicMemoryStream::Restore(DynamicMemoryStreamSnapshot ^snapshot)
+    {
+        if (snapshot == nullptr)
+            throw gcnew ArgumentNullException("snapshot");
+
+        try
+        {
+            mStore->Restore(*snapshot->NativeSnapshot());
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+    }
+
+    DynamicMemoryStream^ DynamicMemoryStream::Fork()
     {
-        auto writeCount = 0;
+        Native::DynamicMemoryStore* store = nullptr;
+
+        try
+        {
+            store = mStore->Fork();
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
 
-        StreamUtils::AssertBufferParameters(mCapacity, mPosition, buffer, offset, count);
+        return gcnew DynamicMemoryStream(store);
+    }
+
+    DynamicMemoryStream^ DynamicMemoryStream::Fork(DynamicMemoryStreamSnapshot ^snapshot)
+    {
+        if (snapshot == nullptr)
+            throw gcnew ArgumentNullException("snapshot");
 
-        auto bufferHandle = GCHandle::Alloc(buffer, GCHandleType::Pinned);
-        auto bufferPointer = (void*)bufferHandle.AddrOfPinnedObject();
+        Native::DynamicMemoryStore* store = nullptr;
 
-        while (writeCount < count)
+        try
+        {
+            store = Native::DynamicMemoryStore::Fork(*snapshot->NativeSnapshot());
+        }
+        catch (const Native::NativeException& ex)
         {
-            auto bufferOffset = offset + writeCount;
+            StreamUtils::ThrowManaged(ex);
+        }
 
-            auto writeBlockSize = (size_t)Math::Min(__mem_cast(count - writeCount), __mem_cast(mBlockSize));
-            auto blockIndex = (size_t)Math::Floor((double)mPosition / mBlockSize);
-            auto blockBegin = (size_t)(blockIndex * mBlockSize);
-            auto nextBlockBegin = (size_t)(blockBegin + mBlockSize);
-            auto innerBlockOffset = (size_t)0;
+        return gcnew DynamicMemoryStream(store);
+    }
 
-            if (mPosition > blockBegin)
-                innerBlockOffset = mPosition - blockBegin;
+    CheckpointStatistics DynamicMemoryStream::Checkpoint(String ^path)
+    {
+        if (path == nullptr)
+            throw gcnew ArgumentNullException("path");
 
-            if (innerBlockOffset + writeBlockSize > mBlockSize)
-                writeBlockSize = mBlockSize - innerBlockOffset;
+        auto fullPath = Path::GetFullPath(path);
+        CheckpointStatistics result;
 
-            auto blockMemory = mMemory[blockIndex];
-            if (blockMemory == nullptr)
+        Monitor::Enter(mImageLock);
+        try
+        {
+            // A different target starts over with a complete image
+            if (mImage != nullptr && !String::Equals(mImagePath, fullPath, StringComparison::OrdinalIgnoreCase))
             {
-                blockMemory = VirtualAlloc(nullptr, mBlockSize, MEM_COMMIT, PAGE_READWRITE);
-                if (blockMemory == nullptr)
-                    throw gcnew IOException("Failed to allocate " + mBlockSize + " bytes of memory");
-
-                mMemory[blockIndex] = blockMemory;
-                mLength += mBlockSize;
+                delete mImage;
+                mImage = nullptr;
             }
 
-            Memory::Copy(
-                bufferPointer, bufferOffset,
-                blockMemory, innerBlockOffset,
-                writeBlockSize);
+            if (mImage == nullptr)
+            {
+                mImage = new Native::StoreImage(StreamUtils::NativePath(fullPath));
+                mImagePath = fullPath;
+            }
 
-            mPosition += writeBlockSize;
-            writeCount += (int)writeBlockSize;
+            auto statistics = mImage->Checkpoint(*mStore);
+            result.Incremental = statistics.Incremental;
+            result.WrittenBlocks = (long long)statistics.WrittenBlocks;
+            result.ClearedBlocks = (long long)statistics.ClearedBlocks;
+            result.BackedBlocks = (long long)statistics.BackedBlocks;
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+        finally
+        {
+            Monitor::Exit(mImageLock);
         }
 
-        bufferHandle.Free();
+        return result;
     }
 
-    void DynamicMemoryStream::AssertRequestedBlockSize()
+    DynamicMemoryStream^ DynamicMemoryStream::Load(String ^path, DynamicMemoryStreamOptions ^options)
     {
-        SYSTEM_INFO info;
-        GetSystemInfo(&info);
+        if (path == nullptr)
+            throw gcnew ArgumentNullException("path");
+
+        if (options == nullptr)
+            throw gcnew ArgumentNullException("options");
+
+        auto fullPath = Path::GetFullPath(path);
+        Native::StoreImage* image = nullptr;
+        Native::DynamicMemoryStore* store = nullptr;
+
+        try
+        {
+            image = new Native::StoreImage(StreamUtils::NativePath(fullPath));
+            store = image->Load(ToNative(options));
+        }
+        catch (const Native::NativeException& ex)
+        {
+            delete image;
+            StreamUtils::ThrowManaged(ex);
+        }
 
-        if ((mBlockSize % info.dwAllocationGranularity) != 0)
-            throw gcnew ArgumentException(String::Format("Requested block-size is not aligned to allocation granularity ({0})",
-                info.dwAllocationGranularity));
+        auto stream = gcnew DynamicMemoryStream(store);
+        stream->mImage = image;
+        stream->mImagePath = fullPath;
+        return stream;
     }
 
 } // IO
@@ -20,18 +20,33 @@
 
 #include "stdafx.h"
 
+#include "CheckpointStatistics.h"
+#include "Core/DynamicMemoryStore.h"
+#include "DynamicMemoryStreamOptions.h"
+#include "DynamicMemoryStreamSnapshot.h"
+#include "IDiscardableStream.h"
+#include "IPositionalStream.h"
+#include "MemoryStreamCounters.h"
+
 using namespace System;
 using namespace System::IO;
 
 namespace nDiscUtils {
+namespace Native {
+
+    class StoreImage;
+
+} // Native
+
 namespace IO {
 
-    public ref class DynamicMemoryStream : Stream, IDisposable
+    public ref class DynamicMemoryStream : Stream, IDisposable, IPositionalStream, IDiscardableStream
     {
 
     public:
         DynamicMemoryStream(long long capacity);
         DynamicMemoryStream(long long capacity, int blockSize);
+        DynamicMemoryStream(long long capacity, int blockSize, DynamicMemoryStreamOptions ^options);
 
         ~DynamicMemoryStream();
 
@@ -79,7 +94,101 @@ namespace IO {
         {
             long long get()
             {
-                return mLength;
+                return mStore->CommittedBytes();
+            }
+        }
+
+        property long long LogicalSize
+        {
+            long long get()
+            {
+                return mStore->LogicalBytes();
+            }
+        }
+
+        property long long CompressedSize
+        {
+            long long get()
+            {
+                return mStore->Statistics().CompressedBytes;
+            }
+        }
+
+        // Uncompressed size of all compressed blocks relative to their compressed size
+        property double CompressionRatio
+        {
+            double get()
+            {
+                auto statistics = mStore->Statistics();
+                if (statistics.CompressedBytes == 0)
+                    return 1.0;
+
+                return (double)statistics.CompressedBlocks * mStore->BlockSize() / statistics.CompressedBytes;
+            }
+        }
+
+        // Share of block accesses which did not have to decompress the block first
+        property double HotHitRate
+        {
+            double get()
+            {
+                auto statistics = mStore->Statistics();
+                auto accesses = statistics.HotHits + statistics.HotMisses;
+                if (accesses == 0)
+                    return 1.0;
+
+                return (double)statistics.HotHits / accesses;
+            }
+        }
+
+        // Memory held by blocks, excluding those moved to the spill file
+        property long long ResidentSize
+        {
+            long long get()
+            {
+                return mStore->Statistics().ResidentBytes;
+            }
+        }
+
+        property long long SpilledSize
+        {
+            long long get()
+            {
+                return mStore->Statistics().SpilledBytes;
+            }
+        }
+
+        // Blocks moved to the spill file and read back from it so far
+        property long long Evictions
+        {
+            long long get()
+            {
+                return mStore->Statistics().Evictions;
+            }
+        }
+
+        property long long SpillReads
+        {
+            long long get()
+            {
+                return mStore->Statistics().SpillReads;
+            }
+        }
+
+        // Requests, allocations and latencies since creation or ResetCounters()
+        property MemoryStreamCounters ^Counters
+        {
+            MemoryStreamCounters^ get()
+            {
+                return gcnew MemoryStreamCounters(mStore->Counters());
+            }
+        }
+
+        property long long IndexSize
+        {
+            long long get()
+            {
+                return mStore->IndexBytes();
             }
         }
 
@@ -97,7 +206,9 @@ namespace IO {
 
         void Flush() override { }
 
-        void SetLength(long long value) override { }
+        // The capacity is fixed and requests to grow are ignored; shrinking
+        // discards everything behind the new length, which reads back as zero
+        void SetLength(long long value) override;
 
         long long Seek(long long offset, SeekOrigin origin) override;
 
@@ -105,17 +216,63 @@ namespace IO {
 
         void Write(array<unsigned char> ^buffer, int offset, int count) override;
 
+        virtual int ReadAt(long long position, array<unsigned char> ^buffer, int offset, int count);
+
+        virtual void WriteAt(long long position, array<unsigned char> ^buffer, int offset, int count);
+
+        // Transfers between the stream and native memory without any pinning
+        void ReadAt(long long position, void *buffer, size_t count);
+
+        void WriteAt(long long position, const void *buffer, size_t count);
+
+        // Performs all segments in order; they are validated before any data is transferred
+        virtual void ReadV(array<IoVector> ^vectors);
+
+        virtual void WriteV(array<IoVector> ^vectors);
+
+        virtual void Discard(long long position, long long count);
+
+        // Freezes the current contents in O(leaves); blocks are copied once
+        // they are written to afterwards
+        DynamicMemoryStreamSnapshot^ Snapshot();
+
+        // Resets the contents to a snapshot of this stream or its forks
+        void Restore(DynamicMemoryStreamSnapshot ^snapshot);
+
+        // Returns an independent stream starting with the current contents
+        DynamicMemoryStream^ Fork();
+
+        // Returns an independent stream starting with the snapshot's contents
+        static DynamicMemoryStream^ Fork(DynamicMemoryStreamSnapshot ^snapshot);
+
+        // Persists the contents to a sparse image file while the stream stays
+        // usable. Only blocks changed since the previous checkpoint to the
+        // same path or since loading from it are written again.
+        CheckpointStatistics Checkpoint(String ^path);
+
+        // Opens an image written by Checkpoint(); blocks are read from the
+        // mapped file on first access instead of being loaded up front
+        static DynamicMemoryStream^ Load(String ^path, DynamicMemoryStreamOptions ^options);
+
+        void ResetCounters()
+        {
+            mStore->ResetCounters();
+        }
+
     private:
+        DynamicMemoryStream(Native::DynamicMemoryStore* store);
+
+        static Native::DynamicMemoryStoreOptions ToNative(DynamicMemoryStreamOptions ^options);
+
+        Native::DynamicMemoryStore* mStore;
         size_t mCapacity;
-        size_t mBlockSize;
-        size_t mBlockCount;
-        void** mMemory;
-        size_t mMemorySize;
 
-        size_t mLength;
-        size_t mPosition;
+        // Image of the last checkpoint or load and its full path
+        Native::StoreImage* mImage;
+        String ^mImagePath;
+        Object ^mImageLock;
 
-        void AssertRequestedBlockSize();
+        size_t mPosition;
 
     };
 
@@ -0,0 +1,64 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+#include "NumaPlacement.h"
+
+using namespace System;
+
+namespace nDiscUtils {
+namespace IO {
+
+    public ref class DynamicMemoryStreamOptions
+    {
+
+    public:
+        // Let blocks with identical contents share their memory
+        property bool Deduplicate;
+
+        // Keep blocks outside of the hot set compressed
+        property bool Compress;
+
+        // Upper bound of uncompressed block memory, zero for no bound
+        property long long HotSize;
+
+        // Seconds after which untouched blocks get compressed, zero to
+        // only compress blocks beyond HotSize
+        property int ColdAfter;
+
+        // NUMA nodes the memory of blocks is taken from
+        property NumaPlacement Placement;
+
+        // Node used by NumaPlacement::Node
+        property int NumaNode;
+
+        // Upper bound of memory held by blocks, zero for no bound; blocks
+        // beyond it are moved to SpillPath and read back on access
+        property long long MemoryBudget;
+
+        // Scratch file receiving blocks beyond MemoryBudget, deleted when
+        // the stream is disposed
+        property String ^SpillPath;
+
+    };
+
+} // IO
+} // nDiscUtils
@@ -0,0 +1,76 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+#include "Core/DynamicMemoryStore.h"
+
+using namespace System;
+
+namespace nDiscUtils {
+namespace IO {
+
+    // Frozen contents of a DynamicMemoryStream; it shares all blocks with
+    // the stream and only keeps memory alive for blocks changed afterwards
+    public ref class DynamicMemoryStreamSnapshot : IDisposable
+    {
+
+    public:
+        ~DynamicMemoryStreamSnapshot()
+        {
+            delete mSnapshot;
+            mSnapshot = nullptr;
+        }
+
+        property long long Length
+        {
+            long long get()
+            {
+                return (long long)NativeSnapshot()->Capacity();
+            }
+        }
+
+        property long long LogicalSize
+        {
+            long long get()
+            {
+                return (long long)NativeSnapshot()->LogicalBytes();
+            }
+        }
+
+    internal:
+        DynamicMemoryStreamSnapshot(Native::DynamicMemorySnapshot* snapshot) :
+            mSnapshot(snapshot) { }
+
+        Native::DynamicMemorySnapshot* NativeSnapshot()
+        {
+            if (mSnapshot == nullptr)
+                throw gcnew ObjectDisposedException("DynamicMemoryStreamSnapshot");
+
+            return mSnapshot;
+        }
+
+    private:
+        Native::DynamicMemorySnapshot* mSnapshot;
+
+    };
+
+} // IO
+} // nDiscUtils
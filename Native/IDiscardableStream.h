@@ -0,0 +1,39 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+using namespace System;
+
+namespace nDiscUtils {
+namespace IO {
+
+    // Streams able to drop the contents of a range, which reads back as
+    // zero afterwards; used to hand memory of freed clusters back
+    public interface class IDiscardableStream
+    {
+
+    public:
+        void Discard(long long position, long long count);
+
+    };
+
+} // IO
+} // nDiscUtils
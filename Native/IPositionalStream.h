@@ -0,0 +1,47 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+#include "IoVector.h"
+
+using namespace System;
+
+namespace nDiscUtils {
+namespace IO {
+
+    // Streams offering reads and writes at explicit positions; unlike
+    // Seek()+Read()/Write() these may be issued from many threads at once
+    // and leave Position untouched
+    public interface class IPositionalStream
+    {
+
+    public:
+        int ReadAt(long long position, array<unsigned char> ^buffer, int offset, int count);
+
+        void WriteAt(long long position, array<unsigned char> ^buffer, int offset, int count);
+
+        void ReadV(array<IoVector> ^vectors);
+
+        void WriteV(array<IoVector> ^vectors);
+
+    };
+
+} // IO
+} // nDiscUtils
@@ -0,0 +1,130 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "stdafx.h"
+
+#include "MappedImageStream.h"
+#include "StreamUtils.h"
+
+#include <algorithm>
+
+using namespace System;
+using namespace System::IO;
+
+namespace nDiscUtils {
+namespace IO {
+
+    MappedImageStream::MappedImageStream(String ^path) :
+        MappedImageStream(path, gcnew MappedImageStreamOptions()) { }
+
+    MappedImageStream::MappedImageStream(String ^path, MappedImageStreamOptions ^options)
+    {
+        if (path == nullptr)
+            throw gcnew ArgumentNullException("path");
+
+        if (options == nullptr)
+            throw gcnew ArgumentNullException("options");
+
+        if (options->WindowSize < 0)
+            throw gcnew ArgumentOutOfRangeException("options", "Window size was expected to be greater than or equal to zero");
+
+        Native::MappedImageOptions imageOptions;
+        imageOptions.WindowBytes = (size_t)std::min<unsigned long long>((unsigned long long)options->WindowSize, SIZE_MAX);
+        imageOptions.Advice = options->RandomAccess ? Native::MapAdvice::Random : Native::MapAdvice::Sequential;
+        imageOptions.Prefetch = options->Prefetch && !options->RandomAccess;
+
+        mImage = nullptr;
+        mPosition = 0;
+
+        try
+        {
+            mImage = new Native::MappedImage(StreamUtils::NativePath(Path::GetFullPath(path)), imageOptions);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+    }
+
+    MappedImageStream::~MappedImageStream()
+    {
+        delete mImage;
+        mImage = nullptr;
+    }
+
+    long long MappedImageStream::Seek(long long offset, SeekOrigin origin)
+    {
+        long long position;
+
+        switch (origin)
+        {
+            case SeekOrigin::Begin: position = offset; break;
+            case SeekOrigin::Current: position = mPosition + offset; break;
+            case SeekOrigin::End: position = Length + offset; break;
+            default: throw gcnew ArgumentException("Invalid seek origin", "origin");
+        }
+
+        if (position < 0)
+            throw gcnew IOException("Attempted to seek before the beginning of the stream");
+
+        mPosition = position;
+        return mPosition;
+    }
+
+    int MappedImageStream::Read(array<unsigned char> ^buffer, int offset, int count)
+    {
+        auto read = ReadAt(mPosition, buffer, offset, count);
+
+        mPosition += read;
+        return read;
+    }
+
+    int MappedImageStream::ReadAt(long long position, array<unsigned char> ^buffer, int offset, int count)
+    {
+        if (buffer == nullptr)
+            throw gcnew ArgumentNullException("buffer");
+
+        if (offset < 0 || count < 0 || offset > buffer->Length - count)
+            throw gcnew ArgumentOutOfRangeException("offset", "Range exceeds the buffer");
+
+        if (count == 0)
+            return 0;
+
+        pin_ptr<unsigned char> bufferPointer = &buffer[offset];
+        return (int)ReadAt(position, bufferPointer, (size_t)count);
+    }
+
+    size_t MappedImageStream::ReadAt(long long position, void *buffer, size_t count)
+    {
+        if (position < 0)
+            throw gcnew IOException("<position> was expected to be greater than or equal to zero");
+
+        try
+        {
+            return mImage->Read((uint64_t)position, buffer, count);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+
+        return 0;
+    }
+
+} // IO
+} // nDiscUtils
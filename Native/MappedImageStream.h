@@ -0,0 +1,123 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+#include "Core/MappedImage.h"
+#include "MappedImageStreamOptions.h"
+
+using namespace System;
+using namespace System::IO;
+
+namespace nDiscUtils {
+namespace IO {
+
+    // Read-only image file served from sliding mappings of the page cache.
+    // The native engines read it in place rather than through a buffer,
+    // see StreamSource::For().
+    public ref class MappedImageStream : Stream
+    {
+
+    public:
+        MappedImageStream(String ^path);
+        MappedImageStream(String ^path, MappedImageStreamOptions ^options);
+
+        ~MappedImageStream();
+
+        property bool CanRead
+        {
+            bool get() override
+            {
+                return true;
+            }
+        }
+
+        property bool CanWrite
+        {
+            bool get() override
+            {
+                return false;
+            }
+        }
+
+        property bool CanSeek
+        {
+            bool get() override
+            {
+                return true;
+            }
+        }
+
+        property long long Length
+        {
+            long long get() override
+            {
+                return (long long)mImage->Length();
+            }
+        }
+
+        property long long Position
+        {
+            long long get() override
+            {
+                return mPosition;
+            }
+            void set(long long value) override
+            {
+                Seek(value, SeekOrigin::Begin);
+            }
+        }
+
+        void Flush() override { }
+
+        void SetLength(long long /* value */) override
+        {
+            throw gcnew NotSupportedException("Mapped images are read-only");
+        }
+
+        long long Seek(long long offset, SeekOrigin origin) override;
+
+        // Returns fewer bytes than requested only at the end of the file
+        int Read(array<unsigned char> ^buffer, int offset, int count) override;
+
+        void Write(array<unsigned char> ^ /* buffer */, int /* offset */, int /* count */) override
+        {
+            throw gcnew NotSupportedException("Mapped images are read-only");
+        }
+
+        int ReadAt(long long position, array<unsigned char> ^buffer, int offset, int count);
+
+        // Reads into native memory without any pinning
+        size_t ReadAt(long long position, void *buffer, size_t count);
+
+    internal:
+        Native::MappedImage* Image()
+        {
+            return mImage;
+        }
+
+    private:
+        Native::MappedImage* mImage;
+        long long mPosition;
+
+    };
+
+} // IO
+} // nDiscUtils
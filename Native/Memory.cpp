@@ -20,6 +20,9 @@
 
 #include "Memory.h"
 
+#include "Core/MemoryKernels.h"
+#include "Core/RandomFill.h"
+
 using namespace System;
 using namespace System::IO;
 
@@ -43,7 +46,7 @@ namespace IO {
 
     void Memory::Set(void* ptr, long long offset, unsigned char data, size_t count)
     {
-        std::memset(((unsigned char*)ptr) + offset, data, count);
+        Native::MemoryKernels::Fill(((unsigned char*)ptr) + offset, data, count);
     }
 
     void Memory::Copy(void *src, const void *dst, size_t count)
@@ -53,11 +56,44 @@ namespace IO {
 
     void Memory::Copy(void *src, long long srcOffset, const void *dst, long long dstOffset, size_t count)
     {
-        memcpy(
+        Native::MemoryKernels::Copy(
             ((unsigned char*)dst) + dstOffset,
             ((unsigned char*)src) + srcOffset,
             count);
     }
 
+    size_t Memory::FindMismatch(const void *left, const void *right, size_t count)
+    {
+        return Native::MemoryKernels::FindMismatch(left, right, count);
+    }
+
+    bool Memory::IsZero(const void *ptr, size_t count)
+    {
+        return Native::MemoryKernels::IsZero(ptr, count);
+    }
+
+    unsigned long long Memory::PopCount(const void *ptr, size_t count)
+    {
+        return Native::MemoryKernels::PopCount(ptr, count);
+    }
+
+    void Memory::FillRandom(void* ptr, size_t count, unsigned long long seed, unsigned long long position, int threads)
+    {
+        if (threads < 0)
+            throw gcnew ArgumentOutOfRangeException("threads", "<threads> may not be negative");
+
+        Native::RandomFill(seed).Fill(ptr, count, position, (size_t)threads);
+    }
+
+    String^ Memory::RandomImplementation::get()
+    {
+        return gcnew String(Native::RandomFill::Implementation());
+    }
+
+    String^ Memory::KernelLevel::get()
+    {
+        return gcnew String(Native::MemoryKernels::LevelName(Native::MemoryKernels::Level()));
+    }
+
 } // IO
 } // nDiscUtils
@@ -49,6 +49,31 @@ namespace IO {
 
         static void Copy(void *src, long long srcOffset, const void *dst, long long dstOffset, size_t count);
 
+        // Offset of the first differing byte, count if both ranges are equal
+        static size_t FindMismatch(const void *left, const void *right, size_t count);
+
+        static bool IsZero(const void *ptr, size_t count);
+
+        // Number of set bits in the range
+        static unsigned long long PopCount(const void *ptr, size_t count);
+
+        // Writes bytes [position, position + count) of the counter-based
+        // random stream for a seed (see Core/RandomFill.h); fills of several
+        // megabytes are split across up to threads threads, zero for one per core
+        static void FillRandom(void* ptr, size_t count, unsigned long long seed, unsigned long long position, int threads);
+
+        // Cipher implementation FillRandom uses
+        static property String^ RandomImplementation
+        {
+            String^ get();
+        }
+
+        // Instruction set the kernels above were dispatched to
+        static property String^ KernelLevel
+        {
+            String^ get();
+        }
+
     };
 
 } // IO
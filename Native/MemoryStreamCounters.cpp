@@ -0,0 +1,65 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "stdafx.h"
+
+#include "MemoryStreamCounters.h"
+
+namespace nDiscUtils {
+namespace IO {
+
+    namespace {
+
+        TimeSpan FromNanoseconds(double nanoseconds)
+        {
+            return TimeSpan::FromTicks((long long)(nanoseconds / 100.0));
+        }
+
+    } // namespace
+
+    MemoryStreamLatency::MemoryStreamLatency(const Native::StoreLatency& latency)
+    {
+        Count = (long long)latency.Count;
+        Mean = FromNanoseconds(latency.Mean());
+        P50 = FromNanoseconds((double)latency.Percentile(50.0));
+        P99 = FromNanoseconds((double)latency.Percentile(99.0));
+        P999 = FromNanoseconds((double)latency.Percentile(99.9));
+        Max = FromNanoseconds((double)latency.Max());
+    }
+
+    MemoryStreamCounters::MemoryStreamCounters(const Native::StoreCountersSnapshot& snapshot)
+    {
+        Reads = (long long)snapshot.Reads;
+        Writes = (long long)snapshot.Writes;
+        ReadBytes = (long long)snapshot.ReadBytes;
+        WrittenBytes = (long long)snapshot.WrittenBytes;
+        Discards = (long long)snapshot.Discards;
+        DiscardedBytes = (long long)snapshot.DiscardedBytes;
+        BlocksAllocated = (long long)snapshot.BlocksAllocated;
+        BlocksFreed = (long long)snapshot.BlocksFreed;
+        ZeroReads = (long long)snapshot.ZeroReads;
+        CommittedBytes = (long long)snapshot.CommittedBytes;
+        ReadLatency = gcnew MemoryStreamLatency(snapshot.ReadLatency);
+        WriteLatency = gcnew MemoryStreamLatency(snapshot.WriteLatency);
+        DiscardLatency = gcnew MemoryStreamLatency(snapshot.DiscardLatency);
+
+        mJson = gcnew String(snapshot.ToJson().c_str());
+    }
+
+} // IO
+} // nDiscUtils
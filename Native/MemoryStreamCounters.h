@@ -0,0 +1,101 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+#include "Core/StoreCounters.h"
+
+using namespace System;
+
+namespace nDiscUtils {
+namespace IO {
+
+    // Service times of one kind of request, percentiles within 25% of the
+    // measured value
+    public ref class MemoryStreamLatency
+    {
+
+    public:
+        property long long Count;
+
+        property TimeSpan Mean;
+        property TimeSpan P50;
+        property TimeSpan P99;
+        property TimeSpan P999;
+        property TimeSpan Max;
+
+    internal:
+        MemoryStreamLatency(const Native::StoreLatency& latency);
+
+    };
+
+    // Snapshot of the counters kept by StaticMemoryStream and
+    // DynamicMemoryStream since creation or their last reset. Builds without
+    // instrumentation only report CommittedBytes.
+    public ref class MemoryStreamCounters
+    {
+
+    public:
+        // Whether the native core was built with instrumentation
+        static property bool Enabled
+        {
+            bool get()
+            {
+                return Native::StoreCounters::Enabled;
+            }
+        }
+
+        property long long Reads;
+        property long long Writes;
+        property long long ReadBytes;
+        property long long WrittenBytes;
+
+        // Ranges dropped by Discard() and SetLength() and their total length
+        property long long Discards;
+        property long long DiscardedBytes;
+
+        property long long BlocksAllocated;
+        property long long BlocksFreed;
+
+        // Block-sized pieces of reads answered with zeros as nothing backed them
+        property long long ZeroReads;
+
+        property long long CommittedBytes;
+
+        property MemoryStreamLatency ^ReadLatency;
+        property MemoryStreamLatency ^WriteLatency;
+        property MemoryStreamLatency ^DiscardLatency;
+
+        // Single-line JSON object of all counters, latencies in nanoseconds
+        String^ ToJson()
+        {
+            return mJson;
+        }
+
+    internal:
+        MemoryStreamCounters(const Native::StoreCountersSnapshot& snapshot);
+
+    private:
+        String ^mJson;
+
+    };
+
+} // IO
+} // nDiscUtils
@@ -0,0 +1,54 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+using namespace System;
+
+namespace nDiscUtils {
+namespace IO {
+
+    // File systems StreamScanner looks for, combined as flags
+    [FlagsAttribute]
+    public enum class FileSystemSignature
+    {
+        None = 0,
+        Ntfs = 1 << 0,
+        Fat = 1 << 1,
+        Ext = 1 << 2,
+        All = Ntfs | Fat | Ext
+    };
+
+    // Position at which the listed file systems may start; the detectors
+    // of the file systems still have to confirm them
+    public value struct SignatureHit
+    {
+
+    public:
+        SignatureHit(long long position, FileSystemSignature signatures) :
+            Position(position), Signatures(signatures) { }
+
+        long long Position;
+        FileSystemSignature Signatures;
+
+    };
+
+} // IO
+} // nDiscUtils
@@ -24,7 +24,6 @@
 
 using namespace System;
 using namespace System::IO;
-using namespace System::Runtime::InteropServices;
 
 using namespace nDiscUtils::IO;
 
@@ -32,6 +31,12 @@ namespace nDiscUtils {
 namespace IO {
 
     StaticMemoryStream::StaticMemoryStream(long long capacity) :
+        StaticMemoryStream(capacity, NumaPlacement::Default, 0) { }
+
+    StaticMemoryStream::StaticMemoryStream(long long capacity, NumaPlacement placement, int node) :
+        StaticMemoryStream(capacity, ToOptions(placement, node)) { }
+
+    StaticMemoryStream::StaticMemoryStream(long long capacity, StaticMemoryStreamOptions ^options) :
 
 #pragma warning(push)
 #pragma warning(disable: 4244) // possible loss of data
@@ -43,19 +48,40 @@ namespace IO {
             throw gcnew OverflowException("Detected numeric overflow in capacity");
         }
 
-        StreamUtils::IsAllocationAlignedStrict(mCapacity, "Capacity");
-
-        mMemory = nullptr;
+        mStore = nullptr;
         mPosition = 0;
 
-        mMemory = GlobalAlloc(GHND, mCapacity);
-        if (mMemory == nullptr || GlobalSize(mMemory) != mCapacity)
-            throw gcnew IOException(String::Format("Failed to allocate {0} bytes of memory", mCapacity), GetLastError());
+        try
+        {
+            mStore = new Native::StaticMemoryStore(mCapacity, ToNative(options));
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+    }
+
+    StaticMemoryStreamOptions^ StaticMemoryStream::ToOptions(NumaPlacement placement, int node)
+    {
+        auto options = gcnew StaticMemoryStreamOptions();
+        options->Placement = placement;
+        options->NumaNode = node;
+        return options;
+    }
+
+    Native::StaticMemoryStoreOptions StaticMemoryStream::ToNative(StaticMemoryStreamOptions ^options)
+    {
+        Native::StaticMemoryStoreOptions storeOptions;
+        storeOptions.Numa = StreamUtils::NativePolicy(options->Placement, options->NumaNode);
+        storeOptions.LargePages = options->LargePages;
+        storeOptions.Prefault = options->Prefault;
+        return storeOptions;
     }
 
     StaticMemoryStream::~StaticMemoryStream()
     {
-        GlobalFree(mMemory);
+        delete mStore;
+        mStore = nullptr;
     }
 
     long long StaticMemoryStream::Seek(long long offset, SeekOrigin origin)
@@ -83,54 +109,142 @@ namespace IO {
         return mPosition;
     }
 
+    void StaticMemoryStream::SetLength(long long value)
+    {
+        if (value < 0)
+            throw gcnew IOException("<value> was expected to be greater than or equal to zero");
+
+        if ((size_t)value >= mCapacity)
+            return;
+
+        Discard(value, (long long)mCapacity - value);
+    }
+
     int StaticMemoryStream::Read(array<unsigned char> ^buffer, int offset, int count)
     {
-        auto readCount = 0;
-        
-        StreamUtils::AssertBufferParameters(mCapacity, mPosition, buffer, offset, count);
+        ReadAt((long long)mPosition, buffer, offset, count);
 
-        auto bufferHandle = GCHandle::Alloc(buffer, GCHandleType::Pinned);
-        auto bufferPointer = (void*)bufferHandle.AddrOfPinnedObject();
+        mPosition += count;
+        return count;
+    }
 
-        auto memoryPointer = GlobalLock(mMemory);
+    void StaticMemoryStream::Write(array<unsigned char> ^buffer, int offset, int count)
+    {
+        WriteAt((long long)mPosition, buffer, offset, count);
 
-        auto actualCount = (int)Math::Min((int)(mCapacity - (mPosition + count)), count);
+        mPosition += count;
+    }
 
-        Memory::Copy(memoryPointer, mPosition, bufferPointer, offset, actualCount);
+    int StaticMemoryStream::ReadAt(long long position, array<unsigned char> ^buffer, int offset, int count)
+    {
+        if (position < 0)
+            throw gcnew IOException("<position> was expected to be greater than or equal to zero");
 
-        mPosition += actualCount;
-        readCount = actualCount;
+        StreamUtils::AssertBufferParameters(mCapacity, (size_t)position, buffer, offset, count);
 
-        GlobalUnlock(mMemory);
-        auto error = GetLastError();
-        if (error != 0)
-            throw gcnew IOException("Failed to unlock memory object", error);
+        pin_ptr<unsigned char> bufferPointer = &buffer[offset];
 
-        bufferHandle.Free();
-        return readCount;
+        try
+        {
+            mStore->Read((size_t)position, bufferPointer, (size_t)count);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+
+        return count;
     }
 
-    void StaticMemoryStream::Write(array<unsigned char> ^buffer, int offset, int count)
+    void StaticMemoryStream::WriteAt(long long position, array<unsigned char> ^buffer, int offset, int count)
     {
-        StreamUtils::AssertBufferParameters(mCapacity, mPosition, buffer, offset, count);
+        if (position < 0)
+            throw gcnew IOException("<position> was expected to be greater than or equal to zero");
 
-        auto bufferHandle = GCHandle::Alloc(buffer, GCHandleType::Pinned);
-        auto bufferPointer = (void*)bufferHandle.AddrOfPinnedObject();
+        StreamUtils::AssertBufferParameters(mCapacity, (size_t)position, buffer, offset, count);
 
-        auto memoryPointer = GlobalLock(mMemory);
+        pin_ptr<unsigned char> bufferPointer = &buffer[offset];
 
-        auto actualCount = (int)Math::Min((int)(mCapacity - (mPosition + count)), count);
+        try
+        {
+            mStore->Write((size_t)position, bufferPointer, (size_t)count);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+    }
 
-        Memory::Copy(bufferPointer, offset, memoryPointer, mPosition, actualCount);
+    void StaticMemoryStream::ReadAt(long long position, void *buffer, size_t count)
+    {
+        StreamUtils::AssertPointerParameters(mCapacity, position, buffer, count);
 
-        mPosition += actualCount;
+        try
+        {
+            mStore->Read((size_t)position, buffer, count);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+    }
+
+    void StaticMemoryStream::WriteAt(long long position, const void *buffer, size_t count)
+    {
+        StreamUtils::AssertPointerParameters(mCapacity, position, buffer, count);
+
+        try
+        {
+            mStore->Write((size_t)position, buffer, count);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+    }
+
+    void StaticMemoryStream::ReadV(array<IoVector> ^vectors)
+    {
+        StreamUtils::AssertVectorParameters(mCapacity, vectors);
+
+        try
+        {
+            for each (auto vector in vectors)
+                mStore->Read((size_t)vector.Position, (void*)vector.Buffer, (size_t)vector.Length);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+    }
 
-        GlobalUnlock(mMemory);
-        auto error = GetLastError();
-        if (error != 0)
-            throw gcnew IOException("Failed to unlock memory object", error);
+    void StaticMemoryStream::WriteV(array<IoVector> ^vectors)
+    {
+        StreamUtils::AssertVectorParameters(mCapacity, vectors);
 
-        bufferHandle.Free();
+        try
+        {
+            for each (auto vector in vectors)
+                mStore->Write((size_t)vector.Position, (const void*)vector.Buffer, (size_t)vector.Length);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+    }
+
+    void StaticMemoryStream::Discard(long long position, long long count)
+    {
+        StreamUtils::AssertRangeParameters(mCapacity, position, count);
+
+        try
+        {
+            mStore->Discard((size_t)position, (size_t)count);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
     }
 
 } // IO
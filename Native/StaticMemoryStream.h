@@ -20,18 +20,31 @@
 
 #include "stdafx.h"
 
+#include "Core/StaticMemoryStore.h"
+#include "IDiscardableStream.h"
+#include "IPositionalStream.h"
+#include "MemoryStreamCounters.h"
+#include "NumaPlacement.h"
+#include "StaticMemoryStreamOptions.h"
+
 using namespace System;
 using namespace System::IO;
 
 namespace nDiscUtils {
     namespace IO {
 
-        public ref class StaticMemoryStream : Stream, IDisposable
+        public ref class StaticMemoryStream : Stream, IDisposable, IPositionalStream, IDiscardableStream
         {
 
         public:
             StaticMemoryStream(long long capacity);
 
+            // The whole region is placed at once, local placement follows
+            // the constructing thread
+            StaticMemoryStream(long long capacity, NumaPlacement placement, int node);
+
+            StaticMemoryStream(long long capacity, StaticMemoryStreamOptions ^options);
+
             ~StaticMemoryStream();
 
             property bool CanRead
@@ -74,6 +87,24 @@ namespace nDiscUtils {
                 }
             }
 
+            // Whether the region is backed by large pages
+            property bool LargePages
+            {
+                bool get()
+                {
+                    return mStore->LargePages();
+                }
+            }
+
+            // Requests, allocations and latencies since creation or ResetCounters()
+            property MemoryStreamCounters ^Counters
+            {
+                MemoryStreamCounters^ get()
+                {
+                    return gcnew MemoryStreamCounters(mStore->Counters());
+                }
+            }
+
             property long long Position
             {
                 long long get() override
@@ -88,7 +119,9 @@ namespace nDiscUtils {
 
             void Flush() override { }
 
-            void SetLength(long long value) override { }
+            // The capacity is fixed and requests to grow are ignored; shrinking
+            // discards everything behind the new length, which reads back as zero
+            void SetLength(long long value) override;
 
             long long Seek(long long offset, SeekOrigin origin) override;
 
@@ -96,9 +129,34 @@ namespace nDiscUtils {
 
             void Write(array<unsigned char> ^buffer, int offset, int count) override;
 
+            virtual int ReadAt(long long position, array<unsigned char> ^buffer, int offset, int count);
+
+            virtual void WriteAt(long long position, array<unsigned char> ^buffer, int offset, int count);
+
+            // Transfers between the stream and native memory without any pinning
+            void ReadAt(long long position, void *buffer, size_t count);
+
+            void WriteAt(long long position, const void *buffer, size_t count);
+
+            // Performs all segments in order; they are validated before any data is transferred
+            virtual void ReadV(array<IoVector> ^vectors);
+
+            virtual void WriteV(array<IoVector> ^vectors);
+
+            virtual void Discard(long long position, long long count);
+
+            void ResetCounters()
+            {
+                mStore->ResetCounters();
+            }
+
         private:
+            static StaticMemoryStreamOptions^ ToOptions(NumaPlacement placement, int node);
+
+            static Native::StaticMemoryStoreOptions ToNative(StaticMemoryStreamOptions ^options);
+
+            Native::StaticMemoryStore* mStore;
             size_t mCapacity;
-            HGLOBAL mMemory;
 
             size_t mPosition;
 
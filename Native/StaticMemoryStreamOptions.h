@@ -0,0 +1,51 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+#include "NumaPlacement.h"
+
+using namespace System;
+
+namespace nDiscUtils {
+namespace IO {
+
+    public ref class StaticMemoryStreamOptions
+    {
+
+    public:
+        // NUMA nodes the region is placed on
+        property NumaPlacement Placement;
+
+        // Node used by NumaPlacement::Node
+        property int NumaNode;
+
+        // Back the region with large pages where available, falling back to
+        // regular pages; requires the default placement
+        property bool LargePages;
+
+        // Fault the whole region in on all processors while constructing
+        // the stream instead of on first access
+        property bool Prefault;
+
+    };
+
+} // IO
+} // nDiscUtils
@@ -0,0 +1,94 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+using namespace System;
+
+namespace nDiscUtils {
+namespace IO {
+
+    // Completed requests of one kind within a report or a whole run
+    public ref class StreamBenchmarkCounters
+    {
+
+    public:
+        property long long Requests;
+        property long long Bytes;
+
+        property double RequestsPerSecond;
+        property double BytesPerSecond;
+
+        // Service times, percentiles within 1% of the measured value
+        property TimeSpan MeanLatency;
+        property TimeSpan P50Latency;
+        property TimeSpan P99Latency;
+        property TimeSpan P999Latency;
+        property TimeSpan MaxLatency;
+
+    };
+
+    // Progress of StreamBenchmarker::Run, reported once per interval and
+    // once at the end; the counters cover the time since the previous report
+    public ref class StreamBenchmarkProgress
+    {
+
+    public:
+        property TimeSpan Elapsed;
+        property TimeSpan Interval;
+
+        property StreamBenchmarkCounters ^Read;
+        property StreamBenchmarkCounters ^Write;
+
+        // Reads and writes together
+        property StreamBenchmarkCounters ^Total;
+
+    };
+
+    public delegate void StreamBenchmarkProgressHandler(StreamBenchmarkProgress ^progress);
+
+    // Outcome of StreamBenchmarker::Run
+    public ref class StreamBenchmark
+    {
+
+    public:
+        property TimeSpan Elapsed;
+
+        property StreamBenchmarkCounters ^Read;
+        property StreamBenchmarkCounters ^Write;
+        property StreamBenchmarkCounters ^Total;
+
+        // Position of the request which failed and the reason; the run
+        // stops at the first failure
+        property long long FailedPosition;
+        property String ^Failure;
+
+        property bool Succeeded
+        {
+            bool get()
+            {
+                return Failure == nullptr;
+            }
+        }
+
+    };
+
+} // IO
+} // nDiscUtils
@@ -0,0 +1,83 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+using namespace System;
+
+namespace nDiscUtils {
+namespace IO {
+
+    public enum class AccessPattern
+    {
+        // Each thread walks its own share of the target and starts over at its end
+        Sequential,
+
+        Random,
+
+        // Few hot blocks, scattered across the target, take most requests
+        Zipfian
+    };
+
+    public ref class StreamBenchmarkOptions
+    {
+
+    public:
+        StreamBenchmarkOptions()
+        {
+            Threads = 1;
+            QueueDepth = 1;
+            BlockSize = 4096;
+            ReadPercentage = 100;
+            Pattern = AccessPattern::Random;
+            ZipfTheta = 1.2;
+            ReportInterval = TimeSpan::FromSeconds(1);
+        }
+
+        // Threads issuing requests and the requests each keeps in flight
+        property int Threads;
+        property int QueueDepth;
+
+        // Bytes per request, which are aligned to it
+        property int BlockSize;
+
+        // Share of reads among all requests, 0 to 100
+        property int ReadPercentage;
+
+        property AccessPattern Pattern;
+
+        // Skew of the zipfian pattern, larger values concentrate the
+        // requests on fewer blocks
+        property double ZipfTheta;
+
+        // The run ends after Duration or once Size bytes were transferred,
+        // whichever comes first; zero disables either limit, but not both
+        property TimeSpan Duration;
+        property long long Size;
+
+        property TimeSpan ReportInterval;
+
+        // Selects the blocks and the data written to them
+        property long long Seed;
+
+    };
+
+} // IO
+} // nDiscUtils
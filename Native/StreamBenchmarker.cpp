@@ -0,0 +1,354 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "stdafx.h"
+
+#include "DynamicMemoryStream.h"
+#include "StaticMemoryStream.h"
+#include "StreamBenchmarker.h"
+#include "StreamUtils.h"
+
+#include "Core/ImageFile.h"
+#include "Core/MemoryKernels.h"
+
+#include <algorithm>
+#include <memory>
+
+#include <vcclr.h>
+
+using namespace System;
+using namespace System::IO;
+using namespace System::Runtime::ExceptionServices;
+
+namespace nDiscUtils {
+namespace IO {
+
+    namespace {
+
+        TimeSpan ToTimeSpan(double seconds)
+        {
+            return TimeSpan::FromTicks((long long)(seconds * TimeSpan::TicksPerSecond));
+        }
+
+        TimeSpan FromNanoseconds(uint64_t nanoseconds)
+        {
+            return TimeSpan::FromTicks((long long)(nanoseconds / 100));
+        }
+
+        StreamBenchmarkCounters^ ToManaged(const Native::BenchmarkCounters& counters, double seconds)
+        {
+            auto managedCounters = gcnew StreamBenchmarkCounters();
+            managedCounters->Requests = (long long)counters.Requests;
+            managedCounters->Bytes = (long long)counters.Bytes;
+            managedCounters->RequestsPerSecond = (seconds <= 0.0 ? 0.0 : counters.Requests / seconds);
+            managedCounters->BytesPerSecond = (seconds <= 0.0 ? 0.0 : counters.Bytes / seconds);
+            managedCounters->MeanLatency = ToTimeSpan(counters.Latency.Mean() / 1e9);
+            managedCounters->P50Latency = FromNanoseconds(counters.Latency.Percentile(50.0));
+            managedCounters->P99Latency = FromNanoseconds(counters.Latency.Percentile(99.0));
+            managedCounters->P999Latency = FromNanoseconds(counters.Latency.Percentile(99.9));
+            managedCounters->MaxLatency = FromNanoseconds(counters.Latency.Max());
+            return managedCounters;
+        }
+
+        StreamBenchmarkCounters^ ToManagedTotal(const Native::BenchmarkCounters& read,
+            const Native::BenchmarkCounters& write, double seconds)
+        {
+            Native::BenchmarkCounters total;
+            total.Merge(read);
+            total.Merge(write);
+            return ToManaged(total, seconds);
+        }
+
+        // Ramdisk streams are transferred to directly; any other stream goes
+        // through a managed buffer one request at a time
+        class StreamTarget : public Native::BenchmarkTarget
+        {
+
+        public:
+            StreamTarget(Stream ^stream, size_t blockBytes) :
+                mStream(stream),
+                mStaticStream(dynamic_cast<StaticMemoryStream^>(stream)),
+                mDynamicStream(dynamic_cast<DynamicMemoryStream^>(stream))
+            {
+                if (!Concurrent())
+                    mBuffer = gcnew array<unsigned char>((int)blockBytes);
+            }
+
+            void Read(uint64_t offset, void* buffer, size_t count) override
+            {
+                try
+                {
+                    StaticMemoryStream ^staticStream = mStaticStream;
+                    DynamicMemoryStream ^dynamicStream = mDynamicStream;
+                    if (staticStream != nullptr)
+                        return staticStream->ReadAt((long long)offset, buffer, count);
+                    if (dynamicStream != nullptr)
+                        return dynamicStream->ReadAt((long long)offset, buffer, count);
+
+                    Stream ^stream = mStream;
+                    array<unsigned char> ^managedBuffer = mBuffer;
+                    stream->Position = (long long)offset;
+
+                    auto total = 0;
+                    while (total < (int)count)
+                    {
+                        auto read = stream->Read(managedBuffer, total, (int)count - total);
+                        if (read <= 0)
+                            throw gcnew EndOfStreamException("Stream ends before the requested block");
+
+                        total += read;
+                    }
+
+                    pin_ptr<unsigned char> bufferPointer = &managedBuffer[0];
+                    Native::MemoryKernels::Copy(buffer, bufferPointer, count);
+                }
+                catch (Exception ^ex)
+                {
+                    throw Native::NativeException(Native::NativeError::IO, StreamUtils::NativePath(ex->Message));
+                }
+            }
+
+            void Write(uint64_t offset, const void* buffer, size_t count) override
+            {
+                try
+                {
+                    StaticMemoryStream ^staticStream = mStaticStream;
+                    DynamicMemoryStream ^dynamicStream = mDynamicStream;
+                    if (staticStream != nullptr)
+                        return staticStream->WriteAt((long long)offset, buffer, count);
+                    if (dynamicStream != nullptr)
+                        return dynamicStream->WriteAt((long long)offset, buffer, count);
+
+                    Stream ^stream = mStream;
+                    array<unsigned char> ^managedBuffer = mBuffer;
+
+                    {
+                        pin_ptr<unsigned char> bufferPointer = &managedBuffer[0];
+                        Native::MemoryKernels::Copy(bufferPointer, buffer, count);
+                    }
+
+                    stream->Position = (long long)offset;
+                    stream->Write(managedBuffer, 0, (int)count);
+                }
+                catch (Exception ^ex)
+                {
+                    throw Native::NativeException(Native::NativeError::IO, StreamUtils::NativePath(ex->Message));
+                }
+            }
+
+            bool Concurrent() const override
+            {
+                StaticMemoryStream ^staticStream = mStaticStream;
+                DynamicMemoryStream ^dynamicStream = mDynamicStream;
+                return staticStream != nullptr || dynamicStream != nullptr;
+            }
+
+        private:
+            gcroot<Stream^> mStream;
+            gcroot<StaticMemoryStream^> mStaticStream;
+            gcroot<DynamicMemoryStream^> mDynamicStream;
+            gcroot<array<unsigned char>^> mBuffer;
+
+        };
+
+        class FileTarget : public Native::BenchmarkTarget
+        {
+
+        public:
+            explicit FileTarget(Native::ImageFile* file) :
+                mFile(file) { }
+
+            void Read(uint64_t offset, void* buffer, size_t count) override
+            {
+                mFile->ReadAt(offset, buffer, count);
+            }
+
+            void Write(uint64_t offset, const void* buffer, size_t count) override
+            {
+                mFile->WriteAt(offset, buffer, count);
+            }
+
+            bool Concurrent() const override
+            {
+                return true;
+            }
+
+        private:
+            Native::ImageFile* mFile;
+
+        };
+
+        // Forwards the engine's reports to the handler. Managed exceptions
+        // may not unwind through the engine, so they are kept aside and
+        // replaced by a NativeException which stops the run.
+        class ProgressSink : public Native::BenchmarkProgressSink
+        {
+
+        public:
+            explicit ProgressSink(StreamBenchmarkProgressHandler ^handler) :
+                mHandler(handler) { }
+
+            void Report(const Native::BenchmarkProgress& progress) override
+            {
+                try
+                {
+                    auto managedProgress = gcnew StreamBenchmarkProgress();
+                    managedProgress->Elapsed = ToTimeSpan(progress.ElapsedSeconds);
+                    managedProgress->Interval = ToTimeSpan(progress.IntervalSeconds);
+                    managedProgress->Read = ToManaged(progress.Read, progress.IntervalSeconds);
+                    managedProgress->Write = ToManaged(progress.Write, progress.IntervalSeconds);
+                    managedProgress->Total = ToManagedTotal(progress.Read, progress.Write, progress.IntervalSeconds);
+
+                    StreamBenchmarkProgressHandler ^handler = mHandler;
+                    handler(managedProgress);
+                }
+                catch (Exception ^ex)
+                {
+                    mException = ExceptionDispatchInfo::Capture(ex);
+                    throw Native::NativeException(Native::NativeError::IO, "Progress handler failed");
+                }
+            }
+
+            // Throws the exception of the handler, if any
+            void Rethrow()
+            {
+                ExceptionDispatchInfo ^exception = mException;
+                if (exception != nullptr)
+                    exception->Throw();
+            }
+
+        private:
+            gcroot<StreamBenchmarkProgressHandler^> mHandler;
+            gcroot<ExceptionDispatchInfo^> mException;
+
+        };
+
+    } // namespace
+
+    StreamBenchmarker::StreamBenchmarker(StreamBenchmarkOptions ^options)
+    {
+        if (options == nullptr)
+            throw gcnew ArgumentNullException("options");
+        if (options->Threads <= 0)
+            throw gcnew ArgumentOutOfRangeException("options", "<Threads> was expected to be greater than zero");
+        if (options->QueueDepth <= 0)
+            throw gcnew ArgumentOutOfRangeException("options", "<QueueDepth> was expected to be greater than zero");
+        if (options->BlockSize <= 0)
+            throw gcnew ArgumentOutOfRangeException("options", "<BlockSize> was expected to be greater than zero");
+        if (options->ReadPercentage < 0 || options->ReadPercentage > 100)
+            throw gcnew ArgumentOutOfRangeException("options", "<ReadPercentage> was expected to be between 0 and 100");
+        if (options->Pattern == AccessPattern::Zipfian && !(options->ZipfTheta > 0.0))
+            throw gcnew ArgumentOutOfRangeException("options", "<ZipfTheta> was expected to be greater than zero");
+        if (options->Duration < TimeSpan::Zero || options->Size < 0 ||
+            (options->Duration == TimeSpan::Zero && options->Size == 0))
+            throw gcnew ArgumentOutOfRangeException("options", "<Duration> or <Size> was expected to be greater than zero");
+        if (options->ReportInterval <= TimeSpan::Zero)
+            throw gcnew ArgumentOutOfRangeException("options", "<ReportInterval> was expected to be greater than zero");
+
+        Native::BenchmarkEngineOptions nativeOptions;
+        nativeOptions.Threads = (size_t)options->Threads;
+        nativeOptions.Depth = (size_t)options->QueueDepth;
+        nativeOptions.BlockBytes = (size_t)options->BlockSize;
+        nativeOptions.ReadPercent = (unsigned)options->ReadPercentage;
+        nativeOptions.Pattern = (Native::AccessPattern)options->Pattern;
+        nativeOptions.ZipfTheta = options->ZipfTheta;
+        nativeOptions.Seconds = options->Duration.TotalSeconds;
+        nativeOptions.Bytes = (uint64_t)options->Size;
+        nativeOptions.ProgressInterval = options->ReportInterval.TotalSeconds;
+        nativeOptions.Seed = (uint64_t)options->Seed;
+
+        mEngine = new Native::BenchmarkEngine(nativeOptions);
+    }
+
+    StreamBenchmarker::~StreamBenchmarker()
+    {
+        delete mEngine;
+        mEngine = nullptr;
+    }
+
+    StreamBenchmark^ StreamBenchmarker::Run(Stream ^target, long long length, StreamBenchmarkProgressHandler ^progress)
+    {
+        if (target == nullptr)
+            throw gcnew ArgumentNullException("target");
+        if (length < 0)
+            throw gcnew ArgumentOutOfRangeException("length", "<length> may not be negative");
+
+        StreamTarget streamTarget(target, mEngine->Options().BlockBytes);
+        return Run(streamTarget, length, progress);
+    }
+
+    StreamBenchmark^ StreamBenchmarker::Run(String ^path, long long length, bool unbuffered, bool writeThrough,
+        StreamBenchmarkProgressHandler ^progress)
+    {
+        if (path == nullptr)
+            throw gcnew ArgumentNullException("path");
+        if (length < 0)
+            throw gcnew ArgumentOutOfRangeException("length", "<length> may not be negative");
+
+        std::unique_ptr<Native::ImageFile> file;
+        try
+        {
+            file.reset(Native::ImageFile::Open(StreamUtils::NativePath(path), Native::ImageFileMode::Write,
+                unbuffered, writeThrough));
+
+            // Raw devices do not necessarily report a length
+            if (length == 0)
+                length = (long long)file->Length();
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+
+        FileTarget fileTarget(file.get());
+        return Run(fileTarget, length, progress);
+    }
+
+    StreamBenchmark^ StreamBenchmarker::Run(Native::BenchmarkTarget& target, long long length,
+        StreamBenchmarkProgressHandler ^progress)
+    {
+        ProgressSink sink(progress);
+
+        Native::BenchmarkResult result;
+        try
+        {
+            result = mEngine->Run(target, (uint64_t)length, (progress != nullptr ? &sink : nullptr));
+        }
+        catch (const Native::NativeException& ex)
+        {
+            sink.Rethrow();
+            StreamUtils::ThrowManaged(ex);
+        }
+
+        auto benchmark = gcnew StreamBenchmark();
+        benchmark->Elapsed = ToTimeSpan(result.Seconds);
+        benchmark->Read = ToManaged(result.Read, result.Seconds);
+        benchmark->Write = ToManaged(result.Write, result.Seconds);
+        benchmark->Total = ToManagedTotal(result.Read, result.Write, result.Seconds);
+
+        if (result.Failed)
+        {
+            benchmark->FailedPosition = (long long)result.FailedOffset;
+            benchmark->Failure = gcnew String(result.Failure.c_str());
+        }
+
+        return benchmark;
+    }
+
+} // IO
+} // nDiscUtils
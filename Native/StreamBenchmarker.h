@@ -0,0 +1,66 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+#include "Core/BenchmarkEngine.h"
+#include "StreamBenchmark.h"
+#include "StreamBenchmarkOptions.h"
+
+using namespace System;
+using namespace System::IO;
+
+namespace nDiscUtils {
+namespace IO {
+
+    // Measures files, raw devices and streams with the native benchmark
+    // engine: Threads * QueueDepth requests of BlockSize bytes are in
+    // flight at any time, and every report carries IOPS, bandwidth and
+    // latency percentiles of reads and writes.
+    public ref class StreamBenchmarker
+    {
+
+    public:
+        StreamBenchmarker(StreamBenchmarkOptions ^options);
+
+        ~StreamBenchmarker();
+
+        // Issues requests to the first length bytes of a stream, which must
+        // only be used by this call meanwhile. Ramdisk streams are accessed
+        // concurrently without any copies, others one request at a time.
+        // Progress may be null and is invoked on the calling thread.
+        StreamBenchmark^ Run(Stream ^target, long long length, StreamBenchmarkProgressHandler ^progress);
+
+        // Issues requests to the first length bytes of an existing file or
+        // raw device, all of it if length is zero. Unbuffered requests
+        // bypass the system cache and write-through ones return once the data
+        // reached the device.
+        StreamBenchmark^ Run(String ^path, long long length, bool unbuffered, bool writeThrough,
+            StreamBenchmarkProgressHandler ^progress);
+
+    private:
+        StreamBenchmark^ Run(Native::BenchmarkTarget& target, long long length, StreamBenchmarkProgressHandler ^progress);
+
+        Native::BenchmarkEngine* mEngine;
+
+    };
+
+} // IO
+} // nDiscUtils
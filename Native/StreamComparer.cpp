@@ -0,0 +1,100 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "stdafx.h"
+
+#include "StreamComparer.h"
+#include "StreamSource.h"
+#include "StreamUtils.h"
+
+using namespace System;
+using namespace System::IO;
+
+namespace nDiscUtils {
+namespace IO {
+
+    StreamComparer::StreamComparer(int chunkSize, int depth, int threads) :
+        StreamComparer(chunkSize, depth, threads, 4096) { }
+
+    StreamComparer::StreamComparer(int chunkSize, int depth, int threads, int maxRanges)
+    {
+        if (chunkSize <= 0)
+            throw gcnew ArgumentOutOfRangeException("chunkSize", "<chunkSize> was expected to be greater than zero");
+        if (depth <= 0)
+            throw gcnew ArgumentOutOfRangeException("depth", "<depth> was expected to be greater than zero");
+        if (threads < 0)
+            throw gcnew ArgumentOutOfRangeException("threads", "<threads> may not be negative");
+        if (maxRanges < 0)
+            throw gcnew ArgumentOutOfRangeException("maxRanges", "<maxRanges> may not be negative");
+
+        Native::CompareEngineOptions options;
+        options.ChunkBytes = (size_t)chunkSize;
+        options.Depth = (size_t)depth;
+        options.Threads = (size_t)threads;
+        options.MaxRanges = (size_t)maxRanges;
+
+        mEngine = new Native::CompareEngine(options);
+    }
+
+    StreamComparer::~StreamComparer()
+    {
+        delete mEngine;
+        mEngine = nullptr;
+    }
+
+    StreamComparison^ StreamComparer::Compare(Stream ^left, Stream ^right, long long length)
+    {
+        if (left == nullptr)
+            throw gcnew ArgumentNullException("left");
+        if (right == nullptr)
+            throw gcnew ArgumentNullException("right");
+        if (length < 0)
+            throw gcnew ArgumentOutOfRangeException("length", "<length> may not be negative");
+
+        auto leftSource = StreamSource::For(left, mEngine->Options().ChunkBytes);
+        auto rightSource = StreamSource::For(right, mEngine->Options().ChunkBytes);
+
+        Native::CompareResult result;
+        try
+        {
+            result = mEngine->Compare(*leftSource, *rightSource, (uint64_t)length);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+
+        auto comparison = gcnew StreamComparison();
+        comparison->ComparedBytes = (long long)result.ComparedBytes;
+        comparison->DifferingBytes = (long long)result.DifferingBytes;
+        comparison->DifferingRangeCount = (long long)result.DifferingRanges;
+
+        comparison->Ranges = gcnew array<DifferingRange>((int)result.Ranges.size());
+        for (size_t i = 0; i < result.Ranges.size(); i++)
+            comparison->Ranges[(int)i] = DifferingRange((long long)result.Ranges[i].Offset, (long long)result.Ranges[i].Length);
+
+        comparison->FailedSide = (CompareSide)result.FailedSide;
+        comparison->FailedPosition = (long long)result.FailedOffset;
+        if (result.FailedSide != Native::CompareSide::None)
+            comparison->Failure = gcnew String(result.Failure.c_str());
+
+        return comparison;
+    }
+
+} // IO
+} // nDiscUtils
@@ -0,0 +1,55 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+#include "Core/CompareEngine.h"
+#include "StreamComparison.h"
+
+using namespace System;
+using namespace System::IO;
+
+namespace nDiscUtils {
+namespace IO {
+
+    // Compares two streams with the native compare engine: both streams are
+    // read at the same time on their own threads, chunkSize bytes per
+    // request and up to depth chunks ahead, while filled chunks are compared
+    // on up to threads threads (zero for one per core)
+    public ref class StreamComparer
+    {
+
+    public:
+        StreamComparer(int chunkSize, int depth, int threads);
+        StreamComparer(int chunkSize, int depth, int threads, int maxRanges);
+
+        ~StreamComparer();
+
+        // Compares the first length bytes of both streams, starting at their
+        // beginning. Each stream must only be used by this call meanwhile.
+        StreamComparison^ Compare(Stream ^left, Stream ^right, long long length);
+
+    private:
+        Native::CompareEngine* mEngine;
+
+    };
+
+} // IO
+} // nDiscUtils
@@ -0,0 +1,69 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+#include "DifferingRange.h"
+
+using namespace System;
+
+namespace nDiscUtils {
+namespace IO {
+
+    public enum class CompareSide
+    {
+        None,
+        Left,
+        Right
+    };
+
+    // Outcome of StreamComparer::Compare
+    public ref class StreamComparison
+    {
+
+    public:
+        // Leading bytes which were compared before the end or a failure
+        property long long ComparedBytes;
+
+        property long long DifferingBytes;
+
+        // Number of differing ranges, which may exceed the listed ones
+        property long long DifferingRangeCount;
+
+        property array<DifferingRange> ^Ranges;
+
+        // Stream which failed to read or ended early, the position of the
+        // failed request and the reason
+        property CompareSide FailedSide;
+        property long long FailedPosition;
+        property String ^Failure;
+
+        property bool Equal
+        {
+            bool get()
+            {
+                return FailedSide == CompareSide::None && DifferingBytes == 0;
+            }
+        }
+
+    };
+
+} // IO
+} // nDiscUtils
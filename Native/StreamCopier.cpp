@@ -0,0 +1,194 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "stdafx.h"
+
+#include "StreamCopier.h"
+#include "StreamSource.h"
+#include "StreamTarget.h"
+#include "StreamUtils.h"
+
+#include <memory>
+#include <vector>
+
+#include <vcclr.h>
+
+using namespace System;
+using namespace System::IO;
+using namespace System::Runtime::ExceptionServices;
+
+namespace nDiscUtils {
+namespace IO {
+
+    namespace {
+
+        TimeSpan ToTimeSpan(double seconds)
+        {
+            return TimeSpan::FromTicks((long long)(seconds * TimeSpan::TicksPerSecond));
+        }
+
+        // Forwards the engine's reports to the handler. Managed exceptions
+        // may not unwind through the engine, so they are kept aside and
+        // replaced by a NativeException which stops the copy.
+        class ProgressSink : public Native::CopyProgressSink
+        {
+
+        public:
+            explicit ProgressSink(StreamCopyProgressHandler ^handler) :
+                mHandler(handler) { }
+
+            void Report(const Native::CopyProgress& progress) override
+            {
+                try
+                {
+                    auto managedProgress = gcnew StreamCopyProgress();
+                    managedProgress->CopiedBytes = (long long)progress.CopiedBytes;
+                    managedProgress->SkippedBytes = (long long)progress.SkippedBytes;
+                    managedProgress->TotalBytes = (long long)progress.TotalBytes;
+                    managedProgress->BytesPerSecond = progress.BytesPerSecond();
+                    managedProgress->ReadLatency = ToTimeSpan(progress.IntervalRead.MeanSeconds());
+                    managedProgress->MaxReadLatency = ToTimeSpan(progress.IntervalRead.MaxSeconds);
+                    managedProgress->WriteLatency = ToTimeSpan(progress.IntervalWrite.MeanSeconds());
+                    managedProgress->MaxWriteLatency = ToTimeSpan(progress.IntervalWrite.MaxSeconds);
+
+                    StreamCopyProgressHandler ^handler = mHandler;
+                    handler(managedProgress);
+                }
+                catch (Exception ^ex)
+                {
+                    mException = ExceptionDispatchInfo::Capture(ex);
+                    throw Native::NativeException(Native::NativeError::IO, "Progress handler failed");
+                }
+            }
+
+            // Throws the exception of the handler, if any
+            void Rethrow()
+            {
+                ExceptionDispatchInfo ^exception = mException;
+                if (exception != nullptr)
+                    exception->Throw();
+            }
+
+        private:
+            gcroot<StreamCopyProgressHandler^> mHandler;
+            gcroot<ExceptionDispatchInfo^> mException;
+
+        };
+
+    } // namespace
+
+    StreamCopier::StreamCopier(int chunkSize, int depth) :
+        StreamCopier(chunkSize, depth, TimeSpan::FromSeconds(1)) { }
+
+    StreamCopier::StreamCopier(int chunkSize, int depth, TimeSpan progressInterval) :
+        StreamCopier(chunkSize, depth, progressInterval, 0) { }
+
+    StreamCopier::StreamCopier(int chunkSize, int depth, TimeSpan progressInterval, int sparseSize)
+    {
+        if (chunkSize <= 0)
+            throw gcnew ArgumentOutOfRangeException("chunkSize", "<chunkSize> was expected to be greater than zero");
+        if (depth <= 0)
+            throw gcnew ArgumentOutOfRangeException("depth", "<depth> was expected to be greater than zero");
+        if (progressInterval <= TimeSpan::Zero)
+            throw gcnew ArgumentOutOfRangeException("progressInterval", "<progressInterval> was expected to be greater than zero");
+        if (sparseSize < 0 || (sparseSize != 0 && (chunkSize % sparseSize) != 0))
+            throw gcnew ArgumentOutOfRangeException("sparseSize", "<sparseSize> was expected to divide <chunkSize>");
+
+        Native::CopyEngineOptions options;
+        options.ChunkBytes = (size_t)chunkSize;
+        options.Depth = (size_t)depth;
+        options.ProgressInterval = progressInterval.TotalSeconds;
+        options.SparseBytes = (size_t)sparseSize;
+
+        mEngine = new Native::CopyEngine(options);
+    }
+
+    StreamCopier::~StreamCopier()
+    {
+        delete mEngine;
+        mEngine = nullptr;
+    }
+
+    StreamCopy^ StreamCopier::Copy(Stream ^source, Stream ^destination, long long length, StreamCopyProgressHandler ^progress)
+    {
+        return Copy(source, destination, length, nullptr, false, progress);
+    }
+
+    StreamCopy^ StreamCopier::Copy(Stream ^source, Stream ^destination, long long length, array<DataExtent> ^allocated,
+        bool destinationZeroed, StreamCopyProgressHandler ^progress)
+    {
+        if (source == nullptr)
+            throw gcnew ArgumentNullException("source");
+        if (destination == nullptr)
+            throw gcnew ArgumentNullException("destination");
+        if (length < 0)
+            throw gcnew ArgumentOutOfRangeException("length", "<length> may not be negative");
+
+        std::unique_ptr<Native::ExtentMap> extents;
+        if (allocated != nullptr)
+        {
+            std::vector<Native::DataExtent> nativeExtents;
+            nativeExtents.reserve((size_t)allocated->Length);
+
+            for each (auto extent in allocated)
+            {
+                if (extent.Offset < 0 || extent.Length < 0)
+                    throw gcnew ArgumentOutOfRangeException("allocated", "Extents may not be negative");
+
+                nativeExtents.push_back(Native::DataExtent { (uint64_t)extent.Offset, (uint64_t)extent.Length });
+            }
+
+            extents.reset(new Native::ExtentMap(std::move(nativeExtents)));
+        }
+
+        auto streamSource = StreamSource::For(source, mEngine->Options().ChunkBytes, extents.get());
+        StreamTarget streamTarget(destination, mEngine->Options().ChunkBytes, destinationZeroed);
+        ProgressSink sink(progress);
+
+        Native::CopyResult result;
+        try
+        {
+            result = mEngine->Copy(*streamSource, streamTarget, (uint64_t)length,
+                (progress != nullptr ? &sink : nullptr));
+        }
+        catch (const Native::NativeException& ex)
+        {
+            sink.Rethrow();
+            StreamUtils::ThrowManaged(ex);
+        }
+
+        auto copy = gcnew StreamCopy();
+        copy->CopiedBytes = (long long)result.CopiedBytes;
+        copy->SkippedBytes = (long long)result.SkippedBytes;
+        copy->UnreadBytes = (long long)result.UnreadBytes;
+        copy->Elapsed = ToTimeSpan(result.Seconds);
+        copy->ReadLatency = ToTimeSpan(result.Read.MeanSeconds());
+        copy->MaxReadLatency = ToTimeSpan(result.Read.MaxSeconds);
+        copy->WriteLatency = ToTimeSpan(result.Write.MeanSeconds());
+        copy->MaxWriteLatency = ToTimeSpan(result.Write.MaxSeconds);
+
+        copy->FailedSide = (CopySide)result.FailedSide;
+        copy->FailedPosition = (long long)result.FailedOffset;
+        if (result.FailedSide != Native::CopySide::None)
+            copy->Failure = gcnew String(result.Failure.c_str());
+
+        return copy;
+    }
+
+} // IO
+} // nDiscUtils
@@ -0,0 +1,68 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+#include "Core/CopyEngine.h"
+#include "DataExtent.h"
+#include "StreamCopy.h"
+
+using namespace System;
+using namespace System::IO;
+
+namespace nDiscUtils {
+namespace IO {
+
+    // Copies one stream to another with the native copy engine: the source
+    // is read chunkSize bytes per request into a ring of depth page-aligned
+    // buffers on one thread while filled chunks are written on another, so
+    // both streams are busy at the same time. With a sparse size, runs of
+    // zeros of that granularity are not written and unallocated ranges of
+    // the source are not read.
+    public ref class StreamCopier
+    {
+
+    public:
+        StreamCopier(int chunkSize, int depth);
+        StreamCopier(int chunkSize, int depth, TimeSpan progressInterval);
+        StreamCopier(int chunkSize, int depth, TimeSpan progressInterval, int sparseSize);
+
+        ~StreamCopier();
+
+        // Copies the first length bytes of the source to the same positions
+        // of the destination and flushes it. Each stream must only be used by
+        // this call meanwhile; progress may be null and is invoked on the
+        // calling thread.
+        StreamCopy^ Copy(Stream ^source, Stream ^destination, long long length, StreamCopyProgressHandler ^progress);
+
+        // Sparse copies only read the allocated extents of the source, all of
+        // it if null. Zeros are discarded on an IDiscardableStream destination
+        // and skipped on a destination which is known to be zeroed, e.g. a
+        // newly created sparse file; they are written to any other one.
+        StreamCopy^ Copy(Stream ^source, Stream ^destination, long long length, array<DataExtent> ^allocated,
+            bool destinationZeroed, StreamCopyProgressHandler ^progress);
+
+    private:
+        Native::CopyEngine* mEngine;
+
+    };
+
+} // IO
+} // nDiscUtils
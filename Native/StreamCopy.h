@@ -0,0 +1,96 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+using namespace System;
+
+namespace nDiscUtils {
+namespace IO {
+
+    public enum class CopySide
+    {
+        None,
+        Source,
+        Destination
+    };
+
+    // Progress of StreamCopier::Copy, reported once per interval and once at
+    // the end; rates and latencies cover the time since the previous report
+    public ref class StreamCopyProgress
+    {
+
+    public:
+        // Bytes written or skipped so far, which are not necessarily contiguous
+        property long long CopiedBytes;
+        property long long SkippedBytes;
+        property long long TotalBytes;
+
+        property double BytesPerSecond;
+
+        // Mean and maximum service time of the completed requests
+        property TimeSpan ReadLatency;
+        property TimeSpan MaxReadLatency;
+        property TimeSpan WriteLatency;
+        property TimeSpan MaxWriteLatency;
+
+    };
+
+    public delegate void StreamCopyProgressHandler(StreamCopyProgress ^progress);
+
+    // Outcome of StreamCopier::Copy
+    public ref class StreamCopy
+    {
+
+    public:
+        // Leading bytes which were written or skipped before the end or a failure
+        property long long CopiedBytes;
+
+        // Zeros which were not written to the destination, and unallocated
+        // ranges of the source which were not read
+        property long long SkippedBytes;
+        property long long UnreadBytes;
+
+        property TimeSpan Elapsed;
+
+        // Mean and maximum service time of all requests
+        property TimeSpan ReadLatency;
+        property TimeSpan MaxReadLatency;
+        property TimeSpan WriteLatency;
+        property TimeSpan MaxWriteLatency;
+
+        // Stream which failed or ended early, the position of the failed
+        // request and the reason
+        property CopySide FailedSide;
+        property long long FailedPosition;
+        property String ^Failure;
+
+        property bool Succeeded
+        {
+            bool get()
+            {
+                return FailedSide == CopySide::None;
+            }
+        }
+
+    };
+
+} // IO
+} // nDiscUtils
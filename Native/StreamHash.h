@@ -0,0 +1,80 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+using namespace System;
+
+namespace nDiscUtils {
+namespace IO {
+
+    public enum class HashAlgorithm
+    {
+        Crc32c,
+        XxHash3,
+        Sha256
+    };
+
+    // Outcome of StreamHasher::Hash
+    public ref class StreamHash
+    {
+
+    public:
+        property HashAlgorithm Algorithm;
+
+        // Bytes covered by each block digest
+        property int BlockSize;
+
+        property int DigestSize;
+
+        // Leading bytes which were hashed before the end or a failure
+        property long long HashedBytes;
+
+        // Digest of all data in the form the algorithm's own tools print,
+        // null after a failure
+        property array<unsigned char> ^Digest;
+
+        // DigestSize bytes per block within HashedBytes
+        property array<unsigned char> ^BlockDigests;
+
+        property int BlockCount
+        {
+            int get()
+            {
+                return BlockDigests->Length / DigestSize;
+            }
+        }
+
+        // Position of the failed request and the reason
+        property long long FailedPosition;
+        property String ^Failure;
+
+        property bool Succeeded
+        {
+            bool get()
+            {
+                return Failure == nullptr;
+            }
+        }
+
+    };
+
+} // IO
+} // nDiscUtils
@@ -0,0 +1,151 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "stdafx.h"
+
+#include "StreamHasher.h"
+#include "StreamSource.h"
+#include "StreamUtils.h"
+
+#include "Core/MemoryKernels.h"
+
+using namespace System;
+using namespace System::IO;
+
+namespace nDiscUtils {
+namespace IO {
+
+    StreamHasher::StreamHasher(HashAlgorithm algorithm, int blockSize) :
+        StreamHasher(algorithm, blockSize, Math::Max(blockSize, 4 << 20), 4, 0) { }
+
+    StreamHasher::StreamHasher(HashAlgorithm algorithm, int blockSize, int chunkSize, int depth, int threads)
+    {
+        if (algorithm != HashAlgorithm::Crc32c && algorithm != HashAlgorithm::XxHash3 && algorithm != HashAlgorithm::Sha256)
+            throw gcnew ArgumentOutOfRangeException("algorithm", "<algorithm> is not a known hash algorithm");
+        if (blockSize <= 0)
+            throw gcnew ArgumentOutOfRangeException("blockSize", "<blockSize> was expected to be greater than zero");
+        if (chunkSize <= 0)
+            throw gcnew ArgumentOutOfRangeException("chunkSize", "<chunkSize> was expected to be greater than zero");
+        if (depth <= 0)
+            throw gcnew ArgumentOutOfRangeException("depth", "<depth> was expected to be greater than zero");
+        if (threads < 0)
+            throw gcnew ArgumentOutOfRangeException("threads", "<threads> may not be negative");
+
+        Native::HashEngineOptions options;
+        options.Algorithm = (Native::HashAlgorithm)algorithm;
+        options.BlockBytes = (size_t)blockSize;
+        options.ChunkBytes = (size_t)chunkSize;
+        options.Depth = (size_t)depth;
+        options.Threads = (size_t)threads;
+
+        try
+        {
+            mEngine = new Native::HashEngine(options);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+    }
+
+    StreamHasher::~StreamHasher()
+    {
+        delete mEngine;
+        mEngine = nullptr;
+    }
+
+    StreamHash^ StreamHasher::Hash(Stream ^stream, long long length)
+    {
+        if (stream == nullptr)
+            throw gcnew ArgumentNullException("stream");
+        if (length < 0)
+            throw gcnew ArgumentOutOfRangeException("length", "<length> may not be negative");
+
+        auto blocks = (length + BlockSize - 1) / BlockSize;
+        if (blocks > Int32::MaxValue / DigestSize(Algorithm))
+            throw gcnew ArgumentOutOfRangeException("length", "<length> has more blocks than the block list can hold");
+
+        auto source = StreamSource::For(stream, mEngine->Options().ChunkBytes);
+
+        Native::HashResult result;
+        try
+        {
+            result = mEngine->Hash(*source, (uint64_t)length);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+
+        auto hash = gcnew StreamHash();
+        hash->Algorithm = Algorithm;
+        hash->BlockSize = BlockSize;
+        hash->DigestSize = DigestSize(Algorithm);
+        hash->HashedBytes = (long long)result.HashedBytes;
+
+        if (!result.Digest.empty())
+        {
+            hash->Digest = gcnew array<unsigned char>((int)result.Digest.size());
+            pin_ptr<unsigned char> digestPointer = &hash->Digest[0];
+            Native::MemoryKernels::Copy(digestPointer, result.Digest.data(), result.Digest.size());
+        }
+
+        hash->BlockDigests = gcnew array<unsigned char>((int)result.BlockDigests.size());
+        if (!result.BlockDigests.empty())
+        {
+            pin_ptr<unsigned char> blockPointer = &hash->BlockDigests[0];
+            Native::MemoryKernels::Copy(blockPointer, result.BlockDigests.data(), result.BlockDigests.size());
+        }
+
+        hash->FailedPosition = (long long)result.FailedOffset;
+        if (!result.Failure.empty())
+            hash->Failure = gcnew String(result.Failure.c_str());
+
+        return hash;
+    }
+
+    int StreamHasher::DigestSize(HashAlgorithm algorithm)
+    {
+        return (int)Native::HashEngine::DigestBytes((Native::HashAlgorithm)algorithm);
+    }
+
+    String^ StreamHasher::AlgorithmName(HashAlgorithm algorithm)
+    {
+        return gcnew String(Native::HashEngine::AlgorithmName((Native::HashAlgorithm)algorithm));
+    }
+
+    bool StreamHasher::TryParseAlgorithm(String ^name, HashAlgorithm %algorithm)
+    {
+        algorithm = HashAlgorithm::XxHash3;
+        if (name == nullptr)
+            return false;
+
+        for each (HashAlgorithm candidate in gcnew array<HashAlgorithm> { HashAlgorithm::Crc32c, HashAlgorithm::XxHash3, HashAlgorithm::Sha256 })
+        {
+            if (String::Equals(name, AlgorithmName(candidate), StringComparison::OrdinalIgnoreCase))
+            {
+                algorithm = candidate;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+} // IO
+} // nDiscUtils
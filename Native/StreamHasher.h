@@ -0,0 +1,79 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+#include "Core/HashEngine.h"
+#include "StreamHash.h"
+
+using namespace System;
+using namespace System::IO;
+
+namespace nDiscUtils {
+namespace IO {
+
+    // Hashes streams with the native hash engine: the stream is read on its
+    // own thread, chunkSize bytes per request and up to depth chunks ahead,
+    // while filled chunks are hashed on up to threads threads (zero for one
+    // per core) into a digest of the whole stream and one per block
+    public ref class StreamHasher
+    {
+
+    public:
+        StreamHasher(HashAlgorithm algorithm, int blockSize);
+        StreamHasher(HashAlgorithm algorithm, int blockSize, int chunkSize, int depth, int threads);
+
+        ~StreamHasher();
+
+        property HashAlgorithm Algorithm
+        {
+            HashAlgorithm get()
+            {
+                return (HashAlgorithm)mEngine->Options().Algorithm;
+            }
+        }
+
+        property int BlockSize
+        {
+            int get()
+            {
+                return (int)mEngine->Options().BlockBytes;
+            }
+        }
+
+        // Hashes the first length bytes of the stream, starting at its
+        // beginning. The stream must only be used by this call meanwhile.
+        StreamHash^ Hash(Stream ^stream, long long length);
+
+        static int DigestSize(HashAlgorithm algorithm);
+
+        // Lower-case name as accepted by TryParseAlgorithm
+        static String^ AlgorithmName(HashAlgorithm algorithm);
+
+        // Accepts crc32c, xxh3 and sha256 in any case
+        static bool TryParseAlgorithm(String ^name, [Runtime::InteropServices::Out] HashAlgorithm %algorithm);
+
+    private:
+        Native::HashEngine* mEngine;
+
+    };
+
+} // IO
+} // nDiscUtils
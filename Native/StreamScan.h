@@ -0,0 +1,59 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+#include "SignatureHit.h"
+
+using namespace System;
+
+namespace nDiscUtils {
+namespace IO {
+
+    // Outcome of StreamScanner::Scan
+    public ref class StreamScan
+    {
+
+    public:
+        // Leading bytes of the range which were scanned before the end or a failure
+        property long long ScannedBytes;
+
+        // Number of hits, which may exceed the listed ones
+        property long long HitCount;
+
+        // Hits in ascending order of their position
+        property array<SignatureHit> ^Hits;
+
+        // Position of the failed request and the reason
+        property long long FailedPosition;
+        property String ^Failure;
+
+        property bool Succeeded
+        {
+            bool get()
+            {
+                return Failure == nullptr;
+            }
+        }
+
+    };
+
+} // IO
+} // nDiscUtils
@@ -0,0 +1,117 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "stdafx.h"
+
+#include "StreamScanner.h"
+#include "StreamSource.h"
+#include "StreamUtils.h"
+
+using namespace System;
+using namespace System::IO;
+
+namespace nDiscUtils {
+namespace IO {
+
+    StreamScanner::StreamScanner(FileSystemSignature signatures, int granularity) :
+        StreamScanner(signatures, granularity, 16 << 20, 4, 0) { }
+
+    StreamScanner::StreamScanner(FileSystemSignature signatures, int granularity, int chunkSize, int depth, int threads) :
+        StreamScanner(signatures, granularity, chunkSize, depth, threads, 1 << 16) { }
+
+    StreamScanner::StreamScanner(FileSystemSignature signatures, int granularity, int chunkSize, int depth, int threads, int maxHits)
+    {
+        if (signatures == FileSystemSignature::None || (signatures & ~FileSystemSignature::All) != FileSystemSignature::None)
+            throw gcnew ArgumentOutOfRangeException("signatures", "<signatures> has to name at least one known file system");
+        if (granularity <= 0)
+            throw gcnew ArgumentOutOfRangeException("granularity", "<granularity> was expected to be greater than zero");
+        if (chunkSize <= 0)
+            throw gcnew ArgumentOutOfRangeException("chunkSize", "<chunkSize> was expected to be greater than zero");
+        if (depth <= 0)
+            throw gcnew ArgumentOutOfRangeException("depth", "<depth> was expected to be greater than zero");
+        if (threads < 0)
+            throw gcnew ArgumentOutOfRangeException("threads", "<threads> may not be negative");
+        if (maxHits < 0)
+            throw gcnew ArgumentOutOfRangeException("maxHits", "<maxHits> may not be negative");
+
+        Native::SignatureScannerOptions options;
+        options.Kinds = (uint32_t)signatures;
+        options.Granularity = (size_t)granularity;
+        options.ChunkBytes = (size_t)chunkSize;
+        options.Depth = (size_t)depth;
+        options.Threads = (size_t)threads;
+        options.MaxHits = (size_t)maxHits;
+
+        try
+        {
+            mScanner = new Native::SignatureScanner(options);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+    }
+
+    StreamScanner::~StreamScanner()
+    {
+        delete mScanner;
+        mScanner = nullptr;
+    }
+
+    StreamScan^ StreamScanner::Scan(Stream ^stream, long long position, long long length)
+    {
+        if (stream == nullptr)
+            throw gcnew ArgumentNullException("stream");
+        if (position < 0)
+            throw gcnew ArgumentOutOfRangeException("position", "<position> may not be negative");
+        if (length < 0)
+            throw gcnew ArgumentOutOfRangeException("length", "<length> may not be negative");
+
+        auto streamLength = stream->Length;
+        if (position > streamLength || length > streamLength - position)
+            throw gcnew ArgumentOutOfRangeException("length", "<position> and <length> exceed the stream");
+
+        auto source = StreamSource::For(stream, mScanner->Options().ChunkBytes + Native::SignatureScanner::Overlap);
+
+        Native::SignatureScanResult result;
+        try
+        {
+            result = mScanner->Scan(*source, (uint64_t)streamLength, (uint64_t)position, (uint64_t)length);
+        }
+        catch (const Native::NativeException& ex)
+        {
+            StreamUtils::ThrowManaged(ex);
+        }
+
+        auto scan = gcnew StreamScan();
+        scan->ScannedBytes = (long long)result.ScannedBytes;
+        scan->HitCount = (long long)result.HitCount;
+
+        scan->Hits = gcnew array<SignatureHit>((int)result.Hits.size());
+        for (size_t i = 0; i < result.Hits.size(); i++)
+            scan->Hits[(int)i] = SignatureHit((long long)result.Hits[i].Offset, (FileSystemSignature)result.Hits[i].Kinds);
+
+        scan->FailedPosition = (long long)result.FailedOffset;
+        if (!result.Failure.empty())
+            scan->Failure = gcnew String(result.Failure.c_str());
+
+        return scan;
+    }
+
+} // IO
+} // nDiscUtils
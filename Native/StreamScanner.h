@@ -0,0 +1,74 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+#include "Core/SignatureScanner.h"
+#include "StreamScan.h"
+
+using namespace System;
+using namespace System::IO;
+
+namespace nDiscUtils {
+namespace IO {
+
+    // Finds positions at which file systems may start with the native
+    // signature scanner: the stream is read on its own thread, chunkSize
+    // bytes per request and up to depth chunks ahead, while filled chunks
+    // are scanned on up to threads threads (zero for one per core). Only
+    // positions which are a multiple of granularity are reported.
+    public ref class StreamScanner
+    {
+
+    public:
+        StreamScanner(FileSystemSignature signatures, int granularity);
+        StreamScanner(FileSystemSignature signatures, int granularity, int chunkSize, int depth, int threads);
+        StreamScanner(FileSystemSignature signatures, int granularity, int chunkSize, int depth, int threads, int maxHits);
+
+        ~StreamScanner();
+
+        property FileSystemSignature Signatures
+        {
+            FileSystemSignature get()
+            {
+                return (FileSystemSignature)mScanner->Options().Kinds;
+            }
+        }
+
+        property int Granularity
+        {
+            int get()
+            {
+                return (int)mScanner->Options().Granularity;
+            }
+        }
+
+        // Scans the positions [position, position + length) of the stream;
+        // signatures reaching beyond its end never match. The stream must
+        // only be used by this call meanwhile.
+        StreamScan^ Scan(Stream ^stream, long long position, long long length);
+
+    private:
+        Native::SignatureScanner* mScanner;
+
+    };
+
+} // IO
+} // nDiscUtils
@@ -0,0 +1,131 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "stdafx.h"
+
+#include "StreamSource.h"
+#include "MappedImageStream.h"
+#include "StreamUtils.h"
+
+#include "Core/MemoryKernels.h"
+
+#include <algorithm>
+
+using namespace System;
+using namespace System::IO;
+
+namespace nDiscUtils {
+namespace IO {
+
+    namespace {
+
+        // Forwards to the image of a MappedImageStream without owning it
+        class MappedSource : public Native::ReadSource
+        {
+
+        public:
+            MappedSource(Native::MappedImage& image, const Native::ExtentMap* extents) :
+                mImage(image),
+                mExtents(extents) { }
+
+            size_t Read(uint64_t offset, void* buffer, size_t count) override
+            {
+                return mImage.Read(offset, buffer, count);
+            }
+
+            Native::DataExtent NextData(uint64_t offset) override
+            {
+                if (mExtents == nullptr)
+                    return mImage.NextData(offset);
+
+                return mExtents->NextData(offset);
+            }
+
+            bool View(uint64_t offset, size_t count, Native::SourceView& view) override
+            {
+                return mImage.View(offset, count, view);
+            }
+
+            bool Concurrent() const override
+            {
+                return true;
+            }
+
+        private:
+            Native::MappedImage& mImage;
+            const Native::ExtentMap* mExtents;
+
+        };
+
+    } // namespace
+
+    StreamSource::StreamSource(Stream ^stream, size_t bufferBytes, const Native::ExtentMap* extents) :
+        mStream(stream),
+        mBuffer(gcnew array<unsigned char>((int)std::min<size_t>(bufferBytes, 1u << 30))),
+        mExtents(extents) { }
+
+    size_t StreamSource::Read(uint64_t offset, void* buffer, size_t count)
+    {
+        try
+        {
+            Stream ^stream = mStream;
+            array<unsigned char> ^managedBuffer = mBuffer;
+
+            stream->Position = (long long)offset;
+
+            auto total = (size_t)0;
+            while (total < count)
+            {
+                auto request = (int)std::min<size_t>(count - total, (size_t)managedBuffer->Length);
+                auto read = stream->Read(managedBuffer, 0, request);
+                if (read <= 0)
+                    break;
+
+                pin_ptr<unsigned char> bufferPointer = &managedBuffer[0];
+                Native::MemoryKernels::Copy((unsigned char*)buffer + total, bufferPointer, (size_t)read);
+                total += (size_t)read;
+            }
+
+            return total;
+        }
+        catch (Exception ^ex)
+        {
+            throw Native::NativeException(Native::NativeError::IO, StreamUtils::NativePath(ex->Message));
+        }
+    }
+
+    std::unique_ptr<Native::ReadSource> StreamSource::For(Stream ^stream, size_t bufferBytes,
+        const Native::ExtentMap* extents)
+    {
+        auto mapped = dynamic_cast<MappedImageStream^>(stream);
+        if (mapped != nullptr)
+            return std::unique_ptr<Native::ReadSource>(new MappedSource(*mapped->Image(), extents));
+
+        return std::unique_ptr<Native::ReadSource>(new StreamSource(stream, bufferBytes, extents));
+    }
+
+    Native::DataExtent StreamSource::NextData(uint64_t offset)
+    {
+        if (mExtents == nullptr)
+            return Native::ReadSource::NextData(offset);
+
+        return mExtents->NextData(offset);
+    }
+
+} // IO
+} // nDiscUtils
@@ -0,0 +1,61 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+#include "Core/ReadSource.h"
+
+#include <memory>
+
+#include <vcclr.h>
+
+using namespace System;
+using namespace System::IO;
+
+namespace nDiscUtils {
+namespace IO {
+
+    // Feeds a managed stream to the native engines through a reusable
+    // managed buffer of up to bufferBytes; Read runs on an engine thread.
+    // Extents, if given, tell where the stream holds data.
+    class StreamSource : public Native::ReadSource
+    {
+
+    public:
+        StreamSource(Stream ^stream, size_t bufferBytes, const Native::ExtentMap* extents = nullptr);
+
+        // Source for any stream; a MappedImageStream is handed to the engines
+        // directly so they read its mapping in place, the stream still owns it
+        static std::unique_ptr<Native::ReadSource> For(Stream ^stream, size_t bufferBytes,
+            const Native::ExtentMap* extents = nullptr);
+
+        size_t Read(uint64_t offset, void* buffer, size_t count) override;
+
+        Native::DataExtent NextData(uint64_t offset) override;
+
+    private:
+        gcroot<Stream^> mStream;
+        gcroot<array<unsigned char>^> mBuffer;
+        const Native::ExtentMap* mExtents;
+
+    };
+
+} // IO
+} // nDiscUtils
@@ -0,0 +1,104 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "stdafx.h"
+
+#include "IDiscardableStream.h"
+#include "StreamTarget.h"
+#include "StreamUtils.h"
+
+#include "Core/MemoryKernels.h"
+
+#include <algorithm>
+
+using namespace System;
+using namespace System::IO;
+
+namespace nDiscUtils {
+namespace IO {
+
+    StreamTarget::StreamTarget(Stream ^stream, size_t bufferBytes, bool zeroed) :
+        mStream(stream),
+        mBuffer(gcnew array<unsigned char>((int)std::min<size_t>(bufferBytes, 1u << 30))),
+        mZeroed(zeroed) { }
+
+    void StreamTarget::Write(uint64_t offset, const void* buffer, size_t count)
+    {
+        try
+        {
+            Stream ^stream = mStream;
+            array<unsigned char> ^managedBuffer = mBuffer;
+
+            stream->Position = (long long)offset;
+
+            auto total = (size_t)0;
+            while (total < count)
+            {
+                auto request = std::min<size_t>(count - total, (size_t)managedBuffer->Length);
+
+                {
+                    pin_ptr<unsigned char> bufferPointer = &managedBuffer[0];
+                    Native::MemoryKernels::Copy(bufferPointer, (const unsigned char*)buffer + total, request);
+                }
+
+                stream->Write(managedBuffer, 0, (int)request);
+                total += request;
+            }
+        }
+        catch (Exception ^ex)
+        {
+            throw Native::NativeException(Native::NativeError::IO, StreamUtils::NativePath(ex->Message));
+        }
+    }
+
+    bool StreamTarget::Discard(uint64_t offset, uint64_t count)
+    {
+        if (mZeroed)
+            return true;
+
+        try
+        {
+            Stream ^stream = mStream;
+            auto discardable = dynamic_cast<IDiscardableStream^>(stream);
+            if (discardable == nullptr)
+                return false;
+
+            discardable->Discard((long long)offset, (long long)count);
+            return true;
+        }
+        catch (Exception ^ex)
+        {
+            throw Native::NativeException(Native::NativeError::IO, StreamUtils::NativePath(ex->Message));
+        }
+    }
+
+    void StreamTarget::Flush()
+    {
+        try
+        {
+            Stream ^stream = mStream;
+            stream->Flush();
+        }
+        catch (Exception ^ex)
+        {
+            throw Native::NativeException(Native::NativeError::IO, StreamUtils::NativePath(ex->Message));
+        }
+    }
+
+} // IO
+} // nDiscUtils
@@ -0,0 +1,57 @@
+/*
+ * nDiscUtils - Advanced utilities for disc management
+ * Copyright (C) 2018  Lukas Berger
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "stdafx.h"
+
+#include "Core/WriteTarget.h"
+
+#include <vcclr.h>
+
+using namespace System;
+using namespace System::IO;
+
+namespace nDiscUtils {
+namespace IO {
+
+    // Counterpart of StreamSource: writes the data of the native engines to
+    // a managed stream through a reusable managed buffer of up to
+    // bufferBytes; Write runs on an engine thread. Ranges are discarded on
+    // an IDiscardableStream or skipped if the stream is known to be zeroed.
+    class StreamTarget : public Native::WriteTarget
+    {
+
+    public:
+        StreamTarget(Stream ^stream, size_t bufferBytes, bool zeroed = false);
+
+        void Write(uint64_t offset, const void* buffer, size_t count) override;
+
+        bool Discard(uint64_t offset, uint64_t count) override;
+
+        void Flush() override;
+
+    private:
+        gcroot<Stream^> mStream;
+        gcroot<array<unsigned char>^> mBuffer;
+        bool mZeroed;
+
+    };
+
+} // IO
+} // nDiscUtils
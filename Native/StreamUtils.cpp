@@ -19,6 +19,7 @@
 #include "stdafx.h"
 
 #include "StreamUtils.h"
+#include "Core/PageProvider.h"
 
 using namespace System;
 using namespace System::IO;
@@ -44,21 +45,89 @@ namespace IO {
             throw gcnew IOException("Operation would exceed memory limits");
     }
 
+    void StreamUtils::AssertRangeParameters(size_t capacity, long long position, long long count)
+    {
+        if (position < 0)
+            throw gcnew IOException("<position> was expected to be greater than or equal to zero");
+
+        if (count < 0)
+            throw gcnew IOException("<count> was expected to be greater than or equal to zero");
+
+        if ((size_t)count > capacity || (size_t)position > capacity - (size_t)count)
+            throw gcnew IOException("Operation would exceed memory limits");
+    }
+
+    void StreamUtils::AssertPointerParameters(size_t capacity, long long position, const void *buffer, size_t count)
+    {
+        if (buffer == nullptr)
+            throw gcnew IOException("<buffer> was expected to be non-null");
+
+        if (position < 0)
+            throw gcnew IOException("<position> was expected to be greater than or equal to zero");
+
+        if (count > capacity || (size_t)position > capacity - count)
+            throw gcnew IOException("Operation would exceed memory limits");
+    }
+
+    void StreamUtils::AssertVectorParameters(size_t capacity, array<IoVector> ^vectors)
+    {
+        if (vectors == nullptr)
+            throw gcnew IOException("<vectors> was expected to be non-null");
+
+        for each (auto vector in vectors)
+        {
+            if (vector.Length < 0)
+                throw gcnew IOException("<vector.Length> was expected to be greater than or equal to zero");
+
+            AssertPointerParameters(capacity, vector.Position, (void*)vector.Buffer, (size_t)vector.Length);
+        }
+    }
+
     bool StreamUtils::IsAllocationAligned(size_t value)
     {
-        SYSTEM_INFO info;
-        GetSystemInfo(&info);
-        return ((value % info.dwAllocationGranularity) == 0);
+        return Native::PageProvider::Default()->IsAligned(value);
     }
 
     void StreamUtils::IsAllocationAlignedStrict(size_t value, const char *description)
     {
-        SYSTEM_INFO info;
-        GetSystemInfo(&info);
+        auto granularity = Native::PageProvider::Default()->Granularity();
 
-        if ((value % info.dwAllocationGranularity) != 0)
+        if (!IsAllocationAligned(value))
             throw gcnew ArgumentException(String::Format("{0} is not aligned to allocation granularity ({1})",
-                gcnew String(description), info.dwAllocationGranularity));
+                gcnew String(description), granularity));
+    }
+
+    void StreamUtils::ThrowManaged(const Native::NativeException& ex)
+    {
+        auto message = gcnew String(ex.what());
+
+        switch (ex.Error())
+        {
+            case Native::NativeError::InvalidArgument: throw gcnew ArgumentException(message);
+            case Native::NativeError::Overflow: throw gcnew OverflowException(message);
+            default: throw gcnew IOException(message, ex.Code());
+        }
+    }
+
+    std::string StreamUtils::NativePath(String ^path)
+    {
+        auto bytes = System::Text::Encoding::UTF8->GetBytes(path);
+        if (bytes->Length == 0)
+            return std::string();
+
+        pin_ptr<unsigned char> bytesPointer = &bytes[0];
+        return std::string((const char*)bytesPointer, (size_t)bytes->Length);
+    }
+
+    Native::NumaPolicy StreamUtils::NativePolicy(NumaPlacement placement, int node)
+    {
+        if (node < 0)
+            throw gcnew ArgumentOutOfRangeException("node", "NUMA node may not be negative");
+
+        Native::NumaPolicy policy;
+        policy.Placement = (Native::NumaPlacement)placement;
+        policy.Node = (size_t)node;
+        return policy;
     }
 
 } // IO
@@ -20,6 +20,13 @@
 
 #include "stdafx.h"
 
+#include <string>
+
+#include "Core/NativeException.h"
+#include "Core/NumaTopology.h"
+#include "IoVector.h"
+#include "NumaPlacement.h"
+
 using namespace System;
 using namespace System::IO;
 
@@ -32,10 +39,23 @@ namespace IO {
 
         static void AssertBufferParameters(size_t capacity, size_t position, array<unsigned char> ^buffer, int offset, int count);
 
+        static void AssertRangeParameters(size_t capacity, long long position, long long count);
+
+        static void AssertPointerParameters(size_t capacity, long long position, const void *buffer, size_t count);
+
+        static void AssertVectorParameters(size_t capacity, array<IoVector> ^vectors);
+
         static bool IsAllocationAligned(size_t value);
 
         static void IsAllocationAlignedStrict(size_t value, const char *description);
 
+        static void ThrowManaged(const Native::NativeException& ex);
+
+        // UTF-8 form of a path as taken by the native core
+        static std::string NativePath(String ^path);
+
+        static Native::NumaPolicy NativePolicy(NumaPlacement placement, int node);
+
     };
 
 } // IO
@@ -86,6 +86,7 @@ namespace nDiscUtils
                 typeof(Compare.Options),
                 typeof(DeepScan.Options),
                 typeof(Erase.Options),
+                typeof(Hash.Options),
                 typeof(ListDisks.Options),
                 typeof(ListPartitions.Options),
                 typeof(MakeDirectoryImage.Options),
@@ -111,6 +112,7 @@ namespace nDiscUtils
                 else if (parsed.Value is Compare.Options) result = Compare.Run((Compare.Options)parsed.Value);
                 else if (parsed.Value is DeepScan.Options) result = DeepScan.Run((DeepScan.Options)parsed.Value);
                 else if (parsed.Value is Erase.Options) result = Erase.Run((Erase.Options)parsed.Value);
+                else if (parsed.Value is Hash.Options) result = Hash.Run((Hash.Options)parsed.Value);
                 else if (parsed.Value is ListDisks.Options) result = ListDisks.Run((ListDisks.Options)parsed.Value);
                 else if (parsed.Value is ListPartitions.Options) result = ListPartitions.Run((ListPartitions.Options)parsed.Value);
                 else if (parsed.Value is MakeDirectoryImage.Options) result = MakeDirectoryImage.Run((MakeDirectoryImage.Options)parsed.Value);
@@ -158,6 +158,7 @@ namespace DiscUtils.Ntfs
 #else
                 _bitmap.MarkAbsentRange(run.Item1, run.Item2);
 #endif
+                DiscardClusters(run.Item1, run.Item2);
             }
         }
 
@@ -166,6 +167,7 @@ namespace DiscUtils.Ntfs
             foreach (Range<long, long> run in runs)
             {
                 _bitmap.MarkAbsentRange(run.Offset, run.Count);
+                DiscardClusters(run.Offset, run.Count);
             }
         }
 
@@ -185,6 +187,34 @@ namespace DiscUtils.Ntfs
             }
         }
 
+        private void DiscardClusters(long first, long count)
+        {
+            if (!_file.Context.Options.DiscardFreedClusters || count <= 0)
+            {
+                return;
+            }
+
+            SparseStream rawStream = _file.Context.RawStream as SparseStream;
+            if (rawStream == null)
+            {
+                rawStream = SparseStream.FromStream(_file.Context.RawStream, Ownership.None);
+            }
+
+            long bytesPerCluster = _file.Context.BiosParameterBlock.BytesPerCluster;
+            long clustersPerClear = Math.Max(1, int.MaxValue / bytesPerCluster);
+
+            while (count > 0)
+            {
+                long numClusters = Math.Min(count, clustersPerClear);
+
+                rawStream.Position = first * bytesPerCluster;
+                rawStream.Clear((int)(numClusters * bytesPerCluster));
+
+                first += numClusters;
+                count -= numClusters;
+            }
+        }
+
         private long ExtendRun(long count, List<Tuple<long, long>> result, long start, long end)
         {
             long focusCluster = start;
@@ -45,6 +45,16 @@ namespace DiscUtils.Ntfs
         /// </summary>
         public BlockCompressor Compressor { get; set; }
 
+        /// <summary>
+        /// Gets or sets a value indicating whether clusters are cleared on the underlying stream once they are freed.
+        /// </summary>
+        /// <remarks>
+        /// <para>The default (<c>false</c>) leaves the contents of freed clusters untouched.  When enabled, every
+        /// run of freed clusters is passed to <see cref="DiscUtils.Streams.SparseStream.Clear"/>, allowing sparse or
+        /// memory-backed storage to release it.</para>
+        /// </remarks>
+        public bool DiscardFreedClusters { get; set; }
+
         /// <summary>
         /// Gets or sets a value indicating whether file length information comes from directory entries or file data.
         /// </summary>
@@ -423,6 +423,32 @@ namespace DiscUtils.Streams
             _position += count;
         }
 
+        /// <summary>
+        /// Clears bytes from the stream.
+        /// </summary>
+        /// <param name="count">The number of bytes (from the current position) to clear.</param>
+        /// <remarks>The wrapped stream is cleared directly, cached blocks of the range are dropped.</remarks>
+        public override void Clear(int count)
+        {
+            CheckDisposed();
+
+            int blockSize = _settings.BlockSize;
+            long firstBlock = _position / blockSize;
+            long endBlock = MathUtilities.Ceil(Math.Min(_position + count, Length), blockSize);
+
+            try
+            {
+                _wrappedStream.Position = _position;
+                _wrappedStream.Clear(count);
+            }
+            finally
+            {
+                InvalidateBlocks(firstBlock, (int)(endBlock - firstBlock));
+            }
+
+            _position += count;
+        }
+
         /// <summary>
         /// Disposes of this instance, freeing up associated resources.
         /// </summary>
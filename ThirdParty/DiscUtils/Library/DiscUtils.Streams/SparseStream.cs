@@ -304,6 +304,18 @@ namespace DiscUtils.Streams
                 _wrapped.Write(buffer, offset, count);
             }
 
+            public override void Clear(int count)
+            {
+                SparseStream wrappedAsSparse = _wrapped as SparseStream;
+                if (_extents == null && wrappedAsSparse != null)
+                {
+                    wrappedAsSparse.Clear(count);
+                    return;
+                }
+
+                base.Clear(count);
+            }
+
             protected override void Dispose(bool disposing)
             {
                 try